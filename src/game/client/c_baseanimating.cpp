@@ -47,6 +47,7 @@
 #include "jigglebones.h"
 #include "toolframework_client.h"
 #include "vstdlib/jobthread.h"
+#include "tier0/fasttimer.h"
 #include "bonetoworldarray.h"
 #include "posedebugger.h"
 #include "tier0/icommandline.h"
@@ -743,6 +744,9 @@ static unsigned long	g_iModelBoneCounter = 0;
 CUtlVector<C_BaseAnimating *> g_PreviousBoneSetups;
 static unsigned long	g_iPreviousBoneCounter = (unsigned)-1;
 
+static bool g_bInThreadedBoneSetup;
+static bool g_bDoThreadedBoneSetup;
+
 class C_BaseAnimatingGameSystem : public CAutoGameSystem
 {
 	void LevelShutdownPostEntity()
@@ -2597,14 +2601,21 @@ void C_BaseAnimating::CalculateIKLocks( float currentTime )
 	if ( targetCount == 0 )
 		return;
 
+	// During threaded bone setup the ground traces were made by PreTraceIKLocks on the
+	// main thread, nothing here may touch the partition or trace.
+	bool bPreTraced = g_bInThreadedBoneSetup;
+
 	// In TF, we might be attaching a player's view to a walking model that's using IK. If we are, it can
 	// get in here during the view setup code, and it's not normally supposed to be able to access the spatial
 	// partition that early in the rendering loop. So we allow access right here for that special case.
-	SpatialPartitionListMask_t curSuppressed = partition->GetSuppressedLists();
-	partition->SuppressLists( PARTITION_ALL_CLIENT_EDICTS, false );
-	CBaseEntity::PushEnableAbsRecomputations( false );
+	SpatialPartitionListMask_t curSuppressed = 0;
+	if ( !bPreTraced )
+	{
+		curSuppressed = partition->GetSuppressedLists();
+		partition->SuppressLists( PARTITION_ALL_CLIENT_EDICTS, false );
+		CBaseEntity::PushEnableAbsRecomputations( false );
+	}
 
-	Ray_t ray;
 	CTraceFilterSkipNPCsAndPlayers traceFilter( this, GetCollisionGroup() );
 
 	// FIXME: trace based on gravity or trace based on angles?
@@ -2627,55 +2638,38 @@ void C_BaseAnimating::CalculateIKLocks( float currentTime )
 		{
 		case IK_GROUND:
 			{
-				Vector estGround;
-				Vector p1, p2;
+				C_BaseEntity *pGround = NULL;
 
-				// adjust ground to original ground position
-				estGround = (pTarget->est.pos - GetRenderOrigin());
-				estGround = estGround - (estGround * up) * up;
-				estGround = GetAbsOrigin() + estGround + pTarget->est.floor * up;
-
-				VectorMA( estGround, pTarget->est.height, up, p1 );
-				VectorMA( estGround, -pTarget->est.height, up, p2 );
+				if ( bPreTraced )
+				{
+					// Only what the main thread traced before the batch can be used here
+					if ( i >= m_IKGroundTraces.Count() || m_IKGroundTraces[i].m_nFrame != gpGlobals->framecount )
+					{
+						SaveIKGroundTrace( i, pTarget );
+						pTarget->IKFailed( );
+						break;
+					}
 
-				float r = MAX( pTarget->est.radius, 1);
+					trace = m_IKGroundTraces[i].m_Trace;
+					pGround = m_IKGroundTraces[i].m_hGround.Get();
+				}
+				else
+				{
+					TraceIKGround( pTarget->est.pos, pTarget->trace.closest, pTarget->est.height, pTarget->est.floor, pTarget->est.radius, up, &traceFilter, trace, &pGround );
+				}
 
-				// don't IK to other characters
-				ray.Init( p1, p2, Vector(-r,-r,0), Vector(r,r,r*2) );
-				enginetrace->TraceRay( ray, PhysicsSolidMaskForEntity(), &traceFilter, &trace );
+				// Next frame's PreTraceIKLocks starts from this estimate
+				SaveIKGroundTrace( i, pTarget );
 
-				if ( trace.m_pEnt != NULL && trace.m_pEnt->GetMoveType() == MOVETYPE_PUSH )
+				if ( pGround )
 				{
-					pTarget->SetOwner( trace.m_pEnt->entindex(), trace.m_pEnt->GetAbsOrigin(), trace.m_pEnt->GetAbsAngles() );
+					pTarget->SetOwner( pGround->entindex(), pGround->GetAbsOrigin(), pGround->GetAbsAngles() );
 				}
 				else
 				{
 					pTarget->ClearOwner( );
 				}
 
-				if (trace.startsolid)
-				{
-					// trace from back towards hip
-					Vector tmp = estGround - pTarget->trace.closest;
-					tmp.NormalizeInPlace();
-					ray.Init( estGround - tmp * pTarget->est.height, estGround, Vector(-r,-r,0), Vector(r,r,1) );
-
-					// debugoverlay->AddLineOverlay( ray.m_Start, ray.m_Start + ray.m_Delta, 255, 0, 0, 0, 0 );
-
-					enginetrace->TraceRay( ray, MASK_SOLID, &traceFilter, &trace );
-
-					if (!trace.startsolid)
-					{
-						p1 = trace.endpos;
-						VectorMA( p1, - pTarget->est.height, up, p2 );
-						ray.Init( p1, p2, Vector(-r,-r,0), Vector(r,r,1) );
-
-						enginetrace->TraceRay( ray, MASK_SOLID, &traceFilter, &trace );
-					}
-
-					// debugoverlay->AddLineOverlay( ray.m_Start, ray.m_Start + ray.m_Delta, 0, 255, 0, 0, 0 );
-				}
-
 
 				if (!trace.startsolid)
 				{
@@ -2770,6 +2764,14 @@ void C_BaseAnimating::CalculateIKLocks( float currentTime )
 
 		case IK_ATTACHMENT:
 			{
+				// Looking for attachments sets up other entities' bones, threaded bone setup
+				// keeps models that use these on the main thread so this is only a first frame
+				if ( bPreTraced )
+				{
+					pTarget->IKFailed( );
+					break;
+				}
+
 				C_BaseEntity *pEntity = NULL;
 				float flDist = pTarget->est.radius;
 
@@ -2820,6 +2822,128 @@ void C_BaseAnimating::CalculateIKLocks( float currentTime )
 	}
 #endif
 
+	if ( !bPreTraced )
+	{
+		CBaseEntity::PopEnableAbsRecomputations();
+		partition->SuppressLists( curSuppressed, true );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The traces CalculateIKLocks makes for an IK_GROUND target. ppGround
+//			gets the pusher under the first trace, if any.
+//-----------------------------------------------------------------------------
+void C_BaseAnimating::TraceIKGround( const Vector &estPos, const Vector &closest, float flHeight, float flFloor, float flRadius, const Vector &up, ITraceFilter *pFilter, trace_t &trace, C_BaseEntity **ppGround )
+{
+	Ray_t ray;
+	Vector estGround;
+	Vector p1, p2;
+
+	// adjust ground to original ground position
+	estGround = (estPos - GetRenderOrigin());
+	estGround = estGround - (estGround * up) * up;
+	estGround = GetAbsOrigin() + estGround + flFloor * up;
+
+	VectorMA( estGround, flHeight, up, p1 );
+	VectorMA( estGround, -flHeight, up, p2 );
+
+	float r = MAX( flRadius, 1);
+
+	// don't IK to other characters
+	ray.Init( p1, p2, Vector(-r,-r,0), Vector(r,r,r*2) );
+	enginetrace->TraceRay( ray, PhysicsSolidMaskForEntity(), pFilter, &trace );
+
+	*ppGround = ( trace.m_pEnt != NULL && trace.m_pEnt->GetMoveType() == MOVETYPE_PUSH ) ? trace.m_pEnt : NULL;
+
+	if (trace.startsolid)
+	{
+		// trace from back towards hip
+		Vector tmp = estGround - closest;
+		tmp.NormalizeInPlace();
+		ray.Init( estGround - tmp * flHeight, estGround, Vector(-r,-r,0), Vector(r,r,1) );
+
+		// debugoverlay->AddLineOverlay( ray.m_Start, ray.m_Start + ray.m_Delta, 255, 0, 0, 0, 0 );
+
+		enginetrace->TraceRay( ray, MASK_SOLID, pFilter, &trace );
+
+		if (!trace.startsolid)
+		{
+			p1 = trace.endpos;
+			VectorMA( p1, - flHeight, up, p2 );
+			ray.Init( p1, p2, Vector(-r,-r,0), Vector(r,r,1) );
+
+			enginetrace->TraceRay( ray, MASK_SOLID, pFilter, &trace );
+		}
+
+		// debugoverlay->AddLineOverlay( ray.m_Start, ray.m_Start + ray.m_Delta, 0, 255, 0, 0, 0 );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Keeps an IK_GROUND target's estimate for the next PreTraceIKLocks,
+//			relative to the render origin so it follows the model
+//-----------------------------------------------------------------------------
+void C_BaseAnimating::SaveIKGroundTrace( int iTarget, CIKTarget *pTarget )
+{
+	while ( m_IKGroundTraces.Count() <= iTarget )
+	{
+		IKGroundTrace_t &ground = m_IKGroundTraces[ m_IKGroundTraces.AddToTail() ];
+		ground.m_bActive = false;
+		ground.m_nFrame = -1;
+	}
+
+	IKGroundTrace_t &ground = m_IKGroundTraces[iTarget];
+	ground.m_bActive = true;
+	ground.m_vecEstPos = pTarget->est.pos - GetRenderOrigin();
+	ground.m_vecClosest = pTarget->trace.closest - GetRenderOrigin();
+	ground.m_flHeight = pTarget->est.height;
+	ground.m_flFloor = pTarget->est.floor;
+	ground.m_flRadius = pTarget->est.radius;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Main thread half of CalculateIKLocks for threaded bone setup. Makes
+//			the ground traces from the estimates the last CalculateIKLocks left,
+//			moved along with the model, and updates IK locks on moving ground.
+//			The feet find the ground from last frame's pose, which is the only
+//			difference from a serial setup.
+//-----------------------------------------------------------------------------
+void C_BaseAnimating::PreTraceIKLocks()
+{
+	if ( !m_pIk || IsRagdoll() )
+		return;
+
+	UpdateIKLocks( gpGlobals->curtime );
+
+	int nTraces = MIN( m_IKGroundTraces.Count(), m_pIk->m_target.Count() );
+	if ( !nTraces )
+		return;
+
+	SpatialPartitionListMask_t curSuppressed = partition->GetSuppressedLists();
+	partition->SuppressLists( PARTITION_ALL_CLIENT_EDICTS, false );
+	CBaseEntity::PushEnableAbsRecomputations( false );
+
+	CTraceFilterSkipNPCsAndPlayers traceFilter( this, GetCollisionGroup() );
+
+	Vector up;
+	AngleVectors( GetRenderAngles(), NULL, NULL, &up );
+
+	Vector vecRenderOrigin = GetRenderOrigin();
+	for ( int i = 0; i < nTraces; i++ )
+	{
+		IKGroundTrace_t &ground = m_IKGroundTraces[i];
+		if ( !ground.m_bActive )
+			continue;
+
+		C_BaseEntity *pGround = NULL;
+		TraceIKGround( vecRenderOrigin + ground.m_vecEstPos, vecRenderOrigin + ground.m_vecClosest, ground.m_flHeight, ground.m_flFloor, ground.m_flRadius, up, &traceFilter, ground.m_Trace, &pGround );
+		ground.m_hGround = pGround;
+		ground.m_nFrame = gpGlobals->framecount;
+
+		// Inactive until CalculateIKLocks sees the target active again
+		ground.m_bActive = false;
+	}
+
 	CBaseEntity::PopEnableAbsRecomputations();
 	partition->SuppressLists( curSuppressed, true );
 }
@@ -2887,16 +3011,65 @@ CMouthInfo *C_BaseAnimating::GetMouth( void )
 #ifdef DEBUG_BONE_SETUP_THREADING
 ConVar cl_warn_thread_contested_bone_setup("cl_warn_thread_contested_bone_setup", "0" );
 #endif
-ConVar cl_threaded_bone_setup("cl_threaded_bone_setup", "0", 0, "Enable parallel processing of C_BaseAnimating::SetupBones()" );
+ConVar cl_threaded_bone_setup("cl_threaded_bone_setup", "1", 0, "Enable parallel processing of C_BaseAnimating::SetupBones()" );
+
+//-----------------------------------------------------------------------------
+// Threaded bone setup works on whole move hierarchies. Weapons, wearables and
+// attached models read their parent's bones while setting up their own, so
+// every entity queued last frame is grouped with the animating entities above
+// it, each group is sorted parent first, and the thread pool hands out whole
+// groups. Parents are always done by the time their children need them, and
+// nothing in one group waits on another.
+//
+// CalculateIKLocks traces against the world, changes which partition lists
+// are suppressed and turns off abs recomputations, none of which is safe off
+// the main thread. PreTraceIKLocks makes the ground traces for every IK model
+// in the batch on the main thread first, and CalculateIKLocks only uses the
+// results. Hierarchies it can't do that for are set up on the main thread
+// before the batch starts.
+//-----------------------------------------------------------------------------
+struct BoneSetupEntry_t
+{
+	C_BaseEntity	*m_pRoot;
+	int				m_nDepth;
+	C_BaseAnimating	*m_pAnimating;
+};
+
+struct BoneSetupGroup_t
+{
+	int				m_iFirst;
+	int				m_nCount;
+};
+
+static CUtlVector< BoneSetupEntry_t > g_BoneSetupOrder;
+static CUtlVector< BoneSetupGroup_t > g_BoneSetupGroups;
+static CUtlVector< BoneSetupGroup_t > g_BoneSetupMainThreadGroups;
+static CUtlVector< C_BaseAnimating * > g_BoneSetupPreTraced;
+
+static int __cdecl BoneSetupEntrySort( const BoneSetupEntry_t *pLeft, const BoneSetupEntry_t *pRight )
+{
+	if ( pLeft->m_pRoot != pRight->m_pRoot )
+		return ( pLeft->m_pRoot < pRight->m_pRoot ) ? -1 : 1;
+
+	if ( pLeft->m_nDepth != pRight->m_nDepth )
+		return pLeft->m_nDepth - pRight->m_nDepth;
+
+	if ( pLeft->m_pAnimating != pRight->m_pAnimating )
+		return ( pLeft->m_pAnimating < pRight->m_pAnimating ) ? -1 : 1;
+
+	return 0;
+}
 
 //-----------------------------------------------------------------------------
 // Purpose: Do the default sequence blending rules as done in HL1
 //-----------------------------------------------------------------------------
 
-static void SetupBonesOnBaseAnimating( C_BaseAnimating *&pBaseAnimating )
+static void SetupBonesOnBoneSetupGroup( BoneSetupGroup_t &group )
 {
-	if ( !pBaseAnimating->GetMoveParent() )
-		pBaseAnimating->SetupBones( NULL, -1, -1, gpGlobals->curtime );
+	for ( int i = 0; i < group.m_nCount; i++ )
+	{
+		g_BoneSetupOrder[ group.m_iFirst + i ].m_pAnimating->SetupBones( NULL, -1, -1, gpGlobals->curtime );
+	}
 }
 
 static void PreThreadedBoneSetup()
@@ -2909,8 +3082,139 @@ static void PostThreadedBoneSetup()
 	mdlcache->EndLock();
 }
 
-static bool g_bInThreadedBoneSetup;
-static bool g_bDoThreadedBoneSetup;
+static int		g_nBoneSetupFrames;
+static int		g_nBoneSetupEntities;
+static int		g_nBoneSetupGroups;
+static int		g_nBoneSetupMainThreadGroups;
+static int		g_nBoneSetupPreTraced;
+static int		g_nBoneSetupMaxDepth;
+static double	g_flBoneSetupTotalMS;
+static double	g_flBoneSetupPeakMS;
+
+//-----------------------------------------------------------------------------
+// Purpose: Turns last frame's requests into parent first groups, one per
+//			move hierarchy
+//-----------------------------------------------------------------------------
+static void BuildBoneSetupGroups()
+{
+	g_BoneSetupOrder.RemoveAll();
+	g_BoneSetupGroups.RemoveAll();
+	g_BoneSetupMainThreadGroups.RemoveAll();
+	g_BoneSetupPreTraced.RemoveAll();
+
+	FOR_EACH_VEC( g_PreviousBoneSetups, i )
+	{
+		// Everything animating above this entity has to be done first, queued or not
+		int nFirst = g_BoneSetupOrder.Count();
+		C_BaseEntity *pRoot = g_PreviousBoneSetups[i];
+		for ( C_BaseEntity *pEntity = pRoot; pEntity; pEntity = pEntity->GetMoveParent() )
+		{
+			pRoot = pEntity;
+
+			C_BaseAnimating *pAnimating = pEntity->GetBaseAnimating();
+			if ( pAnimating )
+			{
+				BoneSetupEntry_t &entry = g_BoneSetupOrder[ g_BoneSetupOrder.AddToTail() ];
+				entry.m_pAnimating = pAnimating;
+			}
+		}
+
+		// Depth counts down from the root, which we only know now
+		int nDepth = g_BoneSetupOrder.Count() - nFirst;
+		for ( int j = nFirst; j < g_BoneSetupOrder.Count(); j++ )
+		{
+			g_BoneSetupOrder[j].m_pRoot = pRoot;
+			g_BoneSetupOrder[j].m_nDepth = --nDepth;
+			g_nBoneSetupMaxDepth = MAX( g_nBoneSetupMaxDepth, g_BoneSetupOrder[j].m_nDepth );
+		}
+	}
+
+	g_BoneSetupOrder.Sort( BoneSetupEntrySort );
+
+	// Drop the duplicates from shared parents and cut the list into hierarchies
+	int nUnique = 0;
+	FOR_EACH_VEC( g_BoneSetupOrder, i )
+	{
+		const BoneSetupEntry_t &entry = g_BoneSetupOrder[i];
+		if ( nUnique && g_BoneSetupOrder[ nUnique - 1 ].m_pAnimating == entry.m_pAnimating )
+			continue;
+
+		if ( !nUnique || g_BoneSetupOrder[ nUnique - 1 ].m_pRoot != entry.m_pRoot )
+		{
+			BoneSetupGroup_t &group = g_BoneSetupGroups[ g_BoneSetupGroups.AddToTail() ];
+			group.m_iFirst = nUnique;
+			group.m_nCount = 0;
+		}
+
+		g_BoneSetupOrder[ nUnique++ ] = entry;
+		g_BoneSetupGroups.Tail().m_nCount++;
+	}
+
+	g_BoneSetupOrder.SetCountNonDestructively( nUnique );
+
+	// IK locks are traced ahead of time where possible, anything else using them
+	// stays on the main thread along with the rest of its hierarchy
+	for ( int i = g_BoneSetupGroups.Count() - 1; i >= 0; i-- )
+	{
+		int nPreTraced = g_BoneSetupPreTraced.Count();
+		for ( int j = 0; j < g_BoneSetupGroups[i].m_nCount; j++ )
+		{
+			C_BaseAnimating *pAnimating = g_BoneSetupOrder[ g_BoneSetupGroups[i].m_iFirst + j ].m_pAnimating;
+			if ( !pAnimating->UsesIKLocks() )
+				continue;
+
+			if ( !pAnimating->CanPreTraceIKLocks() )
+			{
+				g_BoneSetupPreTraced.SetCountNonDestructively( nPreTraced );
+				g_BoneSetupMainThreadGroups.AddToTail( g_BoneSetupGroups[i] );
+				g_BoneSetupGroups.FastRemove( i );
+				break;
+			}
+
+			g_BoneSetupPreTraced.AddToTail( pAnimating );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether SetupBones will run CalculateIKLocks, same checks it makes
+//-----------------------------------------------------------------------------
+bool C_BaseAnimating::UsesIKLocks()
+{
+	if ( IsRagdoll() )
+		return false;
+
+	if ( m_pIk )
+		return true;
+
+	if ( IsModelScaled() || ( m_EntClientFlags & ENTCLIENTFLAG_DONTUSEIK ) )
+		return false;
+
+	CStudioHdr *hdr = GetModelPtr();
+	return hdr && hdr->numikchains() > 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether PreTraceIKLocks covers everything CalculateIKLocks will do.
+//			Attached models only get their render origin from their parent's
+//			bones, and IK_ATTACHMENT rules set up other entities' bones.
+//-----------------------------------------------------------------------------
+bool C_BaseAnimating::CanPreTraceIKLocks()
+{
+	if ( GetMoveParent() )
+		return false;
+
+	if ( m_pIk )
+	{
+		for ( int i = 0; i < m_pIk->m_target.Count(); i++ )
+		{
+			if ( m_pIk->m_target[i].type == IK_ATTACHMENT && m_pIk->m_target[i].IsActive() )
+				return false;
+		}
+	}
+
+	return true;
+}
 
 void C_BaseAnimating::InitBoneSetupThreadPool()
 {
@@ -2925,20 +3229,78 @@ void C_BaseAnimating::ThreadedBoneSetup()
 	g_bDoThreadedBoneSetup = cl_threaded_bone_setup.GetBool();
 	if ( g_bDoThreadedBoneSetup )
 	{
-		int nCount = g_PreviousBoneSetups.Count();
+		CFastTimer timer;
+		timer.Start();
+
+		BuildBoneSetupGroups();
+
+		FOR_EACH_VEC( g_BoneSetupMainThreadGroups, i )
+		{
+			SetupBonesOnBoneSetupGroup( g_BoneSetupMainThreadGroups[i] );
+		}
+
+		FOR_EACH_VEC( g_BoneSetupPreTraced, i )
+		{
+			g_BoneSetupPreTraced[i]->PreTraceIKLocks();
+		}
+
+		int nCount = g_BoneSetupGroups.Count();
 		if ( nCount > 1 )
 		{
 			g_bInThreadedBoneSetup = true;
 
-			ParallelProcess( "C_BaseAnimating::ThreadedBoneSetup", g_PreviousBoneSetups.Base(), nCount, &SetupBonesOnBaseAnimating, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
+			ParallelProcess( "C_BaseAnimating::ThreadedBoneSetup", g_BoneSetupGroups.Base(), nCount, &SetupBonesOnBoneSetupGroup, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
 
 			g_bInThreadedBoneSetup = false;
 		}
+		else if ( nCount == 1 )
+		{
+			SetupBonesOnBoneSetupGroup( g_BoneSetupGroups[0] );
+		}
+
+		timer.End();
+
+		double flMS = timer.GetDuration().GetMillisecondsF();
+		g_nBoneSetupFrames++;
+		g_nBoneSetupEntities += g_BoneSetupOrder.Count();
+		g_nBoneSetupGroups += nCount + g_BoneSetupMainThreadGroups.Count();
+		g_nBoneSetupMainThreadGroups += g_BoneSetupMainThreadGroups.Count();
+		g_nBoneSetupPreTraced += g_BoneSetupPreTraced.Count();
+		g_flBoneSetupTotalMS += flMS;
+		g_flBoneSetupPeakMS = MAX( g_flBoneSetupPeakMS, flMS );
 	}
 	g_iPreviousBoneCounter++;
 	g_PreviousBoneSetups.RemoveAll();
 }
 
+CON_COMMAND( cl_threaded_bone_setup_stats, "Shows how long the threaded bone setup stage takes. Pass 'reset' to clear the counters." )
+{
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_nBoneSetupFrames = 0;
+		g_nBoneSetupEntities = 0;
+		g_nBoneSetupGroups = 0;
+		g_nBoneSetupMainThreadGroups = 0;
+		g_nBoneSetupPreTraced = 0;
+		g_nBoneSetupMaxDepth = 0;
+		g_flBoneSetupTotalMS = 0.0;
+		g_flBoneSetupPeakMS = 0.0;
+		return;
+	}
+
+	if ( !g_nBoneSetupFrames )
+	{
+		Msg( "No threaded bone setup has run yet (cl_threaded_bone_setup %d).\n", cl_threaded_bone_setup.GetInt() );
+		return;
+	}
+
+	Msg( "%d frames: %.3f ms per frame (peak %.3f ms)\n", g_nBoneSetupFrames, g_flBoneSetupTotalMS / g_nBoneSetupFrames, g_flBoneSetupPeakMS );
+	Msg( "  %.1f entities in %.1f hierarchies per frame, deepest hierarchy %d\n",
+		(float)g_nBoneSetupEntities / g_nBoneSetupFrames, (float)g_nBoneSetupGroups / g_nBoneSetupFrames, g_nBoneSetupMaxDepth + 1 );
+	Msg( "  %.1f IK models per frame traced ahead on the main thread, %.1f hierarchies kept on it for IK\n",
+		(float)g_nBoneSetupPreTraced / g_nBoneSetupFrames, (float)g_nBoneSetupMainThreadGroups / g_nBoneSetupFrames );
+}
+
 bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, int boneMask, float currentTime )
 {
 	VPROF_BUDGET( "C_BaseAnimating::SetupBones", VPROF_BUDGETGROUP_CLIENT_ANIMATION );
@@ -3040,7 +3402,7 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 	}
 
 	int nBoneCount = m_CachedBoneData.Count();
-	if ( g_bDoThreadedBoneSetup && !g_bInThreadedBoneSetup && ( nBoneCount >= 16 ) && !GetMoveParent() && m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
+	if ( g_bDoThreadedBoneSetup && !g_bInThreadedBoneSetup && ( nBoneCount >= 16 || GetMoveParent() ) && m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
 	{
 		m_iMostRecentBoneSetupRequest = g_iPreviousBoneCounter;
 		Assert( g_PreviousBoneSetups.Find( this ) == -1 );
@@ -3136,7 +3498,11 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 			// don't calculate IK on ragdolls
 			if ( m_pIk && !IsRagdoll() )
 			{
-				UpdateIKLocks( currentTime );
+				// PreTraceIKLocks did this on the main thread
+				if ( !g_bInThreadedBoneSetup )
+				{
+					UpdateIKLocks( currentTime );
+				}
 
 				m_pIk->UpdateTargets( pos, q, m_BoneAccessor.GetBoneArrayForWrite(), boneComputed );
 
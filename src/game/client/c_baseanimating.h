@@ -45,6 +45,7 @@ class C_BaseClientShader
 
 class IRagdoll;
 class CIKContext;
+class CIKTarget;
 class CIKState;
 class ConVar;
 class C_RopeKeyframe;
@@ -428,6 +429,9 @@ public:
 	static void						ThreadedBoneSetup();
 	static void						InitBoneSetupThreadPool();
 	static void						ShutdownBoneSetupThreadPool();
+	bool							UsesIKLocks();
+	bool							CanPreTraceIKLocks();
+	void							PreTraceIKLocks();
 
 	// Invalidate bone caches so all SetupBones() calls force bone transforms to be regenerated.
 	static void						InvalidateBoneCaches();
@@ -530,6 +534,27 @@ public:
 protected:
 	CIKContext						*m_pIk;
 
+	// IK_GROUND traces, made ahead of time on the main thread for threaded bone setup
+	struct IKGroundTrace_t
+	{
+		// Target estimate from the last CalculateIKLocks, relative to the render origin
+		bool		m_bActive;
+		Vector		m_vecEstPos;
+		Vector		m_vecClosest;
+		float		m_flHeight;
+		float		m_flFloor;
+		float		m_flRadius;
+
+		// What PreTraceIKLocks found for it
+		int			m_nFrame;			// gpGlobals->framecount it was traced on
+		trace_t		m_Trace;
+		EHANDLE		m_hGround;			// pusher under the first trace
+	};
+	CUtlVector< IKGroundTrace_t >	m_IKGroundTraces;
+
+	void							TraceIKGround( const Vector &estPos, const Vector &closest, float flHeight, float flFloor, float flRadius, const Vector &up, ITraceFilter *pFilter, trace_t &trace, C_BaseEntity **ppGround );
+	void							SaveIKGroundTrace( int iTarget, CIKTarget *pTarget );
+
 	int								m_iEyeAttachment;
 
 	// Animation playback framerate
@@ -2010,6 +2010,7 @@ void CHLClient::LevelInitPreEntity( char const* pMapName )
 	
 	// S:O - Stop all FMOD sounds when exiting to the main menu
 	FMODManager()->StopAllSound();
+	FMODManager()->ClearPrefetchedMusic();
 	InitLevelSoundManifest();
 	ParseLevelSoundManifest();
 #endif
@@ -29,6 +29,7 @@ public:
 	void	Spawn( void );	
 
 	virtual void	OnDataChanged( DataUpdateType_t updateType );
+	virtual void	NotifyShouldTransmit( ShouldTransmitState_t state );
 
 	// ITargetIDProvidesHint
 public:
@@ -42,6 +43,7 @@ private:
 	bool	m_bShouldGlow;
 	void	UpdateGlowEffect( void );
 	void	DestroyGlowEffect(void);
+	void	UpdatePilotLight( void );
 
 	Vector		m_vecInitialVelocity;
 
@@ -81,7 +83,21 @@ void C_TFDroppedWeapon::Spawn( void )
 
 	ClientThink();
 
-	if ( m_bFlamethrower )
+	m_pPilotLightSound = NULL;
+	UpdatePilotLight();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The server recycles drops, so the same entity can come back as a
+//			different weapon
+//-----------------------------------------------------------------------------
+void C_TFDroppedWeapon::UpdatePilotLight( void )
+{
+	bool bPilotLight = m_bFlamethrower && !IsDormant();
+	if ( bPilotLight == ( m_pPilotLightSound != NULL ) )
+		return;
+
+	if ( bPilotLight )
 	{
 		// Create the looping pilot light sound
 		const char *pilotlightsound = "Weapon_FlameThrower.PilotLoop";
@@ -92,13 +108,29 @@ void C_TFDroppedWeapon::Spawn( void )
 
 		controller.Play( m_pPilotLightSound, 1.0, 100 );
 	}
-	else
+	else if ( m_pPilotLightSound )
 	{
 		CSoundEnvelopeController::GetController().SoundDestroy( m_pPilotLightSound );
 		m_pPilotLightSound = NULL;
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Dormant drops sitting in the server's pool stop being sent
+//-----------------------------------------------------------------------------
+void C_TFDroppedWeapon::NotifyShouldTransmit( ShouldTransmitState_t state )
+{
+	BaseClass::NotifyShouldTransmit( state );
+
+	if ( state == SHOULDTRANSMIT_END )
+	{
+		m_bShouldGlow = false;
+		UpdateGlowEffect();
+	}
+
+	UpdatePilotLight();
+}
+
 void C_TFDroppedWeapon::ClientThink( void )
 {	
 	bool bShouldGlow = false;
@@ -189,6 +221,10 @@ void C_TFDroppedWeapon::OnDataChanged( DataUpdateType_t updateType )
 		interpolator.ClearHistory();
 		interpolator.AddToHead( flChangeTime - 0.15f, &vecCurOrigin, false );
 	}
+	else
+	{
+		UpdatePilotLight();
+	}
 }
 
 //-----------------------------------------------------------------------------
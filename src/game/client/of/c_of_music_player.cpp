@@ -85,6 +85,7 @@ void C_TFMusicPlayer::ClientThink( void )
 			{
 				FMODManager()->PlayMusicEnd( pChannel, m_Songdata[2].path );
 			}
+			PrefetchNextTrack();
 		}
 		else
 		{
@@ -99,6 +100,7 @@ void C_TFMusicPlayer::ClientThink( void )
 			{
 				FMODManager()->PlayLoopingMusic( pChannel,m_Songdata[1].path, NULL , m_flDelay );
 			}
+			PrefetchNextTrack();
 		}
 	}
 
@@ -180,7 +182,28 @@ void C_TFMusicPlayer::OnDataChanged(DataUpdateType_t updateType)
 			}
 		}
 
-		bParsed = true;			
+		bParsed = true;
+
+		// Start opening the song now so starting it later doesn't hitch
+		PrefetchNextTrack();			
+	}
+}
+
+// Starts opening only what the next Play call needs, the prefetch slots are shared by every music player
+void C_TFMusicPlayer::PrefetchNextTrack( void )
+{
+	if ( !bIsPlaying )
+	{
+		// PlayLoopingMusic opens the intro and the loop together
+		if ( m_Songdata[0].path[0] != 0 )
+			FMODManager()->PrefetchMusic( m_Songdata[0].path );
+
+		if ( m_Songdata[1].path[0] != 0 )
+			FMODManager()->PrefetchMusic( m_Songdata[1].path );
+	}
+	else if ( m_bHardTransition && m_Songdata[2].path[0] != 0 )
+	{
+		FMODManager()->PrefetchMusic( m_Songdata[2].path );
 	}
 }
 
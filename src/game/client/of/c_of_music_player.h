@@ -21,6 +21,7 @@ public:
 	virtual void Spawn(void);
 	virtual void OnDataChanged(DataUpdateType_t updateType);
 private:
+	void PrefetchNextTrack(void);
 
 	int m_iPhase;
 	
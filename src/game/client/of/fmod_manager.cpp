@@ -41,6 +41,56 @@ CFMODManager::~CFMODManager()
 	m_bFadeOut = false;
 }
 
+//-----------------------------------------------------------------------------
+// FMOD file callbacks
+// FMOD pulls stream data through these on its own stream thread, so music is
+// read from the Source filesystem (loose files and VPKs alike) a chunk at a
+// time instead of being loaded whole on the main thread.
+//-----------------------------------------------------------------------------
+static FMOD_RESULT F_CALLBACK FMODFileOpen( const char *name, unsigned int *filesize, void **handle, void *userdata )
+{
+	FileHandle_t hFile = filesystem->Open( name, "rb", "GAME" );
+	if ( hFile == FILESYSTEM_INVALID_HANDLE )
+		return FMOD_ERR_FILE_NOTFOUND;
+
+	*filesize = filesystem->Size( hFile );
+	*handle = hFile;
+
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FMODFileClose( void *handle, void *userdata )
+{
+	if ( !handle )
+		return FMOD_ERR_INVALID_PARAM;
+
+	filesystem->Close( (FileHandle_t)handle );
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FMODFileRead( void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void *userdata )
+{
+	if ( !handle )
+		return FMOD_ERR_INVALID_PARAM;
+
+	int iRead = filesystem->Read( buffer, sizebytes, (FileHandle_t)handle );
+	*bytesread = iRead > 0 ? (unsigned int)iRead : 0;
+
+	if ( *bytesread < sizebytes )
+		return FMOD_ERR_FILE_EOF;
+
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FMODFileSeek( void *handle, unsigned int pos, void *userdata )
+{
+	if ( !handle )
+		return FMOD_ERR_INVALID_PARAM;
+
+	filesystem->Seek( (FileHandle_t)handle, pos, FILESYSTEM_SEEK_HEAD );
+	return FMOD_OK;
+}
+
 // Starts FMOD
 void CFMODManager::InitFMOD(void)
 {
@@ -57,11 +107,22 @@ void CFMODManager::InitFMOD(void)
 		Warning("FMOD ERROR: Failed to initialize properly!\n");
 	else
 		DevMsg("FMOD initialized successfully.\n");
+
+	// Route all file access through the Source filesystem so streams can come out of VPKs
+	result = pSystem->setFileSystem(FMODFileOpen, FMODFileClose, FMODFileRead, FMODFileSeek, 0, 0, 2048);
+
+	if (result != FMOD_OK)
+		Warning("FMOD ERROR: Failed to set file system callbacks!\n");
+
+	// Keep a few seconds of compressed audio buffered so a slow disk doesn't starve the stream
+	pSystem->setStreamBufferSize(FMOD_STREAM_BUFFER_SIZE, FMOD_TIMEUNIT_RAWBYTES);
 }
 
 // Stops FMOD
 void CFMODManager::ExitFMOD(void)
 {
+	ClearPrefetchedMusic();
+
 	result = pSystem->release();
 
 	if (result != FMOD_OK)
@@ -70,35 +131,156 @@ void CFMODManager::ExitFMOD(void)
 		DevMsg("FMOD system terminated successfully.\n");
 }
 
-// Returns the full path of a specified sound file in the /sounds folder
-void *CFMODManager::GetFullPathToSound(const char* pathToFileFromModFolder, int *pLength )
+// Opens a music file from the /sound folder as a stream
+// Only the header is read here, the rest is pulled by FMOD's stream thread while playing
+Sound *CFMODManager::CreateMusicStream( const char* pathToFileFromSoundsFolder, FMOD_MODE mode )
+{
+	if ( !pSystem || !pathToFileFromSoundsFolder || !pathToFileFromSoundsFolder[0] )
+		return NULL;
+
+	// Still opening in the background, callers check IsMusicReady first and try again later
+	if ( !IsMusicReady( pathToFileFromSoundsFolder ) )
+		return NULL;
+
+	// Grab it from the prefetched streams if we already started opening it
+	Sound *pNewSound = TakePrefetchedMusic( pathToFileFromSoundsFolder );
+	if ( pNewSound )
+	{
+		if ( mode & FMOD_LOOP_NORMAL )
+			pNewSound->setMode( FMOD_LOOP_NORMAL );
+
+		return pNewSound;
+	}
+
+	char fullpath[512];
+	Q_snprintf( fullpath, sizeof(fullpath), "sound/%s", pathToFileFromSoundsFolder );
+
+	result = pSystem->createStream( fullpath, FMOD_CREATESTREAM | mode, NULL, &pNewSound );
+	if ( result != FMOD_OK )
+	{
+		Warning( "FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", pathToFileFromSoundsFolder, result );
+		return NULL;
+	}
+
+	return pNewSound;
+}
+
+// Starts opening a music stream in the background so the next track change doesn't have to
+void CFMODManager::PrefetchMusic( const char* pathToFileFromSoundsFolder )
 {
-/*
-	char* resultpath = new char[512];
-*/
+	if ( !pSystem || !pathToFileFromSoundsFolder || !pathToFileFromSoundsFolder[0] )
+		return;
+
+	for ( int i = 0; i < m_PrefetchedMusic.Count(); i++ )
+	{
+		if ( !Q_stricmp( m_PrefetchedMusic[i].szPath, pathToFileFromSoundsFolder ) )
+			return;
+	}
+
+	// Drop the oldest one if we're full
+	if ( m_PrefetchedMusic.Count() >= FMOD_MAX_PREFETCHED_MUSIC )
+	{
+		m_PrefetchedMusic[0].pSound->release();
+		m_PrefetchedMusic.Remove( 0 );
+	}
+
 	char fullpath[512];
-	Q_snprintf(fullpath, sizeof(fullpath), "sound/%s", pathToFileFromModFolder);
-/*	filesystem->GetLocalPath(fullpath, fullpath, sizeof(fullpath));
+	Q_snprintf( fullpath, sizeof(fullpath), "sound/%s", pathToFileFromSoundsFolder );
 
-	Q_snprintf(resultpath, 512, "%s", fullpath);
-	// convert backwards slashes to forward slashes
-	for (int i = 0; i < 512; i++)
+	Sound *pNewSound = NULL;
+	result = pSystem->createStream( fullpath, FMOD_CREATESTREAM | FMOD_NONBLOCKING, NULL, &pNewSound );
+	if ( result != FMOD_OK || !pNewSound )
 	{
-		if (resultpath[i] == '\\')
-			resultpath[i] = '/';
+		DevWarning( "FMOD: Failed to prefetch sound '%s' ! (ERROR NUMBER: %i)\n", pathToFileFromSoundsFolder, result );
+		return;
 	}
 
-*/	
-	void *buffer = NULL;
+	int iIndex = m_PrefetchedMusic.AddToTail();
+	Q_strncpy( m_PrefetchedMusic[iIndex].szPath, pathToFileFromSoundsFolder, sizeof( m_PrefetchedMusic[iIndex].szPath ) );
+	m_PrefetchedMusic[iIndex].pSound = pNewSound;
+}
+
+// Returns false while a prefetched stream is still opening
+// Sounds that weren't prefetched are always ready, they get opened directly
+bool CFMODManager::IsMusicReady( const char* pathToFileFromSoundsFolder )
+{
+	for ( int i = 0; i < m_PrefetchedMusic.Count(); i++ )
+	{
+		if ( Q_stricmp( m_PrefetchedMusic[i].szPath, pathToFileFromSoundsFolder ) )
+			continue;
+
+		FMOD_OPENSTATE openstate = FMOD_OPENSTATE_READY;
+		if ( m_PrefetchedMusic[i].pSound->getOpenState( &openstate, NULL, NULL, NULL ) != FMOD_OK )
+			return true;
+
+		return openstate != FMOD_OPENSTATE_LOADING && openstate != FMOD_OPENSTATE_CONNECTING;
+	}
+
+	return true;
+}
+
+// Returns a prefetched stream and removes it from the list, since a stream can only be played once
+// Returns NULL if the sound wasn't prefetched or if it failed to open
+Sound *CFMODManager::TakePrefetchedMusic( const char* pathToFileFromSoundsFolder )
+{
+	for ( int i = 0; i < m_PrefetchedMusic.Count(); i++ )
+	{
+		if ( Q_stricmp( m_PrefetchedMusic[i].szPath, pathToFileFromSoundsFolder ) )
+			continue;
+
+		Sound *pPrefetched = m_PrefetchedMusic[i].pSound;
+		m_PrefetchedMusic.Remove( i );
+
+		FMOD_OPENSTATE openstate = FMOD_OPENSTATE_READY;
+		pPrefetched->getOpenState( &openstate, NULL, NULL, NULL );
+
+		if ( openstate == FMOD_OPENSTATE_ERROR )
+		{
+			pPrefetched->release();
+			return NULL;
+		}
+
+		return pPrefetched;
+	}
 
-	int length = filesystem->ReadFileEx( fullpath, "GAME", &buffer, true, true );
+	return NULL;
+}
 
-	if ( pLength )
+// Releases all the prefetched streams
+void CFMODManager::ClearPrefetchedMusic( void )
+{
+	for ( int i = 0; i < m_PrefetchedMusic.Count(); i++ )
 	{
-		*pLength = length;
+		m_PrefetchedMusic[i].pSound->release();
 	}
 
-	return buffer;
+	m_PrefetchedMusic.RemoveAll();
+}
+
+// Remembers a play request whose streams are still opening, Think plays it once they're ready
+// The paths aren't copied, same as currentSound they have to stay around until the music is stopped
+void CFMODManager::QueueMusic( ChannelGroup *pNewChannelGroup, const char* pLoopingMusic, const char* pIntroMusic, float flDelay, bool bEnd )
+{
+	// A channel group only ever plays one thing, so a newer request replaces the old one
+	CancelQueuedMusic( pNewChannelGroup );
+
+	int iIndex = m_QueuedMusic.AddToTail();
+	m_QueuedMusic[iIndex].pChannelGroup = pNewChannelGroup;
+	m_QueuedMusic[iIndex].pLoopingMusic = pLoopingMusic;
+	m_QueuedMusic[iIndex].pIntroMusic = pIntroMusic;
+	m_QueuedMusic[iIndex].flDelay = flDelay;
+	m_QueuedMusic[iIndex].flQueueTime = gpGlobals->realtime;
+	m_QueuedMusic[iIndex].bEnd = bEnd;
+}
+
+// Drops the queued request for a channel group, or every request if it's NULL
+void CFMODManager::CancelQueuedMusic( ChannelGroup *pNewChannelGroup )
+{
+	for ( int i = m_QueuedMusic.Count() - 1; i >= 0; i-- )
+	{
+		if ( !pNewChannelGroup || m_QueuedMusic[i].pChannelGroup == pNewChannelGroup )
+			m_QueuedMusic.Remove( i );
+	}
 }
 
 // Returns the name of the current ambient sound being played
@@ -136,19 +318,14 @@ void CFMODManager::FadeThink(void)
 	}
 	else if (m_bShouldTransition)
 	{
-		int iLength = 0;
-		void *buffer = GetFullPathToSound(newSoundFileToTransitionTo, &iLength);
-		
-		FMOD_CREATESOUNDEXINFO info;
-		memset(&info, 0, sizeof(info));
-		info.length = iLength;
-		info.cbsize = sizeof(info);
-		
-		result = pSystem->createStream((const char*)buffer, FMOD_OPENMEMORY , &info, &pSound);
+		// Try again next frame if it's still opening
+		if (!IsMusicReady(newSoundFileToTransitionTo))
+			return;
 
-		if (result != FMOD_OK)
+		pSound = CreateMusicStream(newSoundFileToTransitionTo);
+
+		if (!pSound)
 		{
-			Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", newSoundFileToTransitionTo, result);
 			newSoundFileToTransitionTo = "NULL";
 			m_bShouldTransition = false;
 			return;
@@ -193,8 +370,29 @@ void CFMODManager::FadeThink(void)
 }
 
 // Called every frame when the client is in-game
+// Plays the queued music whose streams finished opening
 void CFMODManager::Think(void)
 {
+	for ( int i = m_QueuedMusic.Count() - 1; i >= 0; i-- )
+	{
+		queuedmusic_t queued = m_QueuedMusic[i];
+
+		if ( !IsMusicReady( queued.pLoopingMusic ) || ( queued.pIntroMusic && !IsMusicReady( queued.pIntroMusic ) ) )
+			continue;
+
+		m_QueuedMusic.Remove( i );
+
+		if ( queued.bEnd )
+		{
+			PlayMusicEnd( queued.pChannelGroup, queued.pLoopingMusic );
+		}
+		else
+		{
+			// Whatever we waited already counts towards the delay
+			float flDelay = MAX( queued.flDelay - ( gpGlobals->realtime - queued.flQueueTime ), 0.0f );
+			PlayLoopingMusic( queued.pChannelGroup, queued.pLoopingMusic, queued.pIntroMusic, flDelay );
+		}
+	}
 }
 
 // Compares specified ambient sound with the current ambient sound being played
@@ -263,21 +461,23 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 	unsigned long long clock_start = 0;
 	float freq = 0;
 	unsigned int slen = 0;
+
+	// Don't hold up the frame on streams that are still opening, Think starts the music once they're ready
+	if ( !IsMusicReady( pLoopingMusic ) || ( pIntroMusic && !IsMusicReady( pIntroMusic ) ) )
+	{
+		QueueMusic( pNewChannelGroup, pLoopingMusic, pIntroMusic, flDelay, false );
+		return;
+	}
 	
 	if (pIntroMusic)
 	{
 		Sound *pIntroSound = NULL;
 		Sound *pLoopingSound = NULL;
 		
-		int iLengthIntro = 0;
-		void *vBufferIntro = GetFullPathToSound(pIntroMusic, &iLengthIntro);
-		
-		FMOD_CREATESOUNDEXINFO infoIntro;
-		memset(&infoIntro, 0, sizeof(infoIntro));
-		infoIntro.length = iLengthIntro;
-		infoIntro.cbsize = sizeof(infoIntro);
-		
-		result = pSystem->createStream((const char *)vBufferIntro, FMOD_OPENMEMORY | FMOD_CREATESTREAM , &infoIntro, &pIntroSound);
+		pIntroSound = CreateMusicStream(pIntroMusic);
+		if (!pIntroSound)
+			return;
+
 		pSystem->playSound(pIntroSound, pNewChannelGroup, true, &pTempChannel);
 
 		result = pIntroSound->getDefaults(&freq, 0);
@@ -294,17 +494,16 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 		result = pTempChannel->setDelay(clock_start, 0, false);
 		result = pTempChannel->setPaused(false);
 
-		result = pLoopingSound->setLoopPoints(0, FMOD_TIMEUNIT_PCM, GetSoundLengthPCM(pLoopingSound), FMOD_TIMEUNIT_PCM);
-
-		int iLengthLoop = 0;
-		void *vBufferLoop = GetFullPathToSound(pLoopingMusic, &iLengthLoop);
-		
-		FMOD_CREATESOUNDEXINFO infoLoop;
-		memset(&infoLoop, 0, sizeof(infoLoop));
-		infoLoop.length = iLengthLoop;
-		infoLoop.cbsize = sizeof(infoLoop);
+		pLoopingSound = CreateMusicStream(pLoopingMusic, FMOD_LOOP_NORMAL);
+		if (!pLoopingSound)
+		{
+			// Don't leave the intro playing on its own
+			pTempChannel->stop();
+			pIntroSound->release();
+			return;
+		}
 
-		result = pSystem->createStream((const char *)vBufferLoop, FMOD_OPENMEMORY | FMOD_LOOP_NORMAL | FMOD_CREATESTREAM, &infoLoop, &pLoopingSound);
+		result = pLoopingSound->setLoopPoints(0, FMOD_TIMEUNIT_PCM, GetSoundLengthPCM(pLoopingSound), FMOD_TIMEUNIT_PCM);
 		pSystem->playSound(pLoopingSound, pNewChannelGroup, true, &pTempLoopChannel);
 
 		result = pIntroSound->getLength(&slen, FMOD_TIMEUNIT_PCM);
@@ -322,21 +521,11 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 	}
 	else
 	{
-		int iLengthLoop = 0;
-		void *vBufferLoop = GetFullPathToSound(pLoopingMusic, &iLengthLoop);
-		
-		FMOD_CREATESOUNDEXINFO infoLoop;
-		memset(&infoLoop, 0, sizeof(infoLoop));
-		infoLoop.length = iLengthLoop;
-		infoLoop.cbsize = sizeof(infoLoop);
-		
-		result = pSound->setLoopPoints(0, FMOD_TIMEUNIT_PCM, GetSoundLengthPCM(pSound), FMOD_TIMEUNIT_PCM);
-		result = pSystem->createStream((const char *)vBufferLoop, FMOD_OPENMEMORY | FMOD_LOOP_NORMAL | FMOD_CREATESTREAM , &infoLoop, &pSound);
-		if (result != FMOD_OK)
-		{
-			Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", pLoopingMusic, result);
+		pSound = CreateMusicStream(pLoopingMusic, FMOD_LOOP_NORMAL);
+		if (!pSound)
 			return;
-		}
+
+		result = pSound->setLoopPoints(0, FMOD_TIMEUNIT_PCM, GetSoundLengthPCM(pSound), FMOD_TIMEUNIT_PCM);
 		result = pSystem->playSound(pSound, pNewChannelGroup, true, &pTempChannel);
 		
 		result = pTempChannel->getDSPClock(0, &clock_start);
@@ -369,22 +558,19 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 // In most cases, we'll want to use TransitionAmbientSounds instead
 void CFMODManager::PlayAmbientSound(const char* pathToFileFromSoundsFolder, bool fadeIn)
 {
-	int iLengthLoop = 0;
-	void *vBufferLoop = GetFullPathToSound(pathToFileFromSoundsFolder, &iLengthLoop);
-	
-	FMOD_CREATESOUNDEXINFO infoLoop;
-	memset(&infoLoop, 0, sizeof(infoLoop));
-	infoLoop.length = iLengthLoop;
-	infoLoop.cbsize = sizeof(infoLoop);	
-	
-	result = pSystem->createStream((const char*)vBufferLoop, FMOD_OPENMEMORY , &infoLoop, &pSound);
-
-	if (result != FMOD_OK)
+	// Still opening, let FadeThink start it once it's ready
+	if (!IsMusicReady(pathToFileFromSoundsFolder))
 	{
-		Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", pathToFileFromSoundsFolder, result);
+		newSoundFileToTransitionTo = pathToFileFromSoundsFolder;
+		m_bShouldTransition = true;
 		return;
 	}
 
+	pSound = CreateMusicStream(pathToFileFromSoundsFolder);
+
+	if (!pSound)
+		return;
+
 	m_flSongStart = gpGlobals->realtime;
 	result = pSystem->playSound(pSound, pChannelGroup, false, &pChannel);
 
@@ -410,6 +596,8 @@ void CFMODManager::PlayAmbientSound(const char* pathToFileFromSoundsFolder, bool
 
 void CFMODManager::StopAmbientSound( ChannelGroup *pNewChannel, bool fadeOut)
 {
+	CancelQueuedMusic( pNewChannel );
+
 	if (fadeOut)
 	{
 		pNewChannel->setVolume(1.0f);
@@ -435,17 +623,18 @@ void CFMODManager::PlayMusicEnd( ChannelGroup *pNewChannelGroup, const char* pLo
 	
 	if (pLoopingMusic)
 	{
+		if ( !IsMusicReady( pLoopingMusic ) )
+		{
+			QueueMusic( pNewChannelGroup, pLoopingMusic, NULL, 0, true );
+			return;
+		}
+
 		Sound *pIntroSound = NULL;
 		
-		int iLength = 0;
-		void *vBuffer = GetFullPathToSound(pLoopingMusic, &iLength);
-		
-		FMOD_CREATESOUNDEXINFO info;
-		memset(&info, 0, sizeof(info));
-		info.length = iLength;
-		info.cbsize = sizeof(info);			
-		
-		result = pSystem->createStream((const char*)vBuffer, FMOD_CREATESTREAM | FMOD_OPENMEMORY, &info, &pIntroSound);
+		pIntroSound = CreateMusicStream(pLoopingMusic);
+		if (!pIntroSound)
+			return;
+
 		pSystem->playSound(pIntroSound, pNewChannelGroup, true, &pTempChannel);
 		
 		result = pTempChannel->setPaused(false);
@@ -463,6 +652,8 @@ static ConCommand fm_stop_all_sound( "fm_stop_all_sound", CommSndStp, "Stops eve
 // Abruptly stops playing all ambient sounds
 void CFMODManager::StopAllSound( void )
 {
+	CancelQueuedMusic( NULL );
+
 //	pChannelGroup->setVolume(0.0f);
 	pChannelGroup->stop();
 //	pChannelGroup->setPaused(true);
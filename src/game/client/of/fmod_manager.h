@@ -8,6 +8,9 @@
 
 using namespace FMOD;
 
+#define FMOD_STREAM_BUFFER_SIZE		( 64 * 1024 )
+#define FMOD_MAX_PREFETCHED_MUSIC	4
+
 class CFMODManager
 {
 public:
@@ -32,9 +35,36 @@ public:
 	float GetSoundLength(void);
 	unsigned int GetSoundLengthPCM( Sound *sound );
 
+	void PrefetchMusic( const char* pathToFileFromSoundsFolder );
+	void ClearPrefetchedMusic( void );
+
 	float m_fDefaultVolume;
 private:
-	void *GetFullPathToSound( const char* pathToFileFromModFolder, int *pLength );
+	Sound *CreateMusicStream( const char* pathToFileFromSoundsFolder, FMOD_MODE mode = FMOD_DEFAULT );
+	Sound *TakePrefetchedMusic( const char* pathToFileFromSoundsFolder );
+	bool IsMusicReady( const char* pathToFileFromSoundsFolder );
+
+	void QueueMusic( ChannelGroup *pNewChannelGroup, const char* pLoopingMusic, const char* pIntroMusic, float flDelay, bool bEnd );
+	void CancelQueuedMusic( ChannelGroup *pNewChannelGroup );
+
+	struct prefetchedmusic_t
+	{
+		char szPath[MAX_PATH];
+		Sound *pSound;
+	};
+	CUtlVector<prefetchedmusic_t> m_PrefetchedMusic;
+
+	// Music waiting on a prefetched stream to finish opening
+	struct queuedmusic_t
+	{
+		ChannelGroup *pChannelGroup;
+		const char *pLoopingMusic;
+		const char *pIntroMusic;
+		float flDelay;
+		float flQueueTime;
+		bool bEnd;
+	};
+	CUtlVector<queuedmusic_t> m_QueuedMusic;
 	const char* GetCurrentSoundName( void );
 
 	const char* currentSound;
@@ -147,7 +147,7 @@ void CTFHudPowerups::OnThink()
 	{
 		if( pPlayer->m_Shared.InCond( m_iConditions[i].m_iCondID ) )
 		{
-			float flRemoveTime = pPlayer->m_Shared.GetConditionDuration( m_iConditions[i].m_iCondID ) + gpGlobals->curtime;
+			float flRemoveTime = pPlayer->m_Shared.GetConditionExpireTime( m_iConditions[i].m_iCondID );
 			float flProgress = 1 - ( (flRemoveTime - gpGlobals->curtime) / (flRemoveTime - m_iConditions[i].m_flStartTime) );
 			if( m_iConditions[i].m_pBar )
 			{
@@ -77,6 +77,7 @@ public:
 	virtual void FireGameEvent( IGameEvent *event );
 	
 	void FireBullet( const FireBulletsInfo_t &info, bool bDoEffects, int nDamageType, int nCustomDamageType = TF_DMG_CUSTOM_NONE );
+	void FireBulletImpact( const FireBulletsInfo_t &info, trace_t &trace, bool bDoEffects, int nDamageType, int nCustomDamageType = TF_DMG_CUSTOM_NONE );
 
 	void ImpactWaterTrace( trace_t &trace, const Vector &vecStart );
 
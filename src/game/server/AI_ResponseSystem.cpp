@@ -15,6 +15,7 @@
 #include "utldict.h"
 #include "ai_speech.h"
 #include "tier0/icommandline.h"
+#include "tier0/fasttimer.h"
 #include <ctype.h>
 #include "sceneentity.h"
 #include "isaverestore.h"
@@ -29,6 +30,11 @@
 ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose matching output (1 for simple, 2 for rule scoring). If set to 3, it will only show response success/failure for npc_selected NPCs." );
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system.");
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
+ConVar rr_ruleindex( "rr_ruleindex", "1", FCVAR_NONE, "Only score the rules whose required criteria can match, instead of every rule." );
+ConVar rr_benchmark_record( "rr_benchmark_record", "0", FCVAR_NONE, "Keep a copy of every criteria set the response systems are asked about, for rr_benchmark." );
+
+#define RR_RULEINDEX_KEY_SIZE	256
+#define RR_BENCHMARK_MAX_SETS	8192
 
 static CUtlSymbolTable g_RS;
 
@@ -683,6 +689,12 @@ public:
 	float		LookupEnumeration( const char *name, bool& found );
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
+	void		FindBestMatchingRules( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< int >& bestrules );
+
+	void		BuildRuleIndex( void );
+	int			FindRuleIndexCriterion( Rule *rule );
+	void		GatherCandidateRules( const AI_CriteriaSet& set, CUtlVector< int >& candidates );
+	bool		BenchmarkRecordedCriteria( const char *pszName, int nIterations );
 
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
@@ -710,6 +722,17 @@ public:
 	CUtlDict< Rule, short >	m_Rules;
 	CUtlDict< Enumeration, short > m_Enumerations;
 
+	// Rules keyed by "criterion\nvalue" of a required criterion that has to match that
+	// value exactly, so only the rules that can match a set get scored. Rules without
+	// such a criterion are always scored.
+	CUtlDict< CUtlVector< int > *, int >	m_RuleIndex;
+	CUtlDict< int, int >	m_RuleIndexCriteria;
+	CUtlVector< int >		m_UnindexedRules;
+	CUtlVector< int >		m_CandidateRules;
+	bool					m_bRuleIndexDirty;
+
+	CUtlVector< AI_CriteriaSet >	m_RecordedCriteria;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
@@ -762,6 +785,7 @@ CResponseSystem::CResponseSystem()
 	m_bUnget = false;
 	m_bPrecache = true;
 	m_bCustomManagable = false;
+	m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -769,6 +793,7 @@ CResponseSystem::CResponseSystem()
 //-----------------------------------------------------------------------------
 CResponseSystem::~CResponseSystem()
 {
+	m_RuleIndex.PurgeAndDeleteElements();
 }
 
 //-----------------------------------------------------------------------------
@@ -817,6 +842,8 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+	m_RecordedCriteria.Purge();
+	m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -1676,21 +1703,150 @@ bool CResponseSystem::GetBestResponse( ResponseSearchResult& searchResult, Rule
 	return bret;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: The criterion a rule is filed under in the rule index, -1 if it has
+//			none. It has to be required and only match one exact string, so the
+//			rule scores zero whenever the set has anything else for it.
+//-----------------------------------------------------------------------------
+int CResponseSystem::FindRuleIndexCriterion( Rule *rule )
+{
+	int iBest = -1;
+	for ( int i = 0; i < rule->m_Criteria.Count(); i++ )
+	{
+		int icriterion = rule->m_Criteria[ i ];
+		Criteria *c = &m_Criteria[ icriterion ];
+		if ( !c->required || c->IsSubCriteriaType() || !c->name )
+			continue;
+
+		Matcher &m = c->matcher;
+		if ( !m.valid || m.isnumeric || m.notequal || m.usemin || m.usemax || !m.GetToken()[0] )
+			continue;
+
+		if ( Q_strlen( c->name ) + Q_strlen( m.GetToken() ) + 2 > RR_RULEINDEX_KEY_SIZE )
+			continue;
+
+		// The concept is nearly always there and splits the rules up the most
+		if ( !Q_stricmp( c->name, "concept" ) )
+			return icriterion;
+
+		if ( iBest == -1 )
+		{
+			iBest = icriterion;
+		}
+	}
+
+	return iBest;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
-// Input  : set - 
-//			verbose - 
-// Output : int
 //-----------------------------------------------------------------------------
-int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose )
+void CResponseSystem::BuildRuleIndex( void )
+{
+	m_RuleIndex.PurgeAndDeleteElements();
+	m_RuleIndexCriteria.RemoveAll();
+	m_UnindexedRules.RemoveAll();
+
+	int c = m_Rules.Count();
+	for ( int i = 0; i < c; i++ )
+	{
+		int icriterion = FindRuleIndexCriterion( &m_Rules[ i ] );
+		if ( icriterion == -1 )
+		{
+			m_UnindexedRules.AddToTail( i );
+			continue;
+		}
+
+		Criteria *crit = &m_Criteria[ icriterion ];
+
+		char szKey[ RR_RULEINDEX_KEY_SIZE ];
+		Q_snprintf( szKey, sizeof( szKey ), "%s\n%s", crit->name, crit->matcher.GetToken() );
+
+		int iBucket = m_RuleIndex.Find( szKey );
+		if ( iBucket == m_RuleIndex.InvalidIndex() )
+		{
+			iBucket = m_RuleIndex.Insert( szKey, new CUtlVector< int > );
+		}
+
+		// Rules go in in order, so every bucket is sorted
+		m_RuleIndex[ iBucket ]->AddToTail( i );
+
+		if ( m_RuleIndexCriteria.Find( crit->name ) == m_RuleIndexCriteria.InvalidIndex() )
+		{
+			m_RuleIndexCriteria.Insert( crit->name, 0 );
+		}
+	}
+
+	m_bRuleIndexDirty = false;
+}
+
+static int RuleIndexSort( const int *pLeft, const int *pRight )
+{
+	return *pLeft - *pRight;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Every rule that could score for this set, in rule order
+//-----------------------------------------------------------------------------
+void CResponseSystem::GatherCandidateRules( const AI_CriteriaSet& set, CUtlVector< int >& candidates )
+{
+	if ( m_bRuleIndexDirty )
+	{
+		BuildRuleIndex();
+	}
+
+	candidates.RemoveAll();
+	candidates.AddVectorToTail( m_UnindexedRules );
+
+	int nLists = 1;
+	for ( int i = m_RuleIndexCriteria.First(); i != m_RuleIndexCriteria.InvalidIndex(); i = m_RuleIndexCriteria.Next( i ) )
+	{
+		const char *pszName = m_RuleIndexCriteria.GetElementName( i );
+		int found = set.FindCriterionIndex( pszName );
+		if ( found == -1 )
+			continue;
+
+		// Too long for a key means too long to match any rule's value too
+		const char *pszValue = set.GetValue( found );
+		if ( !pszValue || Q_strlen( pszName ) + Q_strlen( pszValue ) + 2 > RR_RULEINDEX_KEY_SIZE )
+			continue;
+
+		char szKey[ RR_RULEINDEX_KEY_SIZE ];
+		Q_snprintf( szKey, sizeof( szKey ), "%s\n%s", pszName, pszValue );
+
+		int iBucket = m_RuleIndex.Find( szKey );
+		if ( iBucket != m_RuleIndex.InvalidIndex() )
+		{
+			candidates.AddVectorToTail( *m_RuleIndex[ iBucket ] );
+			nLists++;
+		}
+	}
+
+	// Ties are broken by position, so score them in the same order as a full pass would
+	if ( nLists > 1 )
+	{
+		candidates.Sort( RuleIndexSort );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: All the rules that share the best score
+//-----------------------------------------------------------------------------
+void CResponseSystem::FindBestMatchingRules( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< int >& bestrules )
 {
-	CUtlVector< int >	bestrules;
 	float bestscore = 0.001f;
 
 	int c = m_Rules.Count();
-	int i;
-	for ( i = 0; i < c; i++ )
+	if ( bUseIndex )
 	{
+		GatherCandidateRules( set, m_CandidateRules );
+		c = m_CandidateRules.Count();
+	}
+
+	for ( int n = 0; n < c; n++ )
+	{
+		int i = bUseIndex ? m_CandidateRules[ n ] : n;
+
 		float score = ScoreCriteriaAgainstRule( set, i, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
@@ -1706,6 +1862,87 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 			bestrules.AddToTail( i );
 		}
 	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Replays the recorded criteria sets with and without the rule index
+//-----------------------------------------------------------------------------
+bool CResponseSystem::BenchmarkRecordedCriteria( const char *pszName, int nIterations )
+{
+	int nSets = m_RecordedCriteria.Count();
+	if ( !nSets )
+		return false;
+
+	CUtlVector< int > indexed, scanned;
+
+	// Same answer first, including every tied rule
+	int nMismatches = 0;
+	int nCandidates = 0;
+	for ( int i = 0; i < nSets; i++ )
+	{
+		indexed.RemoveAll();
+		scanned.RemoveAll();
+		FindBestMatchingRules( m_RecordedCriteria[ i ], false, true, indexed );
+		FindBestMatchingRules( m_RecordedCriteria[ i ], false, false, scanned );
+		nCandidates += m_CandidateRules.Count();
+
+		if ( indexed.Count() != scanned.Count() || ( indexed.Count() && V_memcmp( indexed.Base(), scanned.Base(), indexed.Count() * sizeof( int ) ) ) )
+		{
+			nMismatches++;
+		}
+	}
+
+	CFastTimer indexTimer, scanTimer;
+
+	indexTimer.Start();
+	for ( int iIteration = 0; iIteration < nIterations; iIteration++ )
+	{
+		for ( int i = 0; i < nSets; i++ )
+		{
+			indexed.RemoveAll();
+			FindBestMatchingRules( m_RecordedCriteria[ i ], false, true, indexed );
+		}
+	}
+	indexTimer.End();
+
+	scanTimer.Start();
+	for ( int iIteration = 0; iIteration < nIterations; iIteration++ )
+	{
+		for ( int i = 0; i < nSets; i++ )
+		{
+			scanned.RemoveAll();
+			FindBestMatchingRules( m_RecordedCriteria[ i ], false, false, scanned );
+		}
+	}
+	scanTimer.End();
+
+	Msg( "%s: %d rules (%d always scored, %d index keys), %d criteria sets, %.1f candidate rules per set\n",
+		pszName, m_Rules.Count(), m_UnindexedRules.Count(), m_RuleIndex.Count(), nSets, (float)nCandidates / nSets );
+	Msg( "  indexed %8.2f ms  all rules %8.2f ms  (%d iterations)\n",
+		indexTimer.GetDuration().GetMillisecondsF(), scanTimer.GetDuration().GetMillisecondsF(), nIterations );
+	if ( nMismatches )
+	{
+		Warning( "  %d criteria sets picked different rules with the index!\n", nMismatches );
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+// Input  : set - 
+//			verbose - 
+// Output : int
+//-----------------------------------------------------------------------------
+int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose )
+{
+	CUtlVector< int >	bestrules;
+
+	// Anyone watching the scoring expects to see every rule scored
+	const char *pszDebugRule = rr_debugrule.GetString();
+	bool bUseIndex = rr_ruleindex.GetBool() && !verbose && !( pszDebugRule && pszDebugRule[0] );
+
+	FindBestMatchingRules( set, verbose, bUseIndex, bestrules );
 
 	int bestCount = bestrules.Count();
 	if ( bestCount <= 0 )
@@ -1736,6 +1973,11 @@ bool CResponseSystem::FindBestResponse( const AI_CriteriaSet& set, AI_Response&
 	bool showRules = ( iDbgResponse == 2 );
 	bool showResult = ( iDbgResponse == 1 || iDbgResponse == 2 );
 
+	if ( rr_benchmark_record.GetBool() && m_RecordedCriteria.Count() < RR_BENCHMARK_MAX_SETS )
+	{
+		m_RecordedCriteria.AddToTail( set );
+	}
+
 	// Look for match. verbose mode used to be at level 2, but disabled because the writers don't actually care for that info.
 	int bestRule = FindBestMatchingRule( set, iDbgResponse == 3 ); 
 
@@ -2612,6 +2854,7 @@ void CResponseSystem::ParseRule( void )
 	if ( validRule )
 	{
 		m_Rules.Insert( ruleName, newRule );
+		m_bRuleIndexDirty = true;
 	}
 	else
 	{
@@ -2809,6 +3052,7 @@ void CResponseSystem::CopyRuleFrom( Rule *pSrcRule, int iRule, CResponseSystem *
 
 	// Add rule.
 	pCustomSystem->m_Rules.Insert( m_Rules.GetElementName( iRule ), dstRule );
+	pCustomSystem->m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -2933,6 +3177,21 @@ public:
 	IResponseSystem *BuildCustomResponseSystemGivenCriteria( const char *pszBaseFile, const char *pszCustomName, AI_CriteriaSet &criteriaSet, float flCriteriaScore );
 	void DestroyCustomResponseSystems();
 
+	void Benchmark( int nIterations )
+	{
+		bool bAny = BenchmarkRecordedCriteria( GetScriptFile(), nIterations );
+
+		for ( int i = m_InstancedSystems.First(); i != m_InstancedSystems.InvalidIndex(); i = m_InstancedSystems.Next( i ) )
+		{
+			bAny |= m_InstancedSystems[ i ]->BenchmarkRecordedCriteria( m_InstancedSystems.GetElementName( i ), nIterations );
+		}
+
+		if ( !bAny )
+		{
+			Msg( "No criteria sets recorded, set rr_benchmark_record 1 and play for a while first.\n" );
+		}
+	}
+
 	virtual void LevelInitPreEntity()
 	{
 		// This will precache the default system
@@ -3056,6 +3315,15 @@ CON_COMMAND( rr_reloadresponsesystems, "Reload all response system scripts." )
 #endif
 }
 
+CON_COMMAND( rr_benchmark, "Replays the criteria sets recorded with rr_benchmark_record against every response system, with and without the rule index. Usage: rr_benchmark [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 10;
+	defaultresponsesytem.Benchmark( nIterations );
+}
+
 static short RESPONSESYSTEM_SAVE_RESTORE_VERSION = 1;
 
 // note:  this won't save/restore settings from instanced response systems.  Could add that with a CDefSaveRestoreOps implementation if needed
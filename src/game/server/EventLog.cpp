@@ -9,6 +9,7 @@
 #include "EventLog.h"
 #include "team.h"
 #include "KeyValues.h"
+#include "asynclog.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -25,6 +26,14 @@ CEventLog::~CEventLog()
 void CEventLog::FireGameEvent( IGameEvent *event )
 {
 	PrintEvent ( event );
+
+	// Get the round onto disk while nothing much is happening
+	const char *name = event->GetName();
+	if ( !Q_strcmp( name, "teamplay_round_win" ) || !Q_strcmp( name, "teamplay_round_stalemate" ) ||
+		 !Q_strcmp( name, "teamplay_game_over" ) || !Q_strcmp( name, "tf_game_over" ) )
+	{
+		g_AsyncLogWriter.Flush( false );
+	}
 }
 
 bool CEventLog::PrintEvent( IGameEvent *event )
@@ -0,0 +1,406 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Batched server log writer. While it's running UTIL_LogPrintf lines
+//			skip the engine log and are only queued on the game thread, then
+//			written to per map text/JSON files by a background thread so those
+//			writes never stall a tick.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "asynclog.h"
+#include "filesystem.h"
+#include "tier1/utlbuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Don't care about vcr hooks here...
+#undef localtime
+#undef time
+
+#include <time.h>
+
+ConVar sv_log_async( "sv_log_async", "0", FCVAR_NONE, "Write UTIL_LogPrintf lines to per map files from a background thread instead of the engine log." );
+ConVar sv_log_async_dir( "sv_log_async_dir", "logs", FCVAR_NONE, "Directory the background log writer writes to." );
+ConVar sv_log_async_json( "sv_log_async_json", "0", FCVAR_NONE, "Also write every log line to a JSON lines (.jsonl) file next to the text log." );
+ConVar sv_log_async_maxqueue( "sv_log_async_maxqueue", "8192", FCVAR_NONE, "Lines that can be waiting for the background log writer before new ones are dropped.", true, 64, false, 0 );
+ConVar sv_log_async_interval( "sv_log_async_interval", "250", FCVAR_NONE, "Milliseconds the background log writer waits between batches.", true, 10, true, 5000 );
+
+#define ASYNCLOG_BATCH_SIZE		( 64 * 1024 )
+
+CAsyncLogWriter g_AsyncLogWriter;
+
+//-----------------------------------------------------------------------------
+// Purpose: The thread that owns the log files
+//-----------------------------------------------------------------------------
+class CAsyncLogThread : public CThread
+{
+public:
+	CAsyncLogThread( CAsyncLogWriter *pWriter ) : m_pWriter( pWriter ), m_bQuit( false )
+	{
+		m_hTextFile = FILESYSTEM_INVALID_HANDLE;
+		m_hJSONFile = FILESYSTEM_INVALID_HANDLE;
+		m_TextBatch.SetBufferType( true, false );
+		m_JSONBatch.SetBufferType( true, false );
+		SetName( "AsyncLogWriter" );
+	}
+
+	void RequestQuit( void )
+	{
+		m_bQuit = true;
+		m_pWriter->m_WakeEvent.Set();
+	}
+
+protected:
+	virtual int Run()
+	{
+		while ( !m_bQuit )
+		{
+			m_pWriter->m_WakeEvent.Wait( sv_log_async_interval.GetInt() );
+			Drain();
+		}
+
+		// Pick up anything queued while we were told to stop
+		Drain();
+		CloseFiles();
+		return 0;
+	}
+
+private:
+	void Drain( void )
+	{
+		CAsyncLogWriter::logitem_t *pItem = NULL;
+		while ( m_pWriter->m_Queue.PopItem( &pItem ) )
+		{
+			switch ( pItem->nType )
+			{
+			case CAsyncLogWriter::LOGITEM_LINE:
+				AddLine( pItem );
+				break;
+			case CAsyncLogWriter::LOGITEM_OPEN:
+				CloseFiles();
+				OpenFiles( pItem );
+				break;
+			case CAsyncLogWriter::LOGITEM_CLOSE:
+				CloseFiles();
+				break;
+			case CAsyncLogWriter::LOGITEM_FLUSH:
+				WriteBatches();
+				if ( m_hTextFile != FILESYSTEM_INVALID_HANDLE )
+					g_pFullFileSystem->Flush( m_hTextFile );
+				if ( m_hJSONFile != FILESYSTEM_INVALID_HANDLE )
+					g_pFullFileSystem->Flush( m_hJSONFile );
+				m_pWriter->m_nFlushCompleted = pItem->nSequence;
+				m_pWriter->m_FlushDone.Set();
+				break;
+			}
+
+			m_pWriter->m_ItemPool.PutObject( pItem );
+
+			if ( m_TextBatch.TellPut() >= ASYNCLOG_BATCH_SIZE )
+				WriteBatches();
+		}
+
+		WriteBatches();
+	}
+
+	void AddLine( const CAsyncLogWriter::logitem_t *pItem )
+	{
+		// Same layout the engine uses: L MM/DD/YYYY - HH:MM:SS: message
+		m_TextBatch.Printf( "L %s: %s", pItem->szTime, pItem->szText );
+
+		int nLen = Q_strlen( pItem->szText );
+		if ( !nLen || pItem->szText[ nLen - 1 ] != '\n' )
+			m_TextBatch.PutChar( '\n' );
+
+		if ( m_hJSONFile != FILESYSTEM_INVALID_HANDLE )
+		{
+			m_JSONBatch.Printf( "{\"time\":\"%s\",\"tick\":%d,\"map\":\"", pItem->szTime, pItem->nTick );
+			PutJSONString( m_JSONBatch, m_szMapName );
+			m_JSONBatch.PutString( "\",\"msg\":\"" );
+			PutJSONString( m_JSONBatch, pItem->szText );
+			m_JSONBatch.PutString( "\"}\n" );
+		}
+
+		++m_pWriter->m_nWritten;
+	}
+
+	static void PutJSONString( CUtlBuffer &buf, const char *pszText )
+	{
+		for ( const char *pch = pszText; *pch; pch++ )
+		{
+			unsigned char ch = (unsigned char)*pch;
+			switch ( ch )
+			{
+			case '"':	buf.PutString( "\\\"" ); break;
+			case '\\':	buf.PutString( "\\\\" ); break;
+			case '\n':	break; // Every line ends with one, the record separator is enough
+			case '\r':	break;
+			case '\t':	buf.PutString( "\\t" ); break;
+			default:
+				if ( ch < 0x20 )
+					buf.Printf( "\\u%04x", ch );
+				else
+					buf.PutChar( ch );
+				break;
+			}
+		}
+	}
+
+	void WriteBatches( void )
+	{
+		if ( m_TextBatch.TellPut() > 0 )
+		{
+			if ( m_hTextFile != FILESYSTEM_INVALID_HANDLE )
+				g_pFullFileSystem->Write( m_TextBatch.Base(), m_TextBatch.TellPut(), m_hTextFile );
+
+			++m_pWriter->m_nBatches;
+		}
+
+		if ( m_JSONBatch.TellPut() > 0 && m_hJSONFile != FILESYSTEM_INVALID_HANDLE )
+			g_pFullFileSystem->Write( m_JSONBatch.Base(), m_JSONBatch.TellPut(), m_hJSONFile );
+
+		m_TextBatch.Clear();
+		m_JSONBatch.Clear();
+	}
+
+	// szText is the path to write to, without extension
+	void OpenFiles( const CAsyncLogWriter::logitem_t *pItem )
+	{
+		Q_strncpy( m_szMapName, pItem->szMap, sizeof( m_szMapName ) );
+
+		char szFileName[ MAX_PATH ];
+		Q_snprintf( szFileName, sizeof( szFileName ), "%s.log", pItem->szText );
+		m_hTextFile = g_pFullFileSystem->Open( szFileName, "at", "MOD" );
+
+		if ( pItem->bJSON )
+		{
+			Q_snprintf( szFileName, sizeof( szFileName ), "%s.jsonl", pItem->szText );
+			m_hJSONFile = g_pFullFileSystem->Open( szFileName, "at", "MOD" );
+		}
+	}
+
+	void CloseFiles( void )
+	{
+		WriteBatches();
+
+		if ( m_hTextFile != FILESYSTEM_INVALID_HANDLE )
+		{
+			g_pFullFileSystem->Close( m_hTextFile );
+			m_hTextFile = FILESYSTEM_INVALID_HANDLE;
+		}
+
+		if ( m_hJSONFile != FILESYSTEM_INVALID_HANDLE )
+		{
+			g_pFullFileSystem->Close( m_hJSONFile );
+			m_hJSONFile = FILESYSTEM_INVALID_HANDLE;
+		}
+	}
+
+	CAsyncLogWriter		*m_pWriter;
+	volatile bool		m_bQuit;
+
+	FileHandle_t		m_hTextFile;
+	FileHandle_t		m_hJSONFile;
+	CUtlBuffer			m_TextBatch;
+	CUtlBuffer			m_JSONBatch;
+	char				m_szMapName[ MAX_MAP_NAME ];
+};
+
+CAsyncLogWriter::CAsyncLogWriter() : CAutoGameSystem( "CAsyncLogWriter" ), m_FlushDone( false )
+{
+	m_pThread = NULL;
+	m_szMapName[0] = 0;
+	m_nFlushRequested = 0;
+	m_nFlushCompleted = 0;
+}
+
+bool CAsyncLogWriter::Init()
+{
+	return true;
+}
+
+void CAsyncLogWriter::Shutdown()
+{
+	StopThread();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Every map gets its own set of files, like the engine log
+//-----------------------------------------------------------------------------
+void CAsyncLogWriter::LevelInitPreEntity()
+{
+	Q_strncpy( m_szMapName, STRING( gpGlobals->mapname ), sizeof( m_szMapName ) );
+
+	if ( !sv_log_async.GetBool() )
+		return;
+
+	StartThread();
+
+	time_t aclock;
+	time( &aclock );
+	struct tm *newtime = localtime( &aclock );
+
+	g_pFullFileSystem->CreateDirHierarchy( sv_log_async_dir.GetString(), "MOD" );
+
+	char szPath[ MAX_PATH ];
+	Q_snprintf( szPath, sizeof( szPath ), "%s/L%02d%02d%04d_%02d%02d%02d_%s",
+		sv_log_async_dir.GetString(),
+		newtime->tm_mon + 1, newtime->tm_mday, newtime->tm_year + 1900,
+		newtime->tm_hour, newtime->tm_min, newtime->tm_sec,
+		m_szMapName );
+
+	logitem_t *pItem = QueueItem( LOGITEM_OPEN, szPath, false );
+	Q_strncpy( pItem->szMap, m_szMapName, sizeof( pItem->szMap ) );
+	pItem->bJSON = sv_log_async_json.GetBool();
+	m_Queue.PushItem( pItem );
+}
+
+void CAsyncLogWriter::LevelShutdownPostEntity()
+{
+	if ( !m_pThread )
+		return;
+
+	// The writer closes the files on its own time, the next map's open is
+	// queued behind the close so nothing can land in the wrong file
+	QueueItem( LOGITEM_CLOSE, "" );
+	Flush( false );
+}
+
+bool CAsyncLogWriter::IsEnabled( void ) const
+{
+	return m_pThread != NULL && sv_log_async.GetBool();
+}
+
+void CAsyncLogWriter::StartThread( void )
+{
+	if ( m_pThread )
+		return;
+
+	m_pThread = new CAsyncLogThread( this );
+	if ( !m_pThread->Start() )
+	{
+		Warning( "Failed to start the background log writer, falling back to the engine log.\n" );
+		delete m_pThread;
+		m_pThread = NULL;
+	}
+}
+
+void CAsyncLogWriter::StopThread( void )
+{
+	if ( !m_pThread )
+		return;
+
+	m_pThread->RequestQuit();
+	m_pThread->Join();
+
+	delete m_pThread;
+	m_pThread = NULL;
+}
+
+CAsyncLogWriter::logitem_t *CAsyncLogWriter::QueueItem( int nType, const char *pszText, bool bPush )
+{
+	logitem_t *pItem = m_ItemPool.GetObject();
+	pItem->nType = nType;
+	pItem->nTick = gpGlobals->tickcount;
+	pItem->nSequence = 0;
+	pItem->szTime[0] = 0;
+	pItem->szMap[0] = 0;
+	pItem->bJSON = false;
+	Q_strncpy( pItem->szText, pszText, sizeof( pItem->szText ) );
+
+	if ( bPush )
+	{
+		m_Queue.PushItem( pItem );
+	}
+
+	return pItem;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Timestamps a line and hands it to the writer thread
+//-----------------------------------------------------------------------------
+void CAsyncLogWriter::Print( const char *pszMessage )
+{
+	int nDepth = m_Queue.Count();
+	if ( nDepth >= sv_log_async_maxqueue.GetInt() )
+	{
+		++m_nDropped;
+		return;
+	}
+
+	if ( nDepth + 1 > m_nPeakDepth )
+	{
+		m_nPeakDepth = nDepth + 1;
+	}
+
+	logitem_t *pItem = m_ItemPool.GetObject();
+	pItem->nType = LOGITEM_LINE;
+	pItem->nTick = gpGlobals->tickcount;
+	Q_strncpy( pItem->szText, pszMessage, sizeof( pItem->szText ) );
+
+	time_t aclock;
+	time( &aclock );
+	struct tm *newtime = localtime( &aclock );
+	Q_snprintf( pItem->szTime, sizeof( pItem->szTime ), "%02d/%02d/%04d - %02d:%02d:%02d",
+		newtime->tm_mon + 1, newtime->tm_mday, newtime->tm_year + 1900,
+		newtime->tm_hour, newtime->tm_min, newtime->tm_sec );
+
+	m_Queue.PushItem( pItem );
+	++m_nQueued;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called at round end and shutdown so a crash never loses a whole round
+//-----------------------------------------------------------------------------
+void CAsyncLogWriter::Flush( bool bWait )
+{
+	if ( !m_pThread )
+		return;
+
+	int nSequence = ++m_nFlushRequested;
+
+	logitem_t *pItem = QueueItem( LOGITEM_FLUSH, "", false );
+	pItem->nSequence = nSequence;
+	m_Queue.PushItem( pItem );
+	m_WakeEvent.Set();
+
+	if ( !bWait )
+		return;
+
+	// Earlier flushes can still signal while we wait, only stop once ours is done
+	double flTimeout = Plat_FloatTime() + 5.0;
+	while ( m_nFlushCompleted < nSequence )
+	{
+		int nRemaining = (int)( ( flTimeout - Plat_FloatTime() ) * 1000.0 );
+		if ( nRemaining <= 0 || ( !m_FlushDone.Wait( nRemaining ) && m_nFlushCompleted < nSequence ) )
+		{
+			Warning( "Timed out waiting for the background log writer to flush.\n" );
+			return;
+		}
+	}
+}
+
+void CAsyncLogWriter::PrintStats( void )
+{
+	Msg( "Async log writer: %s\n", IsEnabled() ? "running" : "off" );
+	Msg( "  queued %d, written %d, dropped %d\n", (int)m_nQueued, (int)m_nWritten, (int)m_nDropped );
+	Msg( "  queue depth %d (peak %d), batches %d\n", m_Queue.Count(), (int)m_nPeakDepth, (int)m_nBatches );
+}
+
+CON_COMMAND( sv_log_async_stats, "Print background log writer counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_AsyncLogWriter.PrintStats();
+}
+
+CON_COMMAND( sv_log_async_flush, "Write out everything queued for the background log writer." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_AsyncLogWriter.Flush( true );
+}
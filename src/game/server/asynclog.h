@@ -0,0 +1,97 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Batched server log writer. While it's running UTIL_LogPrintf lines
+//			skip the engine log and are only queued on the game thread, then
+//			written to per map text/JSON files by a background thread so those
+//			writes never stall a tick.
+//
+//=============================================================================//
+
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "igamesystem.h"
+#include "tier0/tslist.h"
+#include "tier0/threadtools.h"
+
+#define ASYNCLOG_LINE_SIZE		1024
+#define ASYNCLOG_TIME_SIZE		32
+
+class CAsyncLogThread;
+
+class CAsyncLogWriter : public CAutoGameSystem
+{
+public:
+	CAsyncLogWriter();
+
+	// CAutoGameSystem
+	virtual bool Init();
+	virtual void Shutdown();
+	virtual void LevelInitPreEntity();
+	virtual void LevelShutdownPostEntity();
+
+	bool IsEnabled( void ) const;
+
+	// Queues a line, called from the game thread
+	void Print( const char *pszMessage );
+
+	// Asks the writer to write out everything queued so far, optionally waiting until it's on disk
+	void Flush( bool bWait );
+
+	void PrintStats( void );
+
+private:
+	friend class CAsyncLogThread;
+
+	enum
+	{
+		LOGITEM_LINE = 0,
+		LOGITEM_OPEN,		// Start writing to a new file, szText is the base filename
+		LOGITEM_CLOSE,		// Close the current files
+		LOGITEM_FLUSH,		// Write out anything batched, then mark nSequence done and signal m_FlushDone
+	};
+
+	struct logitem_t
+	{
+		int		nType;
+		int		nTick;
+		int		nSequence;	// Only used by LOGITEM_FLUSH
+		char	szTime[ ASYNCLOG_TIME_SIZE ];
+		char	szText[ ASYNCLOG_LINE_SIZE ];
+
+		// Only used by LOGITEM_OPEN
+		char	szMap[ MAX_MAP_NAME ];
+		bool	bJSON;
+	};
+
+	void		StartThread( void );
+	void		StopThread( void );
+	logitem_t	*QueueItem( int nType, const char *pszText, bool bPush = true );
+
+	CTSPool< logitem_t >		m_ItemPool;
+	CTSQueue< logitem_t * >		m_Queue;
+
+	CAsyncLogThread		*m_pThread;
+	CThreadEvent		m_WakeEvent;
+	CThreadEvent		m_FlushDone;
+
+	// Flushes are numbered so a waiter can tell its own flush from an earlier one finishing
+	int					m_nFlushRequested;
+	CInterlockedInt		m_nFlushCompleted;
+
+	char				m_szMapName[ MAX_MAP_NAME ];
+
+	// Stats, written from both threads
+	CInterlockedInt		m_nQueued;
+	CInterlockedInt		m_nWritten;
+	CInterlockedInt		m_nDropped;
+	CInterlockedInt		m_nBatches;
+	CInterlockedInt		m_nPeakDepth;
+};
+
+extern CAsyncLogWriter g_AsyncLogWriter;
+
+#endif // ASYNCLOG_H
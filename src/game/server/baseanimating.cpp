@@ -27,6 +27,9 @@
 #include "datacache/idatacache.h"
 #include "smoke_trail.h"
 #include "props.h"
+#ifdef OF_DLL
+#include "tf_hitbox_table.h"
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -2709,6 +2712,34 @@ void CBaseAnimating::InvalidateBoneCache( void )
 	Studio_InvalidateBoneCache( m_boneCacheHandle );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Copies out the cached bones, only if GetBoneCache would use them as is
+//-----------------------------------------------------------------------------
+bool CBaseAnimating::SaveBoneCache( CUtlVector< matrix3x4_t > &bones, int &boneMask )
+{
+	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
+	if ( !pcache || !pcache->IsValid( gpGlobals->curtime ) || pcache->m_timeValid > gpGlobals->curtime )
+		return false;
+
+	bones.SetCount( pcache->CachedBoneCount() );
+	pcache->ReadCachedBoneArray( bones.Base() );
+	boneMask = pcache->m_boneMask;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Puts bones saved by SaveBoneCache back, valid as of now
+//-----------------------------------------------------------------------------
+bool CBaseAnimating::RestoreBoneCache( const CUtlVector< matrix3x4_t > &bones, int boneMask )
+{
+	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
+	if ( !pcache || pcache->m_boneMask != boneMask || pcache->CachedBoneCount() != bones.Count() )
+		return false;
+
+	pcache->WriteCachedBoneArray( bones.Base(), gpGlobals->curtime );
+	return true;
+}
+
 bool CBaseAnimating::TestCollision( const Ray_t &ray, unsigned int fContentsMask, trace_t& tr )
 {
 	// Return a special case for scaled physics objects
@@ -2755,7 +2786,11 @@ bool CBaseAnimating::TestHitboxes( const Ray_t &ray, unsigned int fContentsMask,
 	matrix3x4_t *hitboxbones[MAXSTUDIOBONES];
 	pcache->ReadCachedBonePointers( hitboxbones, pStudioHdr->numbones() );
 
+#ifdef OF_DLL
+	if ( TFHitboxTables()->TraceToStudio( GetModel(), ray, pStudioHdr, m_nHitboxSet, hitboxbones, fContentsMask, GetAbsOrigin(), GetModelScale(), tr ) )
+#else
 	if ( TraceToStudio( physprops, ray, pStudioHdr, set, hitboxbones, fContentsMask, GetAbsOrigin(), GetModelScale(), tr ) )
+#endif
 	{
 		mstudiobbox_t *pbox = set->pHitbox( tr.hitbox );
 		mstudiobone_t *pBone = pStudioHdr->pBone(pbox->bone);
@@ -257,6 +257,9 @@ public:
 	virtual bool TestHitboxes( const Ray_t &ray, unsigned int fContentsMask, trace_t& tr );
 	class CBoneCache *GetBoneCache( void );
 	void InvalidateBoneCache();
+	// Copies the bone cache out if it's good for this frame, or puts a copy back in
+	bool SaveBoneCache( CUtlVector< matrix3x4_t > &bones, int &boneMask );
+	bool RestoreBoneCache( const CUtlVector< matrix3x4_t > &bones, int boneMask );
 	void InvalidateBoneCacheIfOlderThan( float deltaTime );
 	virtual int DrawDebugTextOverlays( void );
 	
@@ -617,6 +617,13 @@ CBaseEntity *CBaseEntity::GetFollowedEntity()
 void CBaseEntity::SetClassname( const char *className )
 {
 	m_iClassname = AllocPooledString( className );
+	gEntList.UpdateSearchIndex( this );
+}
+
+void CBaseEntity::SetName( string_t newName )
+{
+	m_iName = newName;
+	gEntList.UpdateSearchIndex( this );
 }
 
 void CBaseEntity::SetModelIndex( int index )
@@ -3313,6 +3320,7 @@ void CBaseEntity::OnRestore()
 #endif
 
 	SimThink_EntityChanged( this );
+	gEntList.UpdateSearchIndex( this );
 
 	// touchlinks get recomputed
 	if ( IsEFlagSet( EFL_CHECK_UNTOUCH ) )
@@ -0,0 +1,209 @@
+//====== Copyright  1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Times bone setup on player models with anim_simd_bonesetup off and
+//			on, and checks that both paths come up with the same pose.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "bone_setup.h"
+#include "datacache/imdlcache.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Above this the two paths are considered to disagree
+#define BONESETUP_BENCHMARK_TOLERANCE	0.0001f
+
+struct BoneSetupBenchmarkPose_t
+{
+	int		iSequence;
+	float	flCycle;
+	int		iLayer;			// blended in at half weight, -1 for none
+	float	flLayerCycle;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Every sequence at a few cycles, each with another sequence layered
+//			on top so SlerpBones gets exercised as well
+//-----------------------------------------------------------------------------
+static void BuildBenchmarkPoses( CStudioHdr *pStudioHdr, CUtlVector< BoneSetupBenchmarkPose_t > &poses )
+{
+	static const float s_flCycles[] = { 0.0f, 0.37f, 0.81f };
+
+	int nSequences = pStudioHdr->GetNumSeq();
+	for ( int iSequence = 0; iSequence < nSequences; iSequence++ )
+	{
+		for ( int i = 0; i < ARRAYSIZE( s_flCycles ); i++ )
+		{
+			BoneSetupBenchmarkPose_t &pose = poses[ poses.AddToTail() ];
+			pose.iSequence = iSequence;
+			pose.flCycle = s_flCycles[i];
+			pose.iLayer = ( nSequences > 1 ) ? ( iSequence + 1 ) % nSequences : -1;
+			pose.flLayerCycle = 1.0f - s_flCycles[i];
+		}
+	}
+}
+
+static void SetupBenchmarkPose( CStudioHdr *pStudioHdr, const float *poseParameter, const BoneSetupBenchmarkPose_t &pose, Vector *pos, Quaternion *q )
+{
+	IBoneSetup boneSetup( pStudioHdr, BONE_USED_BY_ANYTHING, poseParameter );
+	boneSetup.InitPose( pos, q );
+	boneSetup.AccumulatePose( pos, q, pose.iSequence, pose.flCycle, 1.0f, gpGlobals->curtime, NULL );
+	if ( pose.iLayer >= 0 )
+	{
+		boneSetup.AccumulatePose( pos, q, pose.iLayer, pose.flLayerCycle, 0.5f, gpGlobals->curtime, NULL );
+	}
+}
+
+static double TimeBenchmarkPoses( CStudioHdr *pStudioHdr, const float *poseParameter, const CUtlVector< BoneSetupBenchmarkPose_t > &poses, int nIterations )
+{
+	Vector pos[ MAXSTUDIOBONES ];
+	QuaternionAligned q[ MAXSTUDIOBONES ];
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		FOR_EACH_VEC( poses, j )
+		{
+			SetupBenchmarkPose( pStudioHdr, poseParameter, poses[j], pos, q );
+		}
+	}
+	timer.End();
+	return timer.GetDuration().GetMillisecondsF();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs both paths on one model and reports the timings and the
+//			largest difference between them
+//-----------------------------------------------------------------------------
+static bool BenchmarkModel( const char *pszName, CStudioHdr *pStudioHdr, int nIterations, ConVarRef &simd )
+{
+	if ( !pStudioHdr || !pStudioHdr->IsValid() || !pStudioHdr->GetNumSeq() )
+	{
+		Warning( "  %s: no sequences, skipping\n", pszName );
+		return true;
+	}
+
+	float poseParameter[ MAXSTUDIOPOSEPARAM ];
+	for ( int i = 0; i < MAXSTUDIOPOSEPARAM; i++ )
+	{
+		poseParameter[i] = 0.5f;
+	}
+
+	CUtlVector< BoneSetupBenchmarkPose_t > poses;
+	BuildBenchmarkPoses( pStudioHdr, poses );
+
+	Vector scalarPos[ MAXSTUDIOBONES ], simdPos[ MAXSTUDIOBONES ];
+	QuaternionAligned scalarQ[ MAXSTUDIOBONES ], simdQ[ MAXSTUDIOBONES ];
+
+	float flMaxPos = 0.0f;
+	float flMaxQuat = 0.0f;
+	int nBones = pStudioHdr->numbones();
+	FOR_EACH_VEC( poses, i )
+	{
+		simd.SetValue( 0 );
+		SetupBenchmarkPose( pStudioHdr, poseParameter, poses[i], scalarPos, scalarQ );
+		simd.SetValue( 1 );
+		SetupBenchmarkPose( pStudioHdr, poseParameter, poses[i], simdPos, simdQ );
+
+		for ( int iBone = 0; iBone < nBones; iBone++ )
+		{
+			if ( !( pStudioHdr->boneFlags( iBone ) & BONE_USED_BY_ANYTHING ) )
+				continue;
+
+			for ( int j = 0; j < 3; j++ )
+			{
+				flMaxPos = MAX( flMaxPos, fabs( scalarPos[iBone][j] - simdPos[iBone][j] ) );
+			}
+
+			// q and -q are the same rotation
+			float flSame = 0.0f, flFlipped = 0.0f;
+			for ( int j = 0; j < 4; j++ )
+			{
+				flSame = MAX( flSame, fabs( scalarQ[iBone][j] - simdQ[iBone][j] ) );
+				flFlipped = MAX( flFlipped, fabs( scalarQ[iBone][j] + simdQ[iBone][j] ) );
+			}
+			flMaxQuat = MAX( flMaxQuat, MIN( flSame, flFlipped ) );
+		}
+	}
+
+	simd.SetValue( 0 );
+	double flScalar = TimeBenchmarkPoses( pStudioHdr, poseParameter, poses, nIterations );
+	simd.SetValue( 1 );
+	double flSIMD = TimeBenchmarkPoses( pStudioHdr, poseParameter, poses, nIterations );
+
+	bool bMatch = ( flMaxPos <= BONESETUP_BENCHMARK_TOLERANCE && flMaxQuat <= BONESETUP_BENCHMARK_TOLERANCE );
+	Msg( "  %s: %d bones, %d poses  scalar %8.2f ms  simd %8.2f ms  (%.2fx)\n", pszName, nBones, poses.Count(), flScalar, flSIMD, flSIMD > 0.0 ? flScalar / flSIMD : 0.0 );
+	if ( bMatch )
+	{
+		Msg( "    max difference: position %g, quaternion %g\n", flMaxPos, flMaxQuat );
+	}
+	else
+	{
+		Warning( "    max difference: position %g, quaternion %g, paths disagree!\n", flMaxPos, flMaxQuat );
+	}
+
+	return bMatch;
+}
+
+CON_COMMAND( bonesetup_benchmark, "Times scalar vs SIMD bone setup and checks they agree. Usage: bonesetup_benchmark [iterations] [model ...], defaults to the models of the players in the game" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	ConVarRef simd( "anim_simd_bonesetup" );
+	if ( !simd.IsValid() )
+		return;
+
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 20;
+	int nOldValue = simd.GetInt();
+	int nModels = 0;
+	int nMismatches = 0;
+
+	MDLCACHE_CRITICAL_SECTION();
+
+	if ( args.ArgC() > 2 )
+	{
+		for ( int i = 2; i < args.ArgC(); i++ )
+		{
+			int iModel = modelinfo->GetModelIndex( args[i] );
+			const model_t *pModel = ( iModel >= 0 ) ? modelinfo->GetModel( iModel ) : NULL;
+			if ( !pModel || modelinfo->GetModelType( pModel ) != mod_studio )
+			{
+				Warning( "  %s isn't a precached studio model\n", args[i] );
+				continue;
+			}
+
+			CStudioHdr studioHdr( modelinfo->GetStudiomodel( pModel ), mdlcache );
+			nModels++;
+			nMismatches += BenchmarkModel( args[i], &studioHdr, nIterations, simd ) ? 0 : 1;
+		}
+	}
+	else
+	{
+		CUtlVector< string_t > done;
+		for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+		{
+			CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+			if ( !pPlayer || done.Find( pPlayer->GetModelName() ) != done.InvalidIndex() )
+				continue;
+
+			done.AddToTail( pPlayer->GetModelName() );
+			nModels++;
+			nMismatches += BenchmarkModel( STRING( pPlayer->GetModelName() ), pPlayer->GetModelPtr(), nIterations, simd ) ? 0 : 1;
+		}
+	}
+
+	simd.SetValue( nOldValue );
+
+	if ( !nModels )
+	{
+		Msg( "No models to benchmark, spawn some players or name the models to use.\n" );
+		return;
+	}
+
+	Msg( "%d models, %d iterations, %d disagreed\n", nModels, nIterations, nMismatches );
+}
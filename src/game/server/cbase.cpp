@@ -89,6 +89,7 @@ OUTPUTS:
 #endif
 
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -684,12 +685,15 @@ DEFINE_FIXEDSIZE_ALLOCATOR( EventQueuePrioritizedEvent_t, 128, CUtlMemoryPool::G
 
 CEventQueue g_EventQueue;
 
+ConVar eventqueue_target_cache( "eventqueue_target_cache", "1", FCVAR_NONE, "Cache the entities named event targets resolve to until an entity's name changes." );
+
 CEventQueue::CEventQueue()
 {
-	m_Events.m_flFireTime = -FLT_MAX;
-	m_Events.m_pNext = NULL;
+	m_nNextSequence = 0;
+	m_nTargetCacheSerial = 0;
 
 	Init();
+	ResetStats();
 }
 
 CEventQueue::~CEventQueue()
@@ -801,21 +805,14 @@ void CEventQueue::Init( void )
 void CEventQueue::Clear( void )
 {
 	// delete all the events in the queue
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-	
-	while ( pe != NULL )
-	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
-		delete pe;
-		pe = next;
-	}
-
-	m_Events.m_pNext = NULL;
+	m_Heap.PurgeAndDeleteElements();
+	m_TargetCache.PurgeAndDeleteElements();
 }
 
 void CEventQueue::Dump( void )
 {
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	CUtlVector< EventQueuePrioritizedEvent_t * > events;
+	GetSortedEvents( events );
 
 	Msg("Dumping event queue. Current time is: %.2f\n",
 #if defined( TF_DLL ) || defined(OF_DLL)
@@ -825,9 +822,9 @@ void CEventQueue::Dump( void )
 #endif
 		);
 
-	while ( pe != NULL )
+	FOR_EACH_VEC( events, i )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
+		EventQueuePrioritizedEvent_t *pe = events[i];
 
 		Msg("   (%.2f) Target: '%s', Input: '%s', Parameter '%s'. Activator: '%s', Caller '%s'.  \n", 
 			pe->m_flFireTime, 
@@ -836,13 +833,30 @@ void CEventQueue::Dump( void )
 			pe->m_VariantValue.String(),
 			pe->m_pActivator ? pe->m_pActivator->GetDebugName() : "None", 
 			pe->m_pCaller ? pe->m_pCaller->GetDebugName() : "None"  );
-
-		pe = next;
 	}
 
 	Msg("Finished dump.\n");
 }
 
+void CEventQueue::ResetStats( void )
+{
+	m_nAdded = 0;
+	m_nServiced = 0;
+	m_nPeakCount = m_Heap.Count();
+	m_nTargetCacheHits = 0;
+	m_nTargetCacheMisses = 0;
+	m_flServiceTime = 0;
+	m_flPeakServiceTime = 0;
+}
+
+void CEventQueue::PrintStats( void )
+{
+	Msg( "Event queue: %d pending (peak %d), %d added, %d fired\n", m_Heap.Count(), m_nPeakCount, m_nAdded, m_nServiced );
+	Msg( "  servicing took %.3f ms total, %.3f ms in the slowest frame, %.2f us per event\n",
+		m_flServiceTime, m_flPeakServiceTime, m_nServiced ? m_flServiceTime * 1000.0 / m_nServiced : 0.0 );
+	Msg( "  target cache: %d hits, %d misses, %d names cached\n", m_nTargetCacheHits, m_nTargetCacheMisses, m_TargetCache.Count() );
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: adds the action into the correct spot in the priority queue, targeting entity via string name
@@ -899,41 +913,151 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 
 
 //-----------------------------------------------------------------------------
-// Purpose: private function, adds an event into the list
-// Input  : *newEvent - the (already built) event to add
+// Purpose: Events at the same time fire in the order they were added
 //-----------------------------------------------------------------------------
-void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
+bool CEventQueue::FiresBefore( const EventQueuePrioritizedEvent_t *pLeft, const EventQueuePrioritizedEvent_t *pRight )
+{
+	if ( pLeft->m_flFireTime != pRight->m_flFireTime )
+		return pLeft->m_flFireTime < pRight->m_flFireTime;
+
+	// Difference rather than compare so this survives the sequence wrapping
+	return (int)( pLeft->m_nSequence - pRight->m_nSequence ) < 0;
+}
+
+void CEventQueue::SwapEvents( int i, int j )
+{
+	EventQueuePrioritizedEvent_t *pTemp = m_Heap[i];
+	m_Heap[i] = m_Heap[j];
+	m_Heap[j] = pTemp;
+	m_Heap[i]->m_iHeapIndex = i;
+	m_Heap[j]->m_iHeapIndex = j;
+}
+
+void CEventQueue::SiftUp( int i )
 {
-	// loop through the actions looking for a place to insert
-	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	while ( i > 0 )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
-		{
+		int iParent = ( i - 1 ) / 2;
+		if ( !FiresBefore( m_Heap[i], m_Heap[iParent] ) )
 			break;
+
+		SwapEvents( i, iParent );
+		i = iParent;
+	}
+}
+
+void CEventQueue::SiftDown( int i )
+{
+	int nCount = m_Heap.Count();
+	while ( 1 )
+	{
+		int iFirst = i;
+		int iChild = i * 2 + 1;
+		if ( iChild < nCount && FiresBefore( m_Heap[iChild], m_Heap[iFirst] ) )
+		{
+			iFirst = iChild;
 		}
+		if ( iChild + 1 < nCount && FiresBefore( m_Heap[iChild + 1], m_Heap[iFirst] ) )
+		{
+			iFirst = iChild + 1;
+		}
+
+		if ( iFirst == i )
+			break;
+
+		SwapEvents( i, iFirst );
+		i = iFirst;
 	}
+}
 
-	Assert( pe );
+//-----------------------------------------------------------------------------
+// Purpose: private function, adds an event into the heap
+// Input  : *newEvent - the (already built) event to add
+//-----------------------------------------------------------------------------
+void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
+{
+	newEvent->m_nSequence = m_nNextSequence++;
+	newEvent->m_iHeapIndex = m_Heap.AddToTail( newEvent );
+	SiftUp( newEvent->m_iHeapIndex );
+
+	m_nAdded++;
+	m_nPeakCount = MAX( m_nPeakCount, m_Heap.Count() );
+}
 
-	// insert
-	newEvent->m_pNext = pe->m_pNext;
-	newEvent->m_pPrev = pe;
-	pe->m_pNext = newEvent;
-	if ( newEvent->m_pNext )
+// CUtlPriorityQueue::RemoveAt only sifts down, which isn't enough when
+// removing from the middle, so the heap is managed here
+void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
+{
+	int i = pe->m_iHeapIndex;
+	Assert( m_Heap.IsValidIndex( i ) && m_Heap[i] == pe );
+
+	int iLast = m_Heap.Count() - 1;
+	if ( i != iLast )
+	{
+		SwapEvents( i, iLast );
+	}
+	m_Heap.Remove( iLast );
+	pe->m_iHeapIndex = -1;
+
+	// The last event took its place, it may belong above or below it
+	if ( i < m_Heap.Count() )
 	{
-		newEvent->m_pNext->m_pPrev = newEvent;
+		SiftUp( i );
+		SiftDown( i );
 	}
 }
 
-void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
+static int EventFireOrder( EventQueuePrioritizedEvent_t * const *ppLeft, EventQueuePrioritizedEvent_t * const *ppRight )
 {
-	Assert( pe->m_pPrev );
-	pe->m_pPrev->m_pNext = pe->m_pNext;
-	if ( pe->m_pNext )
+	const EventQueuePrioritizedEvent_t *pLeft = *ppLeft;
+	const EventQueuePrioritizedEvent_t *pRight = *ppRight;
+	if ( pLeft->m_flFireTime != pRight->m_flFireTime )
+		return ( pLeft->m_flFireTime < pRight->m_flFireTime ) ? -1 : 1;
+
+	return (int)( pLeft->m_nSequence - pRight->m_nSequence );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: All the pending events in the order they'll fire
+//-----------------------------------------------------------------------------
+void CEventQueue::GetSortedEvents( CUtlVector< EventQueuePrioritizedEvent_t * > &events )
+{
+	events.CopyArray( m_Heap.Base(), m_Heap.Count() );
+	events.Sort( EventFireOrder );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks up the entities a named event targets, caching them until
+//			any entity's name changes. Returns an index into m_TargetCache,
+//			or InvalidIndex() for names that depend on the event (!activator etc.)
+//-----------------------------------------------------------------------------
+int CEventQueue::FindCachedTargets( const char *pszTarget )
+{
+	if ( !eventqueue_target_cache.GetBool() || pszTarget[0] == '!' )
+		return m_TargetCache.InvalidIndex();
+
+	if ( m_nTargetCacheSerial != gEntList.GetTargetnameSerial() || m_TargetCache.Count() >= 256 )
+	{
+		m_TargetCache.PurgeAndDeleteElements();
+		m_nTargetCacheSerial = gEntList.GetTargetnameSerial();
+	}
+
+	int iCached = m_TargetCache.Find( pszTarget );
+	if ( m_TargetCache.IsValidIndex( iCached ) )
 	{
-		pe->m_pNext->m_pPrev = pe->m_pPrev;
+		m_nTargetCacheHits++;
+		return iCached;
 	}
+
+	m_nTargetCacheMisses++;
+
+	CUtlVector< EHANDLE > *pTargets = new CUtlVector< EHANDLE >;
+	for ( CBaseEntity *target = gEntList.FindEntityByName( NULL, pszTarget ); target; target = gEntList.FindEntityByName( target, pszTarget ) )
+	{
+		pTargets->AddToTail( target );
+	}
+
+	return m_TargetCache.Insert( pszTarget, pTargets );
 }
 
 
@@ -947,16 +1071,25 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	if ( !m_Heap.Count() )
+		return;
+
+	CFastTimer timer;
+	timer.Start();
 
 #if defined( TF_DLL ) || defined(OF_DLL)
-	while ( pe != NULL && pe->m_flFireTime <= engine->GetServerTime() )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= engine->GetServerTime() )
 #else
-	while ( pe != NULL && pe->m_flFireTime <= gpGlobals->curtime )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= gpGlobals->curtime )
 #endif
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		// Take it out before firing so inputs that cancel events can't free it under us
+		EventQueuePrioritizedEvent_t *pe = m_Heap[0];
+		RemoveEvent( pe );
+		m_nServiced++;
+
 		bool targetFound = false;
 
 		// find the targets
@@ -965,7 +1098,26 @@ void CEventQueue::ServiceEvents( void )
 			// In the context the event, the searching entity is also the caller
 			CBaseEntity *pSearchingEntity = pe->m_pCaller;
 			CBaseEntity *target = NULL;
-			while ( 1 )
+			bool bSearch = true;
+
+			int iCached = FindCachedTargets( STRING(pe->m_iTarget) );
+			if ( m_TargetCache.IsValidIndex( iCached ) )
+			{
+				// Good for as long as the inputs don't rename, spawn or delete anything named,
+				// if they do carry on searching after the last target like we always did
+				int nSerial = gEntList.GetTargetnameSerial();
+				CUtlVector< EHANDLE > &targets = *m_TargetCache[iCached];
+				for ( int i = 0; i < targets.Count() && gEntList.GetTargetnameSerial() == nSerial; i++ )
+				{
+					target = targets[i];
+					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+					targetFound = true;
+				}
+
+				bSearch = ( gEntList.GetTargetnameSerial() != nSerial );
+			}
+
+			while ( bSearch )
 			{
 				target = gEntList.FindEntityByName( target, pe->m_iTarget, pSearchingEntity, pe->m_pActivator, pe->m_pCaller );
 				if ( !target )
@@ -1025,8 +1177,6 @@ void CEventQueue::ServiceEvents( void )
 			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 		}
 
-		// remove the event from the list (remembering that the queue may have been added to)
-		RemoveEvent( pe );
 		delete pe;
 
 		//
@@ -1039,10 +1189,12 @@ void CEventQueue::ServiceEvents( void )
 				break;
 			}
 		}
-
-		// restart the list (to catch any new items have probably been added to the queue)
-		pe = m_Events.m_pNext;	
 	}
+
+	timer.End();
+	double flServiceTime = timer.GetDuration().GetMillisecondsF();
+	m_flServiceTime += flServiceTime;
+	m_flPeakServiceTime = MAX( m_flPeakServiceTime, flServiceTime );
 }
 
 //-----------------------------------------------------------------------------
@@ -1057,6 +1209,66 @@ void CC_DumpEventQueue()
 }
 static ConCommand dumpeventqueue( "dumpeventqueue", CC_DumpEventQueue, "Dump the contents of the Entity I/O event queue to the console." );
 
+CON_COMMAND( eventqueue_stats, "Shows how long servicing the Entity I/O event queue has taken. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_EventQueue.ResetStats();
+		return;
+	}
+
+	g_EventQueue.PrintStats();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Floods the queue the same way ent_fire does, spread over the next
+//			few seconds. Check eventqueue_stats once they've fired.
+//-----------------------------------------------------------------------------
+CON_COMMAND( eventqueue_stress, "Queues a lot of named events. Usage: eventqueue_stress [events] [max delay] [target] [input]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nEvents = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 10000;
+	float flMaxDelay = ( args.ArgC() > 2 ) ? atof( args[2] ) : 5.0f;
+	const char *pszTarget = ( args.ArgC() > 3 ) ? args[3] : "eventqueue_stress";
+	const char *pszInput = ( args.ArgC() > 4 ) ? args[4] : "Trigger";
+
+	// Without a target of their own, fire at a few relays with no outputs
+	if ( args.ArgC() <= 3 && !gEntList.FindEntityByName( NULL, pszTarget ) )
+	{
+		for ( int i = 0; i < 16; i++ )
+		{
+			CBaseEntity *pRelay = CreateEntityByName( "logic_relay" );
+			if ( !pRelay )
+				break;
+
+			pRelay->KeyValue( "targetname", pszTarget );
+			DispatchSpawn( pRelay );
+		}
+	}
+
+	// Pooled so the events don't point at a temporary
+	string_t iszTarget = AllocPooledString( pszTarget );
+	string_t iszInput = AllocPooledString( pszInput );
+
+	CBasePlayer *pPlayer = UTIL_GetCommandClient();
+
+	variant_t value;
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nEvents; i++ )
+	{
+		g_EventQueue.AddEvent( STRING( iszTarget ), STRING( iszInput ), value, RandomFloat( 0, flMaxDelay ), pPlayer, pPlayer );
+	}
+	timer.End();
+
+	Msg( "Queued %d events for '%s' over %.1f seconds in %.3f ms\n", nEvents, pszTarget, flMaxDelay, timer.GetDuration().GetMillisecondsF() );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Removes all pending events from the I/O queue that were added by the
 //			given caller.
@@ -1069,11 +1281,11 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 	if (!pCaller)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
-
-	while (pCur != NULL)
+	// Removing shuffles the heap, so pick out the victims first
+	CUtlVector< EventQueuePrioritizedEvent_t * > deleteList;
+	FOR_EACH_VEC( m_Heap, i )
 	{
-		bool bDelete = false;
+		EventQueuePrioritizedEvent_t *pCur = m_Heap[i];
 		if (pCur->m_pCaller == pCaller)
 		{
 			// Pointers match; make sure everything else matches.
@@ -1081,18 +1293,15 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 				!stricmp(pCur->m_pCaller->GetClassname(), pCaller->GetClassname()))
 			{
 				// Found a matching event; delete it from the queue.
-				bDelete = true;
+				deleteList.AddToTail( pCur );
 			}
 		}
+	}
 
-		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
-
-		if (bDelete)
-		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
-		}
+	FOR_EACH_VEC( deleteList, i )
+	{
+		RemoveEvent( deleteList[i] );
+		delete deleteList[i];
 	}
 }
 
@@ -1107,28 +1316,24 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 	if (!pTarget)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
-
-	while (pCur != NULL)
+	CUtlVector< EventQueuePrioritizedEvent_t * > deleteList;
+	FOR_EACH_VEC( m_Heap, i )
 	{
-		bool bDelete = false;
+		EventQueuePrioritizedEvent_t *pCur = m_Heap[i];
 		if (pCur->m_pEntTarget == pTarget)
 		{
 			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
 			{
 				// Found a matching event; delete it from the queue.
-				bDelete = true;
+				deleteList.AddToTail( pCur );
 			}
 		}
+	}
 
-		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
-
-		if (bDelete)
-		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
-		}
+	FOR_EACH_VEC( deleteList, i )
+	{
+		RemoveEvent( deleteList[i] );
+		delete deleteList[i];
 	}
 }
 
@@ -1142,10 +1347,9 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 	if (!pTarget)
 		return false;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
-
-	while (pCur != NULL)
+	FOR_EACH_VEC( m_Heap, i )
 	{
+		EventQueuePrioritizedEvent_t *pCur = m_Heap[i];
 		if (pCur->m_pEntTarget == pTarget)
 		{
 			if ( !sInputName )
@@ -1154,8 +1358,6 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
 				return true;
 		}
-
-		pCur = pCur->m_pNext;
 	}
 
 	return false;
@@ -1190,29 +1392,27 @@ BEGIN_SIMPLE_DATADESC( EventQueuePrioritizedEvent_t )
 	DEFINE_FIELD( m_iOutputID, FIELD_INTEGER ),
 	DEFINE_CUSTOM_FIELD( m_VariantValue, variantFuncs ),
 
-//	DEFINE_FIELD( m_pNext, FIELD_??? ),
-//	DEFINE_FIELD( m_pPrev, FIELD_??? ),
+//	DEFINE_FIELD( m_nSequence, FIELD_INTEGER ),	// restored events are re-added in the order they were saved
+//	DEFINE_FIELD( m_iHeapIndex, FIELD_INTEGER ),
 END_DATADESC()
 
 
 int CEventQueue::Save( ISave &save )
 {
-	// count the number of items in the queue
-	EventQueuePrioritizedEvent_t *pe;
+	// save them in firing order, so events at the same time keep their order on restore
+	CUtlVector< EventQueuePrioritizedEvent_t * > events;
+	GetSortedEvents( events );
 
-	m_iListCount = 0;
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
-	{
-		m_iListCount++;
-	}
+	m_iListCount = events.Count();
 
 	// save that value out to disk, so we know how many to restore
 	if ( !save.WriteFields( "EventQueue", this, NULL, m_DataMap.dataDesc, m_DataMap.dataNumFields ) )
 		return 0;
 	
 	// cycle through all the events, saving them all
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	FOR_EACH_VEC( events, i )
 	{
+		EventQueuePrioritizedEvent_t *pe = events[i];
 		if ( !save.WriteFields( "PEvent", pe, NULL, pe->m_DataMap.dataDesc, pe->m_DataMap.dataNumFields ) )
 			return 0;
 	}
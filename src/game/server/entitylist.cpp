@@ -11,7 +11,9 @@
 #include "igamesystem.h"
 #include "collisionutils.h"
 #include "UtlSortVector.h"
+#include "utldict.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
 #include "mapentities.h"
 #include "client.h"
 #include "ai_initutils.h"
@@ -282,6 +284,748 @@ void SimThink_EntityChanged( CBaseEntity *pEntity )
 	g_SimThinkManager.EntityChanged( pEntity );
 }
 
+// Keeps entities bucketed by classname and by targetname so that searching for
+// an exact name only visits the entities that can match. Each bucket is kept in
+// entity list order (by the order entities were added) so iterating a bucket
+// gives the same results, in the same order, as walking the whole list.
+// Wildcard searches can match any number of buckets and still walk the list.
+ConVar ent_search_index( "ent_search_index", "1", FCVAR_NONE, "Use the classname/targetname indexes for exact-name entity searches." );
+
+enum entitysearch_t
+{
+	ENTITY_SEARCH_CLASSNAME = 0,
+	ENTITY_SEARCH_TARGETNAME,
+
+	ENTITY_SEARCH_COUNT
+};
+
+class CEntitySearchIndex
+{
+public:
+	typedef CUtlVector<unsigned short> Bucket_t;
+
+	CEntitySearchIndex()
+	{
+		m_nNextOrder = 0;
+		m_nSerial[ENTITY_SEARCH_CLASSNAME] = 0;
+		m_nSerial[ENTITY_SEARCH_TARGETNAME] = 0;
+		for ( int i = 0; i < NUM_ENT_ENTRIES; i++ )
+		{
+			m_iszIndexed[ENTITY_SEARCH_CLASSNAME][i] = NULL_STRING;
+			m_iszIndexed[ENTITY_SEARCH_TARGETNAME][i] = NULL_STRING;
+			m_nOrder[i] = 0;
+		}
+		ResetStats();
+	}
+
+	~CEntitySearchIndex()
+	{
+		Purge();
+	}
+
+	void Purge()
+	{
+		for ( int iType = 0; iType < ENTITY_SEARCH_COUNT; iType++ )
+		{
+			m_Buckets[iType].PurgeAndDeleteElements();
+		}
+	}
+
+	// Drops the buckets nothing is using any more, the map's names won't be back
+	void LevelShutdownPostEntity()
+	{
+		for ( int iType = 0; iType < ENTITY_SEARCH_COUNT; iType++ )
+		{
+			CUtlDict< Bucket_t *, int > &buckets = m_Buckets[iType];
+			for ( int i = buckets.First(); i != buckets.InvalidIndex(); )
+			{
+				int iNext = buckets.Next( i );
+				if ( !buckets[i]->Count() )
+				{
+					delete buckets[i];
+					buckets.RemoveAt( i );
+				}
+				i = iNext;
+			}
+		}
+	}
+
+	void ResetStats()
+	{
+		Q_memset( m_nSearches, 0, sizeof( m_nSearches ) );
+		Q_memset( m_nVisits, 0, sizeof( m_nVisits ) );
+	}
+
+	// Only exact names can use the index, anything with a '*' may match several buckets
+	bool CanSearch( const char *pszName )
+	{
+		return ent_search_index.GetBool() && pszName && pszName[0] && !Q_strstr( pszName, "*" );
+	}
+
+	void AddEntity( CBaseEntity *pEntity, int iEntry )
+	{
+		// Renumber before the counter wraps, which keeps the relative order of every bucket
+		if ( m_nNextOrder == 0xFFFFFFFF )
+		{
+			Renumber();
+		}
+
+		m_nOrder[iEntry] = m_nNextOrder++;
+		UpdateEntity( pEntity, iEntry );
+	}
+
+	void RemoveEntity( int iEntry )
+	{
+		for ( int iType = 0; iType < ENTITY_SEARCH_COUNT; iType++ )
+		{
+			if ( m_iszIndexed[iType][iEntry] != NULL_STRING )
+			{
+				Remove( iType, iEntry );
+			}
+		}
+	}
+
+	// Re-files the entity if its classname or targetname changed
+	void UpdateEntity( CBaseEntity *pEntity, int iEntry )
+	{
+		string_t iszCurrent[ENTITY_SEARCH_COUNT] = { pEntity->m_iClassname, pEntity->GetEntityName() };
+		for ( int iType = 0; iType < ENTITY_SEARCH_COUNT; iType++ )
+		{
+			if ( m_iszIndexed[iType][iEntry] == iszCurrent[iType] )
+				continue;
+
+			if ( m_iszIndexed[iType][iEntry] != NULL_STRING )
+			{
+				Remove( iType, iEntry );
+			}
+
+			if ( iszCurrent[iType] != NULL_STRING )
+			{
+				Insert( iType, iszCurrent[iType], iEntry );
+			}
+		}
+	}
+
+	// Returns the bucket holding every entity with this exact name, NULL if there are none
+	const Bucket_t *FindBucket( int iType, const char *pszName ) const
+	{
+		int i = m_Buckets[iType].Find( pszName );
+		return m_Buckets[iType].IsValidIndex( i ) ? m_Buckets[iType][i] : NULL;
+	}
+
+	// Position of the first entity in the bucket that comes after pStartEntity in the entity list
+	int FirstAfter( const Bucket_t &bucket, CBaseEntity *pStartEntity ) const
+	{
+		if ( !pStartEntity )
+			return 0;
+
+		return UpperBound( bucket, m_nOrder[ pStartEntity->GetRefEHandle().GetEntryIndex() ] );
+	}
+
+	// Changes whenever an entity joins or leaves one of this type's buckets
+	int GetSerial( int iType ) const
+	{
+		return m_nSerial[iType];
+	}
+
+	// Entities added later have a higher order, this is how they're sorted in the buckets
+	unsigned int GetOrder( int iEntry ) const
+	{
+		return m_nOrder[iEntry];
+	}
+
+	CBaseEntity *GetEntity( const Bucket_t &bucket, int i ) const
+	{
+		return (CBaseEntity *)gEntList.GetEntInfoPtrByIndex( bucket[i] )->m_pEntity;
+	}
+
+	void PrintStats()
+	{
+		static const char *s_pszTypes[ENTITY_SEARCH_COUNT] = { "classname", "targetname" };
+
+		Msg( "Entity search index is %s, %d entities\n", ent_search_index.GetBool() ? "on" : "off", gEntList.NumberOfEntities() );
+		Msg( "  %-10s %8s %10s %10s %12s %10s %12s\n", "search", "buckets", "indexed", "visited", "per search", "scans", "per scan" );
+		for ( int iType = 0; iType < ENTITY_SEARCH_COUNT; iType++ )
+		{
+			int nIndexed = m_nSearches[iType][0];
+			int nScans = m_nSearches[iType][1];
+			Msg( "  %-10s %8d %10d %10d %12.1f %10d %12.1f\n", s_pszTypes[iType], m_Buckets[iType].Count(),
+				nIndexed, m_nVisits[iType][0], nIndexed ? (float)m_nVisits[iType][0] / nIndexed : 0.0f,
+				nScans, nScans ? (float)m_nVisits[iType][1] / nScans : 0.0f );
+		}
+	}
+
+	// [type][0] is searches that used a bucket, [type][1] is searches that walked the list
+	int m_nSearches[ENTITY_SEARCH_COUNT][2];
+	int m_nVisits[ENTITY_SEARCH_COUNT][2];
+
+private:
+	int UpperBound( const Bucket_t &bucket, unsigned int nOrder ) const
+	{
+		int nLow = 0;
+		int nHigh = bucket.Count();
+		while ( nLow < nHigh )
+		{
+			int nMid = ( nLow + nHigh ) / 2;
+			if ( m_nOrder[ bucket[nMid] ] <= nOrder )
+			{
+				nLow = nMid + 1;
+			}
+			else
+			{
+				nHigh = nMid;
+			}
+		}
+		return nLow;
+	}
+
+	void Insert( int iType, string_t iszName, int iEntry )
+	{
+		int iBucket = m_Buckets[iType].Find( STRING( iszName ) );
+		if ( !m_Buckets[iType].IsValidIndex( iBucket ) )
+		{
+			MEM_ALLOC_CREDIT();
+			iBucket = m_Buckets[iType].Insert( STRING( iszName ), new Bucket_t );
+		}
+
+		Bucket_t &bucket = *m_Buckets[iType][iBucket];
+		bucket.InsertBefore( UpperBound( bucket, m_nOrder[iEntry] ), (unsigned short)iEntry );
+		m_iszIndexed[iType][iEntry] = iszName;
+		m_nSerial[iType]++;
+	}
+
+	void Remove( int iType, int iEntry )
+	{
+		int iBucket = m_Buckets[iType].Find( STRING( m_iszIndexed[iType][iEntry] ) );
+		m_iszIndexed[iType][iEntry] = NULL_STRING;
+		m_nSerial[iType]++;
+		if ( !m_Buckets[iType].IsValidIndex( iBucket ) )
+		{
+			Assert( 0 );
+			return;
+		}
+
+		Bucket_t &bucket = *m_Buckets[iType][iBucket];
+		int i = UpperBound( bucket, m_nOrder[iEntry] ) - 1;
+		Assert( i >= 0 && bucket[i] == iEntry );
+		if ( i >= 0 && bucket[i] == iEntry )
+		{
+			bucket.Remove( i );
+		}
+		else
+		{
+			bucket.FindAndRemove( (unsigned short)iEntry );
+		}
+	}
+
+	void Renumber()
+	{
+		m_nNextOrder = 0;
+		for ( const CEntInfo *pInfo = gEntList.FirstEntInfo(); pInfo; pInfo = pInfo->m_pNext )
+		{
+			CBaseEntity *pEntity = (CBaseEntity *)pInfo->m_pEntity;
+			m_nOrder[ pEntity->GetRefEHandle().GetEntryIndex() ] = m_nNextOrder++;
+		}
+	}
+
+	CUtlDict< Bucket_t *, int >	m_Buckets[ENTITY_SEARCH_COUNT];
+	string_t					m_iszIndexed[ENTITY_SEARCH_COUNT][NUM_ENT_ENTRIES];
+	unsigned int				m_nOrder[NUM_ENT_ENTRIES];
+	unsigned int				m_nNextOrder;
+	int							m_nSerial[ENTITY_SEARCH_COUNT];
+};
+
+static CEntitySearchIndex g_EntitySearchIndex;
+
+// Loose uniform grid of entity world AABBs for FindEntityInSphere. Each entity
+// lives in the one cell holding the center of its AABB, and anything with a
+// half extent of more than half a cell goes on a list every query checks, so
+// a query only has to widen its box by half a cell. Entities are re-filed
+// lazily: the collision property marks them dirty whenever their position,
+// angles or bounds change, and the next query catches up. The hash only picks
+// the candidates; each one still goes through the exact same test as the scan
+// and they're visited in entity list order, so results are identical.
+ConVar ent_sphere_hash( "ent_sphere_hash", "1", FCVAR_NONE, "Use the entity spatial hash for FindEntityInSphere." );
+ConVar ent_sphere_hash_verify( "ent_sphere_hash_verify", "0", FCVAR_CHEAT, "Run every hashed FindEntityInSphere through the scan as well and warn when they disagree." );
+
+#define SPATIAL_HASH_CELL_SIZE		256.0f
+#define SPATIAL_HASH_CELL_RANGE		512		// cell coordinates are clamped to [-512, 511]
+#define SPATIAL_HASH_BUCKETS		4096
+#define SPATIAL_HASH_MAX_CELLS		512		// queries touching more cells than this just scan
+#define SPATIAL_HASH_BLOAT			1.0f	// keeps float error in the exact test from mattering
+#define SPATIAL_HASH_INVALID		0xFFFF
+
+class CEntitySpatialHash
+{
+public:
+	CEntitySpatialHash()
+	{
+		for ( int i = 0; i < SPATIAL_HASH_BUCKETS; i++ )
+		{
+			m_nHead[i] = SPATIAL_HASH_INVALID;
+		}
+
+		for ( int i = 0; i < MAX_EDICTS; i++ )
+		{
+			m_nNext[i] = m_nPrev[i] = SPATIAL_HASH_INVALID;
+			m_nCell[i] = 0;
+			m_nState[i] = 0;
+		}
+
+		m_nGeneration = 0;
+		m_nCacheGeneration = -1;
+		ResetStats();
+	}
+
+	void ResetStats()
+	{
+		m_nQueries = 0;
+		m_nScans = 0;
+		m_nCandidates = 0;
+		m_nRefiled = 0;
+	}
+
+	bool IsEnabled() const
+	{
+		return ent_sphere_hash.GetBool();
+	}
+
+	void EntityChanged( CBaseEntity *pEntity )
+	{
+		const CBaseHandle &handle = pEntity->GetRefEHandle();
+		if ( !handle.IsValid() )
+			return;
+
+		int iEntry = handle.GetEntryIndex();
+		if ( iEntry >= MAX_EDICTS || ( m_nState[iEntry] & STATE_DIRTY ) )
+			return;
+
+		m_nState[iEntry] |= STATE_DIRTY;
+		m_Dirty.AddToTail( (unsigned short)iEntry );
+	}
+
+	void RemoveEntity( int iEntry )
+	{
+		if ( iEntry >= MAX_EDICTS )
+			return;
+
+		Unlink( iEntry );
+
+		// Left in m_Dirty, but without the flag it gets skipped
+		m_nState[iEntry] = 0;
+	}
+
+	// Finds the next entity after pStartEntity whose collision box touches the sphere.
+	// Returns false if the sphere is too big for the hash to help, the caller should scan.
+	bool FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius, CBaseEntity **ppResult )
+	{
+		if ( !vecCenter.IsValid() || !IsFinite( flRadius ) )
+		{
+			m_nScans++;
+			return false;
+		}
+
+		// the exact test only ever uses the radius squared
+		int nMins[3], nMaxs[3];
+		float flReach = fabsf( flRadius ) + SPATIAL_HASH_CELL_SIZE * 0.5f + SPATIAL_HASH_BLOAT;
+		int nCells = 1;
+		for ( int i = 0; i < 3; i++ )
+		{
+			nMins[i] = CellCoord( vecCenter[i] - flReach );
+			nMaxs[i] = CellCoord( vecCenter[i] + flReach );
+			nCells *= nMaxs[i] - nMins[i] + 1;
+		}
+
+		if ( nCells > SPATIAL_HASH_MAX_CELLS )
+		{
+			m_nScans++;
+			return false;
+		}
+
+		m_nQueries++;
+		Flush();
+
+		// Iterating callers ask the same question once per result, only gather the candidates once
+		if ( m_nCacheGeneration != m_nGeneration || m_vecCacheCenter != vecCenter || m_flCacheRadius != flRadius )
+		{
+			m_nCacheGeneration = m_nGeneration;
+			m_vecCacheCenter = vecCenter;
+			m_flCacheRadius = flRadius;
+			GatherCandidates( nMins, nMaxs );
+		}
+
+		unsigned int nStartOrder = 0;
+		int iCandidate = 0;
+		if ( pStartEntity )
+		{
+			nStartOrder = g_EntitySearchIndex.GetOrder( pStartEntity->GetRefEHandle().GetEntryIndex() );
+			iCandidate = FirstAfter( nStartOrder );
+		}
+
+		*ppResult = NULL;
+		for ( ; iCandidate < m_Candidates.Count(); iCandidate++ )
+		{
+			m_nCandidates++;
+
+			CBaseEntity *ent = (CBaseEntity *)gEntList.GetEntInfoPtrByIndex( m_Candidates[iCandidate].iEntry )->m_pEntity;
+			if ( !ent || !ent->edict() )
+				continue;
+
+			Vector vecRelativeCenter;
+			ent->CollisionProp()->WorldToCollisionSpace( vecCenter, &vecRelativeCenter );
+			if ( !IsBoxIntersectingSphere( ent->CollisionProp()->OBBMins(),	ent->CollisionProp()->OBBMaxs(), vecRelativeCenter, flRadius ) )
+				continue;
+
+			*ppResult = ent;
+			break;
+		}
+
+		return true;
+	}
+
+	void PrintStats()
+	{
+		int nHashed = 0;
+		int nLarge = m_Large.Count();
+		int nBusiest = 0;
+		for ( int i = 0; i < SPATIAL_HASH_BUCKETS; i++ )
+		{
+			int nCount = 0;
+			for ( int iEntry = m_nHead[i]; iEntry != SPATIAL_HASH_INVALID; iEntry = m_nNext[iEntry] )
+			{
+				nCount++;
+			}
+			nHashed += nCount;
+			nBusiest = MAX( nBusiest, nCount );
+		}
+
+		Msg( "Entity spatial hash is %s: %d entities in cells (busiest bucket %d), %d too big for a cell, %d waiting to be re-filed\n",
+			IsEnabled() ? "on" : "off", nHashed, nBusiest, nLarge, m_Dirty.Count() );
+		Msg( "  %d hashed queries visiting %.1f candidates each, %d queries too big for the hash, %d entities re-filed\n",
+			m_nQueries, m_nQueries ? (float)m_nCandidates / m_nQueries : 0.0f, m_nScans, m_nRefiled );
+	}
+
+private:
+	enum
+	{
+		STATE_DIRTY		= 0x01,
+		STATE_IN_CELL	= 0x02,
+		STATE_LARGE		= 0x04,
+	};
+
+	struct candidate_t
+	{
+		unsigned int	nOrder;
+		unsigned short	iEntry;
+	};
+
+	static int CellCoord( float flValue )
+	{
+		int nCoord = (int)floorf( flValue * ( 1.0f / SPATIAL_HASH_CELL_SIZE ) );
+		return clamp( nCoord, -SPATIAL_HASH_CELL_RANGE, SPATIAL_HASH_CELL_RANGE - 1 );
+	}
+
+	static int CellKey( int x, int y, int z )
+	{
+		return ( x & 0x3FF ) | ( ( y & 0x3FF ) << 10 ) | ( ( z & 0x3FF ) << 20 );
+	}
+
+	static int BucketForKey( int nKey )
+	{
+		return ( (unsigned int)nKey * 2654435761u ) >> ( 32 - 12 );
+	}
+
+	static int CandidateLess( const candidate_t *pLeft, const candidate_t *pRight )
+	{
+		if ( pLeft->nOrder == pRight->nOrder )
+			return 0;
+		return ( pLeft->nOrder < pRight->nOrder ) ? -1 : 1;
+	}
+
+	void Unlink( int iEntry )
+	{
+		if ( m_nState[iEntry] & STATE_IN_CELL )
+		{
+			if ( m_nPrev[iEntry] != SPATIAL_HASH_INVALID )
+			{
+				m_nNext[ m_nPrev[iEntry] ] = m_nNext[iEntry];
+			}
+			else
+			{
+				m_nHead[ BucketForKey( m_nCell[iEntry] ) ] = m_nNext[iEntry];
+			}
+
+			if ( m_nNext[iEntry] != SPATIAL_HASH_INVALID )
+			{
+				m_nPrev[ m_nNext[iEntry] ] = m_nPrev[iEntry];
+			}
+
+			m_nNext[iEntry] = m_nPrev[iEntry] = SPATIAL_HASH_INVALID;
+			m_nGeneration++;
+		}
+		else if ( m_nState[iEntry] & STATE_LARGE )
+		{
+			m_Large.FindAndFastRemove( (unsigned short)iEntry );
+			m_nGeneration++;
+		}
+
+		m_nState[iEntry] &= ~( STATE_IN_CELL | STATE_LARGE );
+	}
+
+	// Brings every entity that changed since the last query up to date
+	void Flush()
+	{
+		for ( int i = 0; i < m_Dirty.Count(); i++ )
+		{
+			int iEntry = m_Dirty[i];
+			if ( !( m_nState[iEntry] & STATE_DIRTY ) )
+				continue;
+
+			m_nState[iEntry] &= ~STATE_DIRTY;
+
+			CBaseEntity *pEntity = (CBaseEntity *)gEntList.GetEntInfoPtrByIndex( iEntry )->m_pEntity;
+			if ( !pEntity )
+				continue;
+
+			Vector vecMins, vecMaxs;
+			pEntity->CollisionProp()->WorldSpaceAABB( &vecMins, &vecMaxs );
+
+			Vector vecHalf = ( vecMaxs - vecMins ) * 0.5f;
+			if ( !( vecHalf.x <= SPATIAL_HASH_CELL_SIZE * 0.5f && vecHalf.y <= SPATIAL_HASH_CELL_SIZE * 0.5f && vecHalf.z <= SPATIAL_HASH_CELL_SIZE * 0.5f ) )
+			{
+				// Also catches NaNs
+				if ( !( m_nState[iEntry] & STATE_LARGE ) )
+				{
+					Unlink( iEntry );
+					m_Large.AddToTail( (unsigned short)iEntry );
+					m_nState[iEntry] |= STATE_LARGE;
+					m_nGeneration++;
+					m_nRefiled++;
+				}
+				continue;
+			}
+
+			Vector vecCenter = ( vecMins + vecMaxs ) * 0.5f;
+			int nKey = CellKey( CellCoord( vecCenter.x ), CellCoord( vecCenter.y ), CellCoord( vecCenter.z ) );
+			if ( ( m_nState[iEntry] & STATE_IN_CELL ) && m_nCell[iEntry] == nKey )
+				continue;
+
+			Unlink( iEntry );
+
+			int iBucket = BucketForKey( nKey );
+			m_nCell[iEntry] = nKey;
+			m_nPrev[iEntry] = SPATIAL_HASH_INVALID;
+			m_nNext[iEntry] = m_nHead[iBucket];
+			if ( m_nHead[iBucket] != SPATIAL_HASH_INVALID )
+			{
+				m_nPrev[ m_nHead[iBucket] ] = (unsigned short)iEntry;
+			}
+			m_nHead[iBucket] = (unsigned short)iEntry;
+			m_nState[iEntry] |= STATE_IN_CELL;
+			m_nGeneration++;
+			m_nRefiled++;
+		}
+
+		m_Dirty.RemoveAll();
+	}
+
+	void AddCandidate( int iEntry )
+	{
+		candidate_t &candidate = m_Candidates[ m_Candidates.AddToTail() ];
+		candidate.nOrder = g_EntitySearchIndex.GetOrder( iEntry );
+		candidate.iEntry = (unsigned short)iEntry;
+	}
+
+	void GatherCandidates( const int *nMins, const int *nMaxs )
+	{
+		m_Candidates.RemoveAll();
+
+		for ( int x = nMins[0]; x <= nMaxs[0]; x++ )
+		{
+			for ( int y = nMins[1]; y <= nMaxs[1]; y++ )
+			{
+				for ( int z = nMins[2]; z <= nMaxs[2]; z++ )
+				{
+					// Buckets are shared between cells, only take the ones really in this cell
+					int nKey = CellKey( x, y, z );
+					for ( int iEntry = m_nHead[ BucketForKey( nKey ) ]; iEntry != SPATIAL_HASH_INVALID; iEntry = m_nNext[iEntry] )
+					{
+						if ( m_nCell[iEntry] == nKey )
+						{
+							AddCandidate( iEntry );
+						}
+					}
+				}
+			}
+		}
+
+		for ( int i = 0; i < m_Large.Count(); i++ )
+		{
+			AddCandidate( m_Large[i] );
+		}
+
+		// Back into entity list order
+		m_Candidates.Sort( CandidateLess );
+	}
+
+	int FirstAfter( unsigned int nOrder ) const
+	{
+		int nLow = 0;
+		int nHigh = m_Candidates.Count();
+		while ( nLow < nHigh )
+		{
+			int nMid = ( nLow + nHigh ) / 2;
+			if ( m_Candidates[nMid].nOrder <= nOrder )
+			{
+				nLow = nMid + 1;
+			}
+			else
+			{
+				nHigh = nMid;
+			}
+		}
+		return nLow;
+	}
+
+	unsigned short	m_nHead[SPATIAL_HASH_BUCKETS];
+	unsigned short	m_nNext[MAX_EDICTS];
+	unsigned short	m_nPrev[MAX_EDICTS];
+	int				m_nCell[MAX_EDICTS];
+	unsigned char	m_nState[MAX_EDICTS];
+
+	CUtlVector<unsigned short>	m_Large;
+	CUtlVector<unsigned short>	m_Dirty;
+
+	// candidates for the last query, sorted by entity list order
+	CUtlVector<candidate_t>	m_Candidates;
+	int						m_nGeneration;
+	int						m_nCacheGeneration;
+	Vector					m_vecCacheCenter;
+	float					m_flCacheRadius;
+
+	int		m_nQueries;
+	int		m_nScans;
+	int		m_nCandidates;
+	int		m_nRefiled;
+};
+
+static CEntitySpatialHash g_EntitySpatialHash;
+
+void SpatialHash_EntityChanged( CBaseEntity *pEntity )
+{
+	g_EntitySpatialHash.EntityChanged( pEntity );
+}
+
+CON_COMMAND( ent_search_stats, "Shows how many entity searches used the classname/targetname indexes and the spatial hash. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_EntitySearchIndex.ResetStats();
+		g_EntitySpatialHash.ResetStats();
+		return;
+	}
+
+	g_EntitySearchIndex.PrintStats();
+	g_EntitySpatialHash.PrintStats();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fills the map up with point entities and compares the spatial hash
+//			against the plain scan on random sphere queries
+//-----------------------------------------------------------------------------
+CON_COMMAND( ent_sphere_benchmark, "Times FindEntityInSphere with and without the spatial hash. Usage: ent_sphere_benchmark [entities] [queries] [radius]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nEntities = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 2000;
+	int nQueries = ( args.ArgC() > 2 ) ? MAX( 1, atoi( args[2] ) ) : 1000;
+	float flRadius = ( args.ArgC() > 3 ) ? atof( args[3] ) : 256.0f;
+
+	CBaseEntity *pWorld = GetWorldEntity();
+	if ( !pWorld )
+		return;
+
+	Vector vecWorldMins = pWorld->WorldAlignMins();
+	Vector vecWorldMaxs = pWorld->WorldAlignMaxs();
+
+	// Leave some edicts for the game itself
+	int nSpawn = nEntities - gEntList.NumberOfEntities();
+	nSpawn = MIN( nSpawn, gpGlobals->maxEntities - engine->GetEntityCount() - 128 );
+
+	CUtlVector< EHANDLE > spawned;
+	for ( int i = 0; i < nSpawn; i++ )
+	{
+		CBaseEntity *pEntity = CreateEntityByName( "info_teleport_destination" );
+		if ( !pEntity )
+			break;
+
+		pEntity->SetAbsOrigin( RandomVector( 0, 1 ) * ( vecWorldMaxs - vecWorldMins ) + vecWorldMins );
+		DispatchSpawn( pEntity );
+		spawned.AddToTail( pEntity );
+	}
+
+	CUtlVector< Vector > centers;
+	centers.SetCount( nQueries );
+	FOR_EACH_VEC( centers, i )
+	{
+		centers[i] = RandomVector( 0, 1 ) * ( vecWorldMaxs - vecWorldMins ) + vecWorldMins;
+	}
+
+	CUtlVector< CBaseEntity * > scanResults, hashResults;
+	scanResults.EnsureCapacity( nQueries * 16 );
+	hashResults.EnsureCapacity( nQueries * 16 );
+
+	CFastTimer scanTimer;
+	scanTimer.Start();
+	FOR_EACH_VEC( centers, i )
+	{
+		for ( CBaseEntity *pEntity = gEntList.ScanForEntityInSphere( NULL, centers[i], flRadius ); pEntity; pEntity = gEntList.ScanForEntityInSphere( pEntity, centers[i], flRadius ) )
+		{
+			scanResults.AddToTail( pEntity );
+		}
+		scanResults.AddToTail( NULL );
+	}
+	scanTimer.End();
+
+	// Hash queries that touch too many cells fall back to the scan, just like FindEntityInSphere
+	CFastTimer hashTimer;
+	hashTimer.Start();
+	FOR_EACH_VEC( centers, i )
+	{
+		CBaseEntity *pEntity = NULL;
+		do
+		{
+			if ( !g_EntitySpatialHash.FindEntityInSphere( pEntity, centers[i], flRadius, &pEntity ) )
+			{
+				pEntity = gEntList.ScanForEntityInSphere( pEntity, centers[i], flRadius );
+			}
+			hashResults.AddToTail( pEntity );
+		}
+		while ( pEntity );
+	}
+	hashTimer.End();
+
+	bool bMatch = ( scanResults.Count() == hashResults.Count() ) &&
+		!V_memcmp( scanResults.Base(), hashResults.Base(), scanResults.Count() * sizeof( CBaseEntity * ) );
+
+	Msg( "%d entities (%d spawned), %d queries of radius %.0f, %d results\n",
+		gEntList.NumberOfEntities(), spawned.Count(), nQueries, flRadius, scanResults.Count() - nQueries );
+	Msg( "  scan %8.2f ms  hash %8.2f ms\n", scanTimer.GetDuration().GetMillisecondsF(), hashTimer.GetDuration().GetMillisecondsF() );
+	if ( !bMatch )
+	{
+		Warning( "  spatial hash results differ from the scan!\n" );
+	}
+
+	FOR_EACH_VEC( spawned, i )
+	{
+		UTIL_Remove( spawned[i] );
+	}
+}
+
 static CBaseEntityClassList *s_pClassLists = NULL;
 CBaseEntityClassList::CBaseEntityClassList()
 {
@@ -483,10 +1227,30 @@ bool CGlobalEntityList::IsEntityPtr( void *pTest )
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 {
+	if ( g_EntitySearchIndex.CanSearch( szName ) )
+	{
+		g_EntitySearchIndex.m_nSearches[ENTITY_SEARCH_CLASSNAME][0]++;
+
+		const CEntitySearchIndex::Bucket_t *pBucket = g_EntitySearchIndex.FindBucket( ENTITY_SEARCH_CLASSNAME, szName );
+		if ( !pBucket )
+			return NULL;
+
+		int i = g_EntitySearchIndex.FirstAfter( *pBucket, pStartEntity );
+		if ( i >= pBucket->Count() )
+			return NULL;
+
+		g_EntitySearchIndex.m_nVisits[ENTITY_SEARCH_CLASSNAME][0]++;
+		return g_EntitySearchIndex.GetEntity( *pBucket, i );
+	}
+
+	g_EntitySearchIndex.m_nSearches[ENTITY_SEARCH_CLASSNAME][1]++;
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
 	{
+		g_EntitySearchIndex.m_nVisits[ENTITY_SEARCH_CLASSNAME][1]++;
+
 		CBaseEntity *pEntity = (CBaseEntity *)pInfo->m_pEntity;
 		if ( !pEntity )
 		{
@@ -593,11 +1357,37 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	if ( g_EntitySearchIndex.CanSearch( szName ) )
+	{
+		g_EntitySearchIndex.m_nSearches[ENTITY_SEARCH_TARGETNAME][0]++;
+
+		const CEntitySearchIndex::Bucket_t *pBucket = g_EntitySearchIndex.FindBucket( ENTITY_SEARCH_TARGETNAME, szName );
+		if ( !pBucket )
+			return NULL;
+
+		for ( int i = g_EntitySearchIndex.FirstAfter( *pBucket, pStartEntity ); i < pBucket->Count(); i++ )
+		{
+			g_EntitySearchIndex.m_nVisits[ENTITY_SEARCH_TARGETNAME][0]++;
+
+			CBaseEntity *ent = g_EntitySearchIndex.GetEntity( *pBucket, i );
+			if ( pFilter && !pFilter->ShouldFindEntity(ent) )
+				continue;
+
+			return ent;
+		}
+
+		return NULL;
+	}
+
+	g_EntitySearchIndex.m_nSearches[ENTITY_SEARCH_TARGETNAME][1]++;
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
 	{
+		g_EntitySearchIndex.m_nVisits[ENTITY_SEARCH_TARGETNAME][1]++;
+
 		CBaseEntity *ent = (CBaseEntity *)pInfo->m_pEntity;
 		if ( !ent )
 		{
@@ -686,6 +1476,31 @@ CBaseEntity	*CGlobalEntityList::FindEntityByTarget( CBaseEntity *pStartEntity, c
 //			flRadius - 
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
+{
+	CBaseEntity *pResult;
+	if ( g_EntitySpatialHash.IsEnabled() && g_EntitySpatialHash.FindEntityInSphere( pStartEntity, vecCenter, flRadius, &pResult ) )
+	{
+		if ( ent_sphere_hash_verify.GetBool() )
+		{
+			CBaseEntity *pScanResult = ScanForEntityInSphere( pStartEntity, vecCenter, flRadius );
+			if ( pScanResult != pResult )
+			{
+				Warning( "FindEntityInSphere( %.1f %.1f %.1f, %.1f ): spatial hash found %s (%d), scan found %s (%d)\n",
+					vecCenter.x, vecCenter.y, vecCenter.z, flRadius,
+					pResult ? pResult->GetClassname() : "nothing", pResult ? pResult->entindex() : -1,
+					pScanResult ? pScanResult->GetClassname() : "nothing", pScanResult ? pScanResult->entindex() : -1 );
+			}
+		}
+		return pResult;
+	}
+
+	return ScanForEntityInSphere( pStartEntity, vecCenter, flRadius );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: FindEntityInSphere without the spatial hash, tests every entity
+//-----------------------------------------------------------------------------
+CBaseEntity *CGlobalEntityList::ScanForEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
 {
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -1098,6 +1913,8 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
+	g_EntitySearchIndex.AddEntity( pBaseEnt, i );
+	g_EntitySpatialHash.EntityChanged( pBaseEnt );
 	//DevMsg(2,"Created %s\n", pBaseEnt->GetClassname() );
 	for ( i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
@@ -1129,6 +1946,33 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 		m_iNumEdicts--;
 
 	m_iNumEnts--;
+
+	g_EntitySearchIndex.RemoveEntity( handle.GetEntryIndex() );
+	g_EntitySpatialHash.RemoveEntity( handle.GetEntryIndex() );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called when an entity's classname or targetname changes so the
+//			search indexes can move it to the right buckets.
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::UpdateSearchIndex( CBaseEntity *pEntity )
+{
+	const CBaseHandle &handle = pEntity->GetRefEHandle();
+
+	// Not in the list yet, it'll be indexed when it's added
+	if ( !handle.IsValid() || GetBaseEntity( handle ) != pEntity )
+		return;
+
+	g_EntitySearchIndex.UpdateEntity( pEntity, handle.GetEntryIndex() );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Changes whenever any entity gets, loses or changes its targetname,
+//			anything caching name lookups is stale once this moves on
+//-----------------------------------------------------------------------------
+int CGlobalEntityList::GetTargetnameSerial( void ) const
+{
+	return g_EntitySearchIndex.GetSerial( ENTITY_SEARCH_TARGETNAME );
 }
 
 void CGlobalEntityList::NotifyCreateEntity( CBaseEntity *pEnt )
@@ -1417,6 +2261,7 @@ public:
 		g_TouchManager.LevelShutdownPostEntity();
 		g_AimManager.LevelShutdownPostEntity();
 		g_SimThinkManager.LevelShutdownPostEntity();
+		g_EntitySearchIndex.LevelShutdownPostEntity();
 #ifdef HL2_DLL
 		OverrideMoveCache_LevelShutdownPostEntity();
 #endif // HL2_DLL
@@ -4,7 +4,8 @@
 //			Events can be posted with a nonzero delay, which determines how long
 //			they are held before being dispatched to their recipients.
 //
-//			The queue is serviced once per server frame.
+//			The queue is serviced once per server frame. It's a binary heap
+//			ordered by fire time, then by the order events were added.
 //
 //=============================================================================//
 
@@ -15,6 +16,8 @@
 #endif
 
 #include "mempool.h"
+#include "utlvector.h"
+#include "utldict.h"
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -28,8 +31,8 @@ struct EventQueuePrioritizedEvent_t
 
 	variant_t m_VariantValue;	// variable-type parameter
 
-	EventQueuePrioritizedEvent_t *m_pNext;
-	EventQueuePrioritizedEvent_t *m_pPrev;
+	unsigned int m_nSequence;	// breaks ties between events firing at the same time
+	int m_iHeapIndex;
 
 	DECLARE_SIMPLE_DATADESC();
 
@@ -65,15 +68,38 @@ public:
 	void Clear( void ); // resets the list
 
 	void Dump( void );
+	void PrintStats( void );
+	void ResetStats( void );
 
 private:
 
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
 
+	static bool FiresBefore( const EventQueuePrioritizedEvent_t *pLeft, const EventQueuePrioritizedEvent_t *pRight );
+	void SwapEvents( int i, int j );
+	void SiftUp( int i );
+	void SiftDown( int i );
+	void GetSortedEvents( CUtlVector< EventQueuePrioritizedEvent_t * > &events );
+
+	int FindCachedTargets( const char *pszTarget );
+
 	DECLARE_SIMPLE_DATADESC();
-	EventQueuePrioritizedEvent_t m_Events;
+	CUtlVector< EventQueuePrioritizedEvent_t * > m_Heap;
+	unsigned int m_nNextSequence;
 	int m_iListCount;
+
+	// Targets of the named events fired since the last time any entity's name changed
+	CUtlDict< CUtlVector< EHANDLE > *, int > m_TargetCache;
+	int m_nTargetCacheSerial;
+
+	int m_nAdded;
+	int m_nServiced;
+	int m_nPeakCount;
+	int m_nTargetCacheHits;
+	int m_nTargetCacheMisses;
+	double m_flServiceTime;
+	double m_flPeakServiceTime;
 };
 
 extern CEventQueue g_EventQueue;
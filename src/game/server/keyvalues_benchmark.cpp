@@ -0,0 +1,217 @@
+//====== Copyright  1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Compares regular and frozen KeyValues trees on the game's own
+//			script files, both for parse time and for FindKey/GetString.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "filesystem.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlbuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+struct KVBenchmarkFile_t
+{
+	char		szName[ MAX_PATH ];
+	CUtlBuffer	text;
+	KeyValues	*pRegular;
+	KeyValues	*pFrozen;
+};
+
+struct KVBenchmarkLookup_t
+{
+	KeyValues	*pParent;
+	const char	*pszName;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Every (parent, child name) pair in the tree, for timing lookups
+//-----------------------------------------------------------------------------
+static int CollectLookups( KeyValues *pKV, CUtlVector< KVBenchmarkLookup_t > &lookups )
+{
+	int nKeys = 0;
+	for ( ; pKV; pKV = pKV->GetNextKey() )
+	{
+		nKeys++;
+		for ( KeyValues *pSub = pKV->GetFirstSubKey(); pSub; pSub = pSub->GetNextKey() )
+		{
+			KVBenchmarkLookup_t &lookup = lookups[ lookups.AddToTail() ];
+			lookup.pParent = pKV;
+			lookup.pszName = pSub->GetName();
+		}
+
+		nKeys += CollectLookups( pKV->GetFirstSubKey(), lookups );
+	}
+	return nKeys;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Both trees have to read back the same, returns the number of differences
+//-----------------------------------------------------------------------------
+static int CompareTrees( KeyValues *pRegular, KeyValues *pFrozen )
+{
+	int nDifferences = 0;
+	for ( ; pRegular || pFrozen; pRegular = pRegular->GetNextKey(), pFrozen = pFrozen->GetNextKey() )
+	{
+		if ( !pRegular || !pFrozen )
+			return nDifferences + 1;
+
+		if ( Q_strcmp( pRegular->GetName(), pFrozen->GetName() ) ||
+			pRegular->GetDataType() != pFrozen->GetDataType() ||
+			Q_strcmp( pRegular->GetString(), pFrozen->GetString() ) )
+		{
+			nDifferences++;
+		}
+
+		nDifferences += CompareTrees( pRegular->GetFirstSubKey(), pFrozen->GetFirstSubKey() );
+	}
+	return nDifferences;
+}
+
+static double TimeLookups( const CUtlVector< KVBenchmarkLookup_t > &lookups, int nIterations )
+{
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		FOR_EACH_VEC( lookups, j )
+		{
+			lookups[j].pParent->GetString( lookups[j].pszName );
+		}
+	}
+	timer.End();
+	return timer.GetDuration().GetMillisecondsF();
+}
+
+CON_COMMAND( kv_frozen_benchmark, "Times regular vs frozen KeyValues parsing and lookups. Usage: kv_frozen_benchmark [wildcard] [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	const char *pszWildcard = ( args.ArgC() > 1 ) ? args[1] : "scripts/*.txt";
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( 1, atoi( args[2] ) ) : 10;
+
+	char szDir[ MAX_PATH ];
+	Q_ExtractFilePath( pszWildcard, szDir, sizeof( szDir ) );
+
+	// Read everything up front so the file system isn't part of the timings
+	CUtlVector< KVBenchmarkFile_t * > files;
+	FileFindHandle_t findHandle;
+	for ( const char *pszFile = filesystem->FindFirstEx( pszWildcard, "GAME", &findHandle ); pszFile; pszFile = filesystem->FindNext( findHandle ) )
+	{
+		if ( filesystem->FindIsDirectory( findHandle ) )
+			continue;
+
+		KVBenchmarkFile_t *pFile = new KVBenchmarkFile_t;
+		Q_snprintf( pFile->szName, sizeof( pFile->szName ), "%s%s", szDir, pszFile );
+		pFile->pRegular = NULL;
+		pFile->pFrozen = NULL;
+
+		if ( !filesystem->ReadFile( pFile->szName, "GAME", pFile->text ) )
+		{
+			delete pFile;
+			continue;
+		}
+
+		pFile->text.PutChar( 0 );
+		pFile->text.PutChar( 0 );
+		files.AddToTail( pFile );
+	}
+	filesystem->FindClose( findHandle );
+
+	if ( !files.Count() )
+	{
+		Msg( "No files match %s\n", pszWildcard );
+		return;
+	}
+
+	CFastTimer regularParse, frozenParse;
+
+	regularParse.Start();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		FOR_EACH_VEC( files, j )
+		{
+			KeyValues *pKV = new KeyValues( files[j]->szName );
+			pKV->LoadFromBuffer( files[j]->szName, (const char *)files[j]->text.Base() );
+
+			if ( files[j]->pRegular )
+			{
+				files[j]->pRegular->deleteThis();
+			}
+			files[j]->pRegular = pKV;
+		}
+	}
+	regularParse.End();
+
+	frozenParse.Start();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		FOR_EACH_VEC( files, j )
+		{
+			KeyValues *pKV = KeyValues::LoadFrozenFromBuffer( files[j]->szName, (const char *)files[j]->text.Base() );
+
+			if ( files[j]->pFrozen )
+			{
+				files[j]->pFrozen->deleteThis();
+			}
+			files[j]->pFrozen = pKV;
+		}
+	}
+	frozenParse.End();
+
+	CUtlVector< KVBenchmarkLookup_t > regularLookups, frozenLookups;
+	int nKeys = 0;
+	int nDifferences = 0;
+	int nFailed = 0;
+	FOR_EACH_VEC( files, j )
+	{
+		if ( !files[j]->pFrozen )
+		{
+			Warning( "  %s: failed to parse into a frozen tree\n", files[j]->szName );
+			nFailed++;
+			continue;
+		}
+
+		nKeys += CollectLookups( files[j]->pRegular, regularLookups );
+		CollectLookups( files[j]->pFrozen, frozenLookups );
+
+		int nFileDifferences = CompareTrees( files[j]->pRegular, files[j]->pFrozen );
+		if ( nFileDifferences )
+		{
+			Warning( "  %s: %d keys differ between the regular and frozen trees\n", files[j]->szName, nFileDifferences );
+			nDifferences += nFileDifferences;
+		}
+	}
+
+	double flRegularLookup = TimeLookups( regularLookups, nIterations );
+	double flFrozenLookup = TimeLookups( frozenLookups, nIterations );
+
+	Msg( "%d files, %d keys, %d iterations\n", files.Count(), nKeys, nIterations );
+	Msg( "  parse:   regular %8.2f ms  frozen %8.2f ms\n", regularParse.GetDuration().GetMillisecondsF(), frozenParse.GetDuration().GetMillisecondsF() );
+	Msg( "  lookups: regular %8.2f ms  frozen %8.2f ms  (%d per iteration)\n", flRegularLookup, flFrozenLookup, regularLookups.Count() );
+	if ( nDifferences )
+	{
+		Warning( "  %d keys differ in total\n", nDifferences );
+	}
+	if ( nFailed )
+	{
+		Warning( "  %d files failed to parse into frozen trees\n", nFailed );
+	}
+
+	FOR_EACH_VEC( files, j )
+	{
+		if ( files[j]->pRegular )
+		{
+			files[j]->pRegular->deleteThis();
+		}
+		if ( files[j]->pFrozen )
+		{
+			files[j]->pFrozen->deleteThis();
+		}
+	}
+	files.PurgeAndDeleteElements();
+}
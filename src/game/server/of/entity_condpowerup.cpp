@@ -163,18 +163,15 @@ bool CCondPowerup::DoPowerupEffect( CTFPlayer *pTFPlayer )
 	int iRandom = random->RandomInt( 0, 1 );
 	pTFPlayer->SpeakConceptIfAllowed( ( iRandom == 1 ) ? MP_CONCEPT_PLAYER_SPELL_PICKUP_RARE : MP_CONCEPT_PLAYER_SPELL_PICKUP_COMMON );
 	
-	Vector vecOrigin;
-	QAngle vecAngles;
-	CTFDroppedPowerup *pPowerup = static_cast<CTFDroppedPowerup*>( CBaseAnimating::CreateNoSpawn( "tf_dropped_powerup", vecOrigin, vecAngles, pTFPlayer ) );
+	CTFDroppedPowerup *pPowerup = CTFDroppedPowerup::Create( pTFPlayer, m_iszPowerupModel );
 	if( pPowerup )
 	{
-		pPowerup->SetModelName( m_iszPowerupModel );
 		pPowerup->m_nSkin = m_nSkin;
 		Q_strncpy( pPowerup->szTimerIcon, STRING(m_iszTimerIcon), sizeof( pPowerup->szTimerIcon ) );
 		pPowerup->m_iPowerupID = m_iCondition;
 		pPowerup->m_flCreationTime = gpGlobals->curtime;
 		pPowerup->m_flDespawnTime = gpGlobals->curtime + m_flCondDuration;
-		pPowerup->SetContextThink( &CBaseEntity::SUB_Remove, pPowerup->m_flDespawnTime, "DieContext" );
+		pPowerup->SetContextThink( &CTFDroppedPowerup::DespawnThink, pPowerup->m_flDespawnTime, "DieContext" );
 	}
 	PowerupHandle hHandle;
 	hHandle = pPowerup;	
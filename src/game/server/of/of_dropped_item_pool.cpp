@@ -0,0 +1,71 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Recycles dropped item entities, see of_dropped_item_pool.h
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "of_dropped_item_pool.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+CDroppedItemPoolBase *CDroppedItemPoolBase::s_pFirst = NULL;
+
+CDroppedItemPoolBase::CDroppedItemPoolBase( const char *pszName, ConVar &maxActive, ConVar &maxDormant ) :
+	CAutoGameSystem( pszName ),
+	m_MaxActive( maxActive ),
+	m_MaxDormant( maxDormant )
+{
+	m_pNext = s_pFirst;
+	s_pFirst = this;
+
+	ResetStats();
+}
+
+void CDroppedItemPoolBase::LevelInitPreEntity()
+{
+	ResetStats();
+}
+
+void CDroppedItemPoolBase::ResetStats( void )
+{
+	m_nCreated = 0;
+	m_nReused = 0;
+	m_nRemoved = 0;
+	m_nEvicted = 0;
+	m_flStatsTime = gpGlobals ? gpGlobals->curtime : 0.0f;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops per minute is what spawning a new entity every time would
+//			cost, created and removed per minute is what we pay instead.
+//-----------------------------------------------------------------------------
+void CDroppedItemPoolBase::PrintStats( void )
+{
+	float flMinutes = MAX( ( gpGlobals->curtime - m_flStatsTime ) / 60.0f, 1.0f / 60.0f );
+	int nDrops = m_nCreated + m_nReused;
+
+	Msg( "%s: %d live (max %d), %d dormant (max %d)\n", Name(), ActiveCount(), m_MaxActive.GetInt(), DormantCount(), m_MaxDormant.GetInt() );
+	Msg( "  over %.1f minutes: %d drops, %d reused, %d evicted\n", flMinutes, nDrops, m_nReused, m_nEvicted );
+	Msg( "  per minute: %.1f drops, %.1f entities created, %.1f removed\n", nDrops / flMinutes, m_nCreated / flMinutes, m_nRemoved / flMinutes );
+}
+
+CON_COMMAND( of_dropped_item_stats, "Shows how many dropped weapons and powerups were recycled instead of spawned. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	bool bReset = ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) );
+	for ( CDroppedItemPoolBase *pPool = CDroppedItemPoolBase::GetFirst(); pPool; pPool = pPool->GetNext() )
+	{
+		if ( bReset )
+		{
+			pPool->ResetStats();
+		}
+		else
+		{
+			pPool->PrintStats();
+		}
+	}
+}
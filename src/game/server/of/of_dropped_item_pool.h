@@ -0,0 +1,172 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Recycles dropped item entities (weapons, powerups) instead of
+//			spawning a new one on every death and removing it a few seconds
+//			later. Released items go dormant: hidden, not solid, not sent
+//			to clients, and keep their edict, model and physics object for
+//			the next drop. Live items are capped per map, the oldest one is
+//			recycled early when a new drop would go over.
+//
+//=============================================================================//
+
+#ifndef OF_DROPPED_ITEM_POOL_H
+#define OF_DROPPED_ITEM_POOL_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "igamesystem.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Bookkeeping shared by all pools, and the list of_dropped_item_stats walks
+//-----------------------------------------------------------------------------
+class CDroppedItemPoolBase : public CAutoGameSystem
+{
+public:
+	CDroppedItemPoolBase( const char *pszName, ConVar &maxActive, ConVar &maxDormant );
+
+	virtual void LevelInitPreEntity();
+
+	void	ResetStats( void );
+	void	PrintStats( void );
+
+	static CDroppedItemPoolBase *GetFirst( void )	{ return s_pFirst; }
+	CDroppedItemPoolBase *GetNext( void )			{ return m_pNext; }
+
+protected:
+	virtual int		ActiveCount( void ) = 0;
+	virtual int		DormantCount( void ) = 0;
+
+	ConVar			&m_MaxActive;
+	ConVar			&m_MaxDormant;
+
+	int				m_nCreated;		// entities actually spawned
+	int				m_nReused;		// drops served by a dormant entity
+	int				m_nRemoved;		// entities actually deleted
+	int				m_nEvicted;		// live items recycled early to stay under the cap
+	float			m_flStatsTime;
+
+private:
+	static CDroppedItemPoolBase	*s_pFirst;
+	CDroppedItemPoolBase		*m_pNext;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: T needs MakeDormant() to take itself out of the world, and has to
+//			call Forget() from UpdateOnRemove.
+//-----------------------------------------------------------------------------
+template< class T >
+class CDroppedItemPool : public CDroppedItemPoolBase
+{
+public:
+	CDroppedItemPool( const char *pszName, ConVar &maxActive, ConVar &maxDormant ) : CDroppedItemPoolBase( pszName, maxActive, maxDormant )
+	{
+	}
+
+	virtual void LevelInitPreEntity()
+	{
+		CDroppedItemPoolBase::LevelInitPreEntity();
+		m_Active.RemoveAll();
+		m_Dormant.RemoveAll();
+	}
+
+	// Recycles the oldest live items until there's room for one more
+	void MakeRoom( void )
+	{
+		int nMax = m_MaxActive.GetInt();
+		while ( nMax > 0 && m_Active.Count() >= nMax )
+		{
+			T *pOldest = m_Active[0];
+			m_Active.Remove( 0 );
+			if ( pOldest )
+			{
+				m_nEvicted++;
+				Release( pOldest );
+			}
+		}
+	}
+
+	// A dormant entity to reuse, preferring one that already uses this model, or NULL
+	T *Acquire( string_t iszModel )
+	{
+		int iBest = m_Dormant.InvalidIndex();
+		FOR_EACH_VEC_BACK( m_Dormant, i )
+		{
+			if ( !m_Dormant[i] )
+			{
+				m_Dormant.Remove( i );
+				continue;
+			}
+
+			if ( iBest == m_Dormant.InvalidIndex() || m_Dormant[i]->GetModelName() == iszModel )
+			{
+				iBest = i;
+				if ( m_Dormant[i]->GetModelName() == iszModel )
+					break;
+			}
+		}
+
+		if ( iBest == m_Dormant.InvalidIndex() )
+			return NULL;
+
+		T *pItem = m_Dormant[iBest];
+		m_Dormant.FastRemove( iBest );
+		m_nReused++;
+		return pItem;
+	}
+
+	void NoteCreated( void )
+	{
+		m_nCreated++;
+	}
+
+	// Starts counting a live item against the cap
+	void Activate( T *pItem )
+	{
+		CHandle< T > hItem;
+		hItem = pItem;
+		if ( m_Active.Find( hItem ) == m_Active.InvalidIndex() )
+		{
+			m_Active.AddToTail( hItem );
+		}
+	}
+
+	// Takes an item out of the world, keeping it if there's room in the pool
+	void Release( T *pItem )
+	{
+		CHandle< T > hItem;
+		hItem = pItem;
+		m_Active.FindAndRemove( hItem );
+
+		if ( m_Dormant.Count() >= m_MaxDormant.GetInt() || pItem->IsMarkedForDeletion() || ( pItem->GetFlags() & FL_DISSOLVING ) )
+		{
+			UTIL_Remove( pItem );
+			return;
+		}
+
+		if ( m_Dormant.Find( hItem ) == m_Dormant.InvalidIndex() )
+		{
+			pItem->MakeDormant();
+			m_Dormant.AddToTail( hItem );
+		}
+	}
+
+	void Forget( T *pItem )
+	{
+		CHandle< T > hItem;
+		hItem = pItem;
+		m_Active.FindAndRemove( hItem );
+		m_Dormant.FindAndRemove( hItem );
+		m_nRemoved++;
+	}
+
+protected:
+	virtual int		ActiveCount( void )		{ return m_Active.Count(); }
+	virtual int		DormantCount( void )	{ return m_Dormant.Count(); }
+
+private:
+	CUtlVector< CHandle< T > >	m_Active;		// oldest first
+	CUtlVector< CHandle< T > >	m_Dormant;
+};
+
+#endif // OF_DROPPED_ITEM_POOL_H
@@ -9,6 +9,7 @@
 
 #include "cbase.h"
 #include "of_dropped_powerup.h"
+#include "of_dropped_item_pool.h"
 #include "tf_shareddefs.h"
 #include "ammodef.h"
 #include "tf_gamerules.h"
@@ -20,6 +21,11 @@
 
 //----------------------------------------------
 
+ConVar of_dropped_powerup_max( "of_dropped_powerup_max", "16", FCVAR_NOTIFY, "How many dropped powerups can be in the map at once, the oldest is removed to make room. 0 for no limit." );
+ConVar of_dropped_powerup_pool( "of_dropped_powerup_pool", "8", FCVAR_NONE, "How many removed dropped powerups are kept around to be reused." );
+
+static CDroppedItemPool< CTFDroppedPowerup > s_DroppedPowerupPool( "tf_dropped_powerup", of_dropped_powerup_max, of_dropped_powerup_pool );
+
 // Network table.
 IMPLEMENT_SERVERCLASS_ST( CTFDroppedPowerup, DT_DroppedPowerup )
 	SendPropVector( SENDINFO( m_vecInitialVelocity ), -1, SPROP_NOSCALE ),
@@ -29,6 +35,7 @@ END_SEND_TABLE()
 
 BEGIN_DATADESC( CTFDroppedPowerup )
 	DEFINE_ENTITYFUNC( PackTouch ),
+	DEFINE_THINKFUNC( DespawnThink ),
 END_DATADESC();
 
 LINK_ENTITY_TO_CLASS( tf_dropped_powerup, CTFDroppedPowerup );
@@ -38,6 +45,7 @@ PRECACHE_REGISTER( tf_dropped_powerup );
 CTFDroppedPowerup::CTFDroppedPowerup()
 {
 	m_iPowerupID = 0;
+	m_bDormant = false;
 	
 	szTimerIcon[0] = 0;
 	SetTouch( &CTFDroppedPowerup::PackTouch );
@@ -56,10 +64,88 @@ CTFDroppedPowerup::~CTFDroppedPowerup()
 
 void CTFDroppedPowerup::Spawn( void )
 {
+	m_bDormant = false;
+	RemoveEffects( EF_NODRAW );
+	DispatchUpdateTransmitState();
+
 	SetModel( STRING( GetModelName() ) );
 	BaseClass::Spawn();
 	SetThink( &CTFDroppedPowerup::FlyThink );
 	SetTouch( &CTFDroppedPowerup::PackTouch );
+
+	s_DroppedPowerupPool.MakeRoom();
+	s_DroppedPowerupPool.Activate( this );
+}
+
+void CTFDroppedPowerup::UpdateOnRemove( void )
+{
+	s_DroppedPowerupPool.Forget( this );
+
+	BaseClass::UpdateOnRemove();
+}
+
+int CTFDroppedPowerup::UpdateTransmitState( void )
+{
+	if ( m_bDormant )
+		return SetTransmitState( FL_EDICT_DONTSEND );
+
+	return BaseClass::UpdateTransmitState();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Carried powerups stay out of the world, and unsent, until Spawn
+//-----------------------------------------------------------------------------
+CTFDroppedPowerup *CTFDroppedPowerup::Create( CBaseEntity *pOwner, string_t iszModelName )
+{
+	CTFDroppedPowerup *pPowerup = s_DroppedPowerupPool.Acquire( iszModelName );
+	if ( !pPowerup )
+	{
+		// vecOrigin and vecAngles don't matter,
+		// so long as they're reasonable values. (no Inf/NaN)
+		pPowerup = static_cast<CTFDroppedPowerup*>( CBaseAnimating::CreateNoSpawn( "tf_dropped_powerup", vec3_origin, vec3_angle, pOwner ) );
+		if ( !pPowerup )
+			return NULL;
+
+		s_DroppedPowerupPool.NoteCreated();
+		pPowerup->MakeDormant();
+	}
+
+	pPowerup->SetOwnerEntity( pOwner );
+	pPowerup->SetModelName( iszModelName );
+	return pPowerup;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes the powerup out of the world until the pool hands it out again
+//-----------------------------------------------------------------------------
+void CTFDroppedPowerup::MakeDormant( void )
+{
+	CTFPlayer *pTFPlayer = ToTFPlayer( GetOwnerEntity() );
+	if ( pTFPlayer )
+	{
+		PowerupHandle hHandle;
+		hHandle = this;	
+		pTFPlayer->m_hPowerups.FindAndRemove( hHandle );
+	}
+
+	m_bDormant = true;
+	AddEffects( EF_NODRAW );
+	SetSolid( SOLID_NONE );
+	SetTouch( NULL );
+	SetThink( NULL );
+	SetContextThink( NULL, TICK_NEVER_THINK, "DieContext" );
+	SetOwnerEntity( NULL );
+	DispatchUpdateTransmitState();
+}
+
+void CTFDroppedPowerup::Release( void )
+{
+	s_DroppedPowerupPool.Release( this );
+}
+
+void CTFDroppedPowerup::DespawnThink( void )
+{
+	Release();
 }
 
 void CTFDroppedPowerup::SetInitialVelocity( Vector &vecVelocity ) // Obsolete, because the entity doesn't have physics, left it in since we may use it later on
@@ -105,21 +191,15 @@ void CTFDroppedPowerup::PackTouch( CBaseEntity *pOther )
 		int iRandom = random->RandomInt( 0, 1 );
 		pTFPlayer->SpeakConceptIfAllowed( ( iRandom == 1 ) ? MP_CONCEPT_PLAYER_SPELL_PICKUP_RARE : MP_CONCEPT_PLAYER_SPELL_PICKUP_COMMON );
 		
-		// vecOrigin and vecAngles don't matter,
-		// so long as they're reasonable values. (no Inf/NaN)
-		Vector vecOrigin(0, 0, 0);
-		QAngle vecAngles(0, 0, 0);
-		
-		CTFDroppedPowerup *pPowerup = static_cast<CTFDroppedPowerup*>( CBaseAnimating::CreateNoSpawn( "tf_dropped_powerup", vecOrigin, vecAngles, pTFPlayer ) );
+		CTFDroppedPowerup *pPowerup = CTFDroppedPowerup::Create( pTFPlayer, GetModelName() );
 		if( pPowerup )
 		{
-			pPowerup->SetModelName( GetModelName() );
 			pPowerup->m_nSkin = m_nSkin;
 			Q_strncpy( pPowerup->szTimerIcon, szTimerIcon, sizeof( pPowerup->szTimerIcon ) );
 			pPowerup->m_iPowerupID = m_iPowerupID;
 			pPowerup->m_flCreationTime = m_flCreationTime;
 			pPowerup->m_flDespawnTime = m_flDespawnTime;
-			pPowerup->SetContextThink( &CBaseEntity::SUB_Remove, m_flDespawnTime, "DieContext" );
+			pPowerup->SetContextThink( &CTFDroppedPowerup::DespawnThink, m_flDespawnTime, "DieContext" );
 		}
 		PowerupHandle hHandle;
 		hHandle = pPowerup;	
@@ -134,7 +214,7 @@ void CTFDroppedPowerup::PackTouch( CBaseEntity *pOther )
 			gameeventmanager->FireEvent( event );
 		}
 		
-		UTIL_Remove( this ); // Remove the dropped powerup
+		Release(); // Remove the dropped powerup
 	}
 }
 
@@ -23,9 +23,19 @@ public:
 	~CTFDroppedPowerup();
 
 	virtual void Spawn();		
+	virtual void UpdateOnRemove( void );
+	virtual int  UpdateTransmitState( void );
 
 	void EXPORT FlyThink( void );
 	void EXPORT PackTouch( CBaseEntity *pOther );
+	void EXPORT DespawnThink( void );
+
+	// A powerup for pOwner to carry, spawned into the world when they die
+	static CTFDroppedPowerup *Create( CBaseEntity *pOwner, string_t iszModelName );
+
+	// Pooling, see of_dropped_item_pool.h
+	void MakeDormant( void );
+	void Release( void );
 
 	virtual unsigned int PhysicsSolidMaskForEntity( void ) const;
 
@@ -42,6 +52,7 @@ public:
 private:
 
 	bool m_bAllowOwnerPickup;
+	bool m_bDormant;
 	CNetworkVector( m_vecInitialVelocity );
 
 private:
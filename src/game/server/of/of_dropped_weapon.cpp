@@ -12,6 +12,7 @@
 #include "in_buttons.h"
 #include "tf_bot.h"
 #include "of_dropped_weapon.h"
+#include "of_dropped_item_pool.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -20,6 +21,11 @@
 
 extern ConVar of_allow_allclass_pickups;
 
+ConVar of_dropped_weapon_max( "of_dropped_weapon_max", "40", FCVAR_NOTIFY, "How many dropped weapons can be in the map at once, the oldest is removed to make room. 0 for no limit." );
+ConVar of_dropped_weapon_pool( "of_dropped_weapon_pool", "16", FCVAR_NONE, "How many removed dropped weapons are kept around to be reused by the next drop." );
+
+static CDroppedItemPool< CTFDroppedWeapon > s_DroppedWeaponPool( "tf_dropped_weapon", of_dropped_weapon_max, of_dropped_weapon_pool );
+
 // Network table.
 IMPLEMENT_SERVERCLASS_ST( CTFDroppedWeapon, DT_DroppedWeapon )
 	SendPropVector( SENDINFO( m_vecInitialVelocity ), -1, SPROP_NOSCALE ),
@@ -31,6 +37,7 @@ END_SEND_TABLE()
 BEGIN_DATADESC( CTFDroppedWeapon )
 	DEFINE_THINKFUNC( FlyThink ),
 	DEFINE_ENTITYFUNC( PackTouch ),
+	DEFINE_THINKFUNC( DespawnThink ),
 END_DATADESC();
 
 LINK_ENTITY_TO_CLASS( tf_dropped_weapon, CTFDroppedWeapon );
@@ -40,6 +47,7 @@ PRECACHE_REGISTER( tf_dropped_weapon );
 CTFDroppedWeapon::CTFDroppedWeapon()
 {
 	m_iTeamNum = TEAM_UNASSIGNED;
+	m_bDormant = false;
 }
 
 void CTFDroppedWeapon::Spawn( void )
@@ -48,6 +56,14 @@ void CTFDroppedWeapon::Spawn( void )
 	SetModel( STRING( GetModelName() ) );
 	BaseClass::Spawn();
 
+	StartLifetime();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything a drop starts with, new or recycled
+//-----------------------------------------------------------------------------
+void CTFDroppedWeapon::StartLifetime( void )
+{
 	SetNextThink( gpGlobals->curtime + 0.75f );
 	SetThink( &CTFDroppedWeapon::FlyThink );
 
@@ -62,7 +78,7 @@ void CTFDroppedWeapon::Spawn( void )
 	
 	// Die in 30 seconds
 	if( flDespawnTime > 0 )
-		SetContextThink( &CBaseEntity::SUB_Remove, gpGlobals->curtime + flDespawnTime, "DieContext" );
+		SetContextThink( &CTFDroppedWeapon::DespawnThink, gpGlobals->curtime + flDespawnTime, "DieContext" );
 
 	if ( IsX360() )
 	{
@@ -74,15 +90,39 @@ void CTFDroppedWeapon::Precache( void )
 {
 }
 
+void CTFDroppedWeapon::UpdateOnRemove( void )
+{
+	s_DroppedWeaponPool.Forget( this );
+
+	BaseClass::UpdateOnRemove();
+}
+
+int CTFDroppedWeapon::UpdateTransmitState( void )
+{
+	if ( m_bDormant )
+		return SetTransmitState( FL_EDICT_DONTSEND );
+
+	return BaseClass::UpdateTransmitState();
+}
+
 CTFDroppedWeapon *CTFDroppedWeapon::Create( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, const char *pszModelName, int iWeaponID, const char *pszClassname )
 {
-	CTFDroppedWeapon *pDroppedWeapon = static_cast<CTFDroppedWeapon*>( CBaseAnimating::CreateNoSpawn( "tf_dropped_weapon", vecOrigin, vecAngles, pOwner ) );
+	string_t iszModelName = AllocPooledString( pszModelName );
+
+	s_DroppedWeaponPool.MakeRoom();
+
+	CTFDroppedWeapon *pDroppedWeapon = s_DroppedWeaponPool.Acquire( iszModelName );
+	bool bRecycled = ( pDroppedWeapon != NULL );
+	if ( !pDroppedWeapon )
+	{
+		pDroppedWeapon = static_cast<CTFDroppedWeapon*>( CBaseAnimating::CreateNoSpawn( "tf_dropped_weapon", vecOrigin, vecAngles, pOwner ) );
+	}
+
 	if ( pDroppedWeapon )
 	{
 		WEAPON_FILE_INFO_HANDLE	hWpnInfo = LookupWeaponInfoSlot( pszClassname );
 		CTFWeaponInfo *pWeaponInfo = dynamic_cast<CTFWeaponInfo*>( GetFileWeaponInfoFromHandle( hWpnInfo ) );
 
-		pDroppedWeapon->SetModelName( AllocPooledString( pszModelName ) );
 		pDroppedWeapon->WeaponID = iWeaponID;
 		pDroppedWeapon->pszWeaponName = pszClassname;
 		pDroppedWeapon->pWeaponInfo = pWeaponInfo;
@@ -91,12 +131,166 @@ CTFDroppedWeapon *CTFDroppedWeapon::Create( const Vector &vecOrigin, const QAngl
 		else
 			pDroppedWeapon->m_bFlamethrower = false;
 
-		DispatchSpawn( pDroppedWeapon );
+		if ( !bRecycled || !pDroppedWeapon->Recycle( vecOrigin, vecAngles, pOwner, iszModelName ) )
+		{
+			if ( !bRecycled )
+			{
+				s_DroppedWeaponPool.NoteCreated();
+			}
+
+			pDroppedWeapon->SetModelName( iszModelName );
+			DispatchSpawn( pDroppedWeapon );
+		}
+
+		s_DroppedWeaponPool.Activate( pDroppedWeapon );
 	}
 
 	return pDroppedWeapon;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Drops the active weapon with its view model, recycles that drop
+//			with the world model and checks it can still be picked up
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( of_dropped_weapon_recycle_test, "Checks that a dropped weapon recycled with a different model can still be picked up.", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	CTFPlayer *pPlayer = ToTFPlayer( UTIL_GetCommandClient() );
+	CTFWeaponBase *pWeapon = pPlayer ? pPlayer->GetActiveTFWeapon() : NULL;
+	if ( !pWeapon )
+	{
+		Msg( "Needs a player holding a weapon.\n" );
+		return;
+	}
+
+	if ( of_dropped_weapon_pool.GetInt() <= 0 )
+	{
+		Msg( "of_dropped_weapon_pool is 0, nothing gets recycled.\n" );
+		return;
+	}
+
+	const char *pszFirstModel = pWeapon->GetViewModel();
+	const char *pszSecondModel = pWeapon->GetWorldModel();
+	if ( !Q_stricmp( pszFirstModel, pszSecondModel ) )
+	{
+		Msg( "%s uses the same view and world model, pick another weapon.\n", pWeapon->GetClassname() );
+		return;
+	}
+
+	Vector vecForward;
+	AngleVectors( pPlayer->EyeAngles(), &vecForward );
+	Vector vecOrigin = pPlayer->EyePosition() + vecForward * 64.0f;
+
+	CTFDroppedWeapon *pFirst = CTFDroppedWeapon::Create( vecOrigin, vec3_angle, NULL, pszFirstModel, pWeapon->GetWeaponID(), pWeapon->GetClassname() );
+	if ( !pFirst )
+		return;
+
+	pFirst->Release();
+	if ( pFirst->IsMarkedForDeletion() )
+	{
+		Msg( "The pool is full, the drop was removed instead of recycled.\n" );
+		return;
+	}
+
+	CTFDroppedWeapon *pSecond = CTFDroppedWeapon::Create( vecOrigin, vec3_angle, NULL, pszSecondModel, pWeapon->GetWeaponID(), pWeapon->GetClassname() );
+	if ( pSecond != pFirst )
+	{
+		Msg( "The pool handed out another drop that already had the world model, nothing was tested.\n" );
+		return;
+	}
+
+	if ( pSecond->CanBeTouched() )
+	{
+		Msg( "Recycled %s from %s to %s, it can be picked up.\n", pWeapon->GetClassname(), pszFirstModel, pszSecondModel );
+	}
+	else
+	{
+		Warning( "Recycled %s from %s to %s, it CAN'T be picked up.\n", pWeapon->GetClassname(), pszFirstModel, pszSecondModel );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Brings a dormant drop back into the world. Keeps the physics
+//			object if the model didn't change, returns false if it has to
+//			go through a full spawn instead.
+//-----------------------------------------------------------------------------
+bool CTFDroppedWeapon::Recycle( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, string_t iszModelName )
+{
+	// Undo everything MakeDormant did before either path, a full spawn keeps
+	// whatever solid flags it finds when it makes the new physics object
+	m_bDormant = false;
+	RemoveEffects( EF_NODRAW );
+	RemoveSolidFlags( FSOLID_NOT_SOLID );
+	StartLifetime();
+	SetOwnerEntity( pOwner );
+	SetAbsOrigin( vecOrigin );
+	SetAbsAngles( vecAngles );
+	SetAbsVelocity( vec3_origin );
+	IncrementInterpolationFrame();
+	DispatchUpdateTransmitState();
+
+	IPhysicsObject *pPhysics = VPhysicsGetObject();
+	if ( GetModelName() != iszModelName || !pPhysics )
+	{
+		VPhysicsDestroyObject();
+		return false;
+	}
+
+	pPhysics->EnableCollisions( true );
+	pPhysics->EnableMotion( true );
+	pPhysics->SetPosition( vecOrigin, vecAngles, true );
+	pPhysics->SetVelocityInstantaneous( &vec3_origin, &vec3_origin );
+	pPhysics->Wake();
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether a player walking into us would get to PackTouch
+//-----------------------------------------------------------------------------
+bool CTFDroppedWeapon::CanBeTouched( void )
+{
+	return !m_bDormant && !IsEffectActive( EF_NODRAW ) && IsSolid() &&
+		!IsSolidFlagSet( FSOLID_NOT_SOLID ) && IsSolidFlagSet( FSOLID_TRIGGER ) &&
+		m_pfnTouch == static_cast< ENTITYFUNCPTR >( &CTFDroppedWeapon::PackTouch );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes the drop out of the world until the pool hands it out again
+//-----------------------------------------------------------------------------
+void CTFDroppedWeapon::MakeDormant( void )
+{
+	m_bDormant = true;
+	AddEffects( EF_NODRAW );
+	AddSolidFlags( FSOLID_NOT_SOLID );
+	SetTouch( NULL );
+	SetThink( NULL );
+	SetContextThink( NULL, TICK_NEVER_THINK, "DieContext" );
+	SetOwnerEntity( NULL );
+
+	IPhysicsObject *pPhysics = VPhysicsGetObject();
+	if ( pPhysics )
+	{
+		pPhysics->EnableMotion( false );
+		pPhysics->EnableCollisions( false );
+		pPhysics->Sleep();
+	}
+
+	DispatchUpdateTransmitState();
+}
+
+void CTFDroppedWeapon::Release( void )
+{
+	s_DroppedWeaponPool.Release( this );
+}
+
+void CTFDroppedWeapon::DespawnThink( void )
+{
+	Release();
+}
+
 void CTFDroppedWeapon::SetInitialVelocity( Vector &vecVelocity )
 { 
 	m_vecInitialVelocity = vecVelocity;
@@ -250,7 +444,7 @@ void CTFDroppedWeapon::PackTouch( CBaseEntity *pOther )
 				pTFPlayer->SpeakConceptIfAllowed( MP_CONCEPT_MVM_LOOT_COMMON ); // common weapons
 			}
 		}
-		UTIL_Remove( this );																	// Remove the dropped weapon entity
+		Release();																				// Remove the dropped weapon entity
 	}
 	
 }
@@ -22,9 +22,17 @@ public:
 
 	virtual void Spawn();
 	virtual void Precache();	
+	virtual void UpdateOnRemove( void );
+	virtual int  UpdateTransmitState( void );
 
 	void EXPORT FlyThink( void );
 	void EXPORT PackTouch( CBaseEntity *pOther );
+	void EXPORT DespawnThink( void );
+
+	// Pooling, see of_dropped_item_pool.h
+	void MakeDormant( void );
+	void Release( void );
+	bool CanBeTouched( void );
 
 	virtual unsigned int PhysicsSolidMaskForEntity( void ) const;
 
@@ -45,7 +53,11 @@ public:
 	CTFWeaponInfo *pWeaponInfo;
 	int WeaponID;
 private:
+	void StartLifetime( void );
+	bool Recycle( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, string_t iszModelName );
+
 	float m_flCreationTime;
+	bool m_bDormant;
 
 	bool m_bAllowOwnerPickup;
 	CNetworkVector( m_vecInitialVelocity );
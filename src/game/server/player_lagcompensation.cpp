@@ -33,6 +33,7 @@ static ConVar sv_lagcompensation_teleport_dist( "sv_lagcompensation_teleport_dis
 ConVar sv_unlag( "sv_unlag", "1", FCVAR_CHEAT, "Enables player lag compensation" );
 ConVar sv_maxunlag( "sv_maxunlag", "1.0", FCVAR_CHEAT, "Maximum lag compensation in seconds", true, 0.0f, true, 1.0f );
 ConVar sv_lagflushbonecache( "sv_lagflushbonecache", "1", FCVAR_CHEAT, "Flushes entity bone cache on lag compensation" );
+ConVar sv_lagcompensation_bonecache( "sv_lagcompensation_bonecache", "1", FCVAR_CHEAT, "Reuse the bones of a player backtracked to the same pose earlier in the frame instead of setting them up again" );
 ConVar sv_showlagcompensation( "sv_showlagcompensation", "0", FCVAR_CHEAT, "Show lag compensated hitboxes whenever a player is lag compensated." );
 
 ConVar sv_unlag_fixstuck( "sv_unlag_fixstuck", "0", FCVAR_CHEAT, "Disallow backtracking a player for lag compensation if it will cause them to become stuck" );
@@ -120,6 +121,49 @@ public:
 #endif
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: The bones a backtracked player ended up with. Every shooter with the
+//			same latency rewinds a player to the same pose, so the first one's
+//			bone setup can be handed to the rest for the remainder of the frame.
+//-----------------------------------------------------------------------------
+#define LAG_BONECACHE_ENTRIES	4
+
+struct LagBoneCacheEntry_t
+{
+	LagBoneCacheEntry_t()
+	{
+		m_nFrame = -1;
+		m_bHasBones = false;
+		m_nBoneMask = 0;
+	}
+
+	// Everything the rewound pose depends on
+	bool SamePose( const LagBoneCacheEntry_t &other ) const
+	{
+		return m_iRecord == other.m_iRecord &&
+			m_iPrevRecord == other.m_iPrevRecord &&
+			m_flFrac == other.m_flFrac &&
+			m_vecOrigin == other.m_vecOrigin &&
+			m_vecAngles == other.m_vecAngles &&
+			m_nModelIndex == other.m_nModelIndex &&
+			m_flModelScale == other.m_flModelScale;
+	}
+
+	int						m_nFrame;
+
+	int						m_iRecord;
+	int						m_iPrevRecord;
+	float					m_flFrac;
+	Vector					m_vecOrigin;
+	QAngle					m_vecAngles;
+	int						m_nModelIndex;
+	float					m_flModelScale;
+
+	bool					m_bHasBones;
+	int						m_nBoneMask;
+	CUtlVector< matrix3x4_t >	m_Bones;
+};
+
 
 //
 // Try to take the player from his current origin to vWantedPos.
@@ -178,6 +222,13 @@ public:
 	CLagCompensationManager( char const *name ) : CAutoGameSystemPerFrame( name ), m_flTeleportDistanceSqr( 64 *64 )
 	{
 		m_isCurrentlyDoingCompensation = false;
+		m_nBoneCacheFrame = 0;
+		for ( int i = 0; i < MAX_PLAYERS; i++ )
+		{
+			m_iBoneCacheEntry[i] = -1;
+			m_iNextBoneCacheEntry[i] = 0;
+		}
+		ResetBoneCacheStats();
 	}
 
 	// IServerSystem stuff
@@ -202,9 +253,15 @@ public:
 
 	bool			IsCurrentlyDoingLagCompensation() const override { return m_isCurrentlyDoingCompensation; }
 
+	void			PrintBoneCacheStats();
+	void			ResetBoneCacheStats();
+
 private:
 	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
 
+	bool			RestoreCachedBones( CBasePlayer *pPlayer, const LagBoneCacheEntry_t &key );
+	void			SaveCachedBones( CBasePlayer *pPlayer );
+
 	void ClearHistory()
 	{
 		for ( int i=0; i<MAX_PLAYERS; i++ )
@@ -226,6 +283,19 @@ private:
 	float					m_flTeleportDistanceSqr;
 
 	bool					m_isCurrentlyDoingCompensation;	// Sentinel to prevent calling StartLagCompensation a second time before a Finish.
+
+	// Bones of the poses players have been backtracked to this frame
+	LagBoneCacheEntry_t		m_BoneCache[ MAX_PLAYERS ][ LAG_BONECACHE_ENTRIES ];
+	int						m_iBoneCacheEntry[ MAX_PLAYERS ];		// the entry for the current backtrack, -1 for none
+	int						m_iNextBoneCacheEntry[ MAX_PLAYERS ];
+	int						m_nBoneCacheFrame;						// moves on whenever the tracks get a new record
+
+	int						m_nFrameSetups;
+	int						m_nFrameReused;
+	int						m_nTotalSetups;
+	int						m_nTotalReused;
+	int						m_nPeakReused;
+	int						m_nFrames;
 };
 
 static CLagCompensationManager g_LagCompensationManager( "CLagCompensationManager" );
@@ -247,6 +317,15 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
 
+	// New records mean new indices, none of the cached poses carry over
+	m_nBoneCacheFrame++;
+	m_nTotalSetups += m_nFrameSetups;
+	m_nTotalReused += m_nFrameReused;
+	m_nPeakReused = MAX( m_nPeakReused, m_nFrameReused );
+	m_nFrames++;
+	m_nFrameSetups = 0;
+	m_nFrameReused = 0;
+
 	// remove all records before that time:
 	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
 
@@ -357,6 +436,10 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 
 	// Assume no players need to be restored
 	m_RestorePlayer.ClearAll();
+	for ( int i = 0; i < MAX_PLAYERS; i++ )
+	{
+		m_iBoneCacheEntry[i] = -1;
+	}
 	
 	m_bNeedToRestore = false;
 
@@ -459,6 +542,8 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 
 	LagRecord *prevRecord = NULL;
 	LagRecord *record = NULL;
+	int iPrevRecord = track->InvalidIndex();
+	int iRecord = track->InvalidIndex();
 
 	Vector prevOrg = pPlayer->GetLocalOrigin();
 	
@@ -467,9 +552,11 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	{
 		// remember last record
 		prevRecord = record;
+		iPrevRecord = iRecord;
 
 		// get next record
 		record = &track->Element( curr );
+		iRecord = curr;
 
 		if ( !(record->m_fFlags & LC_ALIVE) )
 		{
@@ -758,7 +845,31 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 		return; // we didn't change anything
 
 	if ( sv_lagflushbonecache.GetBool() )
-		pPlayer->InvalidateBoneCache();
+	{
+		// Pose parameters only get rewound in OF, elsewhere they'd have to be part of the key
+#ifdef OF_DLL
+		if ( sv_lagcompensation_bonecache.GetBool() )
+		{
+			LagBoneCacheEntry_t key;
+			key.m_iRecord = iRecord;
+			key.m_iPrevRecord = ( frac > 0.0f && interpolationAllowed ) ? iPrevRecord : track->InvalidIndex();
+			key.m_flFrac = ( key.m_iPrevRecord != track->InvalidIndex() ) ? frac : 0.0f;
+			key.m_vecOrigin = org;
+			key.m_vecAngles = ang;
+			key.m_nModelIndex = pPlayer->GetModelIndex();
+			key.m_flModelScale = pPlayer->GetModelScale();
+
+			if ( !RestoreCachedBones( pPlayer, key ) )
+			{
+				pPlayer->InvalidateBoneCache();
+			}
+		}
+		else
+#endif
+		{
+			pPlayer->InvalidateBoneCache();
+		}
+	}
 
 	/*char text[256]; Q_snprintf( text, sizeof(text), "time %.2f", flTargetTime );
 	pPlayer->DrawServerHitboxes( 10 );
@@ -805,6 +916,9 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 			continue;
 		}
 
+		// Hang on to whatever bones the traces against this pose set up
+		SaveCachedBones( pPlayer );
+
 		LagRecord *restore = &m_RestoreData[ pl_index ];
 		LagRecord *change  = &m_ChangeData[ pl_index ];
 
@@ -884,4 +998,115 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 	m_isCurrentlyDoingCompensation = false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Puts the bones from an earlier backtrack to the same pose this frame
+//			into the player's bone cache. Either way the pose gets an entry, so
+//			SaveCachedBones can fill it in once something sets the bones up.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::RestoreCachedBones( CBasePlayer *pPlayer, const LagBoneCacheEntry_t &key )
+{
+	int pl_index = pPlayer->entindex() - 1;
+	LagBoneCacheEntry_t *entries = m_BoneCache[ pl_index ];
+
+	for ( int i = 0; i < LAG_BONECACHE_ENTRIES; i++ )
+	{
+		LagBoneCacheEntry_t &entry = entries[i];
+		if ( entry.m_nFrame != m_nBoneCacheFrame || !entry.SamePose( key ) )
+			continue;
 
+		m_iBoneCacheEntry[ pl_index ] = i;
+		if ( entry.m_bHasBones && pPlayer->RestoreBoneCache( entry.m_Bones, entry.m_nBoneMask ) )
+		{
+			m_nFrameReused++;
+			return true;
+		}
+
+		return false;
+	}
+
+	// Prefer slots left over from earlier frames, then just go round
+	int iSlot = -1;
+	for ( int i = 0; i < LAG_BONECACHE_ENTRIES; i++ )
+	{
+		if ( entries[i].m_nFrame != m_nBoneCacheFrame )
+		{
+			iSlot = i;
+			break;
+		}
+	}
+
+	if ( iSlot == -1 )
+	{
+		iSlot = m_iNextBoneCacheEntry[ pl_index ];
+		m_iNextBoneCacheEntry[ pl_index ] = ( iSlot + 1 ) % LAG_BONECACHE_ENTRIES;
+	}
+
+	LagBoneCacheEntry_t &entry = entries[ iSlot ];
+	entry.m_nFrame = m_nBoneCacheFrame;
+	entry.m_iRecord = key.m_iRecord;
+	entry.m_iPrevRecord = key.m_iPrevRecord;
+	entry.m_flFrac = key.m_flFrac;
+	entry.m_vecOrigin = key.m_vecOrigin;
+	entry.m_vecAngles = key.m_vecAngles;
+	entry.m_nModelIndex = key.m_nModelIndex;
+	entry.m_flModelScale = key.m_flModelScale;
+	entry.m_bHasBones = false;
+
+	m_iBoneCacheEntry[ pl_index ] = iSlot;
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The bone cache was flushed when the player was backtracked, so if
+//			it's valid now it holds the rewound pose
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::SaveCachedBones( CBasePlayer *pPlayer )
+{
+	int pl_index = pPlayer->entindex() - 1;
+	int iEntry = m_iBoneCacheEntry[ pl_index ];
+	if ( iEntry < 0 )
+		return;
+
+	m_iBoneCacheEntry[ pl_index ] = -1;
+
+	LagBoneCacheEntry_t &entry = m_BoneCache[ pl_index ][ iEntry ];
+	if ( entry.m_bHasBones || entry.m_nFrame != m_nBoneCacheFrame )
+		return;
+
+	if ( pPlayer->SaveBoneCache( entry.m_Bones, entry.m_nBoneMask ) )
+	{
+		entry.m_bHasBones = true;
+		m_nFrameSetups++;
+	}
+}
+
+void CLagCompensationManager::ResetBoneCacheStats()
+{
+	m_nFrameSetups = 0;
+	m_nFrameReused = 0;
+	m_nTotalSetups = 0;
+	m_nTotalReused = 0;
+	m_nPeakReused = 0;
+	m_nFrames = 0;
+}
+
+void CLagCompensationManager::PrintBoneCacheStats()
+{
+	Msg( "Lag compensation bone cache is %s\n", sv_lagcompensation_bonecache.GetBool() && sv_lagflushbonecache.GetBool() ? "on" : "off" );
+	Msg( "  %d frames: %d rewound bone setups, %d avoided (%.2f per frame, at most %d in one frame)\n",
+		m_nFrames, m_nTotalSetups, m_nTotalReused, m_nFrames ? (float)m_nTotalReused / m_nFrames : 0.0f, m_nPeakReused );
+}
+
+CON_COMMAND( sv_lagcompensation_bonecache_stats, "Shows how many bone setups of backtracked players were reused. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_LagCompensationManager.ResetBoneCacheStats();
+		return;
+	}
+
+	g_LagCompensationManager.PrintBoneCacheStats();
+}
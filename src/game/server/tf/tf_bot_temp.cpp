@@ -21,6 +21,7 @@
 #include "in_buttons.h"
 #include "movehelper_server.h"
 #include "datacache/imdlcache.h"
+#include "tf_bot_temp.h"
 
 void ClientPutInServer( edict_t *pEdict, const char *playername );
 void Bot_Think( CTFPlayer *pBot );
@@ -73,7 +74,7 @@ static botdata_t g_BotData[ MAX_PLAYERS ];
 // Purpose: Create a new Bot and put it in the game.
 // Output : Pointer to the new Bot, or NULL if there's no free clients.
 //-----------------------------------------------------------------------------
-CBasePlayer *BotPutInServer( bool bFrozen, int iTeam, int iClass, const char *pszCustomName, const Vector &vecColor = vec3_origin )
+CBasePlayer *BotPutInServer( bool bFrozen, int iTeam, int iClass, const char *pszCustomName, const Vector &vecColor )
 {
 	g_iNextBotTeam = iTeam;
 	g_iNextBotClass = iClass;
@@ -13,7 +13,7 @@
 
 
 // If iTeam or iClass is -1, then a team or class is randomly chosen.
-CBasePlayer *BotPutInServer( bool bFrozen, int iTeam, int iClass );
+CBasePlayer *BotPutInServer( bool bFrozen, int iTeam, int iClass, const char *pszCustomName = NULL, const Vector &vecColor = vec3_origin );
 
 void Bot_RunAll();
 
@@ -0,0 +1,749 @@
+//====== Copyright  1996-2005, Valve Corporation, All rights reserved. =======
+//
+// Purpose: Batched flamethrower damage volumes, see tf_flame_manager.h
+//
+//=============================================================================
+#include "cbase.h"
+#include "tf_flame_manager.h"
+#include "tf_player.h"
+#include "tf_team.h"
+#include "tf_obj.h"
+#include "ai_basenpc.h"
+#include "tf_bot_manager.h"
+#include "tf_bot_temp.h"
+#include "collisionutils.h"
+#include "mathlib/ssemath.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+extern ConVar tf_debug_flamethrower;
+extern ConVar tf_flamethrower_batched;
+extern ConVar tf_flamethrower_velocity;
+extern ConVar tf_flamethrower_drag;
+extern ConVar tf_flamethrower_float;
+extern ConVar tf_flamethrower_flametime;
+extern ConVar tf_flamethrower_vecrand;
+extern ConVar tf_flamethrower_boxsize;
+extern ConVar tf_flamethrower_maxdamagedist;
+extern ConVar tf_flamethrower_shortrangedamagemultiplier;
+extern ConVar tf_flamethrower_velocityfadestart;
+extern ConVar tf_flamethrower_velocityfadeend;
+extern ConVar bot_forcefireweapon;
+
+enum
+{
+	FLAME_STRESS_OFF = 0,
+	FLAME_STRESS_SPAWN,				// bots join, pick pyro and spawn
+	FLAME_STRESS_WARMUP_BATCHED,
+	FLAME_STRESS_MEASURE_BATCHED,
+	FLAME_STRESS_WARMUP_ENTITY,		// let the batched flames burn out
+	FLAME_STRESS_MEASURE_ENTITY,
+};
+
+#define FLAME_STRESS_SPAWN_TIME		3.0f
+#define FLAME_STRESS_WARMUP_TIME	1.0f
+
+static CTFFlameManager g_TFFlameManager;
+
+CTFFlameManager *TFFlameManager()
+{
+	return &g_TFFlameManager;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CTFFlameManager::CTFFlameManager() : CAutoGameSystemPerFrame( "CTFFlameManager" )
+{
+	m_iFirstSharedActor = 0;
+	m_flBoxSize = 0.0f;
+	m_nEntityFlames = 0;
+	m_iStressPhase = FLAME_STRESS_OFF;
+	m_flStressPhaseEnd = 0.0f;
+	m_flStressSeconds = 0.0f;
+	m_bStressWasBatched = true;
+
+	for ( int i = 0; i < MAX_TEAMS; i++ )
+	{
+		m_iTeamFirstActor[i] = 0;
+		m_iTeamLastActor[i] = 0;
+	}
+
+	ResetStats();
+}
+
+void CTFFlameManager::LevelShutdownPreEntity()
+{
+	RemoveAllFlames();
+
+	if ( m_iStressPhase != FLAME_STRESS_OFF )
+	{
+		// The bots are going away with the map anyway
+		m_StressBots.RemoveAll();
+		FinishStress();
+	}
+}
+
+void CTFFlameManager::FrameUpdatePreEntityThink()
+{
+	m_FrameTimer.Start();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs after every entity has thought, so the actors are where they
+//			will be sent to clients this tick.
+//-----------------------------------------------------------------------------
+void CTFFlameManager::FrameUpdatePostEntityThink()
+{
+	CFastTimer timer;
+	int nFlames = m_vecPos.Count();
+
+	timer.Start();
+	Simulate();
+	timer.End();
+
+	m_FrameTimer.End();
+
+	FlameTickSample_t sample;
+	sample.nFlames = nFlames + m_nEntityFlames;
+	sample.flFlameTime = timer.GetDuration().GetMicrosecondsF() + m_EntityThinkTime.GetMicrosecondsF();
+	sample.flFrameTime = m_FrameTimer.GetDuration().GetMillisecondsF();
+
+	m_EntityThinkTime.Init();
+	m_nEntityFlames = 0;
+
+	if ( sample.nFlames )
+	{
+		m_nTicks++;
+		m_nTotalFlames += sample.nFlames;
+		m_flTotalFlameTime += sample.flFlameTime;
+		m_flMaxFlameTime = MAX( m_flMaxFlameTime, sample.flFlameTime );
+	}
+
+	if ( m_iStressPhase == FLAME_STRESS_MEASURE_BATCHED )
+	{
+		m_StressSamples[0].AddToTail( sample );
+	}
+	else if ( m_iStressPhase == FLAME_STRESS_MEASURE_ENTITY )
+	{
+		m_StressSamples[1].AddToTail( sample );
+	}
+
+	if ( m_iStressPhase != FLAME_STRESS_OFF )
+	{
+		UpdateStress();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same setup as CTFFlameEntity::Create and Spawn, random calls included
+//-----------------------------------------------------------------------------
+void CTFFlameManager::AddFlame( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pWeapon, int iDmgType, float flDmgAmount, int iCustomDmgType )
+{
+	CBaseEntity *pAttacker = pWeapon->GetOwnerEntity();
+	if ( !pAttacker )
+		return;
+
+	float flTimeRemove = gpGlobals->curtime + ( tf_flamethrower_flametime.GetFloat() * random->RandomFloat( 0.9, 1.1 ) );
+
+	// Setup the initial velocity.
+	Vector vecForward;
+	AngleVectors( vecAngles, &vecForward );
+
+	float velocity = tf_flamethrower_velocity.GetFloat();
+	Vector vecBaseVelocity = vecForward * velocity;
+	vecBaseVelocity += RandomVector( -velocity * tf_flamethrower_vecrand.GetFloat(), velocity * tf_flamethrower_vecrand.GetFloat() );
+
+	m_vecPos.AddToTail( vecOrigin );
+	m_vecPrevPos.AddToTail( vecOrigin );
+	m_vecVelocity.AddToTail( vecBaseVelocity );
+	m_vecBaseVelocity.AddToTail( vecBaseVelocity );
+	m_flTimeRemove.AddToTail( flTimeRemove );
+
+	FlameInfo_t &flame = m_Flames[ m_Flames.AddToTail() ];
+	flame.vecInitialPos = vecOrigin;
+	flame.vecAttackerVelocity = pAttacker->GetAbsVelocity();
+	flame.hWeapon = pWeapon;
+	flame.hAttacker = pAttacker;
+	flame.iDmgType = iDmgType;
+	flame.iCustomDmgType = iCustomDmgType;
+	flame.flDmgAmount = flDmgAmount;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Swaps the last flame into this slot
+//-----------------------------------------------------------------------------
+void CTFFlameManager::RemoveFlame( int iFlame )
+{
+	m_vecPos.FastRemove( iFlame );
+	m_vecPrevPos.FastRemove( iFlame );
+	m_vecVelocity.FastRemove( iFlame );
+	m_vecBaseVelocity.FastRemove( iFlame );
+	m_flTimeRemove.FastRemove( iFlame );
+	m_Flames.FastRemove( iFlame );
+}
+
+void CTFFlameManager::RemoveAllFlames( void )
+{
+	m_vecPos.Purge();
+	m_vecPrevPos.Purge();
+	m_vecVelocity.Purge();
+	m_vecBaseVelocity.Purge();
+	m_flTimeRemove.Purge();
+	m_Flames.Purge();
+	m_Actors.Purge();
+
+	for ( int i = 0; i < 3; i++ )
+	{
+		m_flActorMins[i].Purge();
+		m_flActorMaxs[i].Purge();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Does for every flame what CTFFlameEntity::FlameThink and the
+//			noclip move after it do for one.
+//-----------------------------------------------------------------------------
+void CTFFlameManager::Simulate( void )
+{
+	if ( !m_vecPos.Count() )
+		return;
+
+	m_flBoxSize = tf_flamethrower_boxsize.GetFloat();
+	GatherActors();
+
+	float flFlameTime = tf_flamethrower_flametime.GetFloat();
+	float flFadeStart = tf_flamethrower_velocityfadestart.GetFloat();
+	float flFadeEnd = tf_flamethrower_velocityfadeend.GetFloat();
+	float flDrag = tf_flamethrower_drag.GetFloat();
+	Vector vecFloat( 0, 0, tf_flamethrower_float.GetFloat() );
+	bool bDebug = tf_debug_flamethrower.GetBool();
+	Vector vecBox( m_flBoxSize, m_flBoxSize, m_flBoxSize );
+
+	// Backwards, so a removed flame is replaced by one that's already done
+	for ( int i = m_vecPos.Count() - 1; i >= 0; i-- )
+	{
+		// if we've expired, remove ourselves
+		if ( gpGlobals->curtime >= m_flTimeRemove[i] )
+		{
+			RemoveFlame( i );
+			continue;
+		}
+
+		if ( m_vecPos[i] != m_vecPrevPos[i] )
+		{
+			// The entity stopped thinking for good here and drifted on forever, just drop the flame
+			CTFPlayer *pAttacker = ToTFPlayer( m_Flames[i].hAttacker.Get() );
+			CTFTeam *pTeam = pAttacker ? pAttacker->GetOpposingTFTeam() : NULL;
+			if ( !pTeam )
+			{
+				RemoveFlame( i );
+				continue;
+			}
+
+			if ( CheckCollisions( i, pAttacker, pTeam->GetTeamNumber() ) )
+			{
+				// we hit the world
+				RemoveFlame( i );
+				continue;
+			}
+		}
+
+		// Calculate how long the flame has been alive for
+		float flFlameElapsedTime = flFlameTime - ( m_flTimeRemove[i] - gpGlobals->curtime );
+		// Calculate how much of the attacker's velocity to blend in to the flame's velocity.  The flame gets the attacker's velocity
+		// added right when the flame is fired, but that velocity addition fades quickly to zero.
+		float flAttackerVelocityBlend = RemapValClamped( flFlameElapsedTime, flFadeStart, flFadeEnd, 1.0, 0 );
+
+		// Reduce our base velocity by the air drag constant
+		m_vecBaseVelocity[i] *= flDrag;
+
+		// Add our float upward velocity
+		m_vecVelocity[i] = m_vecBaseVelocity[i] + vecFloat + ( flAttackerVelocityBlend * m_Flames[i].vecAttackerVelocity );
+
+		// Render debug visualization if convar on
+		if ( bDebug )
+		{
+			if ( m_Flames[i].hEntitiesBurnt.Count() > 0 )
+			{
+				int val = ( (int) ( gpGlobals->curtime * 10 ) ) % 255;
+				NDebugOverlay::Box( m_vecPos[i], -vecBox, vecBox, val, 255, val, 0, 0 );
+			}
+			else
+			{
+				NDebugOverlay::Box( m_vecPos[i], -vecBox, vecBox, 0, 100, 255, 0, 0 );
+			}
+		}
+
+		m_vecPrevPos[i] = m_vecPos[i];
+		m_vecPos[i] += m_vecVelocity[i] * gpGlobals->frametime;
+	}
+}
+
+void CTFFlameManager::AddActor( CBaseEntity *pEntity, int iType )
+{
+	FlameActor_t &actor = m_Actors[ m_Actors.AddToTail() ];
+	actor.hEntity = pEntity;
+	actor.iType = iType;
+
+	Vector vecMins, vecMaxs;
+	pEntity->GetCollideable()->WorldSpaceSurroundingBounds( &vecMins, &vecMaxs );
+	for ( int i = 0; i < 3; i++ )
+	{
+		m_flActorMins[i].AddToTail( vecMins[i] );
+		m_flActorMaxs[i].AddToTail( vecMaxs[i] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything a flame could burn, once per tick instead of once per
+//			flame. Same order FlameThink checked them in.
+//-----------------------------------------------------------------------------
+void CTFFlameManager::GatherActors( void )
+{
+	m_Actors.RemoveAll();
+	for ( int i = 0; i < 3; i++ )
+	{
+		m_flActorMins[i].RemoveAll();
+		m_flActorMaxs[i].RemoveAll();
+	}
+
+	for ( int iTeam = 0; iTeam < MAX_TEAMS; iTeam++ )
+	{
+		m_iTeamFirstActor[iTeam] = 0;
+		m_iTeamLastActor[iTeam] = 0;
+	}
+
+	for ( int iTeam = FIRST_GAME_TEAM; iTeam < TF_TEAM_COUNT; iTeam++ )
+	{
+		CTFTeam *pTeam = TFTeamMgr()->GetTeam( iTeam );
+		if ( !pTeam )
+			continue;
+
+		m_iTeamFirstActor[iTeam] = m_Actors.Count();
+
+		for ( int iPlayer = 0; iPlayer < pTeam->GetNumPlayers(); iPlayer++ )
+		{
+			CBasePlayer *pPlayer = pTeam->GetPlayer( iPlayer );
+			if ( pPlayer && pPlayer->IsConnected() && pPlayer->IsAlive() )
+			{
+				AddActor( pPlayer, ACTOR_PLAYER );
+			}
+		}
+
+		for ( int iObject = 0; iObject < pTeam->GetNumObjects(); iObject++ )
+		{
+			CBaseObject *pObject = pTeam->GetObject( iObject );
+			if ( pObject )
+			{
+				AddActor( pObject, ACTOR_OBJECT );
+			}
+		}
+
+		m_iTeamLastActor[iTeam] = m_Actors.Count();
+	}
+
+	m_iFirstSharedActor = m_Actors.Count();
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	for ( int iNPC = 0; iNPC < g_AI_Manager.NumAIs(); iNPC++ )
+	{
+		CAI_BaseNPC *pNPC = ppAIs[iNPC];
+		if ( pNPC && pNPC->IsAlive() )
+		{
+			AddActor( pNPC, ACTOR_NPC );
+		}
+	}
+
+	CUtlVector<INextBot *> bots;
+	TheNextBots().CollectAllBots( &bots );
+	for ( int i = 0; i < bots.Count(); ++i )
+	{
+		CBaseCombatCharacter *pActor = bots[i]->GetEntity();
+		if ( pActor && !pActor->IsPlayer() && pActor->IsAlive() )
+		{
+			AddActor( pActor, ACTOR_NPC );
+		}
+	}
+
+	// Pad to a multiple of four with boxes nothing can overlap, so the last
+	// group can always be loaded whole
+	for ( int i = 0; i < 3; i++ )
+	{
+		for ( int j = 0; j < 3; j++ )
+		{
+			m_flActorMins[i].AddToTail( FLT_MAX );
+			m_flActorMaxs[i].AddToTail( -FLT_MAX );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if the flame hit the world and has to go
+//-----------------------------------------------------------------------------
+bool CTFFlameManager::CheckCollisions( int iFlame, CTFPlayer *pAttacker, int iTeam )
+{
+	// Everything the flame's box passed through since last tick
+	Vector vecBox( m_flBoxSize, m_flBoxSize, m_flBoxSize );
+	Vector vecMins, vecMaxs;
+	VectorMin( m_vecPrevPos[iFlame], m_vecPos[iFlame], vecMins );
+	VectorMax( m_vecPrevPos[iFlame], m_vecPos[iFlame], vecMaxs );
+	vecMins -= vecBox;
+	vecMaxs += vecBox;
+
+	if ( iTeam >= 0 && iTeam < MAX_TEAMS &&
+		CheckActorRange( iFlame, pAttacker, m_iTeamFirstActor[iTeam], m_iTeamLastActor[iTeam], vecMins, vecMaxs ) )
+		return true;
+
+	return CheckActorRange( iFlame, pAttacker, m_iFirstSharedActor, m_Actors.Count(), vecMins, vecMaxs );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Tests the swept box against four actor boxes at a time and runs
+//			CheckCollision on the ones that overlap, in order.
+//-----------------------------------------------------------------------------
+bool CTFFlameManager::CheckActorRange( int iFlame, CTFPlayer *pAttacker, int iFirst, int iLast, const Vector &vecMins, const Vector &vecMaxs )
+{
+	fltx4 flameMins[3], flameMaxs[3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		flameMins[i] = ReplicateX4( vecMins[i] );
+		flameMaxs[i] = ReplicateX4( vecMaxs[i] );
+	}
+
+	for ( int iActor = iFirst; iActor < iLast; iActor += 4 )
+	{
+		fltx4 overlap = CmpLeSIMD( LoadUnalignedSIMD( &m_flActorMins[0][iActor] ), flameMaxs[0] );
+		overlap = AndSIMD( overlap, CmpGeSIMD( LoadUnalignedSIMD( &m_flActorMaxs[0][iActor] ), flameMins[0] ) );
+		for ( int i = 1; i < 3; i++ )
+		{
+			overlap = AndSIMD( overlap, CmpLeSIMD( LoadUnalignedSIMD( &m_flActorMins[i][iActor] ), flameMaxs[i] ) );
+			overlap = AndSIMD( overlap, CmpGeSIMD( LoadUnalignedSIMD( &m_flActorMaxs[i][iActor] ), flameMins[i] ) );
+		}
+
+		int nHits = TestSignSIMD( overlap );
+		if ( iLast - iActor < 4 )
+		{
+			// The rest of the group belongs to the next range
+			nHits &= ( 1 << ( iLast - iActor ) ) - 1;
+		}
+
+		for ( int iLane = 0; nHits; iLane++, nHits >>= 1 )
+		{
+			if ( !( nHits & 1 ) )
+				continue;
+
+			m_nBroadphaseHits++;
+
+			const FlameActor_t &actor = m_Actors[ iActor + iLane ];
+			CBaseEntity *pOther = actor.hEntity.Get();
+			if ( !pOther )
+				continue;
+
+			// An earlier flame this tick may have killed it
+			if ( actor.iType != ACTOR_OBJECT && !pOther->IsAlive() )
+				continue;
+
+			if ( pOther == pAttacker )
+				continue;
+
+			if ( CheckCollision( iFlame, pOther ) )
+				return true;
+		}
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CTFFlameEntity::CheckCollision, returns true if we hit the world
+//-----------------------------------------------------------------------------
+bool CTFFlameManager::CheckCollision( int iFlame, CBaseEntity *pOther )
+{
+	FlameInfo_t &flame = m_Flames[iFlame];
+
+	// if we've already burnt this entity, don't do more damage, so skip even checking for collision with the entity
+	if ( flame.hEntitiesBurnt.Find( pOther ) != flame.hEntitiesBurnt.InvalidIndex() )
+		return false;
+
+	m_nExactTests++;
+
+	Vector vecBox( m_flBoxSize, m_flBoxSize, m_flBoxSize );
+	Vector vecMins, vecMaxs;
+	pOther->GetCollideable()->WorldSpaceSurroundingBounds( &vecMins, &vecMaxs );
+	CBaseTrace trace;
+	Ray_t ray;
+	float flFractionLeftSolid;
+	ray.Init( m_vecPrevPos[iFlame], m_vecPos[iFlame], -vecBox, vecBox );
+	if ( !IntersectRayWithBox( ray, vecMins, vecMaxs, 0.0, &trace, &flFractionLeftSolid ) )
+		return false;
+
+	// if bounding box check passes, check player hitboxes
+	trace_t trHitbox;
+	trace_t trWorld;
+	bool bTested = pOther->GetCollideable()->TestHitboxes( ray, MASK_SOLID | CONTENTS_HITBOX, trHitbox );
+	if ( !bTested || !trHitbox.DidHit() )
+		return false;
+
+	// now, let's see if the flame visual could have actually hit this player.  Trace backward from the
+	// point of impact to where the flame was fired, see if we hit anything.  Since the point of impact was
+	// determined using the flame's bounding box and we're just doing a ray test here, we extend the
+	// start point out by the radius of the box.
+	Vector vDir = ray.m_Delta;
+	vDir.NormalizeInPlace();
+	UTIL_TraceLine( m_vecPos[iFlame] + vDir * m_flBoxSize, flame.vecInitialPos, MASK_SOLID, NULL, COLLISION_GROUP_DEBRIS, &trWorld );
+
+	if ( tf_debug_flamethrower.GetBool() )
+	{
+		NDebugOverlay::Line( trWorld.startpos, trWorld.endpos, 0, 255, 0, true, 3.0f );
+	}
+
+	if ( trWorld.fraction != 1.0 )
+		return true;
+
+	// if there is nothing solid in the way, damage the entity
+	OnCollide( iFlame, pOther );
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CTFFlameEntity::OnCollide
+//-----------------------------------------------------------------------------
+void CTFFlameManager::OnCollide( int iFlame, CBaseEntity *pOther )
+{
+	FlameInfo_t &flame = m_Flames[iFlame];
+
+	// remember that we've burnt this player
+	flame.hEntitiesBurnt.AddToTail( pOther );
+
+	float flDistance = m_vecPos[iFlame].DistTo( flame.vecInitialPos );
+	float flMultiplier;
+	if ( flDistance <= 125 )
+	{
+		// at very short range, apply short range damage multiplier
+		flMultiplier = tf_flamethrower_shortrangedamagemultiplier.GetFloat();
+	}
+	else
+	{
+		// make damage ramp down from 100% to 25% from half the max dist to the max dist
+		flMultiplier = RemapValClamped( flDistance, tf_flamethrower_maxdamagedist.GetFloat()/2, tf_flamethrower_maxdamagedist.GetFloat(), 1.0, 0.25 );
+	}
+	float flDamage = flame.flDmgAmount * flMultiplier;
+	flDamage = max( flDamage, 1.0 );
+	if ( tf_debug_flamethrower.GetBool() )
+	{
+		Msg( "Flame touch dmg: %.1f\n", flDamage );
+	}
+
+	CBaseEntity *pAttacker = flame.hAttacker;
+	if ( !pAttacker )
+		return;
+
+	m_nBurns++;
+
+	flame.iCustomDmgType |= TF_DMG_CUSTOM_BURNING;
+
+	CTakeDamageInfo info( flame.hWeapon, pAttacker, flDamage, flame.iDmgType, flame.iCustomDmgType );
+	info.SetReportedPosition( pAttacker->GetAbsOrigin() );
+
+	// We collided with pOther, so try to find a place on their surface to show blood
+	trace_t pTrace;
+	UTIL_TraceLine( m_vecPos[iFlame], pOther->WorldSpaceCenter(), MASK_SOLID|CONTENTS_HITBOX, NULL, COLLISION_GROUP_NONE, &pTrace );
+
+	pOther->DispatchTraceAttack( info, m_vecVelocity[iFlame], &pTrace );
+	ApplyMultiDamage();
+
+	CAI_BaseNPC *pNPC = pOther->MyNPCPointer();
+
+	if ( pNPC )
+		pNPC->Ignite( TF_BURNING_FLAME_LIFE / 5 ); // much shorter time as otherwise its too overpowered
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTFFlameManager::ResetStats( void )
+{
+	m_EntityThinkTime.Init();
+	m_nTicks = 0;
+	m_nTotalFlames = 0;
+	m_nBroadphaseHits = 0;
+	m_nExactTests = 0;
+	m_nBurns = 0;
+	m_flTotalFlameTime = 0.0;
+	m_flMaxFlameTime = 0.0f;
+}
+
+void CTFFlameManager::PrintStats( void )
+{
+	Msg( "Flames: %d batched live, %d actors last tick, %s\n", m_vecPos.Count(), m_Actors.Count(), tf_flamethrower_batched.GetBool() ? "batched" : "entities" );
+	if ( !m_nTicks )
+		return;
+
+	Msg( "  %d ticks with flames, %.1f flames per tick\n", m_nTicks, (float)m_nTotalFlames / m_nTicks );
+	Msg( "  flame usec per tick: mean %.2f  max %.2f\n", m_flTotalFlameTime / m_nTicks, m_flMaxFlameTime );
+	Msg( "  batched: %d broadphase hits, %d exact tests, %d burns\n", m_nBroadphaseHits, m_nExactTests, m_nBurns );
+}
+
+CON_COMMAND( tf_flame_stats, "Shows flamethrower simulation cost per tick. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		TFFlameManager()->ResetStats();
+		return;
+	}
+
+	TFFlameManager()->PrintStats();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Puts pyro bots on both teams firing nonstop, then measures the
+//			tick cost with batched flames and again with flame entities.
+//-----------------------------------------------------------------------------
+void CTFFlameManager::StartStress( int nPyros, float flSeconds )
+{
+	if ( m_iStressPhase != FLAME_STRESS_OFF )
+	{
+		Msg( "tf_flame_stress is already running.\n" );
+		return;
+	}
+
+	m_StressBots.RemoveAll();
+	for ( int i = 0; i < nPyros; i++ )
+	{
+		CBasePlayer *pBot = BotPutInServer( true, ( i & 1 ) ? TF_TEAM_BLUE : TF_TEAM_RED, TF_CLASS_PYRO, "flame_stress" );
+		if ( !pBot )
+			break;
+
+		m_StressBots.AddToTail( pBot->GetUserID() );
+	}
+
+	if ( !m_StressBots.Count() )
+	{
+		Warning( "tf_flame_stress: no free player slots for bots.\n" );
+		return;
+	}
+
+	m_bStressWasBatched = tf_flamethrower_batched.GetBool();
+	m_StressForceFireWeapon = bot_forcefireweapon.GetString();
+	bot_forcefireweapon.SetValue( "tf_weapon_flamethrower" );
+
+	m_StressSamples[0].RemoveAll();
+	m_StressSamples[1].RemoveAll();
+	m_flStressSeconds = flSeconds;
+	m_iStressPhase = FLAME_STRESS_SPAWN;
+	m_flStressPhaseEnd = gpGlobals->curtime + FLAME_STRESS_SPAWN_TIME;
+
+	Msg( "tf_flame_stress: %d pyros, %.0f seconds batched then %.0f seconds as entities\n", m_StressBots.Count(), flSeconds, flSeconds );
+}
+
+void CTFFlameManager::UpdateStress( void )
+{
+	if ( gpGlobals->curtime < m_flStressPhaseEnd )
+		return;
+
+	switch ( m_iStressPhase )
+	{
+	case FLAME_STRESS_SPAWN:
+		tf_flamethrower_batched.SetValue( 1 );
+		m_iStressPhase = FLAME_STRESS_WARMUP_BATCHED;
+		m_flStressPhaseEnd = gpGlobals->curtime + FLAME_STRESS_WARMUP_TIME;
+		break;
+	case FLAME_STRESS_WARMUP_BATCHED:
+		m_iStressPhase = FLAME_STRESS_MEASURE_BATCHED;
+		m_flStressPhaseEnd = gpGlobals->curtime + m_flStressSeconds;
+		break;
+	case FLAME_STRESS_MEASURE_BATCHED:
+		tf_flamethrower_batched.SetValue( 0 );
+		m_iStressPhase = FLAME_STRESS_WARMUP_ENTITY;
+		m_flStressPhaseEnd = gpGlobals->curtime + FLAME_STRESS_WARMUP_TIME;
+		break;
+	case FLAME_STRESS_WARMUP_ENTITY:
+		m_iStressPhase = FLAME_STRESS_MEASURE_ENTITY;
+		m_flStressPhaseEnd = gpGlobals->curtime + m_flStressSeconds;
+		break;
+	default:
+		FinishStress();
+		break;
+	}
+}
+
+static int SortFloats( const float *a, const float *b )
+{
+	if ( *a < *b )
+		return -1;
+
+	return ( *a > *b ) ? 1 : 0;
+}
+
+static float Percentile( const CUtlVector< float > &sorted, float flPercent )
+{
+	if ( !sorted.Count() )
+		return 0.0f;
+
+	int i = clamp( (int)( flPercent * 0.01f * sorted.Count() ), 0, sorted.Count() - 1 );
+	return sorted[i];
+}
+
+static void PrintStressSamples( const char *pszName, const CUtlVector< FlameTickSample_t > &samples )
+{
+	if ( !samples.Count() )
+	{
+		Msg( "  %-8s no ticks measured\n", pszName );
+		return;
+	}
+
+	CUtlVector< float > flameTimes, frameTimes;
+	double flFlameTotal = 0.0, flFrameTotal = 0.0;
+	int nFlames = 0;
+	FOR_EACH_VEC( samples, i )
+	{
+		flameTimes.AddToTail( samples[i].flFlameTime );
+		frameTimes.AddToTail( samples[i].flFrameTime );
+		flFlameTotal += samples[i].flFlameTime;
+		flFrameTotal += samples[i].flFrameTime;
+		nFlames += samples[i].nFlames;
+	}
+
+	flameTimes.Sort( SortFloats );
+	frameTimes.Sort( SortFloats );
+
+	Msg( "  %-8s %d ticks, %.1f flames per tick\n", pszName, samples.Count(), (float)nFlames / samples.Count() );
+	Msg( "           flame usec: mean %.2f  p50 %.2f  p99 %.2f  max %.2f\n",
+		flFlameTotal / samples.Count(), Percentile( flameTimes, 50 ), Percentile( flameTimes, 99 ), flameTimes.Tail() );
+	Msg( "           frame msec: mean %.3f  p50 %.3f  p99 %.3f  max %.3f\n",
+		flFrameTotal / samples.Count(), Percentile( frameTimes, 50 ), Percentile( frameTimes, 99 ), frameTimes.Tail() );
+}
+
+void CTFFlameManager::FinishStress( void )
+{
+	Msg( "tf_flame_stress results:\n" );
+	PrintStressSamples( "batched", m_StressSamples[0] );
+	PrintStressSamples( "entities", m_StressSamples[1] );
+
+	bot_forcefireweapon.SetValue( m_StressForceFireWeapon.Get() );
+	tf_flamethrower_batched.SetValue( m_bStressWasBatched );
+
+	FOR_EACH_VEC( m_StressBots, i )
+	{
+		engine->ServerCommand( UTIL_VarArgs( "kickid %d\n", m_StressBots[i] ) );
+	}
+
+	m_StressBots.RemoveAll();
+	m_iStressPhase = FLAME_STRESS_OFF;
+}
+
+CON_COMMAND( tf_flame_stress, "Spawns firing pyro bots and compares the tick cost of batched flames and flame entities. Usage: tf_flame_stress [pyros] [seconds]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nPyros = ( args.ArgC() > 1 ) ? clamp( atoi( args[1] ), 1, gpGlobals->maxClients ) : 8;
+	float flSeconds = ( args.ArgC() > 2 ) ? MAX( 1.0f, atof( args[2] ) ) : 10.0f;
+
+	TFFlameManager()->StartStress( nPyros, flSeconds );
+}
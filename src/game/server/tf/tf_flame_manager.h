@@ -0,0 +1,136 @@
+//====== Copyright  1996-2005, Valve Corporation, All rights reserved. =======
+//
+// Purpose: Simulates flamethrower damage volumes as one batch per tick instead
+//			of one thinking entity per flame. Flames live in parallel arrays,
+//			the damageable actors are gathered once per tick and tested four
+//			at a time against each flame's swept box before the exact hitbox
+//			and world traces CTFFlameEntity does. Clients draw flames from the
+//			weapon's own particles, so nothing here is networked.
+//
+//=============================================================================
+#ifndef TF_FLAME_MANAGER_H
+#define TF_FLAME_MANAGER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "igamesystem.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlstring.h"
+
+class CTFPlayer;
+
+//-----------------------------------------------------------------------------
+// Purpose: Per tick costs, kept for tf_flame_stats and tf_flame_stress
+//-----------------------------------------------------------------------------
+struct FlameTickSample_t
+{
+	int		nFlames;			// flames simulated this tick, batched or entities
+	float	flFlameTime;		// microseconds spent simulating them
+	float	flFrameTime;		// milliseconds from the start of the frame to the end of entity thinks
+};
+
+class CTFFlameManager : public CAutoGameSystemPerFrame
+{
+public:
+	CTFFlameManager();
+
+	virtual void LevelShutdownPreEntity();
+	virtual void FrameUpdatePreEntityThink();
+	virtual void FrameUpdatePostEntityThink();
+
+	void	AddFlame( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pWeapon, int iDmgType, float flDmgAmount, int iCustomDmgType );
+	int		GetFlameCount( void ) const { return m_vecPos.Count(); }
+	void	RemoveAllFlames( void );
+
+	// CTFFlameEntity::FlameThink reports here so both paths show up in the same numbers
+	void	NoteEntityFlame( void ) { m_nEntityFlames++; }
+	CCycleCount *GetEntityThinkTime( void ) { return &m_EntityThinkTime; }
+
+	void	StartStress( int nPyros, float flSeconds );
+	void	PrintStats( void );
+	void	ResetStats( void );
+
+private:
+	struct FlameInfo_t
+	{
+		Vector					vecInitialPos;			// position the flame was fired from
+		Vector					vecAttackerVelocity;	// velocity of attacking player at time flame was fired
+		EHANDLE					hWeapon;				// inflictor
+		EHANDLE					hAttacker;				// attacking player
+		int						iDmgType;				// damage type
+		int						iCustomDmgType;			// custom damage type
+		float					flDmgAmount;			// amount of base damage
+		CUtlVector<EHANDLE>		hEntitiesBurnt;			// list of entities this flame has burnt
+	};
+
+	enum
+	{
+		ACTOR_PLAYER = 0,
+		ACTOR_OBJECT,
+		ACTOR_NPC,
+	};
+
+	struct FlameActor_t
+	{
+		EHANDLE		hEntity;
+		int			iType;
+	};
+
+	void	Simulate( void );
+	void	GatherActors( void );
+	void	AddActor( CBaseEntity *pEntity, int iType );
+	bool	CheckCollisions( int iFlame, CTFPlayer *pAttacker, int iTeam );
+	bool	CheckActorRange( int iFlame, CTFPlayer *pAttacker, int iFirst, int iLast, const Vector &vecMins, const Vector &vecMaxs );
+	bool	CheckCollision( int iFlame, CBaseEntity *pOther );
+	void	OnCollide( int iFlame, CBaseEntity *pOther );
+	void	RemoveFlame( int iFlame );
+
+	void	UpdateStress( void );
+	void	FinishStress( void );
+
+	// Touched by every flame every tick, one array per field
+	CUtlVector<Vector>		m_vecPos;
+	CUtlVector<Vector>		m_vecPrevPos;
+	CUtlVector<Vector>		m_vecVelocity;
+	CUtlVector<Vector>		m_vecBaseVelocity;
+	CUtlVector<float>		m_flTimeRemove;
+
+	// Only needed once a flame touches something
+	CUtlVector<FlameInfo_t>	m_Flames;
+
+	// This tick's damageable actors. Each team's players and objects are
+	// contiguous, NPCs and nextbots follow and can be hit by any team.
+	CUtlVector<FlameActor_t>	m_Actors;
+	CUtlVector<float>		m_flActorMins[3];
+	CUtlVector<float>		m_flActorMaxs[3];
+	int						m_iTeamFirstActor[MAX_TEAMS];
+	int						m_iTeamLastActor[MAX_TEAMS];
+	int						m_iFirstSharedActor;
+	float					m_flBoxSize;
+
+	// Stats
+	CFastTimer				m_FrameTimer;
+	CCycleCount				m_EntityThinkTime;
+	int						m_nEntityFlames;
+	int						m_nTicks;
+	int						m_nTotalFlames;
+	int						m_nBroadphaseHits;
+	int						m_nExactTests;
+	int						m_nBurns;
+	double					m_flTotalFlameTime;
+	float					m_flMaxFlameTime;
+
+	// tf_flame_stress
+	int						m_iStressPhase;
+	float					m_flStressPhaseEnd;
+	float					m_flStressSeconds;
+	bool					m_bStressWasBatched;
+	CUtlString				m_StressForceFireWeapon;
+	CUtlVector<int>			m_StressBots;
+	CUtlVector<FlameTickSample_t>	m_StressSamples[2];
+};
+
+extern CTFFlameManager *TFFlameManager();
+
+#endif // TF_FLAME_MANAGER_H
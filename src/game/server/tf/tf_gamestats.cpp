@@ -19,6 +19,7 @@
 // Must run with -gamestats to be able to turn on/off stats with ConVar below.
 static ConVar tf_stats_track( "tf_stats_track", "1", FCVAR_NONE, "Turn on//off tf stats tracking." );
 static ConVar tf_stats_verbose( "tf_stats_verbose", "0", FCVAR_NONE, "Turn on//off verbose logging of stats." );
+static ConVar tf_stats_stream( "tf_stats_stream", "0", FCVAR_NONE, "Stream kills, damage, heals and pickups to a binary file per map (see tf_stats_stream_dir) instead of keeping them in memory. Takes effect on map change." );
 
 CTFGameStats CTF_GameStats;
 
@@ -43,7 +44,7 @@ const char *g_aClassNames[] =
 // Purpose: Constructor
 // Input  :  - 
 //-----------------------------------------------------------------------------
-CTFGameStats::CTFGameStats()
+CTFGameStats::CTFGameStats() : m_StreamHealRemainders( DefLessFunc( int ) )
 {
 	gamestats = this;
 	Clear();	
@@ -66,6 +67,8 @@ void CTFGameStats::Clear( void )
 {
 	m_reportedStats.Clear();
 	Q_memset( m_aPlayerStats, 0, sizeof( m_aPlayerStats ) );
+	m_nStreamedDamage = 0;
+	m_StreamHealRemainders.RemoveAll();
 	CBaseGameStats::Clear();
 }
 
@@ -143,6 +146,12 @@ void CTFGameStats::Event_LevelInit( void )
 
 	TF_Gamestats_LevelStats_t *map = m_reportedStats.FindOrAddMapStats( STRING( gpGlobals->mapname ) );
 	map->Init( STRING( gpGlobals->mapname ), nIPAddr, nPort, gpGlobals->curtime );
+
+	m_StreamHealRemainders.RemoveAll();
+	if ( tf_stats_stream.GetBool() )
+	{
+		m_StatsStream.Open( STRING( gpGlobals->mapname ) );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -159,6 +168,8 @@ void CTFGameStats::Event_LevelShutdown( float flElapsed )
 	// add current game data in to data for this level
 	AccumulateGameData();
 
+	m_StatsStream.Close();
+
 	CBaseGameStats::Event_LevelShutdown( flElapsed );
 }
 
@@ -172,6 +183,8 @@ void CTFGameStats::ResetPlayerStats( CTFPlayer *pPlayer )
 	stats.Reset();
 	// reset the matrix of who killed whom with respect to this player
 	ResetKillHistory( pPlayer );
+	// and any healing to or from them that hasn't been streamed
+	ResetStreamHeals( pPlayer );
 	// let the client know to reset its stats
 	SendStatsToPlayer( pPlayer, STATMSG_RESET );
 }
@@ -383,6 +396,8 @@ void CTFGameStats::Event_PlayerSpawned( CTFPlayer *pPlayer )
 	{
 		SendStatsToPlayer( pPlayer, STATMSG_PLAYERSPAWN );
 	}
+
+	StreamPlayer( pPlayer );
 }
 
 //-----------------------------------------------------------------------------
@@ -407,8 +422,10 @@ void CTFGameStats::Event_PlayerForceRespawn( CTFPlayer *pPlayer )
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void CTFGameStats::Event_PlayerLeachedHealth( CTFPlayer *pPlayer, bool bDispenserHeal, float amount ) 
+void CTFGameStats::Event_PlayerLeachedHealth( CTFPlayer *pPlayer, bool bDispenserHeal, float amount, CTFPlayer *pHealer ) 
 {
+	StreamHeal( pHealer, pPlayer, amount, bDispenserHeal ? STATSSTREAM_HEAL_DISPENSER : STATSSTREAM_HEAL_LEACH );
+
 	if ( !bDispenserHeal )
 	{
 		// If this was a heal by enemy medic and the first such heal that the server is aware of for this player,
@@ -429,9 +446,31 @@ void CTFGameStats::Event_PlayerLeachedHealth( CTFPlayer *pPlayer, bool bDispense
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void CTFGameStats::Event_PlayerHealedOther( CTFPlayer *pPlayer, float amount ) 
+void CTFGameStats::Event_PlayerHealedOther( CTFPlayer *pPlayer, float amount, CTFPlayer *pTarget ) 
 {
 	IncrementStat( pPlayer, TFSTAT_HEALING, (int) amount );
+
+	StreamHeal( pPlayer, pTarget, amount, STATSSTREAM_HEAL_ALLY );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called by the game rules whenever a CItem is picked up
+//-----------------------------------------------------------------------------
+void CTFGameStats::Event_PlayerPickedUpItem( CTFPlayer *pPlayer, CBaseEntity *pItem )
+{
+	if ( !m_StatsStream.IsOpen() || !pPlayer || !pItem )
+		return;
+
+	int16 nItem = m_StatsStream.GetStringID( pItem->GetClassname() );
+
+	StatsStreamPickup_t *pRow = m_StatsStream.AddRow< StatsStreamPickup_t >( STATSSTREAM_PICKUP );
+	pRow->nPlayer = CTFStatsStream::GetPlayerID( pPlayer );
+	pRow->nItem = nItem;
+
+	const Vector &vecOrigin = pItem->GetAbsOrigin();
+	pRow->vecPosition[0] = STATSSTREAM_COORD( vecOrigin.x );
+	pRow->vecPosition[1] = STATSSTREAM_COORD( vecOrigin.y );
+	pRow->vecPosition[2] = STATSSTREAM_COORD( vecOrigin.z );
 }
 
 //-----------------------------------------------------------------------------
@@ -700,8 +739,31 @@ void CTFGameStats::Event_PlayerDamage( CBasePlayer *pBasePlayer, const CTakeDama
 	// record if it was a kill
 	damage.iKill = ( pTarget->GetHealth() <= 0 );
 
+	if ( m_StatsStream.IsOpen() )
+	{
+		// streamed out instead of kept around for the rest of the map
+		int16 nWeapon = m_StatsStream.GetStringID( TFGameRules()->GetKillingWeaponName( info, pTarget ) );
+
+		StatsStreamDamage_t *pRow = m_StatsStream.AddRow< StatsStreamDamage_t >( STATSSTREAM_DAMAGE );
+		pRow->nAttacker = CTFStatsStream::GetPlayerID( pAttacker );
+		pRow->nVictim = CTFStatsStream::GetPlayerID( pTarget );
+		pRow->nWeapon = nWeapon;
+		pRow->nDamage = (int16)Clamp( iDamageTaken, -32768, 32767 );
+		pRow->nAttackerClass = damage.iAttackClass;
+		pRow->nVictimClass = damage.iTargetClass;
+		pRow->bCrit = damage.iCrit;
+		pRow->bKill = damage.iKill;
+		pRow->vecAttacker[0] = STATSSTREAM_COORD( killerOrg.x );
+		pRow->vecAttacker[1] = STATSSTREAM_COORD( killerOrg.y );
+		pRow->vecAttacker[2] = STATSSTREAM_COORD( killerOrg.z );
+		pRow->vecVictim[0] = STATSSTREAM_COORD( org.x );
+		pRow->vecVictim[1] = STATSSTREAM_COORD( org.y );
+		pRow->vecVictim[2] = STATSSTREAM_COORD( org.z );
+
+		m_nStreamedDamage++;
+	}
 	// add it to the list of damages
-	if ( m_reportedStats.m_pCurrentGame != NULL )
+	else if ( m_reportedStats.m_pCurrentGame != NULL )
 	{
 		m_reportedStats.m_pCurrentGame->m_aPlayerDamage.AddToTail( damage );
 	}	
@@ -744,6 +806,18 @@ void CTFGameStats::Event_RoundEnd( int iWinningTeam, bool bFullRound, float flRo
 	m_reportedStats.m_pCurrentGame->m_Header.m_iTotalTime += (int) flRoundTime;
 	m_reportedStats.m_pCurrentGame->m_flRoundStartTime = gpGlobals->curtime;
 
+	if ( m_StatsStream.IsOpen() )
+	{
+		StatsStreamRound_t *pRow = m_StatsStream.AddRow< StatsStreamRound_t >( STATSSTREAM_ROUND );
+		pRow->nWinningTeam = iWinningTeam;
+		pRow->bFullRound = bFullRound;
+		pRow->bSuddenDeath = bWasSuddenDeathWin;
+		pRow->flRoundTime = flRoundTime;
+
+		// round end is a quiet moment, get everything onto disk
+		m_StatsStream.Flush();
+	}
+
 	// only record full rounds, not mini-rounds
 	if ( !bFullRound )
 		return;
@@ -895,11 +969,36 @@ void CTFGameStats::Event_PlayerKilled( CBasePlayer *pPlayer, const CTakeDamageIn
 	// calculate the distance to the killer
 	death.iDistance = static_cast<unsigned short>( ( killerOrg - org ).Length() );
 
+	if ( m_StatsStream.IsOpen() )
+	{
+		int16 nWeapon = m_StatsStream.GetStringID( TFGameRules()->GetKillingWeaponName( info, pTFPlayer ) );
+		CTFPlayer *pAssister = ToTFPlayer( TFGameRules()->GetAssister( pPlayer, pScorer, pInflictor ) );
+
+		StatsStreamKill_t *pRow = m_StatsStream.AddRow< StatsStreamKill_t >( STATSSTREAM_KILL );
+		pRow->nAttacker = CTFStatsStream::GetPlayerID( pScorer );
+		pRow->nVictim = CTFStatsStream::GetPlayerID( pPlayer );
+		pRow->nAssister = CTFStatsStream::GetPlayerID( pAssister );
+		pRow->nAttackerClass = pScorer ? pScorer->GetPlayerClass()->GetClassIndex() : TF_CLASS_UNDEFINED;
+		pRow->nVictimClass = death.iTargetClass;
+		pRow->nWeapon = nWeapon;
+		pRow->nDamageCustom = info.GetDamageCustom();
+		pRow->bCrit = ( info.GetDamageType() & DMG_CRITICAL ) != 0;
+		pRow->vecAttacker[0] = STATSSTREAM_COORD( killerOrg.x );
+		pRow->vecAttacker[1] = STATSSTREAM_COORD( killerOrg.y );
+		pRow->vecAttacker[2] = STATSSTREAM_COORD( killerOrg.z );
+		pRow->vecVictim[0] = STATSSTREAM_COORD( org.x );
+		pRow->vecVictim[1] = STATSSTREAM_COORD( org.y );
+		pRow->vecVictim[2] = STATSSTREAM_COORD( org.z );
+	}
+
 	// add it to the list of deaths
 	TF_Gamestats_LevelStats_t *map = m_reportedStats.m_pCurrentGame;
 	if ( map )
 	{
-		map->m_aPlayerDeaths.AddToTail( death );
+		if ( !m_StatsStream.IsOpen() )
+		{
+			map->m_aPlayerDeaths.AddToTail( death );
+		}
 		int iClass = ToTFPlayer( pPlayer )->GetPlayerClass()->GetClassIndex();
 
 		if ( m_reportedStats.m_pCurrentGame != NULL )
@@ -964,7 +1063,7 @@ void CTFGameStats::AccumulateGameData()
 	// Sanity-check that this looks like real game play -- must have minimum # of players on both teams,
 	// minimum time and some damage to players must have occurred
 	if ( ( game->m_iPeakPlayerCount[TF_TEAM_RED] >= 3  ) && ( game->m_iPeakPlayerCount[TF_TEAM_BLUE] >= 3 ) &&
-		( game->m_Header.m_iTotalTime >= 4 * 60 ) && ( game->m_aPlayerDamage.Count() > 0 ) ) 
+		( game->m_Header.m_iTotalTime >= 4 * 60 ) && ( game->m_aPlayerDamage.Count() > 0 || m_nStreamedDamage > 0 ) ) 
 	{
 		// if this looks like real game play, add it to stats
 		map->Accumulate( game );
@@ -983,6 +1082,7 @@ void CTFGameStats::ClearCurrentGameData()
 		delete m_reportedStats.m_pCurrentGame;
 	}
 	m_reportedStats.m_pCurrentGame = new TF_Gamestats_LevelStats_t;
+	m_nStreamedDamage = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -1024,6 +1124,88 @@ void CTFGameStats::TrackKillStats( CBasePlayer *pAttacker, CBasePlayer *pVictim
 
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Records who a userid is, so the stream can be read without a server log
+//-----------------------------------------------------------------------------
+void CTFGameStats::StreamPlayer( CTFPlayer *pPlayer )
+{
+	if ( !m_StatsStream.IsOpen() )
+		return;
+
+	StatsStreamPlayer_t *pRow = m_StatsStream.AddRow< StatsStreamPlayer_t >( STATSSTREAM_PLAYER );
+	pRow->nUserID = CTFStatsStream::GetPlayerID( pPlayer );
+	pRow->nTeam = pPlayer->GetTeamNumber();
+	pRow->nClass = pPlayer->GetPlayerClass()->GetClassIndex();
+	pRow->bBot = pPlayer->IsBot();
+	Q_strncpy( pRow->szName, pPlayer->GetPlayerName(), sizeof( pRow->szName ) );
+	Q_strncpy( pRow->szNetworkID, pPlayer->GetNetworkIDString(), sizeof( pRow->szNetworkID ) );
+}
+
+// Keys m_StreamHealRemainders, entity indices fit in a byte each
+#define STREAMHEAL_KEY( healer, target, source )	( ( (healer) << 16 ) | ( (target) << 8 ) | (source) )
+
+//-----------------------------------------------------------------------------
+// Purpose: Healing is split between healers every tick, so most calls are a
+//			fraction of a point. They're added up per healer, target and source
+//			and streamed as whole points once there's at least one.
+//-----------------------------------------------------------------------------
+void CTFGameStats::StreamHeal( CTFPlayer *pHealer, CTFPlayer *pTarget, float amount, int iSource )
+{
+	if ( !m_StatsStream.IsOpen() || amount <= 0.0f )
+		return;
+
+	int iKey = STREAMHEAL_KEY( pHealer ? pHealer->entindex() : 0, pTarget ? pTarget->entindex() : 0, iSource );
+	unsigned short iRemainder = m_StreamHealRemainders.Find( iKey );
+	if ( iRemainder == m_StreamHealRemainders.InvalidIndex() )
+	{
+		iRemainder = m_StreamHealRemainders.Insert( iKey, 0.0f );
+	}
+
+	float &flHealing = m_StreamHealRemainders[iRemainder];
+	flHealing += amount;
+	if ( flHealing < 1.0f )
+		return;
+
+	int nAmount = (int)flHealing;
+	flHealing -= nAmount;
+
+	StatsStreamHeal_t *pRow = m_StatsStream.AddRow< StatsStreamHeal_t >( STATSSTREAM_HEAL );
+	pRow->nHealer = CTFStatsStream::GetPlayerID( pHealer );
+	pRow->nTarget = CTFStatsStream::GetPlayerID( pTarget );
+	pRow->nAmount = (int16)Min( nAmount, 32767 );
+	pRow->nSource = iSource;
+
+	if ( pTarget )
+	{
+		const Vector &vecOrigin = pTarget->GetAbsOrigin();
+		pRow->vecTarget[0] = STATSSTREAM_COORD( vecOrigin.x );
+		pRow->vecTarget[1] = STATSSTREAM_COORD( vecOrigin.y );
+		pRow->vecTarget[2] = STATSSTREAM_COORD( vecOrigin.z );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops partial healing to or from this player, so it can't carry
+//			over to whoever gets their entity index next
+//-----------------------------------------------------------------------------
+void CTFGameStats::ResetStreamHeals( CTFPlayer *pPlayer )
+{
+	int iPlayerIndex = pPlayer->entindex();
+
+	for ( int i = m_StreamHealRemainders.FirstInorder(); i != m_StreamHealRemainders.InvalidIndex(); )
+	{
+		int iNext = m_StreamHealRemainders.NextInorder( i );
+
+		int iKey = m_StreamHealRemainders.Key( i );
+		if ( ( ( iKey >> 16 ) & 0xFF ) == iPlayerIndex || ( ( iKey >> 8 ) & 0xFF ) == iPlayerIndex )
+		{
+			m_StreamHealRemainders.RemoveAt( i );
+		}
+
+		i = iNext;
+	}
+}
+
 struct PlayerStats_t *CTFGameStats::FindPlayerStats( CBasePlayer *pPlayer )
 {
 	return &m_aPlayerStats[pPlayer->entindex()];
@@ -1076,3 +1258,11 @@ static void CC_ListDeaths( const CCommand &args )
 }
 
 static ConCommand listDeaths("listdeaths", CC_ListDeaths, "lists player deaths", FCVAR_CHEAT );
+
+CON_COMMAND( tf_stats_stream_status, "Shows what the binary stats stream has written for the current map." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	CTF_GameStats.GetStatsStream().PrintStats();
+}
@@ -12,6 +12,7 @@
 #include "gamestats.h"
 #include "tf_gamestats_shared.h"
 #include "GameEventListener.h"
+#include "tf_statsstream.h"
 
 class CTFPlayer;
 class CBaseObject;
@@ -55,8 +56,9 @@ public:
 	void Event_PlayerChangedClass( CTFPlayer *pPlayer );
 	void Event_PlayerSpawned( CTFPlayer *pPlayer );
 	void Event_PlayerForceRespawn( CTFPlayer *pPlayer );
-	void Event_PlayerLeachedHealth( CTFPlayer *pPlayer, bool bDispenserHeal, float amount );
-	void Event_PlayerHealedOther( CTFPlayer *pPlayer, float amount );
+	void Event_PlayerLeachedHealth( CTFPlayer *pPlayer, bool bDispenserHeal, float amount, CTFPlayer *pHealer = NULL );
+	void Event_PlayerHealedOther( CTFPlayer *pPlayer, float amount, CTFPlayer *pTarget = NULL );
+	void Event_PlayerPickedUpItem( CTFPlayer *pPlayer, CBaseEntity *pItem );
 	void Event_AssistKill( CTFPlayer *pPlayer, CBaseEntity *pVictim );
 	void Event_PlayerInvulnerable( CTFPlayer *pPlayer );
 	void Event_PlayerCreatedBuilding( CTFPlayer *pPlayer, CBaseObject *pBuilding );
@@ -85,6 +87,7 @@ public:
 	TF_Gamestats_LevelStats_t	*GetCurrentMap( void )			{ return m_reportedStats.m_pCurrentGame; }
 
 	struct PlayerStats_t *		FindPlayerStats( CBasePlayer *pPlayer );
+	CTFStatsStream				&GetStatsStream( void )	{ return m_StatsStream; }
 	void						ResetPlayerStats( CTFPlayer *pPlayer );
 	void						ResetKillHistory( CTFPlayer *pPlayer );
 	void						ResetRoundStats();
@@ -93,6 +96,9 @@ protected:
 	void						SendStatsToPlayer( CTFPlayer *pPlayer, int iMsgType );
 	void						AccumulateAndResetPerLifeStats( CTFPlayer *pPlayer );
 	void						TrackKillStats( CBasePlayer *pAttacker, CBasePlayer *pVictim );
+	void						StreamPlayer( CTFPlayer *pPlayer );
+	void						StreamHeal( CTFPlayer *pHealer, CTFPlayer *pTarget, float amount, int iSource );
+	void						ResetStreamHeals( CTFPlayer *pPlayer );
 
 protected:
 
@@ -101,6 +107,11 @@ public:
 protected:
 
 	PlayerStats_t				m_aPlayerStats[MAX_PLAYERS+1];	// List of stats for each player for current life - reset after each death or class change
+
+	// Per-event history goes here instead of m_aPlayerDeaths/m_aPlayerDamage when tf_stats_stream is on
+	CTFStatsStream				m_StatsStream;
+	int							m_nStreamedDamage;		// damage events streamed this game, for the sanity check in AccumulateGameData
+	CUtlMap<int, float>			m_StreamHealRemainders;	// healing not streamed yet, by healer, target and source
 };
 
 extern CTFGameStats CTF_GameStats;
@@ -0,0 +1,394 @@
+//====== Copyright  1996-2005, Valve Corporation, All rights reserved. =======
+//
+// Purpose: Per model hitbox tables, see tf_hitbox_table.h
+//
+//=============================================================================
+#include "cbase.h"
+#include "tf_hitbox_table.h"
+#include "baseanimating.h"
+#include "studio.h"
+#include "bone_setup.h"
+#include "physics_shared.h"
+#include "tier0/fasttimer.h"
+#include "mathlib/ssemath.h"
+#include "vstdlib/random.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar tf_hitbox_table( "tf_hitbox_table", "1", FCVAR_NONE, "Rejects hitboxes a trace can't reach four at a time from a per model table before the exact studio hitbox trace." );
+
+// Slack on every box so float differences against the exact test never drop a box it would hit
+#define HITBOX_TABLE_MARGIN		1.0f
+
+static CTFHitboxTables g_TFHitboxTables;
+
+CTFHitboxTables *TFHitboxTables()
+{
+	return &g_TFHitboxTables;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CTFHitboxTables::CTFHitboxTables() : CAutoGameSystem( "CTFHitboxTables" ), m_Models( DefLessFunc( const model_t * ) )
+{
+	m_nTraces = 0;
+	m_nHitboxesTotal = 0;
+	m_nHitboxesTested = 0;
+}
+
+void CTFHitboxTables::LevelShutdownPostEntity()
+{
+	// Model pointers don't outlive the level
+	Clear();
+}
+
+void CTFHitboxTables::Clear( void )
+{
+	FOR_EACH_MAP_FAST( m_Models, i )
+	{
+		m_Models[i]->sets.PurgeAndDeleteElements();
+		delete m_Models[i];
+	}
+	m_Models.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the model's table for this hitbox set, building it the first
+//			time it's asked for
+//-----------------------------------------------------------------------------
+const HitboxSetTable_t *CTFHitboxTables::GetTable( const model_t *pModel, CStudioHdr *pStudioHdr, int iHitboxSet )
+{
+	if ( !pModel || iHitboxSet < 0 || iHitboxSet >= pStudioHdr->numhitboxsets() )
+		return NULL;
+
+	mstudiohitboxset_t *set = pStudioHdr->pHitboxSet( iHitboxSet );
+	if ( !set || !set->numhitboxes )
+		return NULL;
+
+	unsigned short iModel = m_Models.Find( pModel );
+	if ( iModel == m_Models.InvalidIndex() )
+	{
+		ModelTables_t *pTables = new ModelTables_t;
+		for ( int i = 0; i < pStudioHdr->numhitboxsets(); i++ )
+		{
+			pTables->sets.AddToTail( NULL );
+		}
+		iModel = m_Models.Insert( pModel, pTables );
+	}
+
+	ModelTables_t *pTables = m_Models[iModel];
+	if ( iHitboxSet >= pTables->sets.Count() )
+		return NULL;
+
+	HitboxSetTable_t *pTable = pTables->sets[iHitboxSet];
+	if ( pTable && pTable->nHitboxes == set->numhitboxes )
+		return pTable;
+
+	// First use, or the model was reloaded under us
+	if ( !pTable )
+	{
+		pTable = new HitboxSetTable_t;
+		pTables->sets[iHitboxSet] = pTable;
+	}
+
+	int nPadded = ( set->numhitboxes + 3 ) & ~3;
+	pTable->nHitboxes = set->numhitboxes;
+	pTable->iBone.SetCount( nPadded );
+	pTable->fContents.SetCount( nPadded );
+	for ( int j = 0; j < 3; j++ )
+	{
+		pTable->flCenter[j].SetCount( nPadded );
+		pTable->flExtents[j].SetCount( nPadded );
+	}
+
+	for ( int i = 0; i < nPadded; i++ )
+	{
+		if ( i < set->numhitboxes )
+		{
+			mstudiobbox_t *pbox = set->pHitbox( i );
+			pTable->iBone[i] = pbox->bone;
+			pTable->fContents[i] = pStudioHdr->pBone( pbox->bone )->contents;
+			for ( int j = 0; j < 3; j++ )
+			{
+				pTable->flCenter[j][i] = ( pbox->bbmin[j] + pbox->bbmax[j] ) * 0.5f;
+				pTable->flExtents[j][i] = ( pbox->bbmax[j] - pbox->bbmin[j] ) * 0.5f;
+			}
+		}
+		else
+		{
+			// Padding reuses the first box's bone so its matrix is always valid
+			pTable->iBone[i] = pTable->iBone[0];
+			pTable->fContents[i] = 0;
+			for ( int j = 0; j < 3; j++ )
+			{
+				pTable->flCenter[j][i] = 0.0f;
+				pTable->flExtents[j][i] = 0.0f;
+			}
+		}
+	}
+
+	return pTable;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Tests the ray's whole length against the box face axes, the same
+//			ones ClipRayToHitbox and IntersectRayWithOBB check first. Swept
+//			boxes are handled by growing each hitbox by the ray's extents.
+//			Boxes that aren't separated on any of them are left for the exact
+//			test, in order, so the result is the same as testing every box.
+//-----------------------------------------------------------------------------
+int CTFHitboxTables::GetCandidates( const HitboxSetTable_t *pTable, const Ray_t &ray, matrix3x4_t **hitboxbones, int fContentsMask, int *pHitboxes )
+{
+	Vector vecHalfDelta = ray.m_Delta * 0.5f;
+	Vector vecMid = ray.m_Start + vecHalfDelta;
+
+	fltx4 fl4MidX = ReplicateX4( vecMid.x );
+	fltx4 fl4MidY = ReplicateX4( vecMid.y );
+	fltx4 fl4MidZ = ReplicateX4( vecMid.z );
+	fltx4 fl4HalfDeltaX = ReplicateX4( vecHalfDelta.x );
+	fltx4 fl4HalfDeltaY = ReplicateX4( vecHalfDelta.y );
+	fltx4 fl4HalfDeltaZ = ReplicateX4( vecHalfDelta.z );
+	fltx4 fl4ExtentsX = ReplicateX4( ray.m_Extents.x );
+	fltx4 fl4ExtentsY = ReplicateX4( ray.m_Extents.y );
+	fltx4 fl4ExtentsZ = ReplicateX4( ray.m_Extents.z );
+	fltx4 fl4Margin = ReplicateX4( HITBOX_TABLE_MARGIN );
+
+	int nCandidates = 0;
+	int nPadded = pTable->iBone.Count();
+	for ( int iGroup = 0; iGroup < nPadded; iGroup += 4 )
+	{
+		// One register per matrix element, one lane per box
+		ALIGN16 float flMatrix[12][4] ALIGN16_POST;
+		for ( int k = 0; k < 4; k++ )
+		{
+			const float *pBone = hitboxbones[ pTable->iBone[iGroup + k] ]->Base();
+			for ( int n = 0; n < 12; n++ )
+			{
+				flMatrix[n][k] = pBone[n];
+			}
+		}
+
+		// Ray midpoint relative to the bone origin
+		fltx4 fl4DeltaX = SubSIMD( fl4MidX, LoadAlignedSIMD( flMatrix[3] ) );
+		fltx4 fl4DeltaY = SubSIMD( fl4MidY, LoadAlignedSIMD( flMatrix[7] ) );
+		fltx4 fl4DeltaZ = SubSIMD( fl4MidZ, LoadAlignedSIMD( flMatrix[11] ) );
+
+		fltx4 fl4Separated = Four_Zeros;
+		for ( int j = 0; j < 3; j++ )
+		{
+			fltx4 fl4AxisX = LoadAlignedSIMD( flMatrix[j] );
+			fltx4 fl4AxisY = LoadAlignedSIMD( flMatrix[4 + j] );
+			fltx4 fl4AxisZ = LoadAlignedSIMD( flMatrix[8 + j] );
+
+			fltx4 fl4Coord = MaddSIMD( fl4DeltaZ, fl4AxisZ, MaddSIMD( fl4DeltaY, fl4AxisY, MulSIMD( fl4DeltaX, fl4AxisX ) ) );
+			fl4Coord = SubSIMD( fl4Coord, LoadUnalignedSIMD( &pTable->flCenter[j][iGroup] ) );
+
+			fltx4 fl4HalfDelta = MaddSIMD( fl4HalfDeltaZ, fl4AxisZ, MaddSIMD( fl4HalfDeltaY, fl4AxisY, MulSIMD( fl4HalfDeltaX, fl4AxisX ) ) );
+			fltx4 fl4Reach = AddSIMD( LoadUnalignedSIMD( &pTable->flExtents[j][iGroup] ), fabs( fl4HalfDelta ) );
+			fl4Reach = MaddSIMD( fl4ExtentsX, fabs( fl4AxisX ), fl4Reach );
+			fl4Reach = MaddSIMD( fl4ExtentsY, fabs( fl4AxisY ), fl4Reach );
+			fl4Reach = MaddSIMD( fl4ExtentsZ, fabs( fl4AxisZ ), fl4Reach );
+			fl4Reach = AddSIMD( fl4Reach, fl4Margin );
+
+			fl4Separated = OrSIMD( fl4Separated, CmpGtSIMD( fabs( fl4Coord ), fl4Reach ) );
+		}
+
+		int nSeparated = TestSignSIMD( fl4Separated );
+		for ( int k = 0; k < 4; k++ )
+		{
+			int i = iGroup + k;
+			if ( !( nSeparated & ( 1 << k ) ) && ( pTable->fContents[i] & fContentsMask ) )
+			{
+				pHitboxes[nCandidates++] = i;
+			}
+		}
+	}
+
+	return nCandidates;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CTFHitboxTables::TraceToStudio( const model_t *pModel, const Ray_t &ray, CStudioHdr *pStudioHdr, int iHitboxSet, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &tr )
+{
+	mstudiohitboxset_t *set = pStudioHdr->pHitboxSet( iHitboxSet );
+
+	// The table assumes unscaled bones, TraceToStudio rescales the ray itself
+	const HitboxSetTable_t *pTable = NULL;
+	if ( tf_hitbox_table.GetBool() && flScale >= 1.0f-FLT_EPSILON && flScale <= 1.0f+FLT_EPSILON )
+	{
+		pTable = GetTable( pModel, pStudioHdr, iHitboxSet );
+	}
+
+	if ( !pTable )
+		return ::TraceToStudio( physprops, ray, pStudioHdr, set, hitboxbones, fContentsMask, vecOrigin, flScale, tr );
+
+	int *pHitboxes = (int *)stackalloc( pTable->iBone.Count() * sizeof( int ) );
+	int nHitboxes = GetCandidates( pTable, ray, hitboxbones, fContentsMask, pHitboxes );
+
+	m_nTraces++;
+	m_nHitboxesTotal += pTable->nHitboxes;
+	m_nHitboxesTested += nHitboxes;
+
+	return TraceToStudioHitboxes( physprops, ray, pStudioHdr, set, hitboxbones, pHitboxes, nHitboxes, fContentsMask, vecOrigin, flScale, tr );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: tf_hitbox_bench. Traces the same random rays and melee hull sweeps
+//			at every animating entity through the full studio hitbox trace and
+//			through the table, and checks the two agree.
+//-----------------------------------------------------------------------------
+struct HitboxBenchRay_t
+{
+	Vector	vecStart;
+	Vector	vecEnd;
+	bool	bHull;
+};
+
+static void HitboxBenchTrace( const HitboxBenchRay_t &bench, Ray_t &ray )
+{
+	// Same volume CTFWeaponBaseMelee::DoSwingTrace sweeps
+	static Vector vecSwingMins( -18, -18, -18 );
+	static Vector vecSwingMaxs( 18, 18, 18 );
+
+	if ( bench.bHull )
+	{
+		ray.Init( bench.vecStart, bench.vecEnd, vecSwingMins, vecSwingMaxs );
+	}
+	else
+	{
+		ray.Init( bench.vecStart, bench.vecEnd );
+	}
+}
+
+CON_COMMAND( tf_hitbox_bench, "Compares the full studio hitbox trace against the hitbox tables on every animating entity. Usage: tf_hitbox_bench [rays per entity]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nRays = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 1000;
+
+	CUniformRandomStream random;
+	random.SetSeed( 0 );
+
+	CUtlVector<HitboxBenchRay_t> rays;
+	rays.SetCount( nRays );
+
+	CCycleCount studioTime, tableTime;
+	int nEntities = 0, nHits = 0, nMismatches = 0;
+	int nTraces = 0, nHitboxesTotal = 0, nHitboxesTested = 0;
+
+	matrix3x4_t *hitboxbones[MAXSTUDIOBONES];
+	int hitboxes[MAXSTUDIOBONES];
+
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		CBaseAnimating *pAnimating = pEntity->GetBaseAnimating();
+		if ( !pAnimating || pAnimating->IsEffectActive( EF_NODRAW ) )
+			continue;
+
+		CStudioHdr *pStudioHdr = pAnimating->GetModelPtr();
+		if ( !pStudioHdr || pAnimating->GetHitboxSet() >= pStudioHdr->numhitboxsets() )
+			continue;
+
+		mstudiohitboxset_t *set = pStudioHdr->pHitboxSet( pAnimating->GetHitboxSet() );
+		if ( !set || !set->numhitboxes || set->numhitboxes > MAXSTUDIOBONES )
+			continue;
+
+		const HitboxSetTable_t *pTable = TFHitboxTables()->GetTable( pAnimating->GetModel(), pStudioHdr, pAnimating->GetHitboxSet() );
+		if ( !pTable )
+			continue;
+
+		pAnimating->GetBoneCache()->ReadCachedBonePointers( hitboxbones, pStudioHdr->numbones() );
+
+		// Rays from all around the entity at random points in its bounds, every other one swept like a melee swing
+		Vector vecMins, vecMaxs;
+		pAnimating->CollisionProp()->WorldSpaceSurroundingBounds( &vecMins, &vecMaxs );
+		Vector vecCenter = ( vecMins + vecMaxs ) * 0.5f;
+		float flRadius = ( vecMaxs - vecMins ).Length() * 0.5f + 64.0f;
+
+		for ( int i = 0; i < nRays; i++ )
+		{
+			Vector vecDir( random.RandomFloat( -1, 1 ), random.RandomFloat( -1, 1 ), random.RandomFloat( -1, 1 ) );
+			VectorNormalize( vecDir );
+
+			Vector vecTarget( random.RandomFloat( vecMins.x, vecMaxs.x ), random.RandomFloat( vecMins.y, vecMaxs.y ), random.RandomFloat( vecMins.z, vecMaxs.z ) );
+
+			rays[i].vecStart = vecCenter + vecDir * flRadius;
+			rays[i].vecEnd = rays[i].vecStart + ( vecTarget - rays[i].vecStart ) * 2.0f;
+			rays[i].bHull = ( i & 1 ) != 0;
+		}
+
+		CUtlVector<trace_t> studioTraces, tableTraces;
+		CUtlVector<bool> studioHits, tableHits;
+		studioTraces.SetCount( nRays );
+		tableTraces.SetCount( nRays );
+		studioHits.SetCount( nRays );
+		tableHits.SetCount( nRays );
+
+		CFastTimer timer;
+		timer.Start();
+		for ( int i = 0; i < nRays; i++ )
+		{
+			Ray_t ray;
+			HitboxBenchTrace( rays[i], ray );
+			studioHits[i] = ::TraceToStudio( physprops, ray, pStudioHdr, set, hitboxbones, MASK_SHOT, pAnimating->GetAbsOrigin(), 1.0f, studioTraces[i] );
+		}
+		timer.End();
+		studioTime += timer.GetDuration();
+
+		timer.Start();
+		for ( int i = 0; i < nRays; i++ )
+		{
+			Ray_t ray;
+			HitboxBenchTrace( rays[i], ray );
+
+			int nHitboxes = TFHitboxTables()->GetCandidates( pTable, ray, hitboxbones, MASK_SHOT, hitboxes );
+			tableHits[i] = TraceToStudioHitboxes( physprops, ray, pStudioHdr, set, hitboxbones, hitboxes, nHitboxes, MASK_SHOT, pAnimating->GetAbsOrigin(), 1.0f, tableTraces[i] );
+			nHitboxesTested += nHitboxes;
+		}
+		timer.End();
+		tableTime += timer.GetDuration();
+
+		nTraces += nRays;
+		nHitboxesTotal += set->numhitboxes * nRays;
+
+		for ( int i = 0; i < nRays; i++ )
+		{
+			const trace_t &tr = tableTraces[i];
+			const trace_t &studioTrace = studioTraces[i];
+			if ( tableHits[i] )
+			{
+				nHits++;
+			}
+
+			if ( tableHits[i] != studioHits[i] || tr.fraction != studioTrace.fraction || tr.startsolid != studioTrace.startsolid ||
+				( tableHits[i] && tr.hitbox != studioTrace.hitbox ) )
+			{
+				nMismatches++;
+			}
+		}
+
+		nEntities++;
+	}
+
+	if ( !nTraces )
+	{
+		Msg( "tf_hitbox_bench: no animating entities with hitboxes.\n" );
+		return;
+	}
+
+	Msg( "tf_hitbox_bench: %d entities, %d rays each, half of them swept by the melee hull\n", nEntities, nRays );
+	Msg( "  studio: %.3f usec per trace\n", studioTime.GetMicrosecondsF() / nTraces );
+	Msg( "  table:  %.3f usec per trace, %.2f of %.2f hitboxes tested per trace\n", tableTime.GetMicrosecondsF() / nTraces, (float)nHitboxesTested / nTraces, (float)nHitboxesTotal / nTraces );
+	Msg( "  %d hits, %d mismatches\n", nHits, nMismatches );
+
+	CTFHitboxTables *pTables = TFHitboxTables();
+	if ( pTables->m_nTraces )
+	{
+		Msg( "  in game: %d traces, %.2f of %.2f hitboxes tested per trace\n", pTables->m_nTraces, (float)pTables->m_nHitboxesTested / pTables->m_nTraces, (float)pTables->m_nHitboxesTotal / pTables->m_nTraces );
+	}
+}
@@ -0,0 +1,67 @@
+//====== Copyright  1996-2005, Valve Corporation, All rights reserved. =======
+//
+// Purpose: Per model hitbox tables for the hitscan and melee narrowphase. Each
+//			hitbox set's boxes are copied out of the studio header once, four to
+//			a group in SoA form, so a trace can reject most of a model's boxes
+//			four at a time and only hand the rest to TraceToStudio.
+//
+//=============================================================================
+#ifndef TF_HITBOX_TABLE_H
+#define TF_HITBOX_TABLE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "igamesystem.h"
+#include "tier1/utlmap.h"
+
+class CStudioHdr;
+struct model_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: One hitbox set, padded to a multiple of four boxes. The padding
+//			boxes have no contents so no trace ever keeps them.
+//-----------------------------------------------------------------------------
+struct HitboxSetTable_t
+{
+	int					nHitboxes;
+	CUtlVector<int>		iBone;
+	CUtlVector<int>		fContents;			// contents of the box's bone
+	CUtlVector<float>	flCenter[3];		// box centers in bone space
+	CUtlVector<float>	flExtents[3];		// half sizes
+};
+
+class CTFHitboxTables : public CAutoGameSystem
+{
+public:
+	CTFHitboxTables();
+
+	virtual void LevelShutdownPostEntity();
+
+	// Drop in for TraceToStudio. Does the full trace itself when the table can't be used.
+	bool	TraceToStudio( const model_t *pModel, const Ray_t &ray, CStudioHdr *pStudioHdr, int iHitboxSet, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &tr );
+
+	// Fills pHitboxes with the boxes the ray might touch, in order, and returns how many
+	int		GetCandidates( const HitboxSetTable_t *pTable, const Ray_t &ray, matrix3x4_t **hitboxbones, int fContentsMask, int *pHitboxes );
+
+	const HitboxSetTable_t *GetTable( const model_t *pModel, CStudioHdr *pStudioHdr, int iHitboxSet );
+
+	void	Clear( void );
+
+	// Stats
+	int		m_nTraces;
+	int		m_nHitboxesTotal;
+	int		m_nHitboxesTested;
+
+private:
+	struct ModelTables_t
+	{
+		CUtlVector<HitboxSetTable_t *>	sets;	// built on first use
+	};
+
+	CUtlMap<const model_t *, ModelTables_t *>	m_Models;
+};
+
+extern CTFHitboxTables *TFHitboxTables();
+
+#endif // TF_HITBOX_TABLE_H
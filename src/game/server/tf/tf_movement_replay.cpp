@@ -0,0 +1,664 @@
+//====== Copyright  1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Records players' usercmds along with the state movement starts
+//			from, and replays them offline against the loaded map.
+//
+//			movement_record_start writes one track per stretch of commands
+//			that only movement touched. A track ends as soon as something
+//			else moves the player between two commands (a teleport, a
+//			knockback, death), because that can't be replayed on its own.
+//
+//			movement_replay runs every track through PlayerRunCommand on a
+//			fake client, checks that each command leaves the player exactly
+//			where it did when recorded, and reports what ProcessMovement
+//			cost per command. Nothing else in the world runs meanwhile, so
+//			it works the same on a dedicated server with nobody connected.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tf_movement_replay.h"
+#include "tf_player.h"
+#include "igamemovement.h"
+#include "in_buttons.h"
+#include "world.h"
+#include "movehelper_server.h"
+#include "filesystem.h"
+#include "tier0/fasttimer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define MOVEREPLAY_MAGIC			MAKEID( 'O', 'F', 'M', 'R' )
+#define MOVEREPLAY_VERSION			1
+#define MOVEREPLAY_MAP_NAME			64
+#define MOVEREPLAY_NAME_SIZE		32
+
+// Tracks shorter than this aren't worth keeping
+#define MOVEREPLAY_MIN_COMMANDS		8
+
+// Buttons that would make the replay bot shoot, build or use things for real.
+// Note: the zombie lunge is on IN_ATTACK2 too, so tracks that lunge won't match
+#define MOVEREPLAY_MASKED_BUTTONS	( IN_ATTACK | IN_ATTACK2 | IN_RELOAD | IN_USE | IN_GRENADE1 | IN_GRENADE2 | IN_WEAPON1 | IN_WEAPON2 )
+
+#pragma pack( push, 1 )
+
+struct MoveReplayFileHeader_t
+{
+	int32	nMagic;
+	int32	nVersion;
+	int32	nTracks;
+	float	flTickInterval;
+	char	szMap[ MOVEREPLAY_MAP_NAME ];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything movement reads off the player that isn't in the usercmd
+//-----------------------------------------------------------------------------
+struct MoveReplayStart_t
+{
+	char	szName[ MOVEREPLAY_NAME_SIZE ];
+	char	szWeapon[ MOVEREPLAY_NAME_SIZE ];
+	int32	nTeam;
+	int32	nClass;
+	int32	nCommands;
+
+	Vector	vecOrigin;
+	Vector	vecVelocity;
+	Vector	vecBaseVelocity;
+	QAngle	angEyes;
+	float	flMaxSpeed;
+	int32	fFlags;
+	int32	nMoveType;
+	int32	iGroundEntity;		// -1 in the air
+	int32	nButtons;
+
+	float	flDucktime;
+	float	flDuckJumpTime;
+	float	flJumpTime;
+	float	flFallVelocity;
+	uint8	bDucked;
+	uint8	bDucking;
+	uint8	bInDuckJump;
+
+	uint8	bAirDash;
+	int32	nAirDashCount;
+	uint8	bJumping;
+	uint8	bJumpBuffer;
+	float	flCSlideDuration;
+	float	flNextLungeTime;
+};
+
+struct MoveReplayCommand_t
+{
+	int32	nCommandNumber;
+	int32	nTickCount;
+	int32	nTickBase;
+	QAngle	angView;
+	float	flForwardMove;
+	float	flSideMove;
+	float	flUpMove;
+	int32	nButtons;
+	int32	nRandomSeed;
+	uint8	nImpulse;
+
+	// Where the command left the player
+	Vector	vecOrigin;
+	Vector	vecVelocity;
+};
+
+#pragma pack( pop )
+
+struct MoveReplayTrack_t
+{
+	int									iUserID;
+	MoveReplayStart_t					start;
+	CUtlVector< MoveReplayCommand_t >	commands;
+};
+
+// The fake client a replay is running on, and what its last move cost
+static CBasePlayer	*s_pReplayPlayer = NULL;
+static CFastTimer	s_ReplayMoveTimer;
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects tracks for every player (or one) while recording
+//-----------------------------------------------------------------------------
+class CMovementRecorder : public CAutoGameSystem
+{
+public:
+	CMovementRecorder() : CAutoGameSystem( "CMovementRecorder" )
+	{
+		m_bRecording = false;
+		m_iUserID = 0;
+		m_szFileName[0] = '\0';
+		Q_memset( m_pTracks, 0, sizeof( m_pTracks ) );
+	}
+
+	virtual void LevelShutdownPreEntity()
+	{
+		Stop();
+	}
+
+	bool	IsRecording( void ) const	{ return m_bRecording; }
+	void	Start( const char *pszFileName, int iUserID );
+	void	Stop( void );
+
+	void	StartCommand( CBasePlayer *pPlayer, CUserCmd *pCmd );
+	void	FinishMove( CBasePlayer *pPlayer, const CMoveData *pMove );
+
+private:
+	void	EndTrack( int iSlot );
+	bool	CanStartTrack( CTFPlayer *pPlayer );
+	void	SaveStart( CTFPlayer *pPlayer, MoveReplayStart_t &start );
+
+	bool							m_bRecording;
+	int								m_iUserID;		// 0 records everybody
+	char							m_szFileName[ MAX_PATH ];
+
+	MoveReplayTrack_t				*m_pTracks[ MAX_PLAYERS ];
+	CUtlVector< MoveReplayTrack_t * >	m_Finished;
+};
+
+static CMovementRecorder g_MovementRecorder;
+
+void CMovementRecorder::Start( const char *pszFileName, int iUserID )
+{
+	Stop();
+
+	Q_strncpy( m_szFileName, pszFileName, sizeof( m_szFileName ) );
+	Q_SetExtension( m_szFileName, ".ofmove", sizeof( m_szFileName ) );
+	m_iUserID = iUserID;
+	m_bRecording = true;
+
+	Msg( "Recording movement to %s\n", m_szFileName );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes out everything recorded so far
+//-----------------------------------------------------------------------------
+void CMovementRecorder::Stop( void )
+{
+	if ( !m_bRecording )
+		return;
+
+	m_bRecording = false;
+
+	for ( int i = 0; i < MAX_PLAYERS; i++ )
+	{
+		EndTrack( i );
+	}
+
+	MoveReplayFileHeader_t header;
+	Q_memset( &header, 0, sizeof( header ) );
+	header.nMagic = MOVEREPLAY_MAGIC;
+	header.nVersion = MOVEREPLAY_VERSION;
+	header.nTracks = m_Finished.Count();
+	header.flTickInterval = gpGlobals->interval_per_tick;
+	Q_strncpy( header.szMap, STRING( gpGlobals->mapname ), sizeof( header.szMap ) );
+
+	CUtlBuffer buf;
+	buf.Put( &header, sizeof( header ) );
+
+	int nCommands = 0;
+	FOR_EACH_VEC( m_Finished, i )
+	{
+		MoveReplayTrack_t *pTrack = m_Finished[i];
+		pTrack->start.nCommands = pTrack->commands.Count();
+		buf.Put( &pTrack->start, sizeof( pTrack->start ) );
+		buf.Put( pTrack->commands.Base(), pTrack->commands.Count() * sizeof( MoveReplayCommand_t ) );
+		nCommands += pTrack->commands.Count();
+	}
+
+	if ( g_pFullFileSystem->WriteFile( m_szFileName, "MOD", buf ) )
+	{
+		Msg( "Wrote %d tracks, %d commands to %s\n", m_Finished.Count(), nCommands, m_szFileName );
+	}
+	else
+	{
+		Warning( "Unable to write movement recording %s\n", m_szFileName );
+	}
+
+	m_Finished.PurgeAndDeleteElements();
+}
+
+void CMovementRecorder::EndTrack( int iSlot )
+{
+	MoveReplayTrack_t *pTrack = m_pTracks[iSlot];
+	if ( !pTrack )
+		return;
+
+	m_pTracks[iSlot] = NULL;
+
+	if ( pTrack->commands.Count() < MOVEREPLAY_MIN_COMMANDS )
+	{
+		delete pTrack;
+		return;
+	}
+
+	m_Finished.AddToTail( pTrack );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A grappling hook or a lunge in progress lives outside the player,
+//			wait for it to finish before starting a track.
+//-----------------------------------------------------------------------------
+bool CMovementRecorder::CanStartTrack( CTFPlayer *pPlayer )
+{
+	if ( !pPlayer->IsAlive() || pPlayer->GetMoveType() != MOVETYPE_WALK || pPlayer->GetVehicle() )
+		return false;
+
+	if ( pPlayer->m_Shared.GetHook() || pPlayer->m_Shared.IsLunging() )
+		return false;
+
+	CBaseEntity *pGround = pPlayer->GetGroundEntity();
+	return !pGround || pGround->IsWorld();
+}
+
+void CMovementRecorder::SaveStart( CTFPlayer *pPlayer, MoveReplayStart_t &start )
+{
+	Q_memset( &start, 0, sizeof( start ) );
+	Q_strncpy( start.szName, pPlayer->GetPlayerName(), sizeof( start.szName ) );
+	if ( pPlayer->GetActiveWeapon() )
+	{
+		Q_strncpy( start.szWeapon, pPlayer->GetActiveWeapon()->GetClassname(), sizeof( start.szWeapon ) );
+	}
+
+	start.nTeam = pPlayer->GetTeamNumber();
+	start.nClass = pPlayer->GetPlayerClass()->GetClassIndex();
+
+	start.vecOrigin = pPlayer->GetAbsOrigin();
+	start.vecVelocity = pPlayer->GetAbsVelocity();
+	start.vecBaseVelocity = pPlayer->GetBaseVelocity();
+	start.angEyes = pPlayer->pl.v_angle;
+	start.flMaxSpeed = pPlayer->MaxSpeed();
+	start.fFlags = pPlayer->GetFlags() & ~FL_FAKECLIENT;
+	start.nMoveType = pPlayer->GetMoveType();
+	start.iGroundEntity = pPlayer->GetGroundEntity() ? 0 : -1;
+	start.nButtons = pPlayer->m_nButtons;
+
+	start.flDucktime = pPlayer->m_Local.m_flDucktime;
+	start.flDuckJumpTime = pPlayer->m_Local.m_flDuckJumpTime;
+	start.flJumpTime = pPlayer->m_Local.m_flJumpTime;
+	start.flFallVelocity = pPlayer->m_Local.m_flFallVelocity;
+	start.bDucked = pPlayer->m_Local.m_bDucked;
+	start.bDucking = pPlayer->m_Local.m_bDucking;
+	start.bInDuckJump = pPlayer->m_Local.m_bInDuckJump;
+
+	start.bAirDash = pPlayer->m_Shared.IsAirDashing();
+	start.nAirDashCount = pPlayer->m_Shared.GetAirDashCount();
+	start.bJumping = pPlayer->m_Shared.IsJumping();
+	start.bJumpBuffer = pPlayer->m_Shared.GetJumpBuffer();
+	start.flCSlideDuration = pPlayer->m_Shared.GetCSlideDuration();
+	start.flNextLungeTime = pPlayer->m_Shared.GetNextLungeTime();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Ends the player's track if something besides movement moved them
+//			since the last command, and adds this command to it.
+//-----------------------------------------------------------------------------
+void CMovementRecorder::StartCommand( CBasePlayer *pBasePlayer, CUserCmd *pCmd )
+{
+	CTFPlayer *pPlayer = ToTFPlayer( pBasePlayer );
+	if ( !pPlayer || pPlayer == s_pReplayPlayer )
+		return;
+
+	if ( m_iUserID && pPlayer->GetUserID() != m_iUserID )
+		return;
+
+	int iSlot = pPlayer->entindex() - 1;
+	if ( iSlot < 0 || iSlot >= MAX_PLAYERS )
+		return;
+
+	MoveReplayTrack_t *pTrack = m_pTracks[iSlot];
+	if ( pTrack )
+	{
+		const MoveReplayCommand_t &last = pTrack->commands.Tail();
+		if ( pTrack->iUserID != pPlayer->GetUserID() ||
+			!pPlayer->IsAlive() ||
+			pPlayer->GetAbsOrigin() != last.vecOrigin ||
+			pPlayer->GetAbsVelocity() != last.vecVelocity )
+		{
+			EndTrack( iSlot );
+			pTrack = NULL;
+		}
+	}
+
+	if ( !pTrack )
+	{
+		if ( !CanStartTrack( pPlayer ) )
+			return;
+
+		pTrack = new MoveReplayTrack_t;
+		pTrack->iUserID = pPlayer->GetUserID();
+		SaveStart( pPlayer, pTrack->start );
+		m_pTracks[iSlot] = pTrack;
+	}
+
+	MoveReplayCommand_t &command = pTrack->commands[ pTrack->commands.AddToTail() ];
+	Q_memset( &command, 0, sizeof( command ) );
+	command.nCommandNumber = pCmd->command_number;
+	command.nTickCount = pCmd->tick_count;
+	command.nTickBase = TIME_TO_TICKS( pPlayer->GetTimeBase() );
+	command.angView = pCmd->viewangles;
+	command.flForwardMove = pCmd->forwardmove;
+	command.flSideMove = pCmd->sidemove;
+	command.flUpMove = pCmd->upmove;
+	command.nButtons = pCmd->buttons;
+	command.nRandomSeed = pCmd->random_seed;
+	command.nImpulse = pCmd->impulse;
+
+	// Until FinishMove says otherwise the command didn't move us
+	command.vecOrigin = pPlayer->GetAbsOrigin();
+	command.vecVelocity = pPlayer->GetAbsVelocity();
+}
+
+void CMovementRecorder::FinishMove( CBasePlayer *pPlayer, const CMoveData *pMove )
+{
+	int iSlot = pPlayer->entindex() - 1;
+	if ( iSlot < 0 || iSlot >= MAX_PLAYERS || !m_pTracks[iSlot] )
+		return;
+
+	MoveReplayCommand_t &command = m_pTracks[iSlot]->commands.Tail();
+	command.vecOrigin = pMove->GetAbsOrigin();
+	command.vecVelocity = pMove->m_vecVelocity;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hooks from CTFPlayerMove
+//-----------------------------------------------------------------------------
+void MovementReplay_StartCommand( CBasePlayer *pPlayer, CUserCmd *pCmd )
+{
+	if ( g_MovementRecorder.IsRecording() )
+	{
+		g_MovementRecorder.StartCommand( pPlayer, pCmd );
+	}
+}
+
+void MovementReplay_SetupMove( CBasePlayer *pPlayer )
+{
+	if ( pPlayer == s_pReplayPlayer )
+	{
+		s_ReplayMoveTimer.Start();
+	}
+}
+
+void MovementReplay_FinishMove( CBasePlayer *pPlayer, const CMoveData *pMove )
+{
+	if ( pPlayer == s_pReplayPlayer )
+	{
+		s_ReplayMoveTimer.End();
+	}
+	else if ( g_MovementRecorder.IsRecording() )
+	{
+		g_MovementRecorder.FinishMove( pPlayer, pMove );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Puts the replay player back where the track starts
+//-----------------------------------------------------------------------------
+static void RestoreStart( CTFPlayer *pPlayer, const MoveReplayStart_t &start )
+{
+	pPlayer->SetMoveType( (MoveType_t)start.nMoveType );
+	pPlayer->SetGroundEntity( NULL );
+	pPlayer->Teleport( &start.vecOrigin, &start.angEyes, &start.vecVelocity );
+	pPlayer->SetBaseVelocity( start.vecBaseVelocity );
+	pPlayer->SnapEyeAngles( start.angEyes );
+	pPlayer->pl.v_angle = start.angEyes;
+	pPlayer->SetMaxSpeed( start.flMaxSpeed );
+
+	pPlayer->RemoveFlag( ~FL_FAKECLIENT );
+	pPlayer->AddFlag( start.fFlags );
+	if ( start.iGroundEntity >= 0 )
+	{
+		pPlayer->SetGroundEntity( GetWorldEntity() );
+	}
+	pPlayer->m_nButtons = start.nButtons & ~MOVEREPLAY_MASKED_BUTTONS;
+
+	pPlayer->m_Local.m_flDucktime = start.flDucktime;
+	pPlayer->m_Local.m_flDuckJumpTime = start.flDuckJumpTime;
+	pPlayer->m_Local.m_flJumpTime = start.flJumpTime;
+	pPlayer->m_Local.m_flFallVelocity = start.flFallVelocity;
+	pPlayer->m_Local.m_bDucked = start.bDucked != 0;
+	pPlayer->m_Local.m_bDucking = start.bDucking != 0;
+	pPlayer->m_Local.m_bInDuckJump = start.bInDuckJump != 0;
+	pPlayer->SetCollisionBounds( pPlayer->GetPlayerMins(), pPlayer->GetPlayerMaxs() );
+
+	pPlayer->m_Shared.SetAirDash( start.bAirDash != 0 );
+	pPlayer->m_Shared.SetAirDashCount( start.nAirDashCount );
+	pPlayer->m_Shared.SetJumping( start.bJumping != 0 );
+	pPlayer->m_Shared.SetJumpBuffer( start.bJumpBuffer != 0 );
+	pPlayer->m_Shared.SetCSlideDuration( start.flCSlideDuration );
+	pPlayer->m_Shared.SetNextLungeTime( start.flNextLungeTime );
+}
+
+static void ReplayCommand( CTFPlayer *pPlayer, const MoveReplayCommand_t &command )
+{
+	CUserCmd cmd;
+	cmd.command_number = command.nCommandNumber;
+	cmd.tick_count = command.nTickCount;
+	cmd.viewangles = command.angView;
+	cmd.forwardmove = command.flForwardMove;
+	cmd.sidemove = command.flSideMove;
+	cmd.upmove = command.flUpMove;
+	cmd.buttons = command.nButtons & ~MOVEREPLAY_MASKED_BUTTONS;
+	cmd.impulse = 0;
+	cmd.random_seed = command.nRandomSeed;
+
+	pPlayer->SetTimeBase( TICKS_TO_TIME( command.nTickBase ) );
+	pPlayer->PlayerRunCommand( &cmd, MoveHelperServer() );
+}
+
+static int SortFloats( const float *a, const float *b )
+{
+	if ( *a < *b )
+		return -1;
+
+	return ( *a > *b ) ? 1 : 0;
+}
+
+static float Percentile( const CUtlVector< float > &sorted, float flPercent )
+{
+	if ( !sorted.Count() )
+		return 0.0f;
+
+	int i = clamp( (int)( flPercent * 0.01f * sorted.Count() ), 0, sorted.Count() - 1 );
+	return sorted[i];
+}
+
+CON_COMMAND( movement_record_start, "Records players' movement for movement_replay. Usage: movement_record_start <file> [userid]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: movement_record_start <file> [userid]\n" );
+		return;
+	}
+
+	g_MovementRecorder.Start( args[1], ( args.ArgC() > 2 ) ? atoi( args[2] ) : 0 );
+}
+
+CON_COMMAND( movement_record_stop, "Stops recording movement and writes the file." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_MovementRecorder.Stop();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Replays a recording on a fake client and checks every command
+//			ends up where it did live
+//-----------------------------------------------------------------------------
+CON_COMMAND( movement_replay, "Replays a movement recording against the loaded map, checks the results match and times them. Usage: movement_replay <file> [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: movement_replay <file> [iterations]\n" );
+		return;
+	}
+
+	if ( s_pReplayPlayer )
+		return;
+
+	char szFileName[ MAX_PATH ];
+	Q_strncpy( szFileName, args[1], sizeof( szFileName ) );
+	Q_SetExtension( szFileName, ".ofmove", sizeof( szFileName ) );
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( 1, atoi( args[2] ) ) : 1;
+
+	CUtlBuffer buf;
+	if ( !g_pFullFileSystem->ReadFile( szFileName, "MOD", buf ) )
+	{
+		Warning( "Unable to read %s\n", szFileName );
+		return;
+	}
+
+	MoveReplayFileHeader_t header;
+	buf.Get( &header, sizeof( header ) );
+	if ( !buf.IsValid() || header.nMagic != MOVEREPLAY_MAGIC || header.nVersion != MOVEREPLAY_VERSION )
+	{
+		Warning( "%s is not a version %d movement recording\n", szFileName, MOVEREPLAY_VERSION );
+		return;
+	}
+
+	if ( Q_stricmp( header.szMap, STRING( gpGlobals->mapname ) ) || header.flTickInterval != gpGlobals->interval_per_tick )
+	{
+		Warning( "%s was recorded on %s at %.4f, this is %s at %.4f\n", szFileName,
+			header.szMap, header.flTickInterval, STRING( gpGlobals->mapname ), gpGlobals->interval_per_tick );
+		return;
+	}
+
+	CUtlVector< MoveReplayTrack_t * > tracks;
+	for ( int i = 0; i < header.nTracks; i++ )
+	{
+		MoveReplayTrack_t *pTrack = new MoveReplayTrack_t;
+		buf.Get( &pTrack->start, sizeof( pTrack->start ) );
+		if ( !buf.IsValid() || pTrack->start.nCommands < 0 )
+		{
+			delete pTrack;
+			break;
+		}
+
+		pTrack->commands.SetCount( pTrack->start.nCommands );
+		buf.Get( pTrack->commands.Base(), pTrack->commands.Count() * sizeof( MoveReplayCommand_t ) );
+		if ( !buf.IsValid() )
+		{
+			delete pTrack;
+			break;
+		}
+
+		tracks.AddToTail( pTrack );
+	}
+
+	if ( tracks.Count() != header.nTracks )
+	{
+		Warning( "%s is truncated, replaying the first %d of %d tracks\n", szFileName, tracks.Count(), header.nTracks );
+	}
+
+	edict_t *pEdict = engine->CreateFakeClient( "movement_replay" );
+	if ( !pEdict )
+	{
+		Warning( "No free player slot to replay movement on\n" );
+		tracks.PurgeAndDeleteElements();
+		return;
+	}
+
+	CTFPlayer *pPlayer = ToTFPlayer( CBaseEntity::Instance( pEdict ) );
+	pPlayer->ClearFlags();
+	pPlayer->AddFlag( FL_CLIENT | FL_FAKECLIENT );
+
+	float flSaveCurTime = gpGlobals->curtime;
+	float flSaveFrameTime = gpGlobals->frametime;
+	s_pReplayPlayer = pPlayer;
+
+	CUtlVector< float > times;
+	int nCommands = 0;
+	int nDiverged = 0;
+
+	FOR_EACH_VEC( tracks, iTrack )
+	{
+		const MoveReplayTrack_t *pTrack = tracks[iTrack];
+		const MoveReplayStart_t &start = pTrack->start;
+
+		if ( pPlayer->GetTeamNumber() != start.nTeam || pPlayer->GetPlayerClass()->GetClassIndex() != start.nClass )
+		{
+			pPlayer->ChangeTeam( start.nTeam );
+			pPlayer->SetDesiredPlayerClassIndex( start.nClass );
+			pPlayer->ForceRespawn();
+		}
+
+		if ( start.szWeapon[0] )
+		{
+			CBaseCombatWeapon *pWeapon = pPlayer->Weapon_OwnsThisType( start.szWeapon );
+			if ( pWeapon && pWeapon != pPlayer->GetActiveWeapon() )
+			{
+				pPlayer->Weapon_Switch( pWeapon );
+			}
+		}
+
+		for ( int iIteration = 0; iIteration < nIterations; iIteration++ )
+		{
+			RestoreStart( pPlayer, start );
+
+			int iFirstDiverged = -1;
+			FOR_EACH_VEC( pTrack->commands, iCommand )
+			{
+				const MoveReplayCommand_t &command = pTrack->commands[iCommand];
+				ReplayCommand( pPlayer, command );
+				times.AddToTail( s_ReplayMoveTimer.GetDuration().GetMicrosecondsF() );
+
+				// Bit for bit, a difference in the last place still counts
+				if ( iFirstDiverged < 0 &&
+					( Q_memcmp( &pPlayer->GetAbsOrigin(), &command.vecOrigin, sizeof( Vector ) ) ||
+					Q_memcmp( &pPlayer->GetAbsVelocity(), &command.vecVelocity, sizeof( Vector ) ) ) )
+				{
+					iFirstDiverged = iCommand;
+				}
+			}
+			nCommands += pTrack->commands.Count();
+
+			if ( iFirstDiverged >= 0 )
+			{
+				nDiverged++;
+				const Vector &vecExpected = pTrack->commands[iFirstDiverged].vecOrigin;
+				const Vector &vecFinal = pTrack->commands.Tail().vecOrigin;
+				Warning( "  track %d (%s) pass %d: command %d of %d went to (%.3f %.3f %.3f), recorded (%.3f %.3f %.3f); ended %.3f units off\n",
+					iTrack, start.szName, iIteration, iFirstDiverged, pTrack->commands.Count(),
+					pPlayer->GetAbsOrigin().x, pPlayer->GetAbsOrigin().y, pPlayer->GetAbsOrigin().z,
+					vecExpected.x, vecExpected.y, vecExpected.z, ( pPlayer->GetAbsOrigin() - vecFinal ).Length() );
+			}
+		}
+	}
+
+	s_pReplayPlayer = NULL;
+	gpGlobals->curtime = flSaveCurTime;
+	gpGlobals->frametime = flSaveFrameTime;
+	engine->ServerCommand( UTIL_VarArgs( "kickid %d\n", pPlayer->GetUserID() ) );
+
+	times.Sort( SortFloats );
+	double flTotal = 0.0;
+	FOR_EACH_VEC( times, i )
+	{
+		flTotal += times[i];
+	}
+
+	Msg( "%s: %d tracks, %d commands, %d passes\n", szFileName, tracks.Count(), nCommands, nIterations );
+	Msg( "  ProcessMovement usec: mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+		times.Count() ? flTotal / times.Count() : 0.0, Percentile( times, 50 ), Percentile( times, 90 ), Percentile( times, 99 ),
+		times.Count() ? times.Tail() : 0.0f );
+	if ( nDiverged )
+	{
+		Warning( "  %d of %d track passes did not end where they were recorded\n", nDiverged, tracks.Count() * nIterations );
+	}
+	else
+	{
+		Msg( "  every track ended bit-identical to the recording\n" );
+	}
+
+	tracks.PurgeAndDeleteElements();
+}
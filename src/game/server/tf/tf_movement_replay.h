@@ -0,0 +1,23 @@
+//====== Copyright  1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Records players' usercmds along with the state movement starts
+//			from, and replays them offline against the loaded map to check
+//			movement changes for regressions and time them.
+//
+//=============================================================================//
+#ifndef TF_MOVEMENT_REPLAY_H
+#define TF_MOVEMENT_REPLAY_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CBasePlayer;
+class CUserCmd;
+class CMoveData;
+
+// Called by CTFPlayerMove around every command
+void MovementReplay_StartCommand( CBasePlayer *pPlayer, CUserCmd *pCmd );
+void MovementReplay_SetupMove( CBasePlayer *pPlayer );
+void MovementReplay_FinishMove( CBasePlayer *pPlayer, const CMoveData *pMove );
+
+#endif // TF_MOVEMENT_REPLAY_H
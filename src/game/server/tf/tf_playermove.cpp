@@ -10,6 +10,7 @@
 #include "igamemovement.h"
 #include "tf_player.h"
 #include "iservervehicle.h"
+#include "tf_movement_replay.h"
 
 static CMoveData g_MoveData;
 CMoveData *g_pMoveData = &g_MoveData;
@@ -65,6 +66,8 @@ CPlayerMove *PlayerMove()
 void CTFPlayerMove::StartCommand( CBasePlayer *player, CUserCmd *cmd )
 {
 	BaseClass::StartCommand( player, cmd );
+
+	MovementReplay_StartCommand( player, cmd );
 }
 
 //-----------------------------------------------------------------------------
@@ -96,6 +99,8 @@ void CTFPlayerMove::SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 	{
 		pVehicle->SetupMove( player, ucmd, pHelper, move );
 	}
+
+	MovementReplay_SetupMove( player );
 }
 
 
@@ -107,6 +112,8 @@ void CTFPlayerMove::SetupMove( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 //-----------------------------------------------------------------------------
 void CTFPlayerMove::FinishMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *move )
 {
+	MovementReplay_FinishMove( player, move );
+
 	// Call the default FinishMove code.
 	BaseClass::FinishMove( player, ucmd, move );
 	
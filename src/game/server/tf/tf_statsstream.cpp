@@ -0,0 +1,253 @@
+//====== Copyright © 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Streams per-event stats (kills, damage, heals, pickups) to a
+//			compact columnar file per map instead of keeping them in memory.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tf_statsstream.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Don't care about vcr hooks here...
+#undef localtime
+#undef time
+
+#include <time.h>
+
+ConVar tf_stats_stream_dir( "tf_stats_stream_dir", "stats", FCVAR_NONE, "Directory the per-map binary stats streams are written to." );
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+CTFStatsStream::CTFStatsStream() : m_Strings( true )
+{
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+	m_szFileName[0] = '\0';
+	m_nBlocks = 0;
+	m_nBytes = 0;
+
+	for ( int i = 0; i < STATSSTREAM_EVENT_COUNT; i++ )
+	{
+		m_pRows[i] = NULL;
+		m_nRows[i] = 0;
+		m_nTotalRows[i] = 0;
+	}
+}
+
+CTFStatsStream::~CTFStatsStream()
+{
+	Close();
+
+	for ( int i = 0; i < STATSSTREAM_EVENT_COUNT; i++ )
+	{
+		delete [] m_pRows[i];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Starts a new file for this map, <dir>/<map>_YYYYMMDD_HHMMSS.ofstats
+//-----------------------------------------------------------------------------
+bool CTFStatsStream::Open( const char *pszMapName )
+{
+	Close();
+
+	time_t aclock;
+	time( &aclock );
+	struct tm *newtime = localtime( &aclock );
+
+	g_pFullFileSystem->CreateDirHierarchy( tf_stats_stream_dir.GetString(), "MOD" );
+
+	Q_snprintf( m_szFileName, sizeof( m_szFileName ), "%s/%s_%04d%02d%02d_%02d%02d%02d.ofstats",
+		tf_stats_stream_dir.GetString(), pszMapName,
+		newtime->tm_year + 1900, newtime->tm_mon + 1, newtime->tm_mday,
+		newtime->tm_hour, newtime->tm_min, newtime->tm_sec );
+
+	m_hFile = g_pFullFileSystem->Open( m_szFileName, "wb", "MOD" );
+	if ( m_hFile == FILESYSTEM_INVALID_HANDLE )
+	{
+		Warning( "Unable to open stats stream %s for writing.\n", m_szFileName );
+		return false;
+	}
+
+	StatsStreamFileHeader_t header;
+	Q_memset( &header, 0, sizeof( header ) );
+	header.nMagic = STATSSTREAM_MAGIC;
+	header.nVersion = STATSSTREAM_VERSION;
+	header.nHeaderSize = sizeof( StatsStreamFileHeader_t );
+	header.flTickInterval = gpGlobals->interval_per_tick;
+	header.nStartTime = (int32)aclock;
+	Q_strncpy( header.szMap, pszMapName, sizeof( header.szMap ) );
+
+	g_pFullFileSystem->Write( &header, sizeof( header ), m_hFile );
+
+	m_nBlocks = 0;
+	m_nBytes = sizeof( header );
+	m_Strings.RemoveAll();
+	for ( int i = 0; i < STATSSTREAM_EVENT_COUNT; i++ )
+	{
+		m_nRows[i] = 0;
+		m_nTotalRows[i] = 0;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTFStatsStream::Close( void )
+{
+	if ( !IsOpen() )
+		return;
+
+	Flush();
+
+	g_pFullFileSystem->Close( m_hFile );
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTFStatsStream::Flush( void )
+{
+	if ( !IsOpen() )
+		return;
+
+	for ( int i = 0; i < STATSSTREAM_EVENT_COUNT; i++ )
+	{
+		WriteBlock( i );
+	}
+
+	g_pFullFileSystem->Flush( m_hFile );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void *CTFStatsStream::AllocRow( StatsStreamEvent_t iEvent )
+{
+	Assert( IsOpen() );
+
+	const StatsStreamEventDesc_t &desc = g_StatsStreamEvents[iEvent];
+	if ( !m_pRows[iEvent] )
+	{
+		m_pRows[iEvent] = new byte[ desc.nRowSize * STATSSTREAM_BLOCK_ROWS ];
+	}
+
+	if ( m_nRows[iEvent] == STATSSTREAM_BLOCK_ROWS )
+	{
+		WriteBlock( iEvent );
+	}
+
+	byte *pRow = m_pRows[iEvent] + desc.nRowSize * m_nRows[iEvent];
+	Q_memset( pRow, 0, desc.nRowSize );
+	m_nRows[iEvent]++;
+	m_nTotalRows[iEvent]++;
+
+	// Every row type except strings leads with its tick
+	if ( iEvent != STATSSTREAM_STRING )
+	{
+		*(int32 *)pRow = gpGlobals->tickcount;
+	}
+
+	return pRow;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Transposes the staged rows into columns and writes them out
+//-----------------------------------------------------------------------------
+void CTFStatsStream::WriteBlock( int iEvent )
+{
+	int nRows = m_nRows[iEvent];
+	if ( nRows == 0 )
+		return;
+
+	// Rows can reference strings we haven't written yet, make sure they're on disk first
+	if ( iEvent != STATSSTREAM_STRING )
+	{
+		WriteBlock( STATSSTREAM_STRING );
+	}
+
+	const StatsStreamEventDesc_t &desc = g_StatsStreamEvents[iEvent];
+
+	m_Block.Clear();
+	m_Block.EnsureCapacity( sizeof( StatsStreamBlockHeader_t ) + desc.nRowSize * nRows );
+
+	StatsStreamBlockHeader_t header;
+	header.nEvent = iEvent;
+	header.nColumns = desc.nColumns;
+	header.nRows = (uint16)nRows;
+	header.nBytes = desc.nRowSize * nRows;
+	m_Block.Put( &header, sizeof( header ) );
+
+	for ( int iColumn = 0; iColumn < desc.nColumns; iColumn++ )
+	{
+		const StatsStreamColumn_t &column = desc.pColumns[iColumn];
+		const byte *pField = m_pRows[iEvent] + column.nOffset;
+		for ( int iRow = 0; iRow < nRows; iRow++, pField += desc.nRowSize )
+		{
+			m_Block.Put( pField, column.nSize );
+		}
+	}
+
+	g_pFullFileSystem->Write( m_Block.Base(), m_Block.TellPut(), m_hFile );
+
+	m_nBlocks++;
+	m_nBytes += m_Block.TellPut();
+	m_nRows[iEvent] = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int16 CTFStatsStream::GetStringID( const char *pszString )
+{
+	if ( !pszString || !pszString[0] )
+		return -1;
+
+	int iIndex = m_Strings.Find( pszString );
+	if ( iIndex != m_Strings.InvalidIndex() )
+		return m_Strings[iIndex];
+
+	if ( m_Strings.Count() >= 0x7fff )
+		return -1;
+
+	int16 nID = (int16)m_Strings.Count();
+	m_Strings.Insert( pszString, nID );
+
+	StatsStreamString_t *pRow = AddRow< StatsStreamString_t >( STATSSTREAM_STRING );
+	pRow->nID = nID;
+	Q_strncpy( pRow->szString, pszString, sizeof( pRow->szString ) );
+
+	return nID;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+int16 CTFStatsStream::GetPlayerID( CBasePlayer *pPlayer )
+{
+	return pPlayer ? (int16)pPlayer->GetUserID() : -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTFStatsStream::PrintStats( void )
+{
+	if ( !IsOpen() )
+	{
+		Msg( "Stats stream is not open.\n" );
+		return;
+	}
+
+	Msg( "Stats stream %s: %d blocks, %d bytes, %d strings\n", m_szFileName, m_nBlocks, m_nBytes, m_Strings.Count() );
+	for ( int i = 0; i < STATSSTREAM_EVENT_COUNT; i++ )
+	{
+		Msg( "  %-8s %8d rows (%d staged)\n", g_StatsStreamEvents[i].pszName, m_nTotalRows[i], m_nRows[i] );
+	}
+}
@@ -0,0 +1,65 @@
+//====== Copyright © 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Streams per-event stats (kills, damage, heals, pickups) to a
+//			compact columnar file per map instead of keeping them in memory.
+//			See tf_statsstream_format.h for the layout.
+//
+//=============================================================================//
+#ifndef TF_STATSSTREAM_H
+#define TF_STATSSTREAM_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "filesystem.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utldict.h"
+#include "tf_statsstream_format.h"
+
+class CBasePlayer;
+
+class CTFStatsStream
+{
+public:
+	CTFStatsStream();
+	~CTFStatsStream();
+
+	bool	Open( const char *pszMapName );
+	void	Close( void );
+	bool	IsOpen( void ) const		{ return m_hFile != FILESYSTEM_INVALID_HANDLE; }
+
+	// Writes out all partially filled blocks
+	void	Flush( void );
+
+	// Returns a zeroed row to fill in, with nTick already set. The row is
+	// only valid until the next call.
+	template< class T >
+	T		*AddRow( StatsStreamEvent_t iEvent )	{ return static_cast< T * >( AllocRow( iEvent ) ); }
+
+	// Interns a string, emitting a string row the first time it's seen. -1 if out of ids.
+	int16	GetStringID( const char *pszString );
+
+	static int16	GetPlayerID( CBasePlayer *pPlayer );
+
+	void	PrintStats( void );
+
+private:
+	void	*AllocRow( StatsStreamEvent_t iEvent );
+	void	WriteBlock( int iEvent );
+
+	FileHandle_t			m_hFile;
+	char					m_szFileName[ MAX_PATH ];
+
+	// One block worth of staging rows per event type
+	byte					*m_pRows[ STATSSTREAM_EVENT_COUNT ];
+	int						m_nRows[ STATSSTREAM_EVENT_COUNT ];
+	int						m_nTotalRows[ STATSSTREAM_EVENT_COUNT ];
+
+	CUtlDict< int16, int >	m_Strings;
+	CUtlBuffer				m_Block;
+
+	int						m_nBlocks;
+	int						m_nBytes;
+};
+
+#endif // TF_STATSSTREAM_H
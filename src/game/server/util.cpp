@@ -36,6 +36,7 @@
 #include "datacache/imdlcache.h"
 #include "util.h"
 #include "cdll_int.h"
+#include "asynclog.h"
 
 #ifdef PORTAL
 #include "PortalSimulation.h"
@@ -1944,6 +1945,13 @@ void UTIL_LogPrintf( const char *fmt, ... )
 	Q_vsnprintf( tempString, sizeof(tempString), fmt, argptr );
 	va_end   ( argptr );
 
+	// The background writer takes the line off the game thread when it's running
+	if ( g_AsyncLogWriter.IsEnabled() )
+	{
+		g_AsyncLogWriter.Print( tempString );
+		return;
+	}
+
 	// Print to server console
 	engine->LogPrint( tempString );
 }
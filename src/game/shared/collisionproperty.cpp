@@ -24,6 +24,7 @@
 #include "baseanimating.h"
 #include "sendproxy.h"
 #include "hierarchy.h"
+#include "entitylist.h"
 #endif
 
 #include "predictable_entity.h"
@@ -1356,6 +1357,11 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 //-----------------------------------------------------------------------------
 void CCollisionProperty::MarkPartitionHandleDirty()
 {
+#ifndef CLIENT_DLL
+	// FindEntityInSphere keeps its own spatial hash
+	SpatialHash_EntityChanged( m_pOuter );
+#endif
+
 	// don't bother with the world
 	if ( m_pOuter->entindex() == 0 )
 		return;
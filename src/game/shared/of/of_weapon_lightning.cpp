@@ -11,6 +11,7 @@
 #include "in_buttons.h"
 #include "ammodef.h"
 #include "tf_gamerules.h"
+#include "takedamageinfo.h"
 
 #if defined( CLIENT_DLL )
 
@@ -69,10 +70,22 @@ END_DATADESC()
 
 #ifdef CLIENT_DLL
 extern ConVar of_muzzlelight;
+#else
+extern ConVar tf_debug_bullets;
 #endif
 
+ConVar of_lightning_beam_coherence( "of_lightning_beam_coherence", "1", FCVAR_REPLICATED, "Reuses the lightning gun's last beam trace while the beam and what it hit barely move." );
+ConVar of_lightning_beam_tolerance( "of_lightning_beam_tolerance", "1", FCVAR_REPLICATED | FCVAR_CHEAT, "How far either end of the lightning gun's beam can move before it is traced again." );
+
+#define TF_LIGHTNING_BEAM_MASK			( MASK_SOLID | CONTENTS_HITBOX )	// same as CTFPlayer::FireBullet
+#define TF_LIGHTNING_BEAM_MAX_AGE		0.2f		// seconds a beam trace can be reused for
+#define TF_LIGHTNING_BEAM_VISUAL_RANGE	720.0f		// longest beam the particle is drawn for
+
 CTFLightningGun::CTFLightningGun()
 {
+	m_nBeamTraces = 0;
+	m_nBeamReuses = 0;
+
 	WeaponReset();
 
 #if defined( CLIENT_DLL )
@@ -116,6 +129,11 @@ void CTFLightningGun::WeaponReset( void )
 	m_bCritFire = false;
 	m_flStartFiringTime = 0;
 
+	m_ShotBeam.Invalidate();
+#if defined( CLIENT_DLL )
+	m_ParticleBeam.Invalidate();
+#endif
+
 	DestroySounds();
 }
 
@@ -126,8 +144,10 @@ bool CTFLightningGun::Holster( CBaseCombatWeapon *pSwitchingTo )
 {
 	m_iWeaponState = FT_STATE_IDLE;
 	m_bCritFire = false;
+	m_ShotBeam.Invalidate();
 
 #if defined ( CLIENT_DLL )
+	m_ParticleBeam.Invalidate();
 	StopLightning();
 #endif
 
@@ -347,6 +367,199 @@ void CTFLightningGun::PrimaryAttack()
 
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Fires the beam. Does what FX_FireBullets does for one bullet, but
+//			the trace goes through TraceBeam so the particle end can share it.
+//			No TE_FireBullets either, it was only ever traced again and
+//			thrown away on other clients since the beam has no bullet effects.
+//-----------------------------------------------------------------------------
+void CTFLightningGun::FireBullet( CTFPlayer *pPlayer )
+{
+	StartGroupingSounds();
+
+#if !defined( CLIENT_DLL )
+	pPlayer->NoteWeaponFired();
+
+	// Move other players back to history positions based on local player's lag
+	lagcompensation->StartLagCompensation( pPlayer, pPlayer->GetCurrentCommand() );
+#endif
+
+	Vector vecForward, vecRight, vecUp;
+	AngleVectors( pPlayer->EyeAngles() + pPlayer->GetPunchAngle(), &vecForward, &vecRight, &vecUp );
+
+	// Same spread FX_FireBullets gives a single bullet
+	Vector vecDir = vecForward;
+	float flSpread = GetWeaponSpread();
+	if ( flSpread > 0.0f && !IsFirstShotAccurate() )
+	{
+		RandomSeed( CBaseEntity::GetPredictionRandomSeed() & 255 );
+		float x = RandomFloat( -0.5, 0.5 ) + RandomFloat( -0.5, 0.5 );
+		float y = RandomFloat( -0.5, 0.5 ) + RandomFloat( -0.5, 0.5 );
+		vecDir = vecForward + ( x * flSpread * vecRight ) + ( y * flSpread * vecUp );
+		vecDir.NormalizeInPlace();
+	}
+
+	FireBulletsInfo_t fireInfo;
+	fireInfo.m_vecSrc = pPlayer->Weapon_ShootPosition();
+	fireInfo.m_vecDirShooting = vecDir;
+	fireInfo.m_flDistance = m_pWeaponInfo->GetWeaponData( m_iWeaponMode ).m_flRange;
+	fireInfo.m_flDamage = static_cast<int>( GetProjectileDamage() );
+	fireInfo.m_iShots = 1;
+	fireInfo.m_vecSpread.Init( flSpread, flSpread, 0.0f );
+	fireInfo.m_iAmmoType = m_pWeaponInfo->iAmmoType;
+
+	int nDamageType = GetDamageType();
+	int nCustomDamageType = GetCustomDamageType();
+	if ( IsCurrentAttackACrit() )
+	{
+		nDamageType |= DMG_CRITICAL;
+	}
+	if ( IsCurrentAttackACrit() >= 2 )
+	{
+		nCustomDamageType = TF_DMG_CUSTOM_CRIT_POWERUP;
+	}
+
+	trace_t trace;
+	TraceBeam( pPlayer, fireInfo.m_vecSrc, fireInfo.m_vecDirShooting, fireInfo.m_flDistance, m_ShotBeam, trace );
+
+#ifdef GAME_DLL
+	if ( tf_debug_bullets.GetBool() )
+	{
+		NDebugOverlay::Line( fireInfo.m_vecSrc, trace.endpos, 0,255,0, true, 30 );
+	}
+#endif
+
+	ClearMultiDamage();
+	pPlayer->FireBulletImpact( fireInfo, trace, false, nDamageType, nCustomDamageType );
+	ApplyMultiDamage();
+
+#if !defined( CLIENT_DLL )
+	lagcompensation->FinishLagCompensation( pPlayer );
+#endif
+
+	EndGroupingSounds();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks for anything besides the beam's target that the beam could
+//			hit now, using only the bounds the spatial partition keeps
+//-----------------------------------------------------------------------------
+class CLightningBeamEnumerator : public IEntityEnumerator
+{
+public:
+	CLightningBeamEnumerator( CTFPlayer *pOwner, CBaseEntity *pTarget )
+		: m_Filter( pOwner, COLLISION_GROUP_NONE ), m_pTarget( pTarget ), m_bBlocked( false )
+	{
+	}
+
+	virtual bool EnumEntity( IHandleEntity *pHandleEntity )
+	{
+		CBaseEntity *pEntity = EntityFromEntityHandle( pHandleEntity );
+		if ( !pEntity || pEntity == m_pTarget || !pEntity->IsSolid() )
+			return true;
+
+		if ( !m_Filter.ShouldHitEntity( pHandleEntity, TF_LIGHTNING_BEAM_MASK ) )
+			return true;
+
+		m_bBlocked = true;
+		return false;
+	}
+
+	CTraceFilterSimple	m_Filter;
+	CBaseEntity			*m_pTarget;
+	bool				m_bBlocked;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes the last beam trace in cache over for this ray if both ends
+//			of it stayed within of_lightning_beam_tolerance. The new ray is
+//			still traced against the world and static props, which skips
+//			only the expensive part, and a target it hit is clipped against
+//			again for the exact hitbox. Nothing else may be in the way.
+//-----------------------------------------------------------------------------
+bool CTFLightningGun::ReuseBeam( CTFPlayer *pOwner, const Vector &vecStart, const Vector &vecEnd, const LightningBeamCache_t &cache, trace_t &trace )
+{
+	if ( !cache.bValid || !of_lightning_beam_coherence.GetBool() )
+		return false;
+
+	// Prediction can run the same ticks again, so the last trace may be newer than curtime
+	if ( fabs( gpGlobals->curtime - cache.flTime ) > TF_LIGHTNING_BEAM_MAX_AGE )
+		return false;
+
+	float flToleranceSqr = Square( of_lightning_beam_tolerance.GetFloat() );
+	if ( ( vecStart - cache.trace.startpos ).LengthSqr() > flToleranceSqr )
+		return false;
+
+	Ray_t ray;
+	ray.Init( vecStart, vecEnd );
+
+	// Even a small move can take the beam past an edge, so the world is traced again
+	trace_t worldTr;
+	CTraceFilterWorldAndPropsOnly worldFilter;
+	enginetrace->TraceRay( ray, MASK_SOLID_BRUSHONLY, &worldFilter, &worldTr );
+
+	trace_t tr;
+	CBaseEntity *pTarget = NULL;
+	if ( cache.bHitTarget )
+	{
+		pTarget = cache.hTarget.Get();
+		if ( !pTarget )
+			return false;
+
+		enginetrace->ClipRayToEntity( ray, TF_LIGHTNING_BEAM_MASK, pTarget, &tr );
+		if ( tr.fraction >= 1.0f || worldTr.fraction < tr.fraction )
+			return false;
+
+		tr.m_pEnt = pTarget;
+	}
+	else
+	{
+		if ( cache.trace.fraction < 1.0f && worldTr.fraction >= 1.0f )
+			return false;
+
+		tr = worldTr;
+	}
+
+	if ( ( tr.endpos - cache.trace.endpos ).LengthSqr() > flToleranceSqr )
+		return false;
+
+	// Everything along the new ray up to where it stops
+	CLightningBeamEnumerator enumerator( pOwner, pTarget );
+	Ray_t clearRay;
+	clearRay.Init( vecStart, tr.endpos );
+	enginetrace->EnumerateEntities( clearRay, false, &enumerator );
+	if ( enumerator.m_bBlocked )
+		return false;
+
+	trace = tr;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFLightningGun::TraceBeam( CTFPlayer *pOwner, const Vector &vecStart, const Vector &vecDir, float flRange, LightningBeamCache_t &cache, trace_t &trace )
+{
+	Vector vecEnd = vecStart + vecDir * flRange;
+
+	if ( flRange == cache.flRange && ReuseBeam( pOwner, vecStart, vecEnd, cache, trace ) )
+	{
+		m_nBeamReuses++;
+	}
+	else
+	{
+		UTIL_TraceLine( vecStart, vecEnd, TF_LIGHTNING_BEAM_MASK, pOwner, COLLISION_GROUP_NONE, &trace );
+		m_nBeamTraces++;
+	}
+
+	cache.trace = trace;
+	cache.bHitTarget = ( trace.fraction < 1.0f && trace.m_pEnt && !trace.m_pEnt->IsWorld() );
+	cache.hTarget = cache.bHitTarget ? trace.m_pEnt : NULL;
+	cache.bValid = true;
+	cache.flRange = flRange;
+	cache.flTime = gpGlobals->curtime;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Accessor for damage, so sniper etc can modify damage
 //-----------------------------------------------------------------------------
@@ -503,73 +716,36 @@ void CTFLightningGun::RestartParticleEffect( void )
 	m_bLightningEffects = true;
 }
 
-#ifdef CLIENT_DLL
-
-class CTraceFilterIgnoreTeammates : public CTraceFilterSimple
-{
-public:
-	// It does have a base, but we'll never network anything below here..
-	DECLARE_CLASS( CTraceFilterIgnoreTeammates, CTraceFilterSimple );
-
-	CTraceFilterIgnoreTeammates( const IHandleEntity *passentity, int collisionGroup, int iIgnoreTeam, CBaseEntity *pOwner )
-		: CTraceFilterSimple( passentity, collisionGroup ), m_iIgnoreTeam( iIgnoreTeam ), m_hOwner( pOwner )
-	{
-	}
-
-	virtual bool ShouldHitEntity( IHandleEntity *pServerEntity, int contentsMask )
-	{
-		CBaseEntity *pEntity = EntityFromEntityHandle( pServerEntity );
-
-		if ( ( pEntity->IsPlayer() && pEntity->GetTeamNumber() == m_iIgnoreTeam ) || pEntity == m_hOwner )
-		{
-			return false;
-		}
-
-		return true;
-	}
-	CBaseEntity *m_hOwner;
-	int m_iIgnoreTeam;
-};
-
+//-----------------------------------------------------------------------------
+// Purpose: Ends the particle where the beam does damage. It traces along the
+//			view without spread, so it keeps its own cache apart from the shot's.
+//-----------------------------------------------------------------------------
 void CTFLightningGun::SetParticleEnd()
 {
 	CTFPlayer *pOwner = ToTFPlayer( GetPlayerOwner() );
 	if ( !pOwner )
 		return;
-	
-	Vector vecForward, vecRight, vecUp;
-	AngleVectors( pOwner->EyeAngles(), &vecForward, &vecRight, &vecUp );
-
-	Vector vecShootPos = pOwner->Weapon_ShootPosition();
 
-	// Estimate end point
-	Vector endPos = vecShootPos + vecForward * 720;	
-
-	int team = pOwner->GetTeamNumber();
-	if ( team == TF_TEAM_MERCENARY )
-		team = 0;		
-	
-	trace_t tr;
-	
-	CTraceFilterIgnoreTeammates filter( pOwner, COLLISION_GROUP_NONE, team, pOwner );
-
-	CTraceFilterIgnoreTeammates *pTmpFilter = &filter;
-	if ( !pTmpFilter )
+	if ( !m_pLightningParticle || !m_pLightningParticle->m_pDef || !m_pLightningParticle->m_pDef->ReadsControlPoint( 1 ) )
 		return;
 
-	UTIL_TraceLine( vecShootPos, endPos, MASK_SOLID, &filter, &tr );
+	Vector vecForward;
+	AngleVectors( pOwner->EyeAngles() + pOwner->GetPunchAngle(), &vecForward );
 
-	trace_t *pTmpTr = &tr;
-	if ( !pTmpTr )
-		return;
+	Vector vecShootPos = pOwner->Weapon_ShootPosition();
 
-	if ( m_pLightningParticle && m_pLightningParticle->m_pDef && m_pLightningParticle->m_pDef->ReadsControlPoint( 1 ) )
+	float flRange = m_pWeaponInfo->GetWeaponData( m_iWeaponMode ).m_flRange;
+	trace_t tr;
+	TraceBeam( pOwner, vecShootPos, vecForward, flRange, m_ParticleBeam, tr );
+
+	Vector vecEnd = tr.endpos;
+	if ( tr.fraction * flRange > TF_LIGHTNING_BEAM_VISUAL_RANGE )
 	{
-		m_pLightningParticle->SetControlPoint( 1, tr.endpos );
+		vecEnd = vecShootPos + vecForward * TF_LIGHTNING_BEAM_VISUAL_RANGE;
 	}
-}
 
-#endif
+	m_pLightningParticle->SetControlPoint( 1, vecEnd );
+}
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -678,6 +854,56 @@ void CTFLightningGun::StopLightning( bool bAbrupt /* = false */ )
 
 #endif
 
+//-----------------------------------------------------------------------------
+// Purpose: Beam traces per lightning gun, traced and reused
+//-----------------------------------------------------------------------------
+static void PrintLightningBeamStats( bool bReset )
+{
+	int nGuns = 0;
+#ifdef GAME_DLL
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+#else
+	for ( C_BaseEntity *pEntity = ClientEntityList().FirstBaseEntity(); pEntity; pEntity = ClientEntityList().NextBaseEntity( pEntity ) )
+#endif
+	{
+		CTFLightningGun *pGun = dynamic_cast<CTFLightningGun *>( pEntity );
+		if ( !pGun )
+			continue;
+
+		if ( bReset )
+		{
+			pGun->ResetBeamStats();
+			continue;
+		}
+
+		int nTotal = pGun->GetBeamTraces() + pGun->GetBeamReuses();
+		CBasePlayer *pOwner = pGun->GetPlayerOwner();
+		Msg( "  %-32s %8d traced %8d reused (%.0f%%)\n", pOwner ? pOwner->GetPlayerName() : "(no owner)",
+			pGun->GetBeamTraces(), pGun->GetBeamReuses(), nTotal ? 100.0f * pGun->GetBeamReuses() / nTotal : 0.0f );
+		nGuns++;
+	}
+
+	if ( !bReset && !nGuns )
+	{
+		Msg( "No lightning guns.\n" );
+	}
+}
+
+#ifdef GAME_DLL
+CON_COMMAND( of_lightning_beam_stats, "Shows how many lightning gun beam traces each gun did and reused on the server. Pass 'reset' to clear the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	PrintLightningBeamStats( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) );
+}
+#else
+CON_COMMAND( cl_lightning_beam_stats, "Shows how many lightning gun beam traces each gun did and reused on the client. Pass 'reset' to clear the counters." )
+{
+	PrintLightningBeamStats( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) );
+}
+#endif
+
 acttable_t CTFLightningGun::m_acttableLightningGun[] =
 {
 	{ ACT_MP_STAND_IDLE, ACT_MERC_STAND_LIGHTNING_GUN, false },
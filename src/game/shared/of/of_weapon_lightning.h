@@ -32,6 +32,23 @@ enum LightningGunState_t
 	FT_STATE_FIRING
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Last beam trace, kept so the next one along nearly the same ray can
+//			be reused
+//-----------------------------------------------------------------------------
+struct LightningBeamCache_t
+{
+	LightningBeamCache_t() { Invalidate(); }
+	void Invalidate( void ) { bValid = false; bHitTarget = false; flRange = 0.0f; flTime = 0.0f; }
+
+	trace_t		trace;
+	EHANDLE		hTarget;			// what it hit, unless that was the world or nothing
+	bool		bHitTarget;
+	bool		bValid;
+	float		flRange;
+	float		flTime;
+};
+
 //=============================================================================
 //
 // TF Weapon Sub-machine gun.
@@ -64,6 +81,15 @@ public:
 
 	Vector GetVisualMuzzlePos();
 	Vector GetFlameOriginPos();
+
+	virtual void	FireBullet( CTFPlayer *pPlayer );
+
+	// Beam trace for damage and the particle end. Reuses the last result in
+	// cache while the beam and what it hit hold still.
+	void	TraceBeam( CTFPlayer *pOwner, const Vector &vecStart, const Vector &vecDir, float flRange, LightningBeamCache_t &cache, trace_t &trace );
+	int		GetBeamTraces( void ) const { return m_nBeamTraces; }
+	int		GetBeamReuses( void ) const { return m_nBeamReuses; }
+	void	ResetBeamStats( void ) { m_nBeamTraces = m_nBeamReuses = 0; }
 	
 #if defined( CLIENT_DLL )
 //	virtual bool	Deploy( void );
@@ -89,6 +115,7 @@ private:
 
 private:
 	Vector GetMuzzlePosHelper( bool bVisualPos );
+	bool ReuseBeam( CTFPlayer *pOwner, const Vector &vecStart, const Vector &vecEnd, const LightningBeamCache_t &cache, trace_t &trace );
 	CNetworkVar( int, m_iWeaponState );
 	CNetworkVar( int, m_bCritFire );
 
@@ -97,7 +124,15 @@ private:
 
 	int			m_iParticleWaterLevel;
 	float		m_flAmmoUseRemainder;
+
+	// The shot and the particle trace along different rays at different
+	// times, so each keeps its own last trace
+	LightningBeamCache_t	m_ShotBeam;
+	int			m_nBeamTraces;			// full traces
+	int			m_nBeamReuses;			// traces saved
 #if defined( CLIENT_DLL )
+	LightningBeamCache_t	m_ParticleBeam;
+
 	CSoundPatch	*m_pFiringStartSound;
 	CSoundPatch	*m_pFiringLoop;
 	bool		m_bFiringLoopCritical;
@@ -9,11 +9,7 @@
 
 #if !defined( NO_ENTITY_PREDICTION )
 
-#if defined( CLIENT_DLL )
-
 #include "igamesystem.h"
-
-#endif
 #include <memory.h>
 #include <stdarg.h>
 #include "tier0/dbg.h"
@@ -21,6 +17,11 @@
 #include "predictioncopy.h"
 #include "engine/ivmodelinfo.h"
 #include "tier1/fmtstr.h"
+#include "tier0/fasttimer.h"
+
+#if defined( CLIENT_DLL )
+#include "c_baseplayer.h"
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1238,8 +1239,6 @@ void CPredictionCopy::TransferData_R( int chaincount, datamap_t *dmap )
 	}
 }
 
-static int g_nChainCount = 1;
-
 static typedescription_t *FindFieldByName_R( const char *fieldname, datamap_t *dmap )
 {
 	int c = dmap->dataNumFields;
@@ -1323,6 +1322,329 @@ typedescription_t *FindFieldByName( const char *fieldname, datamap_t *dmap )
 	return FindFieldByName_R( fieldname, dmap );
 }
 
+//-----------------------------------------------------------------------------
+// Compiled copy plans
+//
+// Walking the datamap field by field for every save/restore is expensive, so
+// the first transfer of a given datamap/type/layout flattens the (chain
+// resolved) field list into absolute offsets once, and coalesces fields that
+// sit back to back in both source and destination into single memcpy runs.
+// Copy passes then become a handful of memcpys, and error check passes only
+// fall back to the per field compare for runs that actually differ.
+//-----------------------------------------------------------------------------
+static ConVar cl_pred_compiled_copy( "cl_pred_compiled_copy", "1", FCVAR_NONE, "Use precompiled copy plans for prediction data transfers." );
+
+struct predcopyfield_t
+{
+	typedescription_t	*pField;
+	datamap_t			*pMap;			// Map we were walking when we found this field, for error reporting
+	char const			*pClassName;	// Class that owns the field (differs from pMap for embedded fields)
+	int					nDestOffset;	// Absolute offset of the field
+	int					nSrcOffset;
+	int					nDestBase;		// Absolute offset of the struct holding the field
+	int					nSrcBase;
+	int					nBytes;
+};
+
+struct predcopyrun_t
+{
+	int					nDestOffset;
+	int					nSrcOffset;
+	int					nBytes;
+	int					nFirstField;
+	int					nFieldCount;
+	bool				bString;		// Strings are variable length and always get their own run
+};
+
+class CPredictionCopyPlan
+{
+public:
+	CPredictionCopyPlan() : m_bValid( true ) {}
+
+	bool							m_bValid;
+	CUtlVector< predcopyfield_t >	m_Fields;
+	CUtlVector< predcopyrun_t >		m_Runs;
+};
+
+struct predcopyplankey_t
+{
+	datamap_t	*pMap;
+	int			nType;
+	int			nDestOffsetIndex;
+	int			nSrcOffsetIndex;
+};
+
+static bool PredCopyPlanKeyLessFunc( const predcopyplankey_t &lhs, const predcopyplankey_t &rhs )
+{
+	if ( lhs.pMap != rhs.pMap )
+		return lhs.pMap < rhs.pMap;
+	if ( lhs.nType != rhs.nType )
+		return lhs.nType < rhs.nType;
+	if ( lhs.nDestOffsetIndex != rhs.nDestOffsetIndex )
+		return lhs.nDestOffsetIndex < rhs.nDestOffsetIndex;
+	return lhs.nSrcOffsetIndex < rhs.nSrcOffsetIndex;
+}
+
+static CUtlMap< predcopyplankey_t, CPredictionCopyPlan * > g_PredCopyPlans( 0, 0, PredCopyPlanKeyLessFunc );
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees the compiled plans, they get rebuilt on the next transfer
+//-----------------------------------------------------------------------------
+static void PurgeCopyPlans( void )
+{
+	FOR_EACH_MAP_FAST( g_PredCopyPlans, i )
+	{
+		delete g_PredCopyPlans[ i ];
+	}
+
+	g_PredCopyPlans.RemoveAll();
+}
+
+class CPredictionCopyPlanSystem : public CAutoGameSystem
+{
+public:
+	CPredictionCopyPlanSystem() : CAutoGameSystem( "CPredictionCopyPlanSystem" ) {}
+
+	virtual void LevelShutdownPostEntity() { PurgeCopyPlans(); }
+	virtual void Shutdown() { PurgeCopyPlans(); }
+};
+
+static CPredictionCopyPlanSystem g_PredCopyPlanSystem;
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the number of bytes a field occupies, or -1 if it can't be part of a plan
+//-----------------------------------------------------------------------------
+static int PredCopyFieldBytes( const typedescription_t *pField )
+{
+	switch ( pField->fieldType )
+	{
+	case FIELD_FLOAT:		return sizeof( float ) * pField->fieldSize;
+	case FIELD_VECTOR:		return sizeof( Vector ) * pField->fieldSize;
+	case FIELD_QUATERNION:	return sizeof( Quaternion ) * pField->fieldSize;
+	case FIELD_COLOR32:		return 4 * pField->fieldSize;
+	case FIELD_BOOLEAN:		return sizeof( bool ) * pField->fieldSize;
+	case FIELD_INTEGER:		return sizeof( int ) * pField->fieldSize;
+	case FIELD_SHORT:		return sizeof( short ) * pField->fieldSize;
+	case FIELD_CHARACTER:	return pField->fieldSize;
+	case FIELD_EHANDLE:		return sizeof( EHANDLE ) * pField->fieldSize;
+	case FIELD_STRING:		return 0;
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Mirrors CopyFields, but records the fields that would be visited instead of transferring them
+//-----------------------------------------------------------------------------
+static bool BuildCopyPlan_R( CPredictionCopyPlan *pPlan, int nType, int nDestOffsetIndex, int nSrcOffsetIndex, int chain_count,
+	datamap_t *pRootMap, char const *pClassName, typedescription_t *pFields, int fieldCount, int nDestBase, int nSrcBase )
+{
+	for ( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t *pField = &pFields[ i ];
+		int flags = pField->flags;
+
+		if ( pField->override_field != NULL )
+		{
+			pField->override_field->override_count = chain_count;
+		}
+
+		if ( pField->override_count == chain_count )
+			continue;
+
+		if ( pField->fieldType == FIELD_VOID )
+			continue;
+
+		int nDestOffset = nDestBase + (int)pField->fieldOffset[ nDestOffsetIndex ];
+		int nSrcOffset = nSrcBase + (int)pField->fieldOffset[ nSrcOffsetIndex ];
+
+		if ( pField->fieldType == FIELD_EMBEDDED )
+		{
+			// Pointers have to be followed per object, so we can't flatten through them
+			if ( ( flags & FTYPEDESC_PTR ) && ( nDestOffsetIndex == PC_DATA_NORMAL || nSrcOffsetIndex == PC_DATA_NORMAL ) )
+				return false;
+
+			if ( !BuildCopyPlan_R( pPlan, nType, nDestOffsetIndex, nSrcOffsetIndex, chain_count, pRootMap, 
+				pField->td->dataClassName, pField->td->dataDesc, pField->td->dataNumFields, nDestOffset, nSrcOffset ) )
+				return false;
+
+			continue;
+		}
+
+		if ( flags & FTYPEDESC_PRIVATE )
+			continue;
+
+		if ( nType == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+			continue;
+
+		if ( nType == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+			continue;
+
+		int nBytes = PredCopyFieldBytes( pField );
+		if ( nBytes < 0 )
+			return false;
+
+		predcopyfield_t &field = pPlan->m_Fields[ pPlan->m_Fields.AddToTail() ];
+		field.pField = pField;
+		field.pMap = pRootMap;
+		field.pClassName = pClassName;
+		field.nDestOffset = nDestOffset;
+		field.nSrcOffset = nSrcOffset;
+		field.nDestBase = nDestBase;
+		field.nSrcBase = nSrcBase;
+		field.nBytes = nBytes;
+	}
+
+	return true;
+}
+
+static int g_nChainCount = 1;
+
+//-----------------------------------------------------------------------------
+// Purpose: Flattens a datamap chain and merges adjacent fields into runs
+//-----------------------------------------------------------------------------
+static CPredictionCopyPlan *CompileCopyPlan( datamap_t *dmap, int nType, int nDestOffsetIndex, int nSrcOffsetIndex )
+{
+	CPredictionCopyPlan *pPlan = new CPredictionCopyPlan;
+
+	// Use our own chain count so the override resolution matches a regular transfer
+	int chain_count = ++g_nChainCount;
+
+	for ( datamap_t *pMap = dmap; pMap && pPlan->m_bValid; pMap = pMap->baseMap )
+	{
+		pPlan->m_bValid = BuildCopyPlan_R( pPlan, nType, nDestOffsetIndex, nSrcOffsetIndex, chain_count,
+			pMap, pMap->dataClassName, pMap->dataDesc, pMap->dataNumFields, 0, 0 );
+	}
+
+	if ( !pPlan->m_bValid )
+	{
+		pPlan->m_Fields.Purge();
+		return pPlan;
+	}
+
+	for ( int i = 0; i < pPlan->m_Fields.Count(); i++ )
+	{
+		const predcopyfield_t &field = pPlan->m_Fields[ i ];
+		bool bString = field.pField->fieldType == FIELD_STRING;
+
+		if ( !bString && pPlan->m_Runs.Count() )
+		{
+			predcopyrun_t &last = pPlan->m_Runs.Tail();
+			if ( !last.bString &&
+				last.nDestOffset + last.nBytes == field.nDestOffset &&
+				last.nSrcOffset + last.nBytes == field.nSrcOffset )
+			{
+				last.nBytes += field.nBytes;
+				last.nFieldCount++;
+				continue;
+			}
+		}
+
+		predcopyrun_t &run = pPlan->m_Runs[ pPlan->m_Runs.AddToTail() ];
+		run.nDestOffset = field.nDestOffset;
+		run.nSrcOffset = field.nSrcOffset;
+		run.nBytes = field.nBytes;
+		run.nFirstField = i;
+		run.nFieldCount = 1;
+		run.bString = bString;
+	}
+
+	return pPlan;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the compiled plan for a datamap, or NULL if it has to go through CopyFields
+//-----------------------------------------------------------------------------
+CPredictionCopyPlan *CPredictionCopy::GetCopyPlan( datamap_t *dmap )
+{
+	// Describing and watching look at every field, identical or not
+	if ( !cl_pred_compiled_copy.GetBool() || m_bDescribeFields || m_pWatchField )
+		return NULL;
+
+	// Packed offsets aren't known until the entity has computed them
+	if ( ( m_nDestOffsetIndex == TD_OFFSET_PACKED || m_nSrcOffsetIndex == TD_OFFSET_PACKED ) && !dmap->packed_offsets_computed )
+		return NULL;
+
+	predcopyplankey_t key;
+	key.pMap = dmap;
+	key.nType = m_nType;
+	key.nDestOffsetIndex = m_nDestOffsetIndex;
+	key.nSrcOffsetIndex = m_nSrcOffsetIndex;
+
+	unsigned short idx = g_PredCopyPlans.Find( key );
+	if ( idx == g_PredCopyPlans.InvalidIndex() )
+	{
+		idx = g_PredCopyPlans.Insert( key, CompileCopyPlan( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex ) );
+	}
+
+	CPredictionCopyPlan *pPlan = g_PredCopyPlans[ idx ];
+	return pPlan->m_bValid ? pPlan : NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs a single field through the regular path, used when a run differs
+//-----------------------------------------------------------------------------
+void CPredictionCopy::TransferPlanField( int chain_count, const predcopyfield_t &field )
+{
+	void *saveDest = m_pDest;
+	void const *saveSrc = m_pSrc;
+
+	// CopyFields adds the field offset on its own, so point it at the struct holding the field
+	m_pDest = (char *)saveDest + field.nDestBase;
+	m_pSrc = (char const *)saveSrc + field.nSrcBase;
+	m_pCurrentClassName = field.pClassName;
+
+	CopyFields( chain_count, field.pMap, field.pField, 1 );
+
+	m_pDest = saveDest;
+	m_pSrc = saveSrc;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Transfers data using a compiled plan
+//-----------------------------------------------------------------------------
+void CPredictionCopy::TransferPlan( int chain_count, CPredictionCopyPlan *pPlan )
+{
+	char *pDest = (char *)m_pDest;
+	char const *pSrc = (char const *)m_pSrc;
+
+	int c = pPlan->m_Runs.Count();
+	for ( int i = 0; i < c; i++ )
+	{
+		const predcopyrun_t &run = pPlan->m_Runs[ i ];
+
+		if ( !m_bErrorCheck )
+		{
+			// Nothing to compare, so everything differs and gets copied
+			if ( !m_bPerformCopy )
+				continue;
+
+			if ( run.bString )
+			{
+				char const *pString = pSrc + run.nSrcOffset;
+				memcpy( pDest + run.nDestOffset, pString, Q_strlen( pString ) + 1 );
+			}
+			else
+			{
+				memcpy( pDest + run.nDestOffset, pSrc + run.nSrcOffset, run.nBytes );
+			}
+			continue;
+		}
+
+		// Bitwise identical runs can't differ or need copying. 
+		// NOTE: This treats a NaN that hasn't changed as identical, where the per field float compare would flag it.
+		if ( !run.bString && !memcmp( pDest + run.nDestOffset, pSrc + run.nSrcOffset, run.nBytes ) )
+			continue;
+
+		for ( int j = 0; j < run.nFieldCount; j++ )
+		{
+			TransferPlanField( chain_count, pPlan->m_Fields[ run.nFirstField + j ] );
+		}
+	}
+}
+
 static ConVar pwatchent( "pwatchent", "-1", FCVAR_CHEAT, "Entity to watch for prediction system changes." );
 static ConVar pwatchvar( "pwatchvar", "", FCVAR_CHEAT, "Entity variable to watch in prediction system for changes." );
 
@@ -1391,11 +1713,158 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
-	TransferData_R( g_nChainCount, dmap );
+	CPredictionCopyPlan *pPlan = GetCopyPlan( dmap );
+	if ( pPlan )
+	{
+		TransferPlan( g_nChainCount, pPlan );
+	}
+	else
+	{
+		TransferData_R( g_nChainCount, dmap );
+	}
 
 	return m_nErrorCount;
 }
 
+#if defined( CLIENT_DLL )
+//-----------------------------------------------------------------------------
+// Purpose: Times the transfers prediction does for every predicted command on 
+//  the local player and its weapons, with and without compiled copy plans.
+//  A high ping client re-runs these once per unacknowledged command, so the
+//  per command figure scales with the number of commands in flight.
+//  The check pass compares against a reference snapshot with one networked
+//  field changed, so it has a real difference to find.
+//-----------------------------------------------------------------------------
+static double BenchmarkPredictionCopy( CUtlVector< C_BaseEntity * > &entities, CUtlVector< byte * > &buffers, CUtlVector< byte * > &references, int iterations, bool bCompiled, int &nErrors )
+{
+	bool bOldCompiled = cl_pred_compiled_copy.GetBool();
+	cl_pred_compiled_copy.SetValue( bCompiled );
+
+	nErrors = 0;
+
+	CFastTimer timer;
+	timer.Start();
+
+	for ( int i = 0; i < iterations; i++ )
+	{
+		for ( int j = 0; j < entities.Count(); j++ )
+		{
+			C_BaseEntity *pEntity = entities[ j ];
+			datamap_t *dmap = pEntity->GetPredDescMap();
+
+			// Save, error check against the reference and restore, the same as a predicted command does
+			CPredictionCopy save( PC_EVERYTHING, buffers[ j ], PC_DATA_PACKED, pEntity, PC_DATA_NORMAL );
+			save.TransferData( "", -1, dmap );
+
+			CPredictionCopy check( PC_NETWORKED_ONLY, references[ j ], PC_DATA_PACKED, buffers[ j ], PC_DATA_PACKED, true, false, false );
+			nErrors += check.TransferData( "", -1, dmap );
+
+			CPredictionCopy restore( PC_EVERYTHING, pEntity, PC_DATA_NORMAL, buffers[ j ], PC_DATA_PACKED );
+			restore.TransferData( "", -1, dmap );
+		}
+	}
+
+	timer.End();
+
+	cl_pred_compiled_copy.SetValue( bOldCompiled );
+
+	return timer.GetDuration().GetMillisecondsF();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds a networked int or float the check pass compares
+//-----------------------------------------------------------------------------
+static typedescription_t *FindBenchmarkField( datamap_t *dmap )
+{
+	for ( ; dmap; dmap = dmap->baseMap )
+	{
+		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		{
+			typedescription_t *pField = &dmap->dataDesc[ i ];
+			if ( !( pField->flags & FTYPEDESC_INSENDTABLE ) || ( pField->flags & ( FTYPEDESC_PRIVATE | FTYPEDESC_NOERRORCHECK ) ) )
+				continue;
+
+			if ( pField->fieldType == FIELD_INTEGER || pField->fieldType == FIELD_FLOAT )
+				return pField;
+		}
+	}
+
+	return NULL;
+}
+
+CON_COMMAND_F( cl_pred_copy_benchmark, "Times prediction save/check/restore on the local player and weapons. Usage: cl_pred_copy_benchmark <iterations>", FCVAR_CHEAT )
+{
+	C_BasePlayer *pPlayer = C_BasePlayer::GetLocalPlayer();
+	if ( !pPlayer )
+		return;
+
+	int iterations = args.ArgC() > 1 ? MAX( 1, atoi( args[ 1 ] ) ) : 1000;
+
+	CUtlVector< C_BaseEntity * > entities;
+	entities.AddToTail( pPlayer );
+	for ( int i = 0; i < MAX_WEAPONS; i++ )
+	{
+		C_BaseCombatWeapon *pWeapon = pPlayer->GetWeapon( i );
+		if ( pWeapon && pWeapon->GetPredictable() )
+		{
+			entities.AddToTail( pWeapon );
+		}
+	}
+
+	// Packed offsets only exist once the entity has been predicted
+	CUtlVector< byte * > buffers;
+	for ( int i = entities.Count() - 1; i >= 0; i-- )
+	{
+		datamap_t *dmap = entities[ i ]->GetPredDescMap();
+		if ( !dmap->packed_offsets_computed )
+		{
+			entities.Remove( i );
+		}
+	}
+
+	// Snapshot every entity once and change one networked field in the snapshot
+	CUtlVector< byte * > references;
+	int nExpectedErrors = 0;
+	for ( int i = 0; i < entities.Count(); i++ )
+	{
+		datamap_t *dmap = entities[ i ]->GetPredDescMap();
+		buffers.AddToTail( new byte[ dmap->packed_size ] );
+		references.AddToTail( new byte[ dmap->packed_size ] );
+
+		CPredictionCopy snapshot( PC_EVERYTHING, references[ i ], PC_DATA_PACKED, entities[ i ], PC_DATA_NORMAL );
+		snapshot.TransferData( "", -1, dmap );
+
+		typedescription_t *pField = FindBenchmarkField( dmap );
+		if ( pField )
+		{
+			// Flipping a bit changes an int or a float without ever making it equal within tolerance
+			int *pValue = (int *)( references[ i ] + pField->fieldOffset[ TD_OFFSET_PACKED ] );
+			*pValue ^= 0x40000000;
+			nExpectedErrors++;
+		}
+	}
+
+	int nLegacyErrors, nCompiledErrors;
+	double flLegacy = BenchmarkPredictionCopy( entities, buffers, references, iterations, false, nLegacyErrors );
+	double flCompiled = BenchmarkPredictionCopy( entities, buffers, references, iterations, true, nCompiledErrors );
+
+	Msg( "Prediction copy: %d entities, %d iterations\n", entities.Count(), iterations );
+	Msg( "  per field: %.3f ms total, %.2f us per command, %d differences\n", flLegacy, flLegacy * 1000.0 / iterations, nLegacyErrors );
+	Msg( "  compiled:  %.3f ms total, %.2f us per command, %d differences\n", flCompiled, flCompiled * 1000.0 / iterations, nCompiledErrors );
+
+	if ( nLegacyErrors != nExpectedErrors * iterations || nCompiledErrors != nExpectedErrors * iterations )
+	{
+		Warning( "  expected %d differences from both paths\n", nExpectedErrors * iterations );
+	}
+
+	for ( int i = 0; i < buffers.Count(); i++ )
+	{
+		delete[] buffers[ i ];
+		delete[] references[ i ];
+	}
+}
+#endif
+
 /*
 //-----------------------------------------------------------------------------
 // Purpose: Simply dumps all data fields in object
@@ -16,6 +16,9 @@
 #include "ehandle.h"
 #include "tier1/utlstring.h"
 
+class CPredictionCopyPlan;
+struct predcopyfield_t;
+
 #if defined( CLIENT_DLL )
 class C_BaseEntity;
 typedef CHandle<C_BaseEntity> EHANDLE;
@@ -133,6 +136,10 @@ private:
 
 	void	CopyFields( int chaincount, datamap_t *pMap, typedescription_t *pFields, int fieldCount );
 
+	CPredictionCopyPlan *GetCopyPlan( datamap_t *dmap );
+	void	TransferPlan( int chaincount, CPredictionCopyPlan *pPlan );
+	void	TransferPlanField( int chaincount, const predcopyfield_t &field );
+
 private:
 
 	int				m_nType;
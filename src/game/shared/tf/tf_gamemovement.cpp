@@ -49,6 +49,8 @@ ConVar  of_ramp_up_multiplier("of_ramp_up_multiplier", "0.25", FCVAR_REPLICATED
 ConVar  of_ramp_down_multiplier("of_ramp_down_multiplier", "2.5", FCVAR_REPLICATED | FCVAR_NOTIFY);
 ConVar  of_zombie_lunge_speed("of_zombie_lunge_speed", "800", FCVAR_ARCHIVE | FCVAR_NOTIFY, "How much velocity, in units, to apply to a zombie lunge.");
 ConVar  of_hook_pendulum("of_hook_pendulum", "0", FCVAR_NOTIFY | FCVAR_REPLICATED, "Turn on pendulum physics for the hook");
+ConVar  tf_movement_groundcache("tf_movement_groundcache", "1", FCVAR_REPLICATED | FCVAR_CHEAT, "Reuse a player's last ground trace while the player, its hull and what it's standing on haven't changed.");
+ConVar  tf_movement_groundcache_verify("tf_movement_groundcache_verify", "0", FCVAR_REPLICATED | FCVAR_CHEAT, "Redo every reused ground trace and report any that come out differently.");
 
 #if defined (CLIENT_DLL)
 ConVar 	of_jumpsound("of_jumpsound", "1", FCVAR_CLIENTDLL | FCVAR_ARCHIVE | FCVAR_USERINFO, "Hough", true, 0, true, 2);
@@ -76,6 +78,46 @@ struct NearbyDismount_t
 	float					distSqr;
 };
 
+// Only traces that found the ground within this distance are kept. Nothing
+// else fits in a gap that thin, so the trace can only change if the player
+// or the ground does.
+#define GROUNDCACHE_MAX_GAP		1.0f
+
+//-----------------------------------------------------------------------------
+// Purpose: A player's last ground trace and everything it depended on
+//-----------------------------------------------------------------------------
+struct GroundTraceCache_t
+{
+	bool			m_bValid;
+	int				m_nPlayerHandle;
+	Vector			m_vecStart;
+	Vector			m_vecEnd;
+	Vector			m_vecMins;
+	Vector			m_vecMaxs;
+	unsigned int	m_fMask;
+	bool			m_bSolidObjects;
+
+	// What the trace hit, and where it was at the time
+	EHANDLE			m_hGround;
+	bool			m_bGroundIsWorld;
+	Vector			m_vecGroundOrigin;
+	QAngle			m_angGroundAngles;
+	Vector			m_vecGroundMins;
+	Vector			m_vecGroundMaxs;
+	int				m_nGroundSolid;
+	int				m_nGroundSolidFlags;
+	int				m_nGroundModelIndex;
+
+	trace_t			m_Trace;
+};
+
+extern bool g_bMovementOptimizations;
+
+static int s_nGroundCacheHits;
+static int s_nGroundCacheMisses;
+static int s_nGroundCacheStored;
+static int s_nGroundCacheMismatches;
+
 class CTFGameMovement : public CGameMovement
 {
 public:
@@ -124,10 +166,16 @@ private:
 	void		CheckRamp(float *flMul, int rampMode);
 	void		CheckCSlideSound(bool CSliding);
 
+	void		TraceGround(const Vector& start, const Vector& end, trace_t& trace);
+	bool		IsGroundCacheValid(const GroundTraceCache_t& cache, const Vector& start, const Vector& end);
+	void		StoreGroundCache(GroundTraceCache_t& cache, const Vector& start, const Vector& end, const trace_t& trace);
+
 private:
 
 	Vector		m_vecWaterPoint;
 	CTFPlayer  *m_pTFPlayer;
+
+	GroundTraceCache_t	m_GroundCache[MAX_PLAYERS];
 };
 
 
@@ -144,6 +192,11 @@ EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CGameMovement, IGameMovement, INTERFACENAME_GA
 CTFGameMovement::CTFGameMovement()
 {
 	m_pTFPlayer = NULL;
+
+	for (int i = 0; i < MAX_PLAYERS; i++)
+	{
+		m_GroundCache[i].m_bValid = false;
+	}
 }
 
 //---------------------------------------------------------------------------------------- 
@@ -1262,6 +1315,143 @@ void CTFGameMovement::TracePlayerBBox(const Vector& start, const Vector& end, un
 	enginetrace->TraceRay(ray, fMask, &traceFilter, &pm);
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Does the cache still describe this trace? The player, hull, mask
+//			and filter have to match exactly, and whatever was hit has to be
+//			the same entity, where it was.
+//-----------------------------------------------------------------------------
+bool CTFGameMovement::IsGroundCacheValid(const GroundTraceCache_t& cache, const Vector& start, const Vector& end)
+{
+	if (!cache.m_bValid ||
+		cache.m_nPlayerHandle != mv->m_nPlayerHandle.ToInt() ||
+		cache.m_vecStart != start ||
+		cache.m_vecEnd != end ||
+		cache.m_vecMins != GetPlayerMins() ||
+		cache.m_vecMaxs != GetPlayerMaxs() ||
+		cache.m_fMask != PlayerSolidMask() ||
+		cache.m_bSolidObjects != tf_solidobjects.GetBool())
+	{
+		return false;
+	}
+
+	CBaseEntity *pGround = cache.m_hGround.Get();
+	if (!pGround || pGround != cache.m_Trace.m_pEnt)
+		return false;
+
+	if (cache.m_bGroundIsWorld)
+		return true;
+
+	return pGround->GetAbsOrigin() == cache.m_vecGroundOrigin &&
+		pGround->GetAbsAngles() == cache.m_angGroundAngles &&
+		pGround->CollisionProp()->OBBMins() == cache.m_vecGroundMins &&
+		pGround->CollisionProp()->OBBMaxs() == cache.m_vecGroundMaxs &&
+		pGround->GetSolid() == cache.m_nGroundSolid &&
+		pGround->GetSolidFlags() == cache.m_nGroundSolidFlags &&
+		pGround->GetModelIndex() == cache.m_nGroundModelIndex;
+}
+
+void CTFGameMovement::StoreGroundCache(GroundTraceCache_t& cache, const Vector& start, const Vector& end, const trace_t& trace)
+{
+	cache.m_bValid = false;
+
+	// Only a trace that landed on the ground right below us can be trusted later
+	if (trace.fraction >= 1.0f || trace.startsolid || trace.allsolid || !trace.m_pEnt)
+		return;
+
+	if ((trace.endpos - start).LengthSqr() > GROUNDCACHE_MAX_GAP * GROUNDCACHE_MAX_GAP)
+		return;
+
+	// The world doesn't move, anything else has to be what we're standing on so it's worth tracking
+	CBaseEntity *pGround = trace.m_pEnt;
+	bool bWorld = pGround->IsWorld();
+	if (!bWorld && pGround != player->GetGroundEntity())
+		return;
+
+	cache.m_bValid = true;
+	cache.m_nPlayerHandle = mv->m_nPlayerHandle.ToInt();
+	cache.m_vecStart = start;
+	cache.m_vecEnd = end;
+	cache.m_vecMins = GetPlayerMins();
+	cache.m_vecMaxs = GetPlayerMaxs();
+	cache.m_fMask = PlayerSolidMask();
+	cache.m_bSolidObjects = tf_solidobjects.GetBool();
+
+	cache.m_hGround = pGround;
+	cache.m_bGroundIsWorld = bWorld;
+	cache.m_vecGroundOrigin = pGround->GetAbsOrigin();
+	cache.m_angGroundAngles = pGround->GetAbsAngles();
+	cache.m_vecGroundMins = pGround->CollisionProp()->OBBMins();
+	cache.m_vecGroundMaxs = pGround->CollisionProp()->OBBMaxs();
+	cache.m_nGroundSolid = pGround->GetSolid();
+	cache.m_nGroundSolidFlags = pGround->GetSolidFlags();
+	cache.m_nGroundModelIndex = pGround->GetModelIndex();
+
+	cache.m_Trace = trace;
+	s_nGroundCacheStored++;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The ground trace from CategorizePosition. A player standing still
+//			asks the same question several times per command, so the last
+//			answer is reused for as long as nothing it depends on changes.
+//-----------------------------------------------------------------------------
+void CTFGameMovement::TraceGround(const Vector& start, const Vector& end, trace_t& trace)
+{
+	int idx = player->entindex() - 1;
+	if (!g_bMovementOptimizations || !tf_movement_groundcache.GetBool() || idx < 0 || idx >= MAX_PLAYERS)
+	{
+		TracePlayerBBox(start, end, PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, trace);
+		return;
+	}
+
+	GroundTraceCache_t &cache = m_GroundCache[idx];
+	if (IsGroundCacheValid(cache, start, end))
+	{
+		s_nGroundCacheHits++;
+		trace = cache.m_Trace;
+
+		if (tf_movement_groundcache_verify.GetBool())
+		{
+			trace_t check;
+			TracePlayerBBox(start, end, PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, check);
+			if (check.fraction != trace.fraction || check.endpos != trace.endpos || check.plane.normal != trace.plane.normal ||
+				check.m_pEnt != trace.m_pEnt || check.startsolid != trace.startsolid || check.contents != trace.contents)
+			{
+				s_nGroundCacheMismatches++;
+				Warning("Ground cache mismatch for player %d at (%.2f %.2f %.2f)\n", idx + 1, start.x, start.y, start.z);
+				trace = check;
+				StoreGroundCache(cache, start, end, trace);
+			}
+		}
+		return;
+	}
+
+	s_nGroundCacheMisses++;
+	TracePlayerBBox(start, end, PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, trace);
+	StoreGroundCache(cache, start, end, trace);
+}
+
+#ifdef GAME_DLL
+CON_COMMAND(tf_movement_groundcache_stats, "Shows how many ground traces the movement code reused. Pass 'reset' to clear the counters.")
+{
+	if (!UTIL_IsCommandIssuedByServerAdmin())
+		return;
+
+	if (args.ArgC() > 1 && !Q_stricmp(args[1], "reset"))
+	{
+		s_nGroundCacheHits = 0;
+		s_nGroundCacheMisses = 0;
+		s_nGroundCacheStored = 0;
+		s_nGroundCacheMismatches = 0;
+		return;
+	}
+
+	int nTotal = s_nGroundCacheHits + s_nGroundCacheMisses;
+	Msg("Ground traces: %d, %d reused (%.1f%%), %d cached, %d mismatches\n",
+		nTotal, s_nGroundCacheHits, nTotal ? 100.0f * s_nGroundCacheHits / nTotal : 0.0f, s_nGroundCacheStored, s_nGroundCacheMismatches);
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : &input - 
@@ -1312,7 +1502,7 @@ void CTFGameMovement::CategorizePosition(void)
 	}
 
 	trace_t trace;
-	TracePlayerBBox(vecStartPos, vecEndPos, PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, trace);
+	TraceGround(vecStartPos, vecEndPos, trace);
 
 	// Steep plane, not on ground.
 	if (trace.plane.normal.z < 0.7f)
@@ -4702,6 +4702,16 @@ bool CTFGameRules::CanHaveAmmo( CBaseCombatCharacter *pPlayer, int iAmmoIndex )
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFGameRules::PlayerGotItem( CBasePlayer *pPlayer, CItem *pItem )
+{
+	BaseClass::PlayerGotItem( pPlayer, pItem );
+
+	CTF_GameStats.Event_PlayerPickedUpItem( ToTFPlayer( pPlayer ), pItem );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
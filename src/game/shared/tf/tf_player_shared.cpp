@@ -13,6 +13,9 @@
 #include "fmtstr.h"
 #include "tf_viewmodel.h"
 #include "tf_weapon_fists.h"
+#include "bitvec.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/random.h"
 
 #ifdef CLIENT_DLL
 	#include "c_tf_playerclass.h"
@@ -125,7 +128,7 @@ BEGIN_RECV_TABLE_NOBASE( CTFPlayerShared, DT_TFPlayerSharedLocal )
 	RecvPropFloat( RECVINFO( m_flCloakMeter) ),
 	RecvPropArray3( RECVINFO_ARRAY( m_bPlayerDominated ), RecvPropBool( RECVINFO( m_bPlayerDominated[0] ) ) ),
 	RecvPropArray3( RECVINFO_ARRAY( m_bPlayerDominatingMe ), RecvPropBool( RECVINFO( m_bPlayerDominatingMe[0] ) ) ),
-	RecvPropArray3( RECVINFO_ARRAY( m_flCondExpireTimeLeft ), RecvPropFloat( RECVINFO( m_flCondExpireTimeLeft[0] ) ) ),
+	RecvPropArray3( RECVINFO_ARRAY( m_flCondExpireTime ), RecvPropTime( RECVINFO( m_flCondExpireTime[0] ) ) ),
 END_RECV_TABLE()
 
 BEGIN_RECV_TABLE_NOBASE( CTFPlayerShared, DT_TFPlayerShared )
@@ -191,7 +194,7 @@ BEGIN_SEND_TABLE_NOBASE( CTFPlayerShared, DT_TFPlayerSharedLocal )
 	SendPropFloat( SENDINFO( m_flCloakMeter ), 0, SPROP_NOSCALE | SPROP_CHANGES_OFTEN, 0.0, 100.0 ),
 	SendPropArray3( SENDINFO_ARRAY3( m_bPlayerDominated ), SendPropBool( SENDINFO_ARRAY( m_bPlayerDominated ) ) ),
 	SendPropArray3( SENDINFO_ARRAY3( m_bPlayerDominatingMe ), SendPropBool( SENDINFO_ARRAY( m_bPlayerDominatingMe ) ) ),
-	SendPropArray3( SENDINFO_ARRAY3( m_flCondExpireTimeLeft ), SendPropFloat( SENDINFO_ARRAY( m_flCondExpireTimeLeft ) ) ),
+	SendPropArray3( SENDINFO_ARRAY3( m_flCondExpireTime ), SendPropTime( SENDINFO_ARRAY( m_flCondExpireTime ) ) ),
 END_SEND_TABLE()
 
 BEGIN_SEND_TABLE_NOBASE( CTFPlayerShared, DT_TFPlayerShared )
@@ -283,48 +286,10 @@ void CTFPlayerShared::AddCond( int nCond, float flDuration /* = PERMANENT_CONDIT
 {
 	Assert( nCond >= 0 && nCond < TF_COND_LAST );
 
-	int nCond2 = nCond;
-	int *pCond2 = NULL;
+	GetCondBitsForModify( nCond / 32 ) |= ( 1 << ( nCond % 32 ) );
 
-	// ...... bruh
-
-	// how this works: we store the appropiate m_nPlayerCond into pCond2, 
-	// and then pCond2 gets its values transferred back to the m_nPlayerCond
-	if ( nCond < 128 )
-	{
-		if ( nCond < 96 )
-		{
-			if ( nCond < 64 )
-			{
-				if ( nCond < 32 )
-					pCond2 = &m_nPlayerCond.GetForModify();
-				else
-				{
-					pCond2 = &m_nPlayerCondEx.GetForModify();
-					nCond2 -= 32;
-				}
-			}
-			else
-			{
-				pCond2 = &m_nPlayerCondEx2.GetForModify();
-				nCond2 -= 64;
-			}
-		}
-		else
-		{
-			pCond2 = &m_nPlayerCondEx3.GetForModify();
-			nCond2 -= 96;
-		}
-	}
-	else
-	{
-		pCond2 = &m_nPlayerCondEx4.GetForModify();
-		nCond2 -= 128;
-	}
-
-	*pCond2 |= ( 1 << nCond2 );
-
-	m_flCondExpireTimeLeft.Set( nCond, flDuration );
+	// Networked as the time it runs out, so it only goes out again when the condition is reapplied
+	m_flCondExpireTime.Set( nCond, ( flDuration == PERMANENT_CONDITION ) ? PERMANENT_CONDITION : gpGlobals->curtime + flDuration );
 
 	OnConditionAdded( nCond );
 }
@@ -336,48 +301,9 @@ void CTFPlayerShared::RemoveCond( int nCond )
 {
 	Assert( nCond >= 0 && nCond < TF_COND_LAST );
 
-	int nCond2 = nCond;
-	int *pCond2 = NULL;
-
-	// ...... bruh
+	GetCondBitsForModify( nCond / 32 ) &= ~( 1 << ( nCond % 32 ) );
 
-	// how this works: we store the appropiate m_nPlayerCond into pCond2, 
-	// and then pCond2 gets its values transferred back to the m_nPlayerCond
-	if ( nCond < 128 )
-	{
-		if ( nCond < 96 )
-		{
-			if ( nCond < 64 )
-			{
-				if ( nCond < 32 )
-					pCond2 = &m_nPlayerCond.GetForModify();
-				else
-				{
-					pCond2 = &m_nPlayerCondEx.GetForModify();
-					nCond2 -= 32;
-				}
-			}
-			else
-			{
-				pCond2 = &m_nPlayerCondEx2.GetForModify();
-				nCond2 -= 64;
-			}
-		}
-		else
-		{
-			pCond2 = &m_nPlayerCondEx3.GetForModify();
-			nCond2 -= 96;
-		}
-	}
-	else
-	{
-		pCond2 = &m_nPlayerCondEx4.GetForModify();
-		nCond2 -= 128;
-	}
-
-	*pCond2 &= ~( 1 << nCond2 );
-
-	m_flCondExpireTimeLeft.Set( nCond, 0 );
+	m_flCondExpireTime.Set( nCond, 0 );
 
 	OnConditionRemoved( nCond );
 }
@@ -389,50 +315,38 @@ bool CTFPlayerShared::InCond( int nCond )
 {
 	Assert(nCond >= 0 && nCond < TF_COND_LAST);
 
-	int nCond2 = nCond;
-	const int *pCond2 = NULL;
-
-	// ...... bruh
+	return ( ( GetCondBits( nCond / 32 ) & ( 1 << ( nCond % 32 ) ) ) != 0 );
+}
 
-	// how this works: we store the appropiate m_nPlayerCond into pCond2, 
-	// and then pCond2 gets its values transferred back to the m_nPlayerCond
-	if ( nCond < 128 )
+//-----------------------------------------------------------------------------
+// Purpose: Conditions are split over five networked ints, 32 to each
+//-----------------------------------------------------------------------------
+int CTFPlayerShared::GetCondBits( int iWord ) const
+{
+	switch ( iWord )
 	{
-		if ( nCond < 96 )
-		{
-			if ( nCond < 64 )
-			{
-				if ( nCond < 32 )
-					pCond2 = &m_nPlayerCond.GetForModify();
-				else
-				{
-					pCond2 = &m_nPlayerCondEx.GetForModify();
-					nCond2 -= 32;
-				}
-			}
-			else
-			{
-				pCond2 = &m_nPlayerCondEx2.GetForModify();
-				nCond2 -= 64;
-			}
-		}
-		else
-		{
-			pCond2 = &m_nPlayerCondEx3.GetForModify();
-			nCond2 -= 96;
-		}
+	case 0:		return m_nPlayerCond;
+	case 1:		return m_nPlayerCondEx;
+	case 2:		return m_nPlayerCondEx2;
+	case 3:		return m_nPlayerCondEx3;
+	default:	return m_nPlayerCondEx4;
 	}
-	else
+}
+
+int &CTFPlayerShared::GetCondBitsForModify( int iWord )
+{
+	switch ( iWord )
 	{
-		pCond2 = &m_nPlayerCondEx4.GetForModify();
-		nCond2 -= 128;
+	case 0:		return m_nPlayerCond.GetForModify();
+	case 1:		return m_nPlayerCondEx.GetForModify();
+	case 2:		return m_nPlayerCondEx2.GetForModify();
+	case 3:		return m_nPlayerCondEx3.GetForModify();
+	default:	return m_nPlayerCondEx4.GetForModify();
 	}
-
-	return ( ( *pCond2 & ( 1 << nCond2 ) ) != 0 );
 }
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: Time left on a condition, PERMANENT_CONDITION if it doesn't run out
 //-----------------------------------------------------------------------------
 float CTFPlayerShared::GetConditionDuration( int nCond )
 {
@@ -440,12 +354,30 @@ float CTFPlayerShared::GetConditionDuration( int nCond )
 
 	if ( InCond( nCond ) )
 	{
-		return m_flCondExpireTimeLeft[nCond];
+		if ( m_flCondExpireTime[nCond] == PERMANENT_CONDITION )
+			return PERMANENT_CONDITION;
+
+		return max( m_flCondExpireTime[nCond] - gpGlobals->curtime, 0 );
 	}
 	
 	return 0.0f;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Time a condition runs out, PERMANENT_CONDITION if it doesn't
+//-----------------------------------------------------------------------------
+float CTFPlayerShared::GetConditionExpireTime( int nCond )
+{
+	Assert( nCond >= 0 && nCond < TF_COND_LAST );
+
+	if ( InCond( nCond ) )
+	{
+		return m_flCondExpireTime[nCond];
+	}
+
+	return 0.0f;
+}
+
 void CTFPlayerShared::DebugPrintConditions( void )
 {
 #ifdef GAME_DLL
@@ -462,13 +394,13 @@ void CTFPlayerShared::DebugPrintConditions( void )
 	{
 		if ( InCond(i) )
 		{
-			if ( m_flCondExpireTimeLeft[i] == PERMANENT_CONDITION )
+			if ( m_flCondExpireTime[i] == PERMANENT_CONDITION )
 			{
 				Msg( "( %s ) Condition %d - ( permanent cond )\n", szDll, i );
 			}
 			else
 			{
-				Msg( "( %s ) Condition %d - ( %.1f left )\n", szDll, i, m_flCondExpireTimeLeft[i] );
+				Msg( "( %s ) Condition %d - ( %.1f left )\n", szDll, i, GetConditionDuration( i ) );
 			}
 
 			iNumFound++;
@@ -562,11 +494,14 @@ void CTFPlayerShared::UpdateConditions( int nCond, int nCondOld, int nCondOffset
 //-----------------------------------------------------------------------------
 void CTFPlayerShared::RemoveAllCond(CTFPlayer *pPlayer)
 {
-	int i;
-	for (i = 0; i < TF_COND_LAST; i++)
+	for ( int iWord = 0; iWord < TF_COND_WORDS; iWord++ )
 	{
-		if ( InCond( i ) )
-			RemoveCond( i );
+		for ( unsigned int nBits = GetCondBits( iWord ); nBits; nBits &= nBits - 1 )
+		{
+			int i = FirstBitInWord( nBits, iWord * 32 );
+			if ( InCond( i ) )
+				RemoveCond( i );
+		}
 	}
 
 	// Now remove all the rest
@@ -805,28 +740,34 @@ void CTFPlayerShared::ConditionGameRulesThink( void )
 		m_flNextCritUpdate = gpGlobals->curtime + 0.5;
 	}
 
-	int i;
-	for ( i=0;i<TF_COND_LAST;i++ )
+	// If we're being healed, we reduce bad conditions faster
+	float flHealerReduction = m_aHealers.Count() * gpGlobals->frametime * 4;
+
+	// Only visit the conditions we're in
+	for ( int iWord = 0; iWord < TF_COND_WORDS; iWord++ )
 	{
-		if ( InCond( i ) )
+		for ( unsigned int nBits = GetCondBits( iWord ); nBits; nBits &= nBits - 1 )
 		{
-			// Ignore permanent conditions
-			if ( m_flCondExpireTimeLeft[i] != PERMANENT_CONDITION )
-			{
-				float flReduction = gpGlobals->frametime;
+			int i = FirstBitInWord( nBits, iWord * 32 );
 
-				// If we're being healed, we reduce bad conditions faster
-				if ( i > TF_COND_HEALTH_BUFF && m_aHealers.Count() > 0 )
-				{
-					flReduction += (m_aHealers.Count() * flReduction * 4);
-				}
+			// Removing an earlier one may have taken this one with it
+			if ( !InCond( i ) )
+				continue;
 
-				m_flCondExpireTimeLeft.Set( i, max( m_flCondExpireTimeLeft[i] - flReduction, 0 ) );
+			// Ignore permanent conditions
+			float flExpireTime = m_flCondExpireTime[i];
+			if ( flExpireTime == PERMANENT_CONDITION )
+				continue;
 
-				if ( m_flCondExpireTimeLeft[i] == 0 )
-				{
-					RemoveCond( i );
-				}
+			if ( i > TF_COND_HEALTH_BUFF && flHealerReduction > 0 )
+			{
+				flExpireTime -= flHealerReduction;
+				m_flCondExpireTime.Set( i, flExpireTime );
+			}
+
+			if ( gpGlobals->curtime >= flExpireTime )
+			{
+				RemoveCond( i );
 			}
 		}
 	}
@@ -902,11 +843,11 @@ void CTFPlayerShared::ConditionGameRulesThink( void )
 					CTFPlayer *pPlayer = static_cast<CTFPlayer *>( static_cast<CBaseEntity *>( m_aHealers[i].pPlayer ) );
 					if ( IsAlly( pPlayer ) )
 					{
-						CTF_GameStats.Event_PlayerHealedOther( pPlayer, nHealthToAdd * ( m_aHealers[i].flAmount / fTotalHealAmount ) );
+						CTF_GameStats.Event_PlayerHealedOther( pPlayer, nHealthToAdd * ( m_aHealers[i].flAmount / fTotalHealAmount ), m_pOuter );
 					}
 					else
 					{
-						CTF_GameStats.Event_PlayerLeachedHealth( m_pOuter, m_aHealers[i].bDispenserHeal, nHealthToAdd * ( m_aHealers[i].flAmount / fTotalHealAmount ) );
+						CTF_GameStats.Event_PlayerLeachedHealth( m_pOuter, m_aHealers[i].bDispenserHeal, nHealthToAdd * ( m_aHealers[i].flAmount / fTotalHealAmount ), pPlayer );
 					}
 				}
 			}
@@ -2826,6 +2767,17 @@ void CTFPlayer::FireBullet( const FireBulletsInfo_t &info, bool bDoEffects, int
 	}
 #endif
 
+	FireBulletImpact( info, trace, bDoEffects, nDamageType, nCustomDamageType );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Effects and damage for a bullet that has already been traced.
+//			Weapons that trace their own shots come in here directly.
+//-----------------------------------------------------------------------------
+void CTFPlayer::FireBulletImpact( const FireBulletsInfo_t &info, trace_t &trace, bool bDoEffects, int nDamageType, int nCustomDamageType /*= TF_DMG_CUSTOM_NONE*/ )
+{
+	Vector vecStart = info.m_vecSrc;
+
 	if( trace.fraction < 1.0 )
 	{
 		// Verify we have an entity at the point of impact.
@@ -3832,4 +3784,156 @@ bool CTFPlayerShared::InPowerupCond()
 			return true;
 	}
 	return false;
-}
\ No newline at end of file
+}
+#ifdef GAME_DLL
+
+// Each changed array element goes out as its own prop: the prop index delta plus the 32 bit float
+#define COND_EXPIRE_BITS_PER_CHANGE		40
+
+//-----------------------------------------------------------------------------
+// Purpose: Replays a server full of players picking up powerups, counting
+//			how many expiry entries differ from the last snapshot when they
+//			hold the time left (counted down every tick, the old way) vs. the
+//			time they expire at. Also times the old full condition scan
+//			against the bit scan ConditionGameRulesThink does now.
+//-----------------------------------------------------------------------------
+CON_COMMAND( tf_cond_bandwidth_compare, "Compares condition expiry snapshot traffic for time-left and expire-time networking. Usage: tf_cond_bandwidth_compare [players] [powerups each] [seconds]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nPlayers = ( args.ArgC() > 1 ) ? clamp( atoi( args[1] ), 1, MAX_PLAYERS ) : 24;
+	int nPowerups = ( args.ArgC() > 2 ) ? clamp( atoi( args[2] ), 1, COND_LAST_POWERUP - COND_FIRST_POWERUP + 1 ) : 3;
+	float flSeconds = ( args.ArgC() > 3 ) ? MAX( 1.0f, atof( args[3] ) ) : 60.0f;
+	float flInterval = gpGlobals->interval_per_tick;
+	int nTicks = (int)( flSeconds / flInterval );
+
+	// Same pickups for both, as long as they expire on the same tick
+	CUniformRandomStream oldRandom, newRandom;
+	oldRandom.SetSeed( 1 );
+	newRandom.SetSeed( 1 );
+
+	// Per player: condition bits and expiry array for each scheme, plus what the client last got
+	int nSlots = nPlayers * TF_COND_LAST;
+	CUtlVector< int > oldBits, newBits;
+	CUtlVector< float > timeLeft, timeLeftSent, expireTime, expireTimeSent;
+	oldBits.SetCount( nPlayers * TF_COND_WORDS );
+	newBits.SetCount( nPlayers * TF_COND_WORDS );
+	timeLeft.SetCount( nSlots );
+	timeLeftSent.SetCount( nSlots );
+	expireTime.SetCount( nSlots );
+	expireTimeSent.SetCount( nSlots );
+	Q_memset( oldBits.Base(), 0, oldBits.Count() * sizeof( int ) );
+	Q_memset( newBits.Base(), 0, newBits.Count() * sizeof( int ) );
+	Q_memset( timeLeft.Base(), 0, nSlots * sizeof( float ) );
+	Q_memset( timeLeftSent.Base(), 0, nSlots * sizeof( float ) );
+	Q_memset( expireTime.Base(), 0, nSlots * sizeof( float ) );
+	Q_memset( expireTimeSent.Base(), 0, nSlots * sizeof( float ) );
+
+	int nTimeLeftChanges = 0;
+	int nExpireTimeChanges = 0;
+	int nPickups = 0;
+	CCycleCount scanTime, bitScanTime;
+
+	for ( int iTick = 1; iTick <= nTicks; iTick++ )
+	{
+		float flTime = iTick * flInterval;
+
+		// Everyone holds their powerups, picking one up again as soon as it runs out
+		for ( int iPlayer = 0; iPlayer < nPlayers; iPlayer++ )
+		{
+			for ( int iPowerup = 0; iPowerup < nPowerups; iPowerup++ )
+			{
+				int nCond = COND_FIRST_POWERUP + iPowerup;
+				int iWord = iPlayer * TF_COND_WORDS + nCond / 32;
+				int nBit = 1 << ( nCond % 32 );
+				int iSlot = iPlayer * TF_COND_LAST + nCond;
+
+				if ( !( oldBits[iWord] & nBit ) )
+				{
+					oldBits[iWord] |= nBit;
+					timeLeft[iSlot] = oldRandom.RandomFloat( 10.0f, 30.0f );
+					nPickups++;
+				}
+
+				if ( !( newBits[iWord] & nBit ) )
+				{
+					newBits[iWord] |= nBit;
+					expireTime[iSlot] = flTime + newRandom.RandomFloat( 10.0f, 30.0f );
+				}
+			}
+		}
+
+		// The old ConditionGameRulesThink: every condition, counting down the active ones
+		{
+			CTimeAdder timer( &scanTime );
+			for ( int iPlayer = 0; iPlayer < nPlayers; iPlayer++ )
+			{
+				int *pBits = &oldBits[ iPlayer * TF_COND_WORDS ];
+				float *pTimeLeft = &timeLeft[ iPlayer * TF_COND_LAST ];
+				for ( int i = 0; i < TF_COND_LAST; i++ )
+				{
+					if ( pBits[i / 32] & ( 1 << ( i % 32 ) ) )
+					{
+						pTimeLeft[i] = max( pTimeLeft[i] - flInterval, 0 );
+						if ( pTimeLeft[i] == 0 )
+						{
+							pBits[i / 32] &= ~( 1 << ( i % 32 ) );
+						}
+					}
+				}
+			}
+		}
+
+		// The new one: only the active conditions, against the time they expire
+		{
+			CTimeAdder timer( &bitScanTime );
+			for ( int iPlayer = 0; iPlayer < nPlayers; iPlayer++ )
+			{
+				int *pBits = &newBits[ iPlayer * TF_COND_WORDS ];
+				const float *pExpireTime = &expireTime[ iPlayer * TF_COND_LAST ];
+				for ( int iWord = 0; iWord < TF_COND_WORDS; iWord++ )
+				{
+					for ( unsigned int nBits = pBits[iWord]; nBits; nBits &= nBits - 1 )
+					{
+						int i = FirstBitInWord( nBits, iWord * 32 );
+						if ( flTime >= pExpireTime[i] )
+						{
+							pBits[iWord] &= ~( 1 << ( i % 32 ) );
+						}
+					}
+				}
+			}
+		}
+
+		// Snapshot, sent every tick
+		for ( int iSlot = 0; iSlot < nSlots; iSlot++ )
+		{
+			if ( timeLeft[iSlot] != timeLeftSent[iSlot] )
+			{
+				timeLeftSent[iSlot] = timeLeft[iSlot];
+				nTimeLeftChanges++;
+			}
+
+			if ( expireTime[iSlot] != expireTimeSent[iSlot] )
+			{
+				expireTimeSent[iSlot] = expireTime[iSlot];
+				nExpireTimeChanges++;
+			}
+		}
+	}
+
+	float flSimulated = nTicks * flInterval;
+	Msg( "%d players holding %d powerups each for %.0f seconds at %.0f ticks per second, %d pickups\n",
+		nPlayers, nPowerups, flSimulated, 1.0f / flInterval, nPickups );
+	// The expiry array is in the local table, each player only gets their own
+	float flBytesPerChange = COND_EXPIRE_BITS_PER_CHANGE / 8.0f;
+	Msg( "  time left:   %8d entries sent, ~%.1f bytes/s per player\n",
+		nTimeLeftChanges, nTimeLeftChanges * flBytesPerChange / flSimulated / nPlayers );
+	Msg( "  expire time: %8d entries sent, ~%.1f bytes/s per player\n",
+		nExpireTimeChanges, nExpireTimeChanges * flBytesPerChange / flSimulated / nPlayers );
+	Msg( "  condition think usec per tick: full scan %.2f, bit scan %.2f\n",
+		scanTime.GetMicrosecondsF() / nTicks, bitScanTime.GetMicrosecondsF() / nTicks );
+}
+
+#endif // GAME_DLL
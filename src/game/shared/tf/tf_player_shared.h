@@ -39,6 +39,7 @@
 //=============================================================================
 
 #define PERMANENT_CONDITION		-1
+#define TF_COND_WORDS			( ( TF_COND_LAST + 31 ) / 32 )
 
 // Damage storage for crit multiplier calculation
 class CTFDamageEvent
@@ -99,6 +100,7 @@ public:
 	void	OnConditionRemoved( int nCond );
 	void	ConditionThink( void );
 	float	GetConditionDuration( int nCond );
+	float	GetConditionExpireTime( int nCond );
 
 	void	ConditionGameRulesThink( void );
 
@@ -257,6 +259,9 @@ private:
 
 	void ImpactWaterTrace( trace_t &trace, const Vector &vecStart );
 
+	int		GetCondBits( int iWord ) const;
+	int		&GetCondBitsForModify( int iWord );
+
 	void OnAddStealthed( void );
 	void OnAddInvulnerable( void );
 	void OnAddCritBoosted( void );
@@ -316,7 +321,7 @@ private:
 	CNetworkVar( int, m_nPlayerCondEx3 );		// Disgusting, don't blame me -ficool2
 	CNetworkVar( int, m_nPlayerCondEx4 );
 
-	CNetworkArray( float, m_flCondExpireTimeLeft, TF_COND_LAST );	// Time until each condition expires
+	CNetworkArray( float, m_flCondExpireTime, TF_COND_LAST );	// Time each condition expires at
 
 //TFTODO: What if the player we're disguised as leaves the server?
 //...maybe store the name instead of the index?
@@ -0,0 +1,279 @@
+//====== Copyright © 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: On-disk layout of the per-map binary stats stream written by the
+//			server (tf_statsstream.cpp) and read back by ofstatsdump.
+//
+//			A file is a StatsStreamFileHeader_t followed by any number of
+//			blocks. Every block holds up to STATSSTREAM_BLOCK_ROWS rows of a
+//			single event type, stored column by column: all values of the
+//			first column, then all values of the second, and so on. Column
+//			order and widths come from the tables below, so the reader never
+//			needs game code to walk a file.
+//
+//			Everything is little endian, the only platforms the server runs on.
+//
+//			This header is included by tools, keep it free of game includes.
+//
+//=============================================================================//
+#ifndef TF_STATSSTREAM_FORMAT_H
+#define TF_STATSSTREAM_FORMAT_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include <stddef.h>
+#include "tier0/basetypes.h"
+
+#define STATSSTREAM_MAGIC			MAKEID( 'O', 'F', 'S', 'S' )
+#define STATSSTREAM_VERSION			1
+#define STATSSTREAM_BLOCK_ROWS		256
+#define STATSSTREAM_MAP_NAME		64
+#define STATSSTREAM_STRING_SIZE		62
+#define STATSSTREAM_NETWORKID_SIZE	32
+#define STATSSTREAM_PLAYERNAME_SIZE	32
+
+// Positions are stored as whole units, which fits any legal map
+#define STATSSTREAM_COORD( f )		( (int16)Clamp( (int)( f ), -32768, 32767 ) )
+
+enum StatsStreamEvent_t
+{
+	STATSSTREAM_STRING = 0,		// id -> string, written the first time a string is referenced
+	STATSSTREAM_PLAYER,			// userid -> team, class, name, network id; written on spawn
+	STATSSTREAM_KILL,
+	STATSSTREAM_DAMAGE,
+	STATSSTREAM_HEAL,
+	STATSSTREAM_PICKUP,
+	STATSSTREAM_ROUND,
+
+	STATSSTREAM_EVENT_COUNT
+};
+
+// Heal sources
+enum
+{
+	STATSSTREAM_HEAL_ALLY = 0,	// healed by a teammate (medigun and friends)
+	STATSSTREAM_HEAL_LEACH,		// healed by an enemy
+	STATSSTREAM_HEAL_DISPENSER,
+};
+
+#pragma pack( push, 1 )
+
+struct StatsStreamFileHeader_t
+{
+	uint32	nMagic;
+	uint16	nVersion;
+	uint16	nHeaderSize;					// sizeof( StatsStreamFileHeader_t ), blocks start here
+	float	flTickInterval;
+	int32	nStartTime;						// time( NULL ) when the map started
+	char	szMap[ STATSSTREAM_MAP_NAME ];
+};
+
+struct StatsStreamBlockHeader_t
+{
+	uint8	nEvent;							// StatsStreamEvent_t
+	uint8	nColumns;
+	uint16	nRows;
+	uint32	nBytes;							// size of the column data following this header
+};
+
+//-----------------------------------------------------------------------------
+// Rows. These are only the in-memory staging layout, on disk each field is
+// its own column. Player references are userids, -1 for none.
+//-----------------------------------------------------------------------------
+struct StatsStreamString_t
+{
+	int16	nID;
+	char	szString[ STATSSTREAM_STRING_SIZE ];
+};
+
+struct StatsStreamPlayer_t
+{
+	int32	nTick;
+	int16	nUserID;
+	uint8	nTeam;
+	uint8	nClass;
+	uint8	bBot;
+	char	szName[ STATSSTREAM_PLAYERNAME_SIZE ];
+	char	szNetworkID[ STATSSTREAM_NETWORKID_SIZE ];
+};
+
+struct StatsStreamKill_t
+{
+	int32	nTick;
+	int16	nAttacker;
+	int16	nVictim;
+	int16	nAssister;
+	uint8	nAttackerClass;
+	uint8	nVictimClass;
+	int16	nWeapon;						// string id of the killing weapon name, as in the kill feed
+	uint8	nDamageCustom;
+	uint8	bCrit;
+	int16	vecAttacker[ 3 ];
+	int16	vecVictim[ 3 ];
+};
+
+struct StatsStreamDamage_t
+{
+	int32	nTick;
+	int16	nAttacker;
+	int16	nVictim;
+	int16	nWeapon;						// string id of the weapon name, as in the kill feed
+	int16	nDamage;
+	uint8	nAttackerClass;
+	uint8	nVictimClass;
+	uint8	bCrit;
+	uint8	bKill;
+	int16	vecAttacker[ 3 ];
+	int16	vecVictim[ 3 ];
+};
+
+struct StatsStreamHeal_t
+{
+	int32	nTick;
+	int16	nHealer;
+	int16	nTarget;
+	int16	nAmount;
+	uint8	nSource;
+	int16	vecTarget[ 3 ];
+};
+
+struct StatsStreamPickup_t
+{
+	int32	nTick;
+	int16	nPlayer;
+	int16	nItem;							// string id of the item's classname
+	int16	vecPosition[ 3 ];
+};
+
+struct StatsStreamRound_t
+{
+	int32	nTick;
+	uint8	nWinningTeam;
+	uint8	bFullRound;
+	uint8	bSuddenDeath;
+	float	flRoundTime;
+};
+
+#pragma pack( pop )
+
+//-----------------------------------------------------------------------------
+// Column descriptions, in on-disk order
+//-----------------------------------------------------------------------------
+enum StatsStreamColumnType_t
+{
+	STATSSTREAM_COL_INT = 0,				// signed integer of nSize bytes, nCount elements
+	STATSSTREAM_COL_UINT,
+	STATSSTREAM_COL_FLOAT,
+	STATSSTREAM_COL_STRING,					// fixed size, null terminated
+	STATSSTREAM_COL_STRINGID,				// int16 id of a string row, -1 for none
+};
+
+struct StatsStreamColumn_t
+{
+	const char	*pszName;
+	uint16		nOffset;
+	uint16		nSize;
+	uint8		nType;
+	uint8		nCount;
+};
+
+#define STATSSTREAM_FIELD_SIZE( row, field )	sizeof( ((row *)0)->field )
+#define STATSSTREAM_COLUMN( row, field, type )	{ #field, (uint16)offsetof( row, field ), (uint16)STATSSTREAM_FIELD_SIZE( row, field ), type, 1 }
+#define STATSSTREAM_COLUMN_VEC( row, field )	{ #field, (uint16)offsetof( row, field ), (uint16)STATSSTREAM_FIELD_SIZE( row, field ), STATSSTREAM_COL_INT, 3 }
+
+static const StatsStreamColumn_t g_StatsStreamStringColumns[] =
+{
+	STATSSTREAM_COLUMN( StatsStreamString_t, nID, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamString_t, szString, STATSSTREAM_COL_STRING ),
+};
+
+static const StatsStreamColumn_t g_StatsStreamPlayerColumns[] =
+{
+	STATSSTREAM_COLUMN( StatsStreamPlayer_t, nTick, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamPlayer_t, nUserID, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamPlayer_t, nTeam, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamPlayer_t, nClass, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamPlayer_t, bBot, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamPlayer_t, szName, STATSSTREAM_COL_STRING ),
+	STATSSTREAM_COLUMN( StatsStreamPlayer_t, szNetworkID, STATSSTREAM_COL_STRING ),
+};
+
+static const StatsStreamColumn_t g_StatsStreamKillColumns[] =
+{
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nTick, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nAttacker, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nVictim, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nAssister, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nAttackerClass, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nVictimClass, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nWeapon, STATSSTREAM_COL_STRINGID ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, nDamageCustom, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamKill_t, bCrit, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN_VEC( StatsStreamKill_t, vecAttacker ),
+	STATSSTREAM_COLUMN_VEC( StatsStreamKill_t, vecVictim ),
+};
+
+static const StatsStreamColumn_t g_StatsStreamDamageColumns[] =
+{
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, nTick, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, nAttacker, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, nVictim, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, nWeapon, STATSSTREAM_COL_STRINGID ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, nDamage, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, nAttackerClass, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, nVictimClass, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, bCrit, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamDamage_t, bKill, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN_VEC( StatsStreamDamage_t, vecAttacker ),
+	STATSSTREAM_COLUMN_VEC( StatsStreamDamage_t, vecVictim ),
+};
+
+static const StatsStreamColumn_t g_StatsStreamHealColumns[] =
+{
+	STATSSTREAM_COLUMN( StatsStreamHeal_t, nTick, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamHeal_t, nHealer, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamHeal_t, nTarget, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamHeal_t, nAmount, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamHeal_t, nSource, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN_VEC( StatsStreamHeal_t, vecTarget ),
+};
+
+static const StatsStreamColumn_t g_StatsStreamPickupColumns[] =
+{
+	STATSSTREAM_COLUMN( StatsStreamPickup_t, nTick, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamPickup_t, nPlayer, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamPickup_t, nItem, STATSSTREAM_COL_STRINGID ),
+	STATSSTREAM_COLUMN_VEC( StatsStreamPickup_t, vecPosition ),
+};
+
+static const StatsStreamColumn_t g_StatsStreamRoundColumns[] =
+{
+	STATSSTREAM_COLUMN( StatsStreamRound_t, nTick, STATSSTREAM_COL_INT ),
+	STATSSTREAM_COLUMN( StatsStreamRound_t, nWinningTeam, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamRound_t, bFullRound, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamRound_t, bSuddenDeath, STATSSTREAM_COL_UINT ),
+	STATSSTREAM_COLUMN( StatsStreamRound_t, flRoundTime, STATSSTREAM_COL_FLOAT ),
+};
+
+struct StatsStreamEventDesc_t
+{
+	const char					*pszName;
+	int							nRowSize;
+	const StatsStreamColumn_t	*pColumns;
+	int							nColumns;
+};
+
+#define STATSSTREAM_EVENT( name, row, columns )	{ name, sizeof( row ), columns, ARRAYSIZE( columns ) }
+
+static const StatsStreamEventDesc_t g_StatsStreamEvents[ STATSSTREAM_EVENT_COUNT ] =
+{
+	STATSSTREAM_EVENT( "string", StatsStreamString_t, g_StatsStreamStringColumns ),
+	STATSSTREAM_EVENT( "player", StatsStreamPlayer_t, g_StatsStreamPlayerColumns ),
+	STATSSTREAM_EVENT( "kill", StatsStreamKill_t, g_StatsStreamKillColumns ),
+	STATSSTREAM_EVENT( "damage", StatsStreamDamage_t, g_StatsStreamDamageColumns ),
+	STATSSTREAM_EVENT( "heal", StatsStreamHeal_t, g_StatsStreamHealColumns ),
+	STATSSTREAM_EVENT( "pickup", StatsStreamPickup_t, g_StatsStreamPickupColumns ),
+	STATSSTREAM_EVENT( "round", StatsStreamRound_t, g_StatsStreamRoundColumns ),
+};
+
+#endif // TF_STATSSTREAM_FORMAT_H
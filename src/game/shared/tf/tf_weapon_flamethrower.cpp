@@ -21,6 +21,7 @@
 	#include "tf_obj.h"
 	#include "ai_basenpc.h"
 	#include "tf_bot_manager.h"
+	#include "tf_flame_manager.h"
 
 	ConVar	tf_debug_flamethrower("tf_debug_flamethrower", "0", FCVAR_CHEAT, "Visualize the flamethrower damage." );
 	ConVar  tf_flamethrower_velocity( "tf_flamethrower_velocity", "2300.0", FCVAR_CHEAT, "Initial velocity of flame damage entities." );
@@ -33,6 +34,7 @@
 	ConVar  tf_flamethrower_shortrangedamagemultiplier("tf_flamethrower_shortrangedamagemultiplier", "1.2", FCVAR_CHEAT, "Damage multiplier for close-in flamethrower damage." );
 	ConVar  tf_flamethrower_velocityfadestart("tf_flamethrower_velocityfadestart", ".3", FCVAR_CHEAT, "Time at which attacker's velocity contribution starts to fade." );
 	ConVar  tf_flamethrower_velocityfadeend("tf_flamethrower_velocityfadeend", ".5", FCVAR_CHEAT, "Time at which attacker's velocity contribution finishes fading." );
+	ConVar  tf_flamethrower_batched("tf_flamethrower_batched", "1", FCVAR_CHEAT, "Simulate flame damage in one batch per tick instead of as flame entities." );
 	//ConVar  tf_flame_force( "tf_flame_force", "30" );
 #endif
 
@@ -438,7 +440,14 @@ void CTFFlameThrower::PrimaryAttack()
 
 		float flDamage = (float)iDamagePerSec * flFiringInterval;
 
-		CTFFlameEntity::Create( GetFlameOriginPos(), pOwner->EyeAngles(), this, iDmgType, flDamage, iCustomDmgType );
+		if ( tf_flamethrower_batched.GetBool() )
+		{
+			TFFlameManager()->AddFlame( GetFlameOriginPos(), pOwner->EyeAngles(), this, iDmgType, flDamage, iCustomDmgType );
+		}
+		else
+		{
+			CTFFlameEntity::Create( GetFlameOriginPos(), pOwner->EyeAngles(), this, iDmgType, flDamage, iCustomDmgType );
+		}
 #endif
 	}
 
@@ -1119,6 +1128,10 @@ CTFFlameEntity *CTFFlameEntity::Create( const Vector &vecOrigin, const QAngle &v
 //-----------------------------------------------------------------------------
 void CTFFlameEntity::FlameThink( void )
 {
+	// Counted alongside the batched flames for tf_flame_stats
+	CTimeAdder thinkTime( TFFlameManager()->GetEntityThinkTime() );
+	TFFlameManager()->NoteEntityFlame();
+
 	// if we've expired, remove ourselves
 	if ( gpGlobals->curtime >= m_flTimeRemove )
 	{
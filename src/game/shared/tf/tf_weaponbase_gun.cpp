@@ -485,7 +485,7 @@ void CTFWeaponBaseGun::FireBullet( CTFPlayer *pPlayer )
 	if ( GetWeaponID() != TF_WEAPON_LIGHTNING_GUN )
 		PlayWeaponShootSound();
 
-	bool bFirstShot =  m_flAccurateAtTick < gpGlobals->curtime;
+	bool bFirstShot = IsFirstShotAccurate();
 	
 	FX_FireBullets(
 		pPlayer->entindex(),
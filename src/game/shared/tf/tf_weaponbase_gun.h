@@ -66,7 +66,7 @@ public:
 	void				GetProjectileFireSetup( CTFPlayer *pPlayer, Vector vecOffset, Vector *vecSrc, QAngle *angForward, bool bHitTeammates = true );
 	void				GetProjectileAirblastSetup( CTFPlayer *pPlayer, Vector vecOffset, Vector *vecSrc, bool bHitTeammates = true );
 
-	void FireBullet( CTFPlayer *pPlayer );
+	virtual void FireBullet( CTFPlayer *pPlayer );
 	CBaseEntity *FireRocket( CTFPlayer *pPlayer );
 	CBaseEntity *FireCoom( CTFPlayer *pPlayer );
 	CBaseEntity *FireNail( CTFPlayer *pPlayer, int iSpecificNail );
@@ -76,6 +76,7 @@ public:
 	CBaseEntity *FireIncendRocket( CTFPlayer *pPlayer );
 
 	virtual float GetWeaponSpread( void );
+	bool IsFirstShotAccurate( void ) const { return m_flAccurateAtTick < gpGlobals->curtime; }
 	virtual float GetProjectileSpeed( void );
 
 	void UpdatePunchAngles( CTFPlayer *pPlayer );
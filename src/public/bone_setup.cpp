@@ -188,6 +188,17 @@ void CBoneCache::ReadCachedBonePointers( matrix3x4_t **bones, int numbones )
 	}
 }
 
+void CBoneCache::ReadCachedBoneArray( matrix3x4_t *pBones )
+{
+	memcpy( pBones, BoneArray(), sizeof( matrix3x4_t ) * m_cachedBoneCount );
+}
+
+void CBoneCache::WriteCachedBoneArray( const matrix3x4_t *pBones, float curtime )
+{
+	memcpy( BoneArray(), pBones, sizeof( matrix3x4_t ) * m_cachedBoneCount );
+	m_timeValid = curtime;
+}
+
 bool CBoneCache::IsValid( float curtime, float dt )
 {
 	if ( curtime - m_timeValid <= dt )
@@ -566,6 +577,371 @@ inline void CalcBonePosition( int frame, float s,
 }
 
 
+//-----------------------------------------------------------------------------
+// SIMD bone setup. Groups of four bones are transposed into xxxx yyyy zzzz wwww
+// form so the quaternion math runs once per group rather than once per bone.
+// Results match the scalar functions they replace up to float rounding; see
+// bonesetup_benchmark on the server.
+//-----------------------------------------------------------------------------
+static ConVar anim_simd_bonesetup( "anim_simd_bonesetup", "1", FCVAR_REPLICATED, "Decode and blend animation four bones at a time with SIMD." );
+
+struct FourQuaternions_t
+{
+	fltx4 x, y, z, w;
+};
+
+static FORCEINLINE void LoadFourQuaternions( FourQuaternions_t &out, const Quaternion &a, const Quaternion &b, const Quaternion &c, const Quaternion &d )
+{
+	out.x = LoadUnalignedSIMD( a.Base() );
+	out.y = LoadUnalignedSIMD( b.Base() );
+	out.z = LoadUnalignedSIMD( c.Base() );
+	out.w = LoadUnalignedSIMD( d.Base() );
+	TransposeSIMD( out.x, out.y, out.z, out.w );
+}
+
+static FORCEINLINE void StoreFourQuaternions( const FourQuaternions_t &in, Quaternion **ppOut, int nCount )
+{
+	fltx4 rows[4] = { in.x, in.y, in.z, in.w };
+	TransposeSIMD( rows[0], rows[1], rows[2], rows[3] );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		StoreUnalignedSIMD( ppOut[i]->Base(), rows[i] );
+	}
+}
+
+static FORCEINLINE fltx4 DotFourQuaternions( const FourQuaternions_t &p, const FourQuaternions_t &q )
+{
+	fltx4 dot = MulSIMD( p.x, q.x );
+	dot = MaddSIMD( p.y, q.y, dot );
+	dot = MaddSIMD( p.z, q.z, dot );
+	return MaddSIMD( p.w, q.w, dot );
+}
+
+// QuaternionAlign( p, q, q ) for the lanes set in fl4Allowed
+static FORCEINLINE void AlignFourQuaternions( const FourQuaternions_t &p, FourQuaternions_t &q, const fltx4 &fl4Allowed )
+{
+	fltx4 dx = SubSIMD( p.x, q.x ), dy = SubSIMD( p.y, q.y ), dz = SubSIMD( p.z, q.z ), dw = SubSIMD( p.w, q.w );
+	fltx4 sx = AddSIMD( p.x, q.x ), sy = AddSIMD( p.y, q.y ), sz = AddSIMD( p.z, q.z ), sw = AddSIMD( p.w, q.w );
+	fltx4 a = MaddSIMD( dw, dw, MaddSIMD( dz, dz, MaddSIMD( dy, dy, MulSIMD( dx, dx ) ) ) );
+	fltx4 b = MaddSIMD( sw, sw, MaddSIMD( sz, sz, MaddSIMD( sy, sy, MulSIMD( sx, sx ) ) ) );
+
+	fltx4 flip = AndSIMD( CmpGtSIMD( a, b ), fl4Allowed );
+	q.x = MaskedAssign( flip, NegSIMD( q.x ), q.x );
+	q.y = MaskedAssign( flip, NegSIMD( q.y ), q.y );
+	q.z = MaskedAssign( flip, NegSIMD( q.z ), q.z );
+	q.w = MaskedAssign( flip, NegSIMD( q.w ), q.w );
+}
+
+static FORCEINLINE void NormalizeFourQuaternions( FourQuaternions_t &q )
+{
+	fltx4 radius = DotFourQuaternions( q, q );
+	fltx4 iradius = DivSIMD( Four_Ones, SqrtSIMD( radius ) );
+	iradius = MaskedAssign( CmpGtSIMD( radius, Four_Zeros ), iradius, Four_Ones );
+	q.x = MulSIMD( q.x, iradius );
+	q.y = MulSIMD( q.y, iradius );
+	q.z = MulSIMD( q.z, iradius );
+	q.w = MulSIMD( q.w, iradius );
+}
+
+// qt = sclp * p + sclq * q
+static FORCEINLINE void LerpFourQuaternions( const FourQuaternions_t &p, const fltx4 &sclp, const FourQuaternions_t &q, const fltx4 &sclq, FourQuaternions_t &qt )
+{
+	qt.x = MaddSIMD( sclp, p.x, MulSIMD( sclq, q.x ) );
+	qt.y = MaddSIMD( sclp, p.y, MulSIMD( sclq, q.y ) );
+	qt.z = MaddSIMD( sclp, p.z, MulSIMD( sclq, q.z ) );
+	qt.w = MaddSIMD( sclp, p.w, MulSIMD( sclq, q.w ) );
+}
+
+// AngleQuaternion( RadianEuler ) for four sets of angles
+static FORCEINLINE void AngleFourQuaternions( const fltx4 &x, const fltx4 &y, const fltx4 &z, FourQuaternions_t &out )
+{
+	fltx4 sr, cr, sp, cp, sy, cy;
+	SinCosSIMD( sy, cy, MulSIMD( z, Four_PointFives ) );
+	SinCosSIMD( sp, cp, MulSIMD( y, Four_PointFives ) );
+	SinCosSIMD( sr, cr, MulSIMD( x, Four_PointFives ) );
+
+	fltx4 srXcp = MulSIMD( sr, cp ), crXsp = MulSIMD( cr, sp );
+	out.x = SubSIMD( MulSIMD( srXcp, cy ), MulSIMD( crXsp, sy ) );
+	out.y = AddSIMD( MulSIMD( crXsp, cy ), MulSIMD( srXcp, sy ) );
+
+	fltx4 crXcp = MulSIMD( cr, cp ), srXsp = MulSIMD( sr, sp );
+	out.z = SubSIMD( MulSIMD( crXcp, sy ), MulSIMD( srXsp, cy ) );
+	out.w = AddSIMD( MulSIMD( crXcp, cy ), MulSIMD( srXsp, sy ) );
+}
+
+// Gathers one component of four Vectors, scattering is the reverse
+static FORCEINLINE fltx4 GatherVectorComponent( const Vector *pVecs, const int *pIndices, int nComponent )
+{
+	fltx4 result;
+	SubFloat( result, 0 ) = pVecs[ pIndices[0] ][ nComponent ];
+	SubFloat( result, 1 ) = pVecs[ pIndices[1] ][ nComponent ];
+	SubFloat( result, 2 ) = pVecs[ pIndices[2] ][ nComponent ];
+	SubFloat( result, 3 ) = pVecs[ pIndices[3] ][ nComponent ];
+	return result;
+}
+
+static FORCEINLINE void ScatterVectorComponent( const fltx4 &value, Vector *pVecs, const int *pIndices, int nComponent, int nCount )
+{
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pVecs[ pIndices[i] ][ nComponent ] = SubFloat( value, i );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: CalcBoneQuaternion, with the euler to quaternion conversion and the
+//			sub-frame blend deferred until four rotations have been extracted.
+//			Rotations stored raw are still handled right away. The results are
+//			only written on Flush().
+//-----------------------------------------------------------------------------
+class CBoneQuaternionBatch
+{
+public:
+	CBoneQuaternionBatch( float s ) : m_s( s ), m_nCount( 0 ) {}
+	~CBoneQuaternionBatch() { Assert( m_nCount == 0 ); }
+
+	void Add( int frame, const Quaternion &baseQuat, const RadianEuler &baseRot, const Vector &baseRotScale, 
+		int iBaseFlags, const Quaternion &baseAlignment, const mstudioanim_t *panim, Quaternion &q );
+
+	void Add( int frame, const mstudiobone_t *pBone, const mstudiolinearbone_t *pLinearBones, const mstudioanim_t *panim, Quaternion &q )
+	{
+		if (pLinearBones)
+		{
+			Add( frame, pLinearBones->quat(panim->bone), pLinearBones->rot(panim->bone), pLinearBones->rotscale(panim->bone), pLinearBones->flags(panim->bone), pLinearBones->qalignment(panim->bone), panim, q );
+		}
+		else
+		{
+			Add( frame, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, q );
+		}
+	}
+
+	void Flush();
+
+private:
+	float		m_s;
+	int			m_nCount;
+	float		m_flAngle1[3][4];
+	float		m_flAngle2[3][4];
+	Quaternion	*m_pOut[4];
+	Quaternion	m_Alignment[4];
+	bool		m_bAlign[4];
+};
+
+void CBoneQuaternionBatch::Add( int frame, const Quaternion &baseQuat, const RadianEuler &baseRot, const Vector &baseRotScale, 
+	int iBaseFlags, const Quaternion &baseAlignment, const mstudioanim_t *panim, Quaternion &q )
+{
+	if ( ( panim->flags & ( STUDIO_ANIM_RAWROT | STUDIO_ANIM_RAWROT2 ) ) || !( panim->flags & STUDIO_ANIM_ANIMROT ) )
+	{
+		CalcBoneQuaternion( frame, m_s, baseQuat, baseRot, baseRotScale, iBaseFlags, baseAlignment, panim, q );
+		return;
+	}
+
+	mstudioanim_valueptr_t *pValuesPtr = panim->pRotV();
+	RadianEuler angle1, angle2;
+
+	if (m_s > 0.001f)
+	{
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
+	}
+	else
+	{
+		// Identical angles skip the blend, same as the scalar version
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z );
+		angle2 = angle1;
+	}
+
+	if (!(panim->flags & STUDIO_ANIM_DELTA))
+	{
+		angle1.x = angle1.x + baseRot.x;
+		angle1.y = angle1.y + baseRot.y;
+		angle1.z = angle1.z + baseRot.z;
+		angle2.x = angle2.x + baseRot.x;
+		angle2.y = angle2.y + baseRot.y;
+		angle2.z = angle2.z + baseRot.z;
+	}
+
+	Assert( angle1.IsValid() && angle2.IsValid() );
+
+	int n = m_nCount++;
+	m_flAngle1[0][n] = angle1.x;
+	m_flAngle1[1][n] = angle1.y;
+	m_flAngle1[2][n] = angle1.z;
+	m_flAngle2[0][n] = angle2.x;
+	m_flAngle2[1][n] = angle2.y;
+	m_flAngle2[2][n] = angle2.z;
+	m_pOut[n] = &q;
+	m_bAlign[n] = !(panim->flags & STUDIO_ANIM_DELTA) && (iBaseFlags & BONE_FIXED_ALIGNMENT);
+	if ( m_bAlign[n] )
+	{
+		m_Alignment[n] = baseAlignment;
+	}
+
+	if ( m_nCount == 4 )
+	{
+		Flush();
+	}
+}
+
+void CBoneQuaternionBatch::Flush()
+{
+	if ( !m_nCount )
+		return;
+
+	for ( int i = m_nCount; i < 4; i++ )
+	{
+		for ( int j = 0; j < 3; j++ )
+		{
+			m_flAngle1[j][i] = m_flAngle2[j][i] = 0.0f;
+		}
+	}
+
+	fltx4 x1 = LoadUnalignedSIMD( m_flAngle1[0] ), y1 = LoadUnalignedSIMD( m_flAngle1[1] ), z1 = LoadUnalignedSIMD( m_flAngle1[2] );
+	fltx4 x2 = LoadUnalignedSIMD( m_flAngle2[0] ), y2 = LoadUnalignedSIMD( m_flAngle2[1] ), z2 = LoadUnalignedSIMD( m_flAngle2[2] );
+
+	FourQuaternions_t q1;
+	AngleFourQuaternions( x1, y1, z1, q1 );
+
+	fltx4 same = AndSIMD( AndSIMD( CmpEqSIMD( x1, x2 ), CmpEqSIMD( y1, y2 ) ), CmpEqSIMD( z1, z2 ) );
+	if ( TestSignSIMD( same ) != 0xF )
+	{
+		// QuaternionBlend( q1, q2, s )
+		FourQuaternions_t q2, blend;
+		AngleFourQuaternions( x2, y2, z2, q2 );
+		AlignFourQuaternions( q1, q2, LoadAlignedSIMD( g_SIMD_AllOnesMask ) );
+		LerpFourQuaternions( q1, ReplicateX4( 1.0f - m_s ), q2, ReplicateX4( m_s ), blend );
+		NormalizeFourQuaternions( blend );
+
+		q1.x = MaskedAssign( same, q1.x, blend.x );
+		q1.y = MaskedAssign( same, q1.y, blend.y );
+		q1.z = MaskedAssign( same, q1.z, blend.z );
+		q1.w = MaskedAssign( same, q1.w, blend.w );
+	}
+
+	StoreFourQuaternions( q1, m_pOut, m_nCount );
+
+	// align to unified bone
+	for ( int i = 0; i < m_nCount; i++ )
+	{
+		Assert( m_pOut[i]->IsValid() );
+		if ( m_bAlign[i] )
+		{
+			QuaternionAlign( m_Alignment[i], *m_pOut[i], *m_pOut[i] );
+		}
+	}
+
+	m_nCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: SlerpBones/BlendBones for up to four bones. pBones and pS2 have room
+//			for four entries, the unused ones repeat the first bone.
+//-----------------------------------------------------------------------------
+template< class QUATERNION >
+static void BlendFourBones( const CStudioHdr *pStudioHdr, bool bSlerp, Quaternion *q1, Vector *pos1, 
+	const QUATERNION *q2, const Vector *pos2, int *pBones, float *pS2, int nCount )
+{
+	float flS1[4];
+	Quaternion *pOut[4];
+	fltx4 fl4Align = Four_Zeros;
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( i >= nCount )
+		{
+			pBones[i] = pBones[0];
+			pS2[i] = pS2[0];
+		}
+
+		flS1[i] = 1.0 - pS2[i];
+		pOut[i] = &q1[ pBones[i] ];
+		if ( !( pStudioHdr->boneFlags( pBones[i] ) & BONE_FIXED_ALIGNMENT ) )
+		{
+			fl4Align = OrSIMD( fl4Align, LoadAlignedSIMD( g_SIMD_ComponentMask[i] ) );
+		}
+	}
+
+	fltx4 s1 = LoadUnalignedSIMD( flS1 );
+	fltx4 s2 = LoadUnalignedSIMD( pS2 );
+
+	// q1 = q2 blended towards q1 by s1
+	FourQuaternions_t p, q, qt;
+	LoadFourQuaternions( p, q2[ pBones[0] ], q2[ pBones[1] ], q2[ pBones[2] ], q2[ pBones[3] ] );
+	LoadFourQuaternions( q, q1[ pBones[0] ], q1[ pBones[1] ], q1[ pBones[2] ], q1[ pBones[3] ] );
+	AlignFourQuaternions( p, q, fl4Align );
+
+	if ( bSlerp )
+	{
+		// QuaternionSlerpNoAlign. There's no SIMD acos, so the weights are worked out a lane
+		// at a time; opposite quaternions are rare enough to leave to the scalar version.
+		fltx4 cosom = DotFourQuaternions( p, q );
+		fltx4 sclp, sclq;
+		bool bOpposite[4];
+		Quaternion opposite[4];
+		for ( int i = 0; i < 4; i++ )
+		{
+			float flCosom = SubFloat( cosom, i );
+			float t = flS1[i];
+			bOpposite[i] = !( (1.0f + flCosom) > 0.000001f );
+			if ( bOpposite[i] )
+			{
+				SubFloat( sclp, i ) = SubFloat( sclq, i ) = 0.0f;
+				if ( i < nCount )
+				{
+					const Quaternion &a = q2[ pBones[i] ];
+					if ( pStudioHdr->boneFlags( pBones[i] ) & BONE_FIXED_ALIGNMENT )
+					{
+						QuaternionSlerpNoAlign( a, q1[ pBones[i] ], t, opposite[i] );
+					}
+					else
+					{
+						QuaternionSlerp( a, q1[ pBones[i] ], t, opposite[i] );
+					}
+				}
+			}
+			else if ( (1.0f - flCosom) > 0.000001f )
+			{
+				float omega = acos( flCosom );
+				float sinom = sin( omega );
+				SubFloat( sclp, i ) = sin( (1.0f - t)*omega) / sinom;
+				SubFloat( sclq, i ) = sin( t*omega ) / sinom;
+			}
+			else
+			{
+				SubFloat( sclp, i ) = 1.0f - t;
+				SubFloat( sclq, i ) = t;
+			}
+		}
+
+		LerpFourQuaternions( p, sclp, q, sclq, qt );
+		StoreFourQuaternions( qt, pOut, nCount );
+
+		for ( int i = 0; i < nCount; i++ )
+		{
+			if ( bOpposite[i] )
+			{
+				*pOut[i] = opposite[i];
+			}
+		}
+	}
+	else
+	{
+		// QuaternionBlendNoAlign
+		LerpFourQuaternions( p, SubSIMD( Four_Ones, s1 ), q, s1, qt );
+		NormalizeFourQuaternions( qt );
+		StoreFourQuaternions( qt, pOut, nCount );
+	}
+
+	for ( int j = 0; j < 3; j++ )
+	{
+		fltx4 a = GatherVectorComponent( pos1, pBones, j );
+		fltx4 b = GatherVectorComponent( pos2, pBones, j );
+		ScatterVectorComponent( MaddSIMD( a, s1, MulSIMD( b, s2 ) ), pos1, pBones, j, nCount );
+	}
+}
+
 
 void SetupSingleBoneMatrix( 
 	CStudioHdr *pOwnerHdr, 
@@ -965,6 +1341,9 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 		return;
 	}
 
+	bool bSIMD = anim_simd_bonesetup.GetBool();
+	CBoneQuaternionBatch quaternions( s );
+
 	// FIXME: change encoding so that bone -1 is never the case
 	while (panim && panim->bone < 255)
 	{
@@ -975,7 +1354,14 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 
 			if (k >= 0 && pweight[k] > 0.0f)
 			{
-				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
+				if ( bSIMD )
+				{
+					quaternions.Add( iLocalFrame, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
+				}
+				else
+				{
+					CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
+				}
 				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j] );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
@@ -985,6 +1371,8 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 		panim = panim->pNext();
 	}
 
+	quaternions.Flush();
+
 	// cross fade in previous zeroframe data
 	if (flStall > 0.0f)
 	{
@@ -1096,6 +1484,9 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		return;
 	}
 
+	bool bSIMD = anim_simd_bonesetup.GetBool();
+	CBoneQuaternionBatch quaternions( s );
+
 	// BUGBUG: the sequence, the anim, and the model can have all different bone mappings.
 	for (i = 0; i < pStudioHdr->numbones(); i++, pbone++, pweight++)
 	{
@@ -1103,7 +1494,14 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		{
 			if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 			{
-				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
+				if ( bSIMD )
+				{
+					quaternions.Add( iLocalFrame, pbone, pLinearBones, panim, q[i] );
+				}
+				else
+				{
+					CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
+				}
 				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i] );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
@@ -1130,6 +1528,8 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		}
 	}
 
+	quaternions.Flush();
+
 	// cross fade in previous zeroframe data
 	if (flStall > 0.0f)
 	{
@@ -1481,6 +1881,32 @@ void SlerpBones(
 		return;
 	}
 
+	if ( anim_simd_bonesetup.GetBool() )
+	{
+		int iBones[4];
+		float flS2[4];
+		int nCount = 0;
+		for (i = 0; i < nBoneCount; i++)
+		{
+			if ( pS2[i] <= 0.0f )
+				continue;
+
+			iBones[nCount] = i;
+			flS2[nCount] = pS2[i];
+			if ( ++nCount == 4 )
+			{
+				BlendFourBones( pStudioHdr, true, q1, pos1, q2, pos2, iBones, flS2, nCount );
+				nCount = 0;
+			}
+		}
+
+		if ( nCount )
+		{
+			BlendFourBones( pStudioHdr, true, q1, pos1, q2, pos2, iBones, flS2, nCount );
+		}
+		return;
+	}
+
 	QuaternionAligned q3;
 	for (i = 0; i < nBoneCount; i++)
 	{
@@ -1592,6 +2018,39 @@ void BlendBones(
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
+	if ( anim_simd_bonesetup.GetBool() )
+	{
+		int iBones[4];
+		float flS2[4];
+		int nCount = 0;
+		for (i = 0; i < pStudioHdr->numbones(); i++)
+		{
+			// skip unused bones
+			if (!(pStudioHdr->boneFlags(i) & boneMask))
+			{
+				continue;
+			}
+
+			j = pSeqGroup ? pSeqGroup->boneMap[i] : i;
+			if (j >= 0 && seqdesc.weight( j ) > 0.0)
+			{
+				iBones[nCount] = i;
+				flS2[nCount] = s2;
+				if ( ++nCount == 4 )
+				{
+					BlendFourBones( pStudioHdr, false, q1, pos1, q2, pos2, iBones, flS2, nCount );
+					nCount = 0;
+				}
+			}
+		}
+
+		if ( nCount )
+		{
+			BlendFourBones( pStudioHdr, false, q1, pos1, q2, pos2, iBones, flS2, nCount );
+		}
+		return;
+	}
+
 	for (i = 0; i < pStudioHdr->numbones(); i++)
 	{
 		// skip unused bones
@@ -5263,8 +5722,8 @@ static int ClipRayToHitbox( const Ray_t &ray, mstudiobbox_t *pbox, matrix3x4_t&
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
-bool SweepBoxToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, 
-				   matrix3x4_t **hitboxbones, int fContentsMask, trace_t &tr )
+static bool SweepBoxToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, 
+				   matrix3x4_t **hitboxbones, const int *pHitboxes, int nHitboxes, int fContentsMask, trace_t &tr )
 {
 	tr.fraction = 1.0;
 	tr.startsolid = false;
@@ -5272,8 +5731,10 @@ bool SweepBoxToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHd
 	// OPTIMIZE: Partition these?
 	Ray_t clippedRay = ray;
 	int hitbox = -1;
-	for ( int i = 0; i < set->numhitboxes; i++ )
+	int nCount = pHitboxes ? nHitboxes : set->numhitboxes;
+	for ( int n = 0; n < nCount; n++ )
 	{
+		int i = pHitboxes ? pHitboxes[n] : n;
 		mstudiobbox_t *pbox = set->pHitbox(i);
 
 		// Filter based on contents mask
@@ -5323,10 +5784,20 @@ bool SweepBoxToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHd
 //-----------------------------------------------------------------------------
 bool TraceToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, 
 				   matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &tr )
+{
+	return TraceToStudioHitboxes( pProps, ray, pStudioHdr, set, hitboxbones, NULL, 0, fContentsMask, vecOrigin, flScale, tr );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Only tests the listed hitboxes. NULL tests all of them.
+//-----------------------------------------------------------------------------
+bool TraceToStudioHitboxes( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, 
+				   matrix3x4_t **hitboxbones, const int *pHitboxes, int nHitboxes, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &tr )
 {
 	if ( !ray.m_IsRay )
 	{
-		return SweepBoxToStudio( pProps, ray, pStudioHdr, set, hitboxbones, fContentsMask, tr );
+		return SweepBoxToStudio( pProps, ray, pStudioHdr, set, hitboxbones, pHitboxes, nHitboxes, fContentsMask, tr );
 	}
 
 	tr.fraction = 1.0;
@@ -5337,8 +5808,10 @@ bool TraceToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *
 	int hitside = -1;
 
 	// OPTIMIZE: Partition these?
-	for ( int i = 0; i < set->numhitboxes; i++ )
+	int nCount = pHitboxes ? nHitboxes : set->numhitboxes;
+	for ( int n = 0; n < nCount; n++ )
 	{
+		int i = pHitboxes ? pHitboxes[n] : n;
 		mstudiobbox_t *pbox = set->pHitbox(i);
 
 		// Filter based on contents mask
@@ -413,6 +413,11 @@ public:
 	void			ReadCachedBones( matrix3x4_t *pBoneToWorld );
 	void			ReadCachedBonePointers( matrix3x4_t **bones, int numbones );
 
+	// Raw copies of the CachedBoneCount() cached bones, in cache order
+	int				CachedBoneCount() const { return m_cachedBoneCount; }
+	void			ReadCachedBoneArray( matrix3x4_t *pBones );
+	void			WriteCachedBoneArray( const matrix3x4_t *pBones, float curtime );
+
 	bool			IsValid( float curtime, float dt = 0.1f );
 
 public:
@@ -439,6 +444,10 @@ void Studio_InvalidateBoneCache( memhandle_t cacheHandle );
 // Given a ray, trace for an intersection with this studiomodel.  Get the array of bones from StudioSetupHitboxBones
 bool TraceToStudio( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &trace );
 
+// Same as TraceToStudio, but only tests the nHitboxes hitboxes in pHitboxes, which must be in ascending order so
+// the result matches TraceToStudio whenever the hitboxes left out are ones the ray can't reach
+bool TraceToStudioHitboxes( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, const int *pHitboxes, int nHitboxes, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &trace );
+
 void QuaternionSM( float s, const Quaternion &p, const Quaternion &q, Quaternion &qt );
 void QuaternionMA( const Quaternion &p, float s, const Quaternion &q, Quaternion &qt );
 
@@ -56,6 +56,9 @@ void CMaterialReference::Init( char const* pMaterialName, const char *pTextureGr
 
 void CMaterialReference::Init( const char *pMaterialName, KeyValues *pVMTKeyValues )
 {
+	// The material system keeps and frees the keys with its own KeyValues code
+	AssertMsg( !pVMTKeyValues || !pVMTKeyValues->IsFrozen(), "CMaterialReference::Init: frozen KeyValues can't be handed to the material system, MakeCopy() it first" );
+
 	// CreateMaterial has a refcount of 1
 	Shutdown();
 	m_pMaterial = materials->CreateMaterial( pMaterialName, pVMTKeyValues );
@@ -63,6 +66,8 @@ void CMaterialReference::Init( const char *pMaterialName, KeyValues *pVMTKeyValu
 
 void CMaterialReference::Init( const char *pMaterialName, const char *pTextureGroupName, KeyValues *pVMTKeyValues )
 {
+	AssertMsg( !pVMTKeyValues || !pVMTKeyValues->IsFrozen(), "CMaterialReference::Init: frozen KeyValues can't be handed to the material system, MakeCopy() it first" );
+
 	IMaterial *pMaterial = materials->FindProceduralMaterial( pMaterialName, pTextureGroupName, pVMTKeyValues );
 	Assert( pMaterial );
 	Init( pMaterial );
@@ -129,6 +129,22 @@ public:
 	// Read from a utlbuffer...
 	bool LoadFromBuffer( char const *resourceName, CUtlBuffer &buf, IBaseFileSystem* pFileSystem = NULL, const char *pPathID = NULL );
 
+	// Read-only "frozen" trees. The file is parsed into a single allocation with every key's
+	// children stored next to each other, and long child lists get a symbol hash so FindKey
+	// doesn't walk them. The usual getters all work; deleteThis() on the returned key frees
+	// the whole tree. Frozen trees are meant to be read, MakeCopy() one if you need to edit it.
+	// Frozen keys can't be added to another tree with AddSubKey/SetNextKey, MakeCopy() those too.
+	// Frozen trees must never cross a module boundary either. The engine, vgui2 and the material
+	// system have their own copy of this code, and their deleteThis()/SetString()/RemoveSubKey()
+	// would free or rewrite arena memory. MakeCopy() before handing a tree to another module.
+	static KeyValues *LoadFrozenFromFile( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID = NULL, bool bUsesEscapeSequences = false );
+	static KeyValues *LoadFrozenFromBuffer( char const *resourceName, const char *pBuffer, IBaseFileSystem* pFileSystem = NULL, const char *pPathID = NULL, bool bUsesEscapeSequences = false );
+
+	// Allocate & create a frozen copy of the keys
+	KeyValues *MakeFrozenCopy( bool copySiblings = false ) const;
+
+	bool IsFrozen() const { return ( m_nFrozenFlags & KEYVALUES_FROZEN_NODE ) != 0; }
+
 	// Find a keyValue, create it if it is not found.
 	// Set bCreate to true to create the key if it doesn't already exist (which ensures a valid pointer will be returned)
 	KeyValues *FindKey(const char *keyName, bool bCreate = false);
@@ -262,6 +278,16 @@ public:
 	void RecursiveMergeKeyValues( KeyValues *baseKV );
 
 private:
+	friend class CKeyValuesFrozenBuilder;
+
+	enum
+	{
+		KEYVALUES_FROZEN_NODE		= 0x01,	// lives in a frozen tree's arena
+		KEYVALUES_FROZEN_ROOT		= 0x02,	// first key in the arena, deleteThis() frees the arena
+		KEYVALUES_FROZEN_VALUE		= 0x04,	// m_sValue/m_wsValue point into the arena
+		KEYVALUES_FROZEN_INDEXED	= 0x08,	// m_sValue is the arena's symbol hash of our children
+	};
+
 	KeyValues( KeyValues& );	// prevent copy constructor being used
 
 	// prevent delete being called except through deleteThis()
@@ -280,6 +306,12 @@ private:
 	void CopyKeyValue( const KeyValues& src, size_t tmpBufferSizeB, char* tmpBuffer );
 
 	void RemoveEverything();
+
+	// Deletes a key, or just releases what it owns if it lives in a frozen arena
+	static void DestroyKey( KeyValues *pKey );
+	void FreeFrozenArena();
+	KeyValues *FindFrozenKey( int keySymbol ) const;
+
 //	void RecursiveSaveToFile( IBaseFileSystem *filesystem, CUtlBuffer &buffer, int indentLevel );
 //	void WriteConvertedString( CUtlBuffer &buffer, const char *pszString );
 	
@@ -305,6 +337,7 @@ private:
 	
 	void Init();
 	const char * ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasConditional );
+	static const char * ReadToken( CUtlBuffer &buf, bool bUsesEscapeSequences, bool &wasQuoted, bool &wasConditional );
 	void WriteIndents( IBaseFileSystem *filesystem, FileHandle_t f, CUtlBuffer *pBuf, int indentLevel );
 
 	void FreeAllocatedValue();
@@ -328,7 +361,7 @@ private:
 	char	   m_iDataType;
 	char	   m_bHasEscapeSequences; // true, if while parsing this KeyValue, Escape Sequences are used (default false)
 	char	   m_bEvaluateConditionals; // true, if while parsing this KeyValue, conditionals blocks are evaluated (default true)
-	char	   unused[1];
+	char	   m_nFrozenFlags; // KEYVALUES_FROZEN_*, this used to be padding so the layout is unchanged
 
 	KeyValues *m_pPeer;	// pointer to next key in list
 	KeyValues *m_pSub;	// pointer to Start of a new sub key list
@@ -470,8 +470,7 @@ void KeyValues::Init()
 	m_bHasEscapeSequences = false;
 	m_bEvaluateConditionals = true;
 
-	// for future proof
-	memset( unused, 0, sizeof(unused) );
+	m_nFrozenFlags = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -495,20 +494,50 @@ void KeyValues::RemoveEverything()
 	{
 		datNext = dat->m_pPeer;
 		dat->m_pPeer = NULL;
-		delete dat;
+		DestroyKey( dat );
 	}
 
 	for ( dat = m_pPeer; dat && dat != this; dat = datNext )
 	{
 		datNext = dat->m_pPeer;
 		dat->m_pPeer = NULL;
-		delete dat;
+		DestroyKey( dat );
+	}
+
+	FreeAllocatedValue();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees the value strings, unless they belong to a frozen arena
+//-----------------------------------------------------------------------------
+void KeyValues::FreeAllocatedValue()
+{
+	if ( !( m_nFrozenFlags & KEYVALUES_FROZEN_VALUE ) )
+	{
+		delete [] m_sValue;
+		delete [] m_wsValue;
 	}
 
-	delete [] m_sValue;
 	m_sValue = NULL;
-	delete [] m_wsValue;
 	m_wsValue = NULL;
+	m_nFrozenFlags &= ~( KEYVALUES_FROZEN_VALUE | KEYVALUES_FROZEN_INDEXED );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Keys in a frozen arena aren't individually allocated, so they only
+//			let go of what they own; the memory goes away with the arena.
+//-----------------------------------------------------------------------------
+void KeyValues::DestroyKey( KeyValues *pKey )
+{
+	if ( pKey->m_nFrozenFlags & KEYVALUES_FROZEN_NODE )
+	{
+		pKey->RemoveEverything();
+		pKey->m_pSub = NULL;
+	}
+	else
+	{
+		delete pKey;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -544,6 +573,11 @@ const char *KeyValues::GetName( void ) const
 //-----------------------------------------------------------------------------
 #pragma warning (disable:4706)
 const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasConditional )
+{
+	return ReadToken( buf, m_bHasEscapeSequences != 0, wasQuoted, wasConditional );
+}
+
+const char *KeyValues::ReadToken( CUtlBuffer &buf, bool bUsesEscapeSequences, bool &wasQuoted, bool &wasConditional )
 {
 	wasQuoted = false;
 	wasConditional = false;
@@ -571,7 +605,7 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 	if ( *c == '\"' )
 	{
 		wasQuoted = true;
-		buf.GetDelimitedString( m_bHasEscapeSequences ? GetCStringCharConversion() : GetNoEscCharConversion(), 
+		buf.GetDelimitedString( bUsesEscapeSequences ? GetCStringCharConversion() : GetNoEscCharConversion(), 
 			s_pTokenBuf, KEYVALUES_TOKEN_SIZE );
 		return s_pTokenBuf;
 	}
@@ -977,6 +1011,9 @@ void KeyValues::SaveKeyToFile( KeyValues *dat, IBaseFileSystem *filesystem, File
 //-----------------------------------------------------------------------------
 KeyValues *KeyValues::FindKey(int keySymbol) const
 {
+	if ( m_nFrozenFlags & KEYVALUES_FROZEN_INDEXED )
+		return FindFrozenKey( keySymbol );
+
 	for (KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer)
 	{
 		if (dat->m_iKeyName == keySymbol)
@@ -1022,15 +1059,26 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 
 	KeyValues *lastItem = NULL;
 	KeyValues *dat;
-	// find the searchStr in the current peer list
-	for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer)
+	if ( m_nFrozenFlags & KEYVALUES_FROZEN_INDEXED )
 	{
-		lastItem = dat;	// record the last item looked at (for if we need to append to the end of the list)
-
-		// symbol compare
-		if (dat->m_iKeyName == iSearchStr)
+		dat = FindFrozenKey( iSearchStr );
+		if ( !dat && bCreate )
 		{
-			break;
+			lastItem = FindLastSubKey();
+		}
+	}
+	else
+	{
+		// find the searchStr in the current peer list
+		for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer)
+		{
+			lastItem = dat;	// record the last item looked at (for if we need to append to the end of the list)
+
+			// symbol compare
+			if (dat->m_iKeyName == iSearchStr)
+			{
+				break;
+			}
 		}
 	}
 
@@ -1061,6 +1109,7 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 				m_pSub = dat;
 			}
 			dat->m_pPeer = NULL;
+			m_nFrozenFlags &= ~KEYVALUES_FROZEN_INDEXED;
 
 			// a key graduates to be a submsg as soon as it's m_pSub is set
 			// this should be the only place m_pSub is set
@@ -1143,6 +1192,8 @@ void KeyValues::AddSubkeyUsingKnownLastChild( KeyValues *pSubkey, KeyValues *pLa
 	Assert( pSubkey != NULL );
 	Assert( pSubkey->m_pPeer == NULL );
 
+	m_nFrozenFlags &= ~KEYVALUES_FROZEN_INDEXED;
+
 	// Empty child list?
 	if ( pLastChild == NULL )
 	{
@@ -1180,6 +1231,15 @@ void KeyValues::AddSubKey( KeyValues *pSubkey )
 	Assert( pSubkey->m_pPeer == NULL );
 #endif 
 
+	// A frozen key's memory belongs to its tree's arena, another tree can't own it
+	if ( pSubkey && pSubkey->IsFrozen() )
+	{
+		AssertMsg( false, "KeyValues::AddSubKey: can't add a frozen key to another tree, MakeCopy() it first" );
+		return;
+	}
+
+	m_nFrozenFlags &= ~KEYVALUES_FROZEN_INDEXED;
+
 	// add into subkey list
 	if ( m_pSub == NULL )
 	{
@@ -1207,6 +1267,8 @@ void KeyValues::RemoveSubKey(KeyValues *subKey)
 	if (!subKey)
 		return;
 
+	m_nFrozenFlags &= ~KEYVALUES_FROZEN_INDEXED;
+
 	// check the list pointer
 	if (m_pSub == subKey)
 	{
@@ -1255,6 +1317,13 @@ KeyValues *KeyValues::FindLastSubKey()
 //-----------------------------------------------------------------------------
 void KeyValues::SetNextKey( KeyValues *pDat )
 {
+	// Same as AddSubKey, the arena would never be freed through the new owner
+	if ( pDat && pDat->IsFrozen() )
+	{
+		AssertMsg( false, "KeyValues::SetNextKey: can't chain a frozen key into another tree, MakeCopy() it first" );
+		return;
+	}
+
 	m_pPeer = pDat;
 }
 
@@ -1603,10 +1672,8 @@ void KeyValues::SetColor( const char *keyName, Color value)
 void KeyValues::SetStringValue( char const *strValue )
 {
 	// delete the old value
-	delete [] m_sValue;
 	// make sure we're not storing the WSTRING  - as we're converting over to STRING
-	delete [] m_wsValue;
-	m_wsValue = NULL;
+	FreeAllocatedValue();
 
 	if (!strValue)
 	{
@@ -1637,10 +1704,8 @@ void KeyValues::SetString( const char *keyName, const char *value )
 		}
 
 		// delete the old value
-		delete [] dat->m_sValue;
 		// make sure we're not storing the WSTRING  - as we're converting over to STRING
-		delete [] dat->m_wsValue;
-		dat->m_wsValue = NULL;
+		dat->FreeAllocatedValue();
 
 		if (!value)
 		{
@@ -1666,10 +1731,8 @@ void KeyValues::SetWString( const char *keyName, const wchar_t *value )
 	if ( dat )
 	{
 		// delete the old value
-		delete [] dat->m_wsValue;
 		// make sure we're not storing the STRING  - as we're converting over to WSTRING
-		delete [] dat->m_sValue;
-		dat->m_sValue = NULL;
+		dat->FreeAllocatedValue();
 
 		if (!value)
 		{
@@ -1710,10 +1773,8 @@ void KeyValues::SetUint64( const char *keyName, uint64 value )
 	if ( dat )
 	{
 		// delete the old value
-		delete [] dat->m_sValue;
 		// make sure we're not storing the WSTRING  - as we're converting over to STRING
-		delete [] dat->m_wsValue;
-		dat->m_wsValue = NULL;
+		dat->FreeAllocatedValue();
 
 		dat->m_sValue = new char[sizeof(uint64)];
 		*((uint64 *)dat->m_sValue) = value;
@@ -1883,8 +1944,12 @@ void KeyValues::CopyKeyValue( const KeyValues& src, size_t tmpBufferSizeB, char*
 
 KeyValues& KeyValues::operator=( const KeyValues& src )
 {
+	// a frozen key still lives in its arena afterwards
+	char nFrozenFlags = m_nFrozenFlags & ( KEYVALUES_FROZEN_NODE | KEYVALUES_FROZEN_ROOT );
+
 	RemoveEverything();
 	Init();	// reset all values
+	m_nFrozenFlags = nFrozenFlags;
 	CopyKeyValuesFromRecursive( src );
 	return *this;
 }
@@ -2024,8 +2089,12 @@ bool KeyValues::IsEmpty(const char *keyName)
 //-----------------------------------------------------------------------------
 void KeyValues::Clear( void )
 {
-	delete m_pSub;
+	if ( m_pSub )
+	{
+		DestroyKey( m_pSub );
+	}
 	m_pSub = NULL;
+	m_nFrozenFlags &= ~KEYVALUES_FROZEN_INDEXED;
 	m_iDataType = TYPE_NONE;
 }
 
@@ -2046,6 +2115,20 @@ KeyValues::types_t KeyValues::GetDataType(const char *keyName)
 //-----------------------------------------------------------------------------
 void KeyValues::deleteThis()
 {
+	if ( m_nFrozenFlags & KEYVALUES_FROZEN_NODE )
+	{
+		// Frozen keys live in their tree's arena, deleting the root frees all of it
+		if ( m_nFrozenFlags & KEYVALUES_FROZEN_ROOT )
+		{
+			FreeFrozenArena();
+		}
+		else
+		{
+			DestroyKey( this );
+		}
+		return;
+	}
+
 	delete this;
 }
 
@@ -2384,6 +2467,64 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, const char *pBuffer, I
 	return retVal;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Works out whether a parsed value is an int, float, uint64 or string.
+//			Shared by the regular and frozen parsers so both type values the same.
+//-----------------------------------------------------------------------------
+static KeyValues::types_t ParseValueType( const char *value, int len, int &ival, float &fval, uint64 &ulval )
+{
+	// Here, let's determine if we got a float or an int....
+	char* pIEnd;	// pos where int scan ended
+	char* pFEnd;	// pos where float scan ended
+	const char* pSEnd = value + len ; // pos where token ends
+
+	ival = strtol( value, &pIEnd, 10 );
+	fval = (float)strtod( value, &pFEnd );
+	ulval = 0;
+	bool bOverflow = ( ival == LONG_MAX || ival == LONG_MIN ) && errno == ERANGE;
+#ifdef POSIX
+	// strtod supports hex representation in strings under posix but we DON'T
+	// want that support in keyvalues, so undo it here if needed
+	if ( len > 1 &&  tolower(value[1]) == 'x' )
+	{
+		fval = 0.0f;
+		pFEnd = (char *)value;
+	}
+#endif
+		
+	if ( *value == 0 )
+	{
+		return KeyValues::TYPE_STRING;	
+	}
+	else if ( ( 18 == len ) && ( value[0] == '0' ) && ( value[1] == 'x' ) )
+	{
+		// an 18-byte value prefixed with "0x" (followed by 16 hex digits) is an int64 value
+		int64 retVal = 0;
+		for( int i=2; i < 2 + 16; i++ )
+		{
+			char digit = value[i];
+			if ( digit >= 'a' ) 
+				digit -= 'a' - ( '9' + 1 );
+			else
+				if ( digit >= 'A' )
+					digit -= 'A' - ( '9' + 1 );
+			retVal = ( retVal * 16 ) + ( digit - '0' );
+		}
+		ulval = retVal;
+		return KeyValues::TYPE_UINT64;
+	}
+	else if ( (pFEnd > pIEnd) && (pFEnd == pSEnd) )
+	{
+		return KeyValues::TYPE_FLOAT;
+	}
+	else if (pIEnd == pSEnd && !bOverflow)
+	{
+		return KeyValues::TYPE_INT;
+	}
+
+	return KeyValues::TYPE_STRING;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -2481,66 +2622,28 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 
 			int len = Q_strlen( value );
 
-			// Here, let's determine if we got a float or an int....
-			char* pIEnd;	// pos where int scan ended
-			char* pFEnd;	// pos where float scan ended
-			const char* pSEnd = value + len ; // pos where token ends
+			int ival;
+			float fval;
+			uint64 ulval;
+			dat->m_iDataType = ParseValueType( value, len, ival, fval, ulval );
 
-			int ival = strtol( value, &pIEnd, 10 );
-			float fval = (float)strtod( value, &pFEnd );
-			bool bOverflow = ( ival == LONG_MAX || ival == LONG_MIN ) && errno == ERANGE;
-#ifdef POSIX
-			// strtod supports hex representation in strings under posix but we DON'T
-			// want that support in keyvalues, so undo it here if needed
-			if ( len > 1 &&  tolower(value[1]) == 'x' )
-			{
-				fval = 0.0f;
-				pFEnd = (char *)value;
-			}
-#endif
-				
-			if ( *value == 0 )
+			switch ( dat->m_iDataType )
 			{
-				dat->m_iDataType = TYPE_STRING;	
-			}
-			else if ( ( 18 == len ) && ( value[0] == '0' ) && ( value[1] == 'x' ) )
-			{
-				// an 18-byte value prefixed with "0x" (followed by 16 hex digits) is an int64 value
-				int64 retVal = 0;
-				for( int i=2; i < 2 + 16; i++ )
-				{
-					char digit = value[i];
-					if ( digit >= 'a' ) 
-						digit -= 'a' - ( '9' + 1 );
-					else
-						if ( digit >= 'A' )
-							digit -= 'A' - ( '9' + 1 );
-					retVal = ( retVal * 16 ) + ( digit - '0' );
-				}
+			case TYPE_UINT64:
 				dat->m_sValue = new char[sizeof(uint64)];
-				*((uint64 *)dat->m_sValue) = retVal;
-				dat->m_iDataType = TYPE_UINT64;
-			}
-			else if ( (pFEnd > pIEnd) && (pFEnd == pSEnd) )
-			{
+				*((uint64 *)dat->m_sValue) = ulval;
+				break;
+			case TYPE_FLOAT:
 				dat->m_flValue = fval; 
-				dat->m_iDataType = TYPE_FLOAT;
-			}
-			else if (pIEnd == pSEnd && !bOverflow)
-			{
+				break;
+			case TYPE_INT:
 				dat->m_iValue = ival; 
-				dat->m_iDataType = TYPE_INT;
-			}
-			else
-			{
-				dat->m_iDataType = TYPE_STRING;
-			}
-
-			if (dat->m_iDataType == TYPE_STRING)
-			{
+				break;
+			default:
 				// copy in the string information
 				dat->m_sValue = new char[len+1];
 				Q_memcpy( dat->m_sValue, value, len+1 );
+				break;
 			}
 
 			// Look ahead one token for a conditional tag
@@ -2583,6 +2686,665 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, CUtlBuffer &b
 }
 
 
+//-----------------------------------------------------------------------------
+// Frozen trees
+//
+// Everything lives in one allocation:
+//	KeyValuesFrozenArena_t, padded to KEYVALUES_FROZEN_HEADER_SIZE
+//	the keys, breadth first so every child list is contiguous
+//	KeyValuesFrozenIndex_t child hashes for keys with lots of children
+//	string/wstring/uint64 values
+// The root is the first key, so the arena header is always just in front of it.
+//-----------------------------------------------------------------------------
+#define KEYVALUES_FROZEN_INDEX_MIN		8	// child lists at least this long get a symbol hash
+#define KEYVALUES_FROZEN_HEADER_SIZE	( (int)ALIGN_VALUE( sizeof( KeyValuesFrozenArena_t ), 16 ) )
+
+struct KeyValuesFrozenArena_t
+{
+	int		nSize;
+	int		nKeys;
+};
+
+// open addressed, at most half full so a probe always ends on an empty slot
+struct KeyValuesFrozenIndex_t
+{
+	int			nShift;
+	unsigned	nMask;
+	KeyValues	*pSlots[1];
+};
+
+static inline unsigned FrozenIndexHash( int keySymbol, int nShift )
+{
+	return ( (unsigned)keySymbol * 2654435761u ) >> nShift;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects a tree as flat nodes, then lays it out in an arena
+//-----------------------------------------------------------------------------
+class CKeyValuesFrozenBuilder
+{
+public:
+	CKeyValuesFrozenBuilder( bool bUsesEscapeSequences );
+
+	// Returns false if the buffer needs #include/#base handling, which is left to the regular parser
+	bool		ParseBuffer( CUtlBuffer &buf );
+	void		AddTree( const KeyValues *pSource, bool bSiblings );
+	KeyValues	*Build();
+
+private:
+	struct node_t
+	{
+		int		iKeyName;
+		int		iFirstChild;
+		int		iLastChild;
+		int		iNextPeer;
+		int		nChildren;
+		int		nValueOffset;	// into m_Values, -1 for none
+		int		nValueSize;
+		char	iDataType;
+		char	bHasEscapeSequences;
+		char	bEvaluateConditionals;
+		union
+		{
+			int				iValue;
+			float			flValue;
+			void			*pValue;
+			unsigned char	ucColor[4];
+		};
+	};
+
+	int		AddNode( int iParent, int iKeyName );
+	void	RemoveLastChild( int iParent, int iPrevChild );
+	void	SetValue( int iNode, const void *pData, int nSize );
+	void	ParseBlock( int iParent, CUtlBuffer &buf );
+	void	AddKey( int iParent, const KeyValues *pSource );
+
+	// node 0 is a placeholder whose children are the top level keys
+	CUtlVector< node_t >	m_Nodes;
+	CUtlVector< char >		m_Values;
+	bool					m_bUsesEscapeSequences;
+};
+
+CKeyValuesFrozenBuilder::CKeyValuesFrozenBuilder( bool bUsesEscapeSequences )
+{
+	m_bUsesEscapeSequences = bUsesEscapeSequences;
+	AddNode( -1, INVALID_KEY_SYMBOL );
+}
+
+int CKeyValuesFrozenBuilder::AddNode( int iParent, int iKeyName )
+{
+	int iNode = m_Nodes.AddToTail();
+	node_t &node = m_Nodes[iNode];
+	node.iKeyName = iKeyName;
+	node.iFirstChild = -1;
+	node.iLastChild = -1;
+	node.iNextPeer = -1;
+	node.nChildren = 0;
+	node.nValueOffset = -1;
+	node.nValueSize = 0;
+	node.iDataType = KeyValues::TYPE_NONE;
+	node.bHasEscapeSequences = m_bUsesEscapeSequences;
+	node.bEvaluateConditionals = true;
+	node.pValue = NULL;
+
+	if ( iParent >= 0 )
+	{
+		node_t &parent = m_Nodes[iParent];
+		if ( parent.iLastChild >= 0 )
+		{
+			m_Nodes[parent.iLastChild].iNextPeer = iNode;
+		}
+		else
+		{
+			parent.iFirstChild = iNode;
+		}
+		parent.iLastChild = iNode;
+		parent.nChildren++;
+	}
+
+	return iNode;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops a key the conditionals rejected. The node is left behind
+//			unreferenced and never makes it into the arena.
+//-----------------------------------------------------------------------------
+void CKeyValuesFrozenBuilder::RemoveLastChild( int iParent, int iPrevChild )
+{
+	node_t &parent = m_Nodes[iParent];
+	parent.iLastChild = iPrevChild;
+	parent.nChildren--;
+	if ( iPrevChild >= 0 )
+	{
+		m_Nodes[iPrevChild].iNextPeer = -1;
+	}
+	else
+	{
+		parent.iFirstChild = -1;
+	}
+}
+
+void CKeyValuesFrozenBuilder::SetValue( int iNode, const void *pData, int nSize )
+{
+	m_Nodes[iNode].nValueOffset = m_Values.AddMultipleToTail( nSize, (const char *)pData );
+	m_Nodes[iNode].nValueSize = nSize;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same grammar and error reporting as LoadFromBuffer
+//-----------------------------------------------------------------------------
+bool CKeyValuesFrozenBuilder::ParseBuffer( CUtlBuffer &buf )
+{
+	int iPrevKey = -1;
+	bool wasQuoted;
+	bool wasConditional;
+	do 
+	{
+		bool bAccepted = true;
+
+		// the first thing must be a key
+		const char *s = KeyValues::ReadToken( buf, m_bUsesEscapeSequences, wasQuoted, wasConditional );
+		if ( !buf.IsValid() || !s || *s == 0 )
+			break;
+
+		if ( !Q_stricmp( s, "#include" ) || !Q_stricmp( s, "#base" ) )
+			return false;
+
+		int iKey = AddNode( 0, KeyValues::s_pfGetSymbolForString( s, true ) );
+
+		// get the '{'
+		s = KeyValues::ReadToken( buf, m_bUsesEscapeSequences, wasQuoted, wasConditional );
+
+		if ( wasConditional )
+		{
+			bAccepted = EvaluateConditional( s );
+
+			// Now get the '{'
+			s = KeyValues::ReadToken( buf, m_bUsesEscapeSequences, wasQuoted, wasConditional );
+		}
+
+		if ( s && *s == '{' && !wasQuoted )
+		{
+			// header is valid so load the file
+			ParseBlock( iKey, buf );
+		}
+		else
+		{
+			g_KeyValuesErrorStack.ReportError("LoadFromBuffer: missing {" );
+		}
+
+		if ( !bAccepted )
+		{
+			RemoveLastChild( 0, iPrevKey );
+		}
+		else
+		{
+			iPrevKey = iKey;
+		}
+	} while ( buf.IsValid() );
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same grammar and error reporting as RecursiveLoadFromBuffer
+//-----------------------------------------------------------------------------
+void CKeyValuesFrozenBuilder::ParseBlock( int iParent, CUtlBuffer &buf )
+{
+	CKeyErrorContext errorReport( m_Nodes[iParent].iKeyName );
+	bool wasQuoted;
+	bool wasConditional;
+	if ( errorReport.GetStackLevel() > 100 )
+	{
+		g_KeyValuesErrorStack.ReportError( "RecursiveLoadFromBuffer:  recursion overflow" );
+		return;
+	}
+
+	// keep this out of the stack until a key is parsed
+	CKeyErrorContext errorKey( INVALID_KEY_SYMBOL );
+
+	int iPrevChild = m_Nodes[iParent].iLastChild;
+
+	// Keep parsing until we hit the closing brace which terminates this block, or a parse error
+	while ( 1 )
+	{
+		bool bAccepted = true;
+
+		// get the key name
+		const char * name = KeyValues::ReadToken( buf, m_bUsesEscapeSequences, wasQuoted, wasConditional );
+
+		if ( !name )	// EOF stop reading
+		{
+			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got EOF instead of keyname" );
+			break;
+		}
+
+		if ( !*name ) // empty token, maybe "" or EOF
+		{
+			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got empty keyname" );
+			break;
+		}
+
+		if ( *name == '}' && !wasQuoted )	// top level closed, stop reading
+			break;
+
+		int iKey = AddNode( iParent, KeyValues::s_pfGetSymbolForString( name, true ) );
+
+		errorKey.Reset( m_Nodes[iKey].iKeyName );
+
+		// get the value
+		const char * value = KeyValues::ReadToken( buf, m_bUsesEscapeSequences, wasQuoted, wasConditional );
+
+		if ( wasConditional && value )
+		{
+			bAccepted = EvaluateConditional( value );
+
+			// get the real value
+			value = KeyValues::ReadToken( buf, m_bUsesEscapeSequences, wasQuoted, wasConditional );
+		}
+
+		if ( !value )
+		{
+			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got NULL key" );
+			break;
+		}
+		
+		if ( *value == '}' && !wasQuoted )
+		{
+			g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got } in key" );
+			break;
+		}
+
+		if ( *value == '{' && !wasQuoted )
+		{
+			// this isn't a key, it's a section
+			errorKey.Reset( INVALID_KEY_SYMBOL );
+			// sub value list
+			ParseBlock( iKey, buf );
+		}
+		else 
+		{
+			if ( wasConditional )
+			{
+				g_KeyValuesErrorStack.ReportError("RecursiveLoadFromBuffer:  got conditional between key and value" );
+				break;
+			}
+
+			int len = Q_strlen( value );
+
+			int ival;
+			float fval;
+			uint64 ulval;
+			KeyValues::types_t type = ParseValueType( value, len, ival, fval, ulval );
+			m_Nodes[iKey].iDataType = type;
+
+			switch ( type )
+			{
+			case KeyValues::TYPE_UINT64:
+				SetValue( iKey, &ulval, sizeof( uint64 ) );
+				break;
+			case KeyValues::TYPE_FLOAT:
+				m_Nodes[iKey].flValue = fval;
+				break;
+			case KeyValues::TYPE_INT:
+				m_Nodes[iKey].iValue = ival;
+				break;
+			default:
+				SetValue( iKey, value, len + 1 );
+				break;
+			}
+
+			// Look ahead one token for a conditional tag
+			int prevPos = buf.TellGet();
+			const char *peek = KeyValues::ReadToken( buf, m_bUsesEscapeSequences, wasQuoted, wasConditional );
+			if ( wasConditional )
+			{
+				bAccepted = EvaluateConditional( peek );
+			}
+			else
+			{
+				buf.SeekGet( CUtlBuffer::SEEK_HEAD, prevPos );
+			}
+		}
+
+		if ( bAccepted )
+		{
+			iPrevChild = iKey;
+		}
+		else
+		{
+			RemoveLastChild( iParent, iPrevChild );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies an existing tree, values are taken the same way MakeCopy does
+//-----------------------------------------------------------------------------
+void CKeyValuesFrozenBuilder::AddTree( const KeyValues *pSource, bool bSiblings )
+{
+	for ( const KeyValues *pKey = pSource; pKey; pKey = pKey->m_pPeer )
+	{
+		AddKey( 0, pKey );
+
+		if ( !bSiblings )
+			break;
+	}
+}
+
+void CKeyValuesFrozenBuilder::AddKey( int iParent, const KeyValues *pSource )
+{
+	int iKey = AddNode( iParent, pSource->m_iKeyName );
+	node_t &node = m_Nodes[iKey];
+	node.iDataType = pSource->m_iDataType;
+	node.bHasEscapeSequences = pSource->m_bHasEscapeSequences;
+	node.bEvaluateConditionals = pSource->m_bEvaluateConditionals;
+
+	switch ( pSource->m_iDataType )
+	{
+	case KeyValues::TYPE_STRING:
+		if ( pSource->m_sValue )
+		{
+			SetValue( iKey, pSource->m_sValue, Q_strlen( pSource->m_sValue ) + 1 );
+		}
+		break;
+	case KeyValues::TYPE_WSTRING:
+		if ( pSource->m_wsValue )
+		{
+			SetValue( iKey, pSource->m_wsValue, ( Q_wcslen( pSource->m_wsValue ) + 1 ) * sizeof( wchar_t ) );
+		}
+		break;
+	case KeyValues::TYPE_UINT64:
+		SetValue( iKey, pSource->m_sValue, sizeof( uint64 ) );
+		break;
+	case KeyValues::TYPE_INT:
+		node.iValue = pSource->m_iValue;
+		break;
+	case KeyValues::TYPE_FLOAT:
+		node.flValue = pSource->m_flValue;
+		break;
+	case KeyValues::TYPE_PTR:
+		node.pValue = pSource->m_pValue;
+		break;
+	case KeyValues::TYPE_COLOR:
+		Q_memcpy( node.ucColor, pSource->m_Color, sizeof( node.ucColor ) );
+		break;
+	}
+
+	for ( const KeyValues *pSub = pSource->m_pSub; pSub; pSub = pSub->m_pPeer )
+	{
+		AddKey( iKey, pSub );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lays the collected nodes out in a single allocation
+//-----------------------------------------------------------------------------
+KeyValues *CKeyValuesFrozenBuilder::Build()
+{
+	// Always hand back a key, like an empty file loaded into a new KeyValues would
+	if ( m_Nodes[0].iFirstChild < 0 )
+	{
+		AddNode( 0, KeyValues::s_pfGetSymbolForString( "", true ) );
+	}
+
+	// Breadth first, so each key's children sit next to each other
+	CUtlVector< int > order;
+	order.EnsureCapacity( m_Nodes.Count() );
+	for ( int iNode = m_Nodes[0].iFirstChild; iNode >= 0; iNode = m_Nodes[iNode].iNextPeer )
+	{
+		order.AddToTail( iNode );
+	}
+
+	for ( int i = 0; i < order.Count(); i++ )
+	{
+		for ( int iNode = m_Nodes[ order[i] ].iFirstChild; iNode >= 0; iNode = m_Nodes[iNode].iNextPeer )
+		{
+			order.AddToTail( iNode );
+		}
+	}
+
+	CUtlVector< int > slot;
+	slot.SetCount( m_Nodes.Count() );
+
+	int nKeys = order.Count();
+	int nSize = KEYVALUES_FROZEN_HEADER_SIZE + nKeys * sizeof( KeyValues );
+	for ( int i = 0; i < nKeys; i++ )
+	{
+		slot[ order[i] ] = i;
+
+		const node_t &node = m_Nodes[ order[i] ];
+		if ( node.nChildren >= KEYVALUES_FROZEN_INDEX_MIN )
+		{
+			int nSlots = 1;
+			while ( nSlots < node.nChildren * 2 )
+			{
+				nSlots <<= 1;
+			}
+			nSize = ALIGN_VALUE( nSize, 8 ) + sizeof( KeyValuesFrozenIndex_t ) + ( nSlots - 1 ) * sizeof( KeyValues * );
+		}
+
+		if ( node.nValueSize )
+		{
+			nSize = ALIGN_VALUE( nSize, 8 ) + node.nValueSize;
+		}
+	}
+
+	char *pArena = new char[ nSize ];
+	KeyValuesFrozenArena_t *pHeader = (KeyValuesFrozenArena_t *)pArena;
+	pHeader->nSize = nSize;
+	pHeader->nKeys = nKeys;
+
+	KeyValues *pKeys = (KeyValues *)( pArena + KEYVALUES_FROZEN_HEADER_SIZE );
+	int nOffset = KEYVALUES_FROZEN_HEADER_SIZE + nKeys * sizeof( KeyValues );
+
+	for ( int i = 0; i < nKeys; i++ )
+	{
+		const node_t &node = m_Nodes[ order[i] ];
+
+		// KeyValues has no virtuals, Init() is all a constructor would do
+		KeyValues *pKey = &pKeys[i];
+		pKey->Init();
+		pKey->m_iKeyName = node.iKeyName;
+		pKey->m_iDataType = node.iDataType;
+		pKey->m_bHasEscapeSequences = node.bHasEscapeSequences;
+		pKey->m_bEvaluateConditionals = node.bEvaluateConditionals;
+		pKey->m_nFrozenFlags = KeyValues::KEYVALUES_FROZEN_NODE;
+		pKey->m_pSub = ( node.iFirstChild >= 0 ) ? &pKeys[ slot[ node.iFirstChild ] ] : NULL;
+		pKey->m_pPeer = ( node.iNextPeer >= 0 ) ? &pKeys[ slot[ node.iNextPeer ] ] : NULL;
+
+		switch ( node.iDataType )
+		{
+		case KeyValues::TYPE_INT:
+			pKey->m_iValue = node.iValue;
+			break;
+		case KeyValues::TYPE_FLOAT:
+			pKey->m_flValue = node.flValue;
+			break;
+		case KeyValues::TYPE_PTR:
+			pKey->m_pValue = node.pValue;
+			break;
+		case KeyValues::TYPE_COLOR:
+			Q_memcpy( pKey->m_Color, node.ucColor, sizeof( pKey->m_Color ) );
+			break;
+		}
+
+		if ( node.nValueSize )
+		{
+			nOffset = ALIGN_VALUE( nOffset, 8 );
+			Q_memcpy( pArena + nOffset, m_Values.Base() + node.nValueOffset, node.nValueSize );
+			if ( node.iDataType == KeyValues::TYPE_WSTRING )
+			{
+				pKey->m_wsValue = (wchar_t *)( pArena + nOffset );
+			}
+			else
+			{
+				pKey->m_sValue = pArena + nOffset;
+			}
+			pKey->m_nFrozenFlags |= KeyValues::KEYVALUES_FROZEN_VALUE;
+			nOffset += node.nValueSize;
+		}
+		else if ( node.nChildren >= KEYVALUES_FROZEN_INDEX_MIN && node.iDataType == KeyValues::TYPE_NONE )
+		{
+			int nBits = 1;
+			while ( ( 1 << nBits ) < node.nChildren * 2 )
+			{
+				nBits++;
+			}
+
+			nOffset = ALIGN_VALUE( nOffset, 8 );
+			KeyValuesFrozenIndex_t *pIndex = (KeyValuesFrozenIndex_t *)( pArena + nOffset );
+			pIndex->nShift = 32 - nBits;
+			pIndex->nMask = ( 1u << nBits ) - 1;
+			Q_memset( pIndex->pSlots, 0, ( 1 << nBits ) * sizeof( KeyValues * ) );
+			nOffset += sizeof( KeyValuesFrozenIndex_t ) + ( ( 1 << nBits ) - 1 ) * sizeof( KeyValues * );
+
+			// children are in order, so skipping duplicates keeps FindKey returning the first one
+			for ( KeyValues *pChild = pKey->m_pSub; pChild; pChild = pChild->m_pPeer )
+			{
+				unsigned h = FrozenIndexHash( pChild->m_iKeyName, pIndex->nShift );
+				while ( pIndex->pSlots[h] && pIndex->pSlots[h]->m_iKeyName != pChild->m_iKeyName )
+				{
+					h = ( h + 1 ) & pIndex->nMask;
+				}
+
+				if ( !pIndex->pSlots[h] )
+				{
+					pIndex->pSlots[h] = pChild;
+				}
+			}
+
+			pKey->m_sValue = (char *)pIndex;
+			pKey->m_nFrozenFlags |= KeyValues::KEYVALUES_FROZEN_VALUE | KeyValues::KEYVALUES_FROZEN_INDEXED;
+		}
+	}
+
+	Assert( nOffset <= nSize );
+
+	pKeys[0].m_nFrozenFlags |= KeyValues::KEYVALUES_FROZEN_ROOT;
+	return &pKeys[0];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks up a child through the arena's symbol hash
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::FindFrozenKey( int keySymbol ) const
+{
+	Assert( m_nFrozenFlags & KEYVALUES_FROZEN_INDEXED );
+
+	const KeyValuesFrozenIndex_t *pIndex = (const KeyValuesFrozenIndex_t *)m_sValue;
+	for ( unsigned h = FrozenIndexHash( keySymbol, pIndex->nShift ); pIndex->pSlots[h]; h = ( h + 1 ) & pIndex->nMask )
+	{
+		if ( pIndex->pSlots[h]->m_iKeyName == keySymbol )
+			return pIndex->pSlots[h];
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Releases anything hung off the tree since it was frozen, then the arena
+//-----------------------------------------------------------------------------
+void KeyValues::FreeFrozenArena()
+{
+	Assert( m_nFrozenFlags & KEYVALUES_FROZEN_ROOT );
+
+	RemoveEverything();
+
+	char *pArena = (char *)this - KEYVALUES_FROZEN_HEADER_SIZE;
+	delete [] pArena;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Parses a buffer into a frozen tree, NULL on failure
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::LoadFrozenFromBuffer( char const *resourceName, const char *pBuffer, IBaseFileSystem* pFileSystem, const char *pPathID, bool bUsesEscapeSequences )
+{
+	if ( !pBuffer )
+		return NULL;
+
+	int nLen = Q_strlen( pBuffer );
+	CUtlBuffer buf( pBuffer, nLen, CUtlBuffer::READ_ONLY | CUtlBuffer::TEXT_BUFFER );
+
+	// Translate Unicode files into UTF-8 before proceeding
+	if ( nLen > 2 && (uint8)pBuffer[0] == 0xFF && (uint8)pBuffer[1] == 0xFE )
+	{
+		int nUTF8Len = V_UnicodeToUTF8( (wchar_t*)(pBuffer+2), NULL, 0 );
+		char *pUTF8Buf = new char[nUTF8Len];
+		V_UnicodeToUTF8( (wchar_t*)(pBuffer+2), pUTF8Buf, nUTF8Len );
+		buf.AssumeMemory( pUTF8Buf, nUTF8Len, nUTF8Len, CUtlBuffer::READ_ONLY | CUtlBuffer::TEXT_BUFFER );
+	}
+
+	CKeyValuesFrozenBuilder builder( bUsesEscapeSequences );
+
+	g_KeyValuesErrorStack.SetFilename( resourceName );
+	bool bParsed = builder.ParseBuffer( buf );
+	g_KeyValuesErrorStack.SetFilename( "" );
+
+	if ( bParsed )
+		return builder.Build();
+
+	// #include and #base merge other files in, let the regular parser do that and freeze the result
+	KeyValues *pKV = new KeyValues( resourceName );
+	pKV->UsesEscapeSequences( bUsesEscapeSequences );
+
+	KeyValues *pFrozen = NULL;
+	if ( pKV->LoadFromBuffer( resourceName, pBuffer, pFileSystem, pPathID ) )
+	{
+		pFrozen = pKV->MakeFrozenCopy( true );
+	}
+
+	pKV->deleteThis();
+	return pFrozen;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Loads a file into a frozen tree, NULL if it couldn't be read
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::LoadFrozenFromFile( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, bool bUsesEscapeSequences )
+{
+	Assert( filesystem );
+
+	FileHandle_t f = filesystem->Open( resourceName, "rb", pathID );
+	if ( !f )
+		return NULL;
+
+	s_LastFileLoadingFrom = (char*)resourceName;
+
+	// load file into a null-terminated buffer
+	int fileSize = filesystem->Size( f );
+	unsigned bufSize = ((IFileSystem *)filesystem)->GetOptimalReadSize( f, fileSize + 2 );
+
+	char *buffer = (char*)((IFileSystem *)filesystem)->AllocOptimalReadBuffer( f, bufSize );
+	Assert( buffer );
+
+	// read into local buffer
+	bool bRetOK = ( ((IFileSystem *)filesystem)->ReadEx( buffer, bufSize, fileSize, f ) != 0 );
+
+	filesystem->Close( f );	// close file after reading
+
+	KeyValues *pFrozen = NULL;
+	if ( bRetOK )
+	{
+		buffer[fileSize] = 0; // null terminate file as EOF
+		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
+		pFrozen = LoadFrozenFromBuffer( resourceName, buffer, filesystem, pathID, bUsesEscapeSequences );
+	}
+
+	( (IFileSystem *)filesystem )->FreeOptimalReadBuffer( buffer );
+
+	return pFrozen;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Make a frozen copy of the subkey tree, and optionally our peers
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::MakeFrozenCopy( bool copySiblings ) const
+{
+	CKeyValuesFrozenBuilder builder( m_bHasEscapeSequences != 0 );
+	builder.AddTree( this, copySiblings );
+	return builder.Build();
+}
 
 // writes KeyValue as binary data to buffer
 bool KeyValues::WriteAsBinary( CUtlBuffer &buffer )
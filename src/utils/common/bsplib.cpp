@@ -28,6 +28,14 @@
 #include "vtf/vtf.h"
 #include "lzma/lzma.h"
 #include "tier1/lzmaDecoder.h"
+#include "tier1/snappy.h"
+#include "threads.h"
+#ifdef POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 
 //=============================================================================
 
@@ -705,6 +713,11 @@ template< class T > static void AddLump( int lumpnum, CUtlVector<T> &data, int v
 dheader_t		*g_pBSPHeader;
 FileHandle_t	g_hBSPFile;
 
+#ifdef POSIX
+// Nonzero while g_pBSPHeader is a mapping of the file rather than a malloc'd copy
+static size_t	s_nBSPMappedSize;
+#endif
+
 struct Lump_t
 {
 	void	*pLumps[HEADER_LUMPS];
@@ -2177,12 +2190,45 @@ void ValidateHeader( const char *filename, const dheader_t *pHeader )
 //	Low level BSP opener for external parsing. Parses headers, but nothing else.
 //	You must close the BSP, via CloseBSPFile().
 //-----------------------------------------------------------------------------
+static void LoadBSPHeader( const char *filename )
+{
+#ifdef POSIX
+	// Lumps are only ever copied out of the file once, so map it instead of
+	// reading it all into a buffer first. The mapping is private because byte
+	// swapping on load rewrites fields in place.
+	if ( V_IsAbsolutePath( filename ) )
+	{
+		int fd = open( filename, O_RDONLY );
+		if ( fd >= 0 )
+		{
+			void *pData = MAP_FAILED;
+			struct stat st;
+			if ( fstat( fd, &st ) == 0 && st.st_size > 0 )
+			{
+				pData = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+			}
+			close( fd );
+
+			if ( pData != MAP_FAILED )
+			{
+				madvise( pData, st.st_size, MADV_WILLNEED );
+				g_pBSPHeader = (dheader_t *)pData;
+				s_nBSPMappedSize = st.st_size;
+				return;
+			}
+		}
+	}
+#endif
+
+	LoadFile( filename, (void **)&g_pBSPHeader );
+}
+
 void OpenBSPFile( const char *filename )
 {
 	Lumps_Init();
 
 	// load the file header
-	LoadFile( filename, (void **)&g_pBSPHeader );
+	LoadBSPHeader( filename );
 
 	if ( g_bSwapOnLoad )
 	{
@@ -2200,6 +2246,16 @@ void OpenBSPFile( const char *filename )
 //-----------------------------------------------------------------------------
 void CloseBSPFile( void )
 {
+#ifdef POSIX
+	if ( s_nBSPMappedSize )
+	{
+		munmap( g_pBSPHeader, s_nBSPMappedSize );
+		s_nBSPMappedSize = 0;
+		g_pBSPHeader = NULL;
+		return;
+	}
+#endif
+
 	free( g_pBSPHeader );
 	g_pBSPHeader = NULL;
 }
@@ -2731,6 +2787,9 @@ void WriteBSPFile( const char *filename, char *pUnused )
 	g_pFileSystem->Seek( g_hBSPFile, 0, FILESYSTEM_SEEK_HEAD );
 	WriteData( g_pBSPHeader );
 	g_pFileSystem->Close( g_hBSPFile );
+
+	// outHeader is about to go out of scope
+	g_pBSPHeader = NULL;
 }
 
 // Generate the next clear lump filename for the bsp file
@@ -4440,7 +4499,59 @@ int SortLumpsByOffset( const SortedLump_t *pSortedLumpA, const SortedLump_t *pSo
 	return 0;
 }
 
-bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc )
+//-----------------------------------------------------------------------------
+// RepackBSP compresses every lump and game lump up front, largest first across
+// all threads, then writes them out in the same order it always has. Nothing
+// about the output depends on the thread count.
+//-----------------------------------------------------------------------------
+struct RepackLump_t
+{
+	CUtlBuffer	inputBuffer;		// uncompressed contents, may point into the source bsp
+	CUtlBuffer	compressedBuffer;
+	bool		bCompress;			// false for the pakfile and the game lump directory
+	bool		bCompressed;
+	char		szName[48];
+	float		flCompressTime;
+};
+
+static CompressFunc_t				s_pRepackCompressFunc;
+static CUtlVector< RepackLump_t * >	s_RepackLumps;
+static CUtlVector< int >			s_RepackOrder;
+
+static RepackLump_t *AddRepackLump( const char *pName, bool bCompress )
+{
+	RepackLump_t *pLump = new RepackLump_t;
+	Q_strncpy( pLump->szName, pName, sizeof( pLump->szName ) );
+	pLump->bCompress = bCompress;
+	pLump->bCompressed = false;
+	pLump->flCompressTime = 0;
+	s_RepackLumps.AddToTail( pLump );
+	return pLump;
+}
+
+static int SortRepackLumpsBySize( const int *pA, const int *pB )
+{
+	int nSizeA = s_RepackLumps[*pA]->inputBuffer.TellPut();
+	int nSizeB = s_RepackLumps[*pB]->inputBuffer.TellPut();
+	if ( nSizeA != nSizeB )
+		return ( nSizeA > nSizeB ) ? -1 : 1;
+
+	return *pA - *pB;
+}
+
+static void RepackCompress_Thread( int iThread, int iWorkItem )
+{
+	RepackLump_t *pLump = s_RepackLumps[ s_RepackOrder[iWorkItem] ];
+
+	double flStart = Plat_FloatTime();
+	pLump->bCompressed = s_pRepackCompressFunc( pLump->inputBuffer, pLump->compressedBuffer );
+	pLump->flCompressTime = Plat_FloatTime() - flStart;
+}
+
+//-----------------------------------------------------------------------------
+// Queues each game lump's uncompressed contents for compression
+//-----------------------------------------------------------------------------
+static void GatherGameLumps( dheader_t *pInBSPHeader )
 {
 	CByteswap	byteSwap;
 
@@ -4454,6 +4565,60 @@ bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBu
 		byteSwap.SwapFieldsToTargetEndian( pInGameLump, pInGameLumpHeader->lumpCount );
 	}
 
+	for ( int i = 0; i < pInGameLumpHeader->lumpCount; i++ )
+	{
+		if ( !pInGameLump[i].filelen )
+			continue;
+
+		int id = pInGameLump[i].id;
+		char name[48];
+		Q_snprintf( name, sizeof( name ), "LUMP_GAME_LUMP %c%c%c%c", ( id >> 24 ) & 0xFF, ( id >> 16 ) & 0xFF, ( id >> 8 ) & 0xFF, id & 0xFF );
+
+		CUtlBuffer &inputBuffer = AddRepackLump( name, true )->inputBuffer;
+		if ( pInGameLump[i].flags & GAMELUMPFLAG_COMPRESSED )
+		{
+			byte *pCompressedLump = ((byte *)pInBSPHeader) + pInGameLump[i].fileofs;
+			if ( CLZMA::IsCompressed( pCompressedLump ) )
+			{
+				inputBuffer.EnsureCapacity( CLZMA::GetActualSize( pCompressedLump ) );
+				unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)inputBuffer.Base() );
+				inputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
+				if ( outSize != CLZMA::GetActualSize( pCompressedLump ) )
+				{
+					Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
+				}
+			}
+			else
+			{
+				Assert( CLZMA::IsCompressed( pCompressedLump ) );
+				Warning( "Unsupported BSP: Unrecognized compressed game lump\n" );
+			}
+
+		}
+		else
+		{
+			inputBuffer.SetExternalBuffer( ((byte *)pInBSPHeader) + pInGameLump[i].fileofs,
+			                               pInGameLump[i].filelen, pInGameLump[i].filelen );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Writes the game lumps queued by GatherGameLumps, starting at iRepackLump
+//-----------------------------------------------------------------------------
+bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBuffer &outputBuffer, int &iRepackLump )
+{
+	CByteswap	byteSwap;
+
+	// GatherGameLumps has already swapped these
+	dgamelumpheader_t* pInGameLumpHeader = (dgamelumpheader_t*)(((byte *)pInBSPHeader) + pInBSPHeader->lumps[LUMP_GAME_LUMP].fileofs);
+	dgamelump_t* pInGameLump = (dgamelump_t*)(pInGameLumpHeader + 1);
+
+	if ( IsX360() )
+	{
+		byteSwap.ActivateByteSwapping( true );
+	}
+
 	unsigned int newOffset = outputBuffer.TellPut();
 	// Make room for gamelump header and gamelump structs, which we'll write at the end
 	outputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, sizeof( dgamelumpheader_t ) );
@@ -4474,52 +4639,22 @@ bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBu
 
 	for ( int i = 0; i < pInGameLumpHeader->lumpCount; i++ )
 	{
-		CUtlBuffer inputBuffer;
-		CUtlBuffer compressedBuffer;
-
 		sOutGameLump[i].fileofs = AlignBuffer( outputBuffer, 4 );
 
 		if ( pInGameLump[i].filelen )
 		{
-			if ( pInGameLump[i].flags & GAMELUMPFLAG_COMPRESSED )
-			{
-				byte *pCompressedLump = ((byte *)pInBSPHeader) + pInGameLump[i].fileofs;
-				if ( CLZMA::IsCompressed( pCompressedLump ) )
-				{
-					inputBuffer.EnsureCapacity( CLZMA::GetActualSize( pCompressedLump ) );
-					unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)inputBuffer.Base() );
-					inputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
-					if ( outSize != CLZMA::GetActualSize( pCompressedLump ) )
-					{
-						Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
-					}
-				}
-				else
-				{
-					Assert( CLZMA::IsCompressed( pCompressedLump ) );
-					Warning( "Unsupported BSP: Unrecognized compressed game lump\n" );
-				}
-
-			}
-			else
-			{
-				inputBuffer.SetExternalBuffer( ((byte *)pInBSPHeader) + pInGameLump[i].fileofs,
-				                               pInGameLump[i].filelen, pInGameLump[i].filelen );
-			}
-
-			bool bCompressed = pCompressFunc ? pCompressFunc( inputBuffer, compressedBuffer ) : false;
-			if ( bCompressed )
+			RepackLump_t *pLump = s_RepackLumps[ iRepackLump++ ];
+			if ( pLump->bCompressed )
 			{
 				sOutGameLump[i].flags |= GAMELUMPFLAG_COMPRESSED;
 
-				outputBuffer.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
-				compressedBuffer.Purge();
+				outputBuffer.Put( pLump->compressedBuffer.Base(), pLump->compressedBuffer.TellPut() );
 			}
 			else
 			{
 				// as is, clear compression flag from input lump
 				sOutGameLump[i].flags &= ~GAMELUMPFLAG_COMPRESSED;
-				outputBuffer.Put( inputBuffer.Base(), inputBuffer.TellPut() );
+				outputBuffer.Put( pLump->inputBuffer.Base(), pLump->inputBuffer.TellPut() );
 			}
 		}
 	}
@@ -4577,8 +4712,69 @@ bool RepackBSPCallback_LZMA( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer )
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Per lump sizes and what decoding them costs at map load. The engine only
+// reads LZMA lumps, snappy is listed to show what a faster codec would buy.
+//-----------------------------------------------------------------------------
+static void PrintRepackReport( float flWallTime )
+{
+	unsigned int nTotalSize = 0, nTotalCompressed = 0, nTotalSnappy = 0;
+	double flTotalCompress = 0, flTotalDecode = 0, flTotalSnappyDecode = 0;
+
+	Msg( "%-36s %10s %10s %6s %9s %10s %6s %9s\n", "lump", "size", "packed", "ratio", "decode ms", "snappy", "ratio", "decode ms" );
+	for ( int i = 0; i < s_RepackLumps.Count(); i++ )
+	{
+		RepackLump_t *pLump = s_RepackLumps[i];
+		unsigned int nSize = pLump->inputBuffer.TellPut();
+		if ( !pLump->bCompress || !nSize )
+			continue;
+
+		unsigned int nCompressed = pLump->bCompressed ? pLump->compressedBuffer.TellPut() : nSize;
+		unsigned char *pDecoded = (unsigned char *)malloc( nSize );
+
+		// Decode the way the engine does at map load
+		double flDecode = 0;
+		unsigned char *pPacked = (unsigned char *)pLump->compressedBuffer.Base();
+		if ( pLump->bCompressed && CLZMA::IsCompressed( pPacked ) && CLZMA::GetActualSize( pPacked ) == nSize )
+		{
+			double flStart = Plat_FloatTime();
+			CLZMA::Uncompress( pPacked, pDecoded );
+			flDecode = Plat_FloatTime() - flStart;
+		}
+
+		size_t nSnappy = 0;
+		char *pSnappy = (char *)malloc( snappy::MaxCompressedLength( nSize ) );
+		snappy::RawCompress( (const char *)pLump->inputBuffer.Base(), nSize, pSnappy, &nSnappy );
+		double flStart = Plat_FloatTime();
+		snappy::RawUncompress( pSnappy, nSnappy, (char *)pDecoded );
+		double flSnappyDecode = Plat_FloatTime() - flStart;
+
+		free( pSnappy );
+		free( pDecoded );
+
+		Msg( "%-36s %10u %10u %5.1f%% %9.2f %10u %5.1f%% %9.2f\n", pLump->szName,
+			nSize, nCompressed, 100.0f * nCompressed / nSize, flDecode * 1000.0,
+			(unsigned int)nSnappy, 100.0f * nSnappy / nSize, flSnappyDecode * 1000.0 );
+
+		nTotalSize += nSize;
+		nTotalCompressed += nCompressed;
+		nTotalSnappy += nSnappy;
+		flTotalCompress += pLump->flCompressTime;
+		flTotalDecode += flDecode;
+		flTotalSnappyDecode += flSnappyDecode;
+	}
+
+	if ( !nTotalSize )
+		return;
+
+	Msg( "%-36s %10u %10u %5.1f%% %9.2f %10u %5.1f%% %9.2f\n", "total",
+		nTotalSize, nTotalCompressed, 100.0f * nTotalCompressed / nTotalSize, flTotalDecode * 1000.0,
+		nTotalSnappy, 100.0f * nTotalSnappy / nTotalSize, flTotalSnappyDecode * 1000.0 );
+	Msg( "Compressed in %.2fs on %d threads (%.2fs of work)\n", flWallTime, numthreads, flTotalCompress );
+}
 
-bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc, IZip::eCompressionType packfileCompression )
+
+bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc, IZip::eCompressionType packfileCompression, bool bReport )
 {
 	dheader_t *pInBSPHeader = (dheader_t *)inputBuffer.Base();
 	// The 360 swaps this header to disk. For some reason.
@@ -4613,7 +4809,72 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 	}
 	sortedLumps.Sort( SortLumpsByOffset );
 
+	// gather the uncompressed contents of everything, in the order it's written
+	for ( int i = 0; i < HEADER_LUMPS; ++i )
+	{
+		SortedLump_t *pSortedLump = &sortedLumps[i];
+		int lumpNum = pSortedLump->lumpNum;
+
+		if ( !pSortedLump->pLump->filelen ) // Otherwise its degenerate
+			continue;
+
+		bool bCompress = ( lumpNum != LUMP_GAME_LUMP && lumpNum != LUMP_PAKFILE );
+		CUtlBuffer &inputBuffer = AddRepackLump( GetLumpName( lumpNum ), bCompress )->inputBuffer;
+		if ( pSortedLump->pLump->uncompressedSize )
+		{
+			byte *pCompressedLump = ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs;
+			if ( CLZMA::IsCompressed( pCompressedLump ) && pSortedLump->pLump->uncompressedSize == CLZMA::GetActualSize( pCompressedLump ) )
+			{
+				inputBuffer.EnsureCapacity( CLZMA::GetActualSize( pCompressedLump ) );
+				unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)inputBuffer.Base() );
+				inputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
+				if ( outSize != pSortedLump->pLump->uncompressedSize )
+				{
+					Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
+				}
+			}
+			else
+			{
+				Assert( CLZMA::IsCompressed( pCompressedLump ) &&
+				        pSortedLump->pLump->uncompressedSize == CLZMA::GetActualSize( pCompressedLump ) );
+				Warning( "Unsupported BSP: Unrecognized compressed lump\n" );
+			}
+		}
+		else
+		{
+			// Just use input
+			inputBuffer.SetExternalBuffer( ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs,
+			                               pSortedLump->pLump->filelen, pSortedLump->pLump->filelen );
+		}
+
+		if ( lumpNum == LUMP_GAME_LUMP )
+		{
+			// the game lump has to have each of its components individually compressed
+			GatherGameLumps( pInBSPHeader );
+		}
+	}
+
+	// compress them, biggest first so one large lump doesn't finish last on its own
+	double flCompressStart = Plat_FloatTime();
+	if ( pCompressFunc )
+	{
+		for ( int i = 0; i < s_RepackLumps.Count(); i++ )
+		{
+			if ( s_RepackLumps[i]->bCompress )
+			{
+				s_RepackOrder.AddToTail( i );
+			}
+		}
+		s_RepackOrder.Sort( SortRepackLumpsBySize );
+
+		s_pRepackCompressFunc = pCompressFunc;
+		RunThreadsOnIndividual( s_RepackOrder.Count(), true, RepackCompress_Thread );
+		s_pRepackCompressFunc = NULL;
+	}
+	float flCompressTime = Plat_FloatTime() - flCompressStart;
+
 	// iterate in sorted order
+	int iRepackLump = 0;
 	for ( int i = 0; i < HEADER_LUMPS; ++i )
 	{
 		SortedLump_t *pSortedLump = &sortedLumps[i];
@@ -4634,38 +4895,13 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 			}
 			unsigned int newOffset = AlignBuffer( outputBuffer, alignment );
 
-			CUtlBuffer inputBuffer;
-			if ( pSortedLump->pLump->uncompressedSize )
-			{
-				byte *pCompressedLump = ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs;
-				if ( CLZMA::IsCompressed( pCompressedLump ) && pSortedLump->pLump->uncompressedSize == CLZMA::GetActualSize( pCompressedLump ) )
-				{
-					inputBuffer.EnsureCapacity( CLZMA::GetActualSize( pCompressedLump ) );
-					unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)inputBuffer.Base() );
-					inputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
-					if ( outSize != pSortedLump->pLump->uncompressedSize )
-					{
-						Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
-					}
-				}
-				else
-				{
-					Assert( CLZMA::IsCompressed( pCompressedLump ) &&
-					        pSortedLump->pLump->uncompressedSize == CLZMA::GetActualSize( pCompressedLump ) );
-					Warning( "Unsupported BSP: Unrecognized compressed lump\n" );
-				}
-			}
-			else
-			{
-				// Just use input
-				inputBuffer.SetExternalBuffer( ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs,
-				                               pSortedLump->pLump->filelen, pSortedLump->pLump->filelen );
-			}
+			RepackLump_t *pLump = s_RepackLumps[ iRepackLump++ ];
+			CUtlBuffer &inputBuffer = pLump->inputBuffer;
 
 			if ( lumpNum == LUMP_GAME_LUMP )
 			{
 				// the game lump has to have each of its components individually compressed
-				CompressGameLump( pInBSPHeader, &sOutBSPHeader, outputBuffer, pCompressFunc );
+				CompressGameLump( pInBSPHeader, &sOutBSPHeader, outputBuffer, iRepackLump );
 			}
 			else if ( lumpNum == LUMP_PAKFILE )
 			{
@@ -4709,15 +4945,12 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 			}
 			else
 			{
-				CUtlBuffer compressedBuffer;
-				bool bCompressed = pCompressFunc ? pCompressFunc( inputBuffer, compressedBuffer ) : false;
-				if ( bCompressed )
+				if ( pLump->bCompressed )
 				{
 					sOutBSPHeader.lumps[lumpNum].uncompressedSize = inputBuffer.TellPut();
-					sOutBSPHeader.lumps[lumpNum].filelen = compressedBuffer.TellPut();
+					sOutBSPHeader.lumps[lumpNum].filelen = pLump->compressedBuffer.TellPut();
 					sOutBSPHeader.lumps[lumpNum].fileofs = newOffset;
-					outputBuffer.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
-					compressedBuffer.Purge();
+					outputBuffer.Put( pLump->compressedBuffer.Base(), pLump->compressedBuffer.TellPut() );
 				}
 				else
 				{
@@ -4730,6 +4963,14 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 		}
 	}
 
+	if ( bReport )
+	{
+		PrintRepackReport( flCompressTime );
+	}
+
+	s_RepackLumps.PurgeAndDeleteElements();
+	s_RepackOrder.Purge();
+
 	if ( IsX360() )
 	{
 		// fix the output for 360, swapping it back
@@ -4746,6 +4987,33 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// LZMA compresses the lumps of a bsp on disk in place
+//-----------------------------------------------------------------------------
+bool CompressBSPFile( const char *pFilename, bool bReport )
+{
+	CUtlBuffer inputBuffer;
+	if ( !g_pFileSystem->ReadFile( pFilename, NULL, inputBuffer ) )
+	{
+		Warning( "Error! Couldn't read file %s - BSP compression failed!\n", pFilename );
+		return false;
+	}
+
+	CUtlBuffer outputBuffer;
+	if ( !RepackBSP( inputBuffer, outputBuffer, RepackBSPCallback_LZMA, IZip::eCompressionType_None, bReport ) )
+	{
+		Warning( "Error! Failed to compress BSP '%s'!\n", pFilename );
+		return false;
+	}
+
+	FileHandle_t hFile = SafeOpenWrite( pFilename );
+	SafeWrite( hFile, outputBuffer.Base(), outputBuffer.TellPut() );
+	g_pFileSystem->Close( hFile );
+
+	Msg( "Compressed %s: %d -> %d bytes\n", pFilename, inputBuffer.TellPut(), outputBuffer.TellPut() );
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 //  For all lumps in a bsp: Loads the lump from file A, swaps it, writes it to file B.
 //  This limits the memory used for the swap process which helps the Xbox 360.
@@ -16,8 +16,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "tier1/strtools.h"
+#include "tier0/threadtools.h"
 #ifdef _WIN32
 #include <conio.h>
+#else
+#include <unistd.h>
 #endif
 #include "utlvector.h"
 #include "filesystem_helpers.h"
@@ -59,8 +62,6 @@ CUtlLinkedList<SpewHookFn, unsigned short> g_ExtraSpewHooks;
 bool g_bStopOnExit = false;
 void (*g_ExtraSpewHook)(const char*) = NULL;
 
-#if defined( _WIN32 ) || defined( WIN32 )
-
 void CmdLib_FPrintf( FileHandle_t hFile, const char *pFormat, ... )
 {
 	static CUtlVector<char> buf;
@@ -126,7 +127,7 @@ char* CmdLib_FGets( char *pOut, int outSize, FileHandle_t hFile )
 	return pOut;
 }
 
-#if !defined( _X360 )
+#if defined( _WIN32 ) && !defined( _X360 )
 #include <wincon.h>
 #endif
 
@@ -139,7 +140,11 @@ public:
 		if ( g_bStopOnExit )
 		{
 			Warning( "\nPress any key to quit.\n" );
+#ifdef _WIN32
 			getch();
+#else
+			getchar();
+#endif
 		}
 	}
 } g_ExitStopper;
@@ -148,10 +153,10 @@ public:
 static unsigned short g_InitialColor = 0xFFFF;
 static unsigned short g_LastColor = 0xFFFF;
 static unsigned short g_BadColor = 0xFFFF;
-static WORD g_BackgroundFlags = 0xFFFF;
+static unsigned short g_BackgroundFlags = 0xFFFF;
 static void GetInitialColors( )
 {
-#if !defined( _X360 )
+#if defined( _WIN32 ) && !defined( _X360 )
 	// Get the old background attributes.
 	CONSOLE_SCREEN_BUFFER_INFO oldInfo;
 	GetConsoleScreenBufferInfo( GetStdHandle( STD_OUTPUT_HANDLE ), &oldInfo );
@@ -170,10 +175,10 @@ static void GetInitialColors( )
 #endif
 }
 
-WORD SetConsoleTextColor( int red, int green, int blue, int intensity )
+unsigned short SetConsoleTextColor( int red, int green, int blue, int intensity )
 {
-	WORD ret = g_LastColor;
-#if !defined( _X360 )
+	unsigned short ret = g_LastColor;
+#if defined( _WIN32 ) && !defined( _X360 )
 	
 	g_LastColor = 0;
 	if( red )	g_LastColor |= FOREGROUND_RED;
@@ -190,9 +195,9 @@ WORD SetConsoleTextColor( int red, int green, int blue, int intensity )
 	return ret;
 }
 
-void RestoreConsoleTextColor( WORD color )
+void RestoreConsoleTextColor( unsigned short color )
 {
-#if !defined( _X360 )
+#if defined( _WIN32 ) && !defined( _X360 )
 	SetConsoleTextAttribute( GetStdHandle( STD_OUTPUT_HANDLE ), color | g_BackgroundFlags );
 	g_LastColor = color;
 #endif
@@ -214,23 +219,15 @@ void Error( char const *pMsg, ... )
 
 #else
 
-CRITICAL_SECTION g_SpewCS;
-bool g_bSpewCSInitted = false;
+CThreadMutex g_SpewMutex;
 bool g_bSuppressPrintfOutput = false;
 
 SpewRetval_t CmdLib_SpewOutputFunc( SpewType_t type, char const *pMsg )
 {
-	// Hopefully two threads won't call this simultaneously right at the start!
-	if ( !g_bSpewCSInitted )
-	{
-		InitializeCriticalSection( &g_SpewCS );
-		g_bSpewCSInitted = true;
-	}
-
-	WORD old;
+	unsigned short old;
 	SpewRetval_t retVal;
 	
-	EnterCriticalSection( &g_SpewCS );
+	g_SpewMutex.Lock();
 	{
 		if (( type == SPEW_MESSAGE ) || (type == SPEW_LOG ))
 		{
@@ -295,12 +292,12 @@ SpewRetval_t CmdLib_SpewOutputFunc( SpewType_t type, char const *pMsg )
 		if ( !g_bSuppressPrintfOutput || type == SPEW_ERROR )
 			printf( "%s", pMsg );
 
-		OutputDebugString( pMsg );
+		Plat_DebugString( pMsg );
 		
 		if ( type == SPEW_ERROR )
 		{
 			printf( "\n" );
-			OutputDebugString( "\n" );
+			Plat_DebugString( "\n" );
 		}
 
 		if( g_pLogFile )
@@ -315,7 +312,7 @@ SpewRetval_t CmdLib_SpewOutputFunc( SpewType_t type, char const *pMsg )
 
 		RestoreConsoleTextColor( old );
 	}
-	LeaveCriticalSection( &g_SpewCS );
+	g_SpewMutex.Unlock();
 
 	if ( type == SPEW_ERROR )
 	{
@@ -411,15 +408,17 @@ void CmdLib_Cleanup()
 
 void CmdLib_Exit( int exitCode )
 {
+#ifdef _WIN32
 	TerminateProcess( GetCurrentProcess(), 1 );
+#else
+	_exit( 1 );
+#endif
 }	
 
 
 
 #endif
 
-#endif
-
 
 
 
@@ -0,0 +1,1158 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Hands vvis/vrad work units to other processes over plain TCP.
+//			See distwork.h.
+//
+//			Messages are a DistWorkMsg_t followed by its payload. They are sent
+//			in native byte order, so the coordinator and its workers have to
+//			be the same build on the same architecture.
+//
+//			Workers prove they know the session secret by answering a random
+//			challenge with MD5( challenge + secret ), so the secret itself
+//			never crosses the network.
+//
+//=============================================================================//
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#include <wincrypt.h>
+typedef int socklen_t;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET	(-1)
+#define closesocket		close
+#endif
+#include "cmdlib.h"
+#include "threads.h"
+#include "pacifier.h"
+#include "distwork.h"
+#include "tier0/icommandline.h"
+#include "tier0/threadtools.h"
+#include "tier1/checksum_md5.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlvector.h"
+
+
+#define DISTWORK_MAGIC				0x4b575344	// 'DSWK'
+#define DISTWORK_VERSION			2
+
+// Work units kept queued on a worker per thread, so its threads don't sit idle
+// while results and new units cross the network.
+#define DISTWORK_UNITS_PER_THREAD	2
+
+// A worker that stops halfway through a message for this long is dropped.
+#define DISTWORK_RECV_TIMEOUT		60
+
+// Connections that haven't finished the handshake by then are dropped. The
+// accept thread takes one at a time, so this is kept short.
+#define DISTWORK_HELLO_TIMEOUT		10
+
+// Nothing a worker sends legitimately comes close to this
+#define DISTWORK_MAX_PAYLOAD		( 64 * 1024 * 1024 )
+
+// Default for -distunittimeout
+#define DISTWORK_UNIT_TIMEOUT		600
+
+// Passes the session secret to local workers without putting it on their command line
+#define DISTWORK_SECRET_ENV			"DISTWORK_SECRET"
+#define DISTWORK_CHALLENGE_SIZE		16
+
+enum
+{
+	DISTWORK_MSG_HELLO = 0,		// worker -> coordinator, DistWorkHello_t
+	DISTWORK_MSG_CHALLENGE,		// coordinator -> worker, DISTWORK_CHALLENGE_SIZE random bytes
+	DISTWORK_MSG_AUTH,			// worker -> coordinator, MD5( challenge + secret )
+	DISTWORK_MSG_READY,			// worker -> coordinator, nValue = stage the worker has reached
+	DISTWORK_MSG_STAGE,			// coordinator -> worker, nValue = work units in the stage
+	DISTWORK_MSG_WORK,			// coordinator -> worker, nValue = work unit
+	DISTWORK_MSG_RESULT,		// worker -> coordinator, nValue = work unit, payload = its results
+	DISTWORK_MSG_STAGE_DONE,	// coordinator -> worker, the stage is finished or was missed
+};
+
+struct DistWorkMsg_t
+{
+	int32	nType;
+	int32	nValue;
+	int32	nBytes;				// payload that follows
+};
+
+struct DistWorkHello_t
+{
+	int32	nMagic;
+	int32	nVersion;
+	int32	nThreads;
+	char	szTool[16];
+};
+
+struct DistUnit_t
+{
+	int		iUnit;
+	double	flSent;				// Plat_FloatTime when it was handed out
+};
+
+struct DistWorker_t
+{
+	SOCKET					m_Socket;
+	char					m_szName[64];	// address, for messages
+	int						m_nThreads;
+	bool					m_bLocal;		// connected over loopback, so it shares our CPUs
+	int						m_iStage;		// stage it's working on, -1 until it says it's ready
+	CUtlVector<DistUnit_t>	m_Units;		// handed out and not back yet
+};
+
+
+static bool			s_bCoordinator = false;
+static bool			s_bWorker = false;
+static int			s_nLocalWorkers = 0;
+static int			s_nListenPort = 0;
+static char			s_szListenAddress[64];		// empty for loopback only
+static char			s_szCoordinator[256];
+static char			s_szSecret[64];
+static bool			s_bGeneratedSecret = false;
+static double		s_flUnitTimeout = DISTWORK_UNIT_TIMEOUT;
+static char			s_szToolName[16];
+static int			s_nStage = 0;				// DistWork_Run calls so far
+static int			s_nLocalWorkerThreads = 0;	// threads each local worker is started with
+
+static SOCKET		s_ListenSocket = INVALID_SOCKET;
+static SOCKET		s_CoordinatorSocket = INVALID_SOCKET;
+static CUtlVector<DistWorker_t *>	s_Workers;
+#ifdef _WIN32
+static CUtlVector<HANDLE>	s_LocalProcesses;
+#else
+static CUtlVector<pid_t>	s_LocalProcesses;
+#endif
+
+// The current stage, shared with the threads doing work units
+static CThreadMutex			s_QueueMutex;
+static CThreadMutex			s_SendMutex;
+static CThreadEvent			s_WorkEvent;
+static DistProcessFn		s_ProcessFn;
+static int					s_nWorkUnits;
+static int					s_iNextUnit;
+static int					s_nUnitsDone;
+static CUtlVector<int>		s_ReissuedUnits;	// coordinator: taken back from dropped workers
+static CUtlVector<int>		s_QueuedUnits;		// worker: received and not started yet
+static volatile bool		s_bStageDone;
+
+// Workers the accept thread has let in, the main thread moves them to s_Workers
+static CThreadMutex					s_PendingMutex;
+static CUtlVector<DistWorker_t *>	s_PendingWorkers;
+static ThreadHandle_t				s_hAcceptThread = NULL;
+static volatile bool				s_bStopAccepting = false;
+
+
+//-----------------------------------------------------------------------------
+// Sockets
+//-----------------------------------------------------------------------------
+static bool SendAll( SOCKET s, const void *pData, int nBytes )
+{
+	const char *pCur = (const char *)pData;
+	while ( nBytes > 0 )
+	{
+		int nSent = send( s, pCur, nBytes, 0 );
+		if ( nSent <= 0 )
+			return false;
+
+		pCur += nSent;
+		nBytes -= nSent;
+	}
+	return true;
+}
+
+static bool RecvAll( SOCKET s, void *pData, int nBytes )
+{
+	char *pCur = (char *)pData;
+	while ( nBytes > 0 )
+	{
+		int nReceived = recv( s, pCur, nBytes, 0 );
+		if ( nReceived <= 0 )
+			return false;
+
+		pCur += nReceived;
+		nBytes -= nReceived;
+	}
+	return true;
+}
+
+static bool SendMsg( SOCKET s, int nType, int nValue, const void *pData = NULL, int nBytes = 0 )
+{
+	DistWorkMsg_t msg;
+	msg.nType = nType;
+	msg.nValue = nValue;
+	msg.nBytes = nBytes;
+	if ( !SendAll( s, &msg, sizeof( msg ) ) )
+		return false;
+
+	return !nBytes || SendAll( s, pData, nBytes );
+}
+
+// Reads a whole message, the payload goes into buf. Payloads over nMaxBytes
+// fail before anything is allocated for them.
+static bool RecvMsg( SOCKET s, DistWorkMsg_t &msg, CUtlBuffer &buf, int nMaxBytes = DISTWORK_MAX_PAYLOAD )
+{
+	if ( !RecvAll( s, &msg, sizeof( msg ) ) || msg.nBytes < 0 || msg.nBytes > nMaxBytes )
+		return false;
+
+	buf.Clear();
+	if ( msg.nBytes )
+	{
+		buf.EnsureCapacity( msg.nBytes );
+		if ( !RecvAll( s, buf.Base(), msg.nBytes ) )
+			return false;
+
+		buf.SeekPut( CUtlBuffer::SEEK_HEAD, msg.nBytes );
+	}
+	return true;
+}
+
+static void SetSocketOptions( SOCKET s )
+{
+	// Work units and results are sent as soon as they're ready
+	int nOn = 1;
+	setsockopt( s, IPPROTO_TCP, TCP_NODELAY, (const char *)&nOn, sizeof( nOn ) );
+
+	// Notices machines that vanish without closing the connection
+	setsockopt( s, SOL_SOCKET, SO_KEEPALIVE, (const char *)&nOn, sizeof( nOn ) );
+}
+
+static void SetRecvTimeout( SOCKET s, int nSeconds )
+{
+#ifdef _WIN32
+	DWORD nTimeout = nSeconds * 1000;
+#else
+	struct timeval nTimeout;
+	nTimeout.tv_sec = nSeconds;
+	nTimeout.tv_usec = 0;
+#endif
+	setsockopt( s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&nTimeout, sizeof( nTimeout ) );
+}
+
+//-----------------------------------------------------------------------------
+// Session secret
+//-----------------------------------------------------------------------------
+static void GetRandomBytes( void *pData, int nBytes )
+{
+#ifdef _WIN32
+	HCRYPTPROV hProv;
+	if ( CryptAcquireContext( &hProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT ) )
+	{
+		bool bOk = CryptGenRandom( hProv, nBytes, (BYTE *)pData ) != 0;
+		CryptReleaseContext( hProv, 0 );
+		if ( bOk )
+			return;
+	}
+#else
+	int fd = open( "/dev/urandom", O_RDONLY );
+	if ( fd >= 0 )
+	{
+		bool bOk = ( read( fd, pData, nBytes ) == nBytes );
+		close( fd );
+		if ( bOk )
+			return;
+	}
+#endif
+	Error( "DistWork: couldn't get random bytes for the session secret.\n" );
+}
+
+static void GenerateSecret()
+{
+	unsigned char secret[16];
+	GetRandomBytes( secret, sizeof( secret ) );
+	for ( int i = 0; i < sizeof( secret ); i++ )
+	{
+		Q_snprintf( &s_szSecret[i * 2], sizeof( s_szSecret ) - i * 2, "%02x", secret[i] );
+	}
+	s_bGeneratedSecret = true;
+}
+
+static void ComputeAuth( const unsigned char *pChallenge, unsigned char digest[MD5_DIGEST_LENGTH] )
+{
+	MD5Context_t ctx;
+	memset( &ctx, 0, sizeof( ctx ) );
+	MD5Init( &ctx );
+	MD5Update( &ctx, pChallenge, DISTWORK_CHALLENGE_SIZE );
+	MD5Update( &ctx, (const unsigned char *)s_szSecret, Q_strlen( s_szSecret ) );
+	MD5Final( digest, &ctx );
+}
+
+// Takes the same time however many bytes match
+static bool AuthMatches( const unsigned char *pA, const unsigned char *pB )
+{
+	unsigned char diff = 0;
+	for ( int i = 0; i < MD5_DIGEST_LENGTH; i++ )
+	{
+		diff |= pA[i] ^ pB[i];
+	}
+	return diff == 0;
+}
+
+static void InitSockets()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if ( WSAStartup( MAKEWORD( 2, 2 ), &wsaData ) != 0 )
+		Error( "DistWork: WSAStartup failed.\n" );
+#else
+	// A worker that dies while we're sending to it should only fail the send
+	signal( SIGPIPE, SIG_IGN );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Command line
+//-----------------------------------------------------------------------------
+bool DistWork_ParseArg( int argc, char **argv, int &i )
+{
+	if ( !Q_stricmp( argv[i], "-workers" ) && i + 1 < argc )
+	{
+		s_nLocalWorkers = MAX( 0, atoi( argv[++i] ) );
+		return true;
+	}
+	else if ( !Q_stricmp( argv[i], "-distport" ) && i + 1 < argc )
+	{
+		// [address:]port, only an explicit address opens us up beyond this machine
+		const char *pArg = argv[++i];
+		const char *pPort = strrchr( pArg, ':' );
+		if ( pPort )
+		{
+			Q_strncpy( s_szListenAddress, pArg, MIN( (int)sizeof( s_szListenAddress ), (int)( pPort - pArg ) + 1 ) );
+			pArg = pPort + 1;
+		}
+		s_nListenPort = atoi( pArg );
+		return true;
+	}
+	else if ( !Q_stricmp( argv[i], "-distsecret" ) && i + 1 < argc )
+	{
+		Q_strncpy( s_szSecret, argv[++i], sizeof( s_szSecret ) );
+		return true;
+	}
+	else if ( !Q_stricmp( argv[i], "-distunittimeout" ) && i + 1 < argc )
+	{
+		s_flUnitTimeout = atof( argv[++i] );
+		return true;
+	}
+	else if ( !Q_stricmp( argv[i], "-worker" ) && i + 1 < argc )
+	{
+		Q_strncpy( s_szCoordinator, argv[++i], sizeof( s_szCoordinator ) );
+		return true;
+	}
+
+	return false;
+}
+
+const char *DistWork_GetUsage()
+{
+	return
+		"  -workers <n>    : Start n worker processes on this machine and share the\n"
+		"                    PortalFlow/BuildFacelights/BuildVisLeafs work with them.\n"
+		"  -distport <[address:]port> : Listen for workers on this port. Only\n"
+		"                    workers on this machine can connect unless an address\n"
+		"                    to listen on is given, e.g. 0.0.0.0:27100.\n"
+		"  -worker <host:port> : Work for the coordinator at host:port. Use the same\n"
+		"                    options and map as the coordinator.\n"
+		"  -distsecret <secret> : Secret workers need to join. The coordinator makes\n"
+		"                    one up and prints it if this (or the DISTWORK_SECRET\n"
+		"                    environment variable) isn't set.\n"
+		"  -distunittimeout <seconds> : Drop a worker that hasn't returned a work unit\n"
+		"                    this long after it was sent and hand its units out\n"
+		"                    again. Default 600, 0 waits forever.\n";
+}
+
+bool DistWork_IsActive()
+{
+	return s_bCoordinator || s_bWorker;
+}
+
+bool DistWork_IsWorker()
+{
+	return s_bWorker;
+}
+
+
+//-----------------------------------------------------------------------------
+// Coordinator
+//-----------------------------------------------------------------------------
+static int GetNextUnit()
+{
+	int iUnit = -1;
+
+	s_QueueMutex.Lock();
+	if ( s_ReissuedUnits.Count() )
+	{
+		iUnit = s_ReissuedUnits.Tail();
+		s_ReissuedUnits.RemoveMultipleFromTail( 1 );
+	}
+	else if ( s_iNextUnit < s_nWorkUnits )
+	{
+		iUnit = s_iNextUnit++;
+	}
+	s_QueueMutex.Unlock();
+
+	return iUnit;
+}
+
+static void DropWorker( int iWorker, const char *pReason )
+{
+	DistWorker_t *pWorker = s_Workers[iWorker];
+
+	Warning( "\nDistWork: dropped worker %s (%s)", pWorker->m_szName, pReason );
+	if ( pWorker->m_Units.Count() )
+	{
+		Warning( ", handing its %d work units out again", pWorker->m_Units.Count() );
+
+		s_QueueMutex.Lock();
+		FOR_EACH_VEC( pWorker->m_Units, i )
+		{
+			s_ReissuedUnits.AddToTail( pWorker->m_Units[i].iUnit );
+		}
+		s_QueueMutex.Unlock();
+	}
+	Warning( "\n" );
+
+	closesocket( pWorker->m_Socket );
+	delete pWorker;
+	s_Workers.Remove( iWorker );
+}
+
+// Runs on the accept thread
+static void AcceptWorker()
+{
+	sockaddr_in addr;
+	socklen_t addrLen = sizeof( addr );
+	SOCKET s = accept( s_ListenSocket, (sockaddr *)&addr, &addrLen );
+	if ( s == INVALID_SOCKET )
+		return;
+
+	SetSocketOptions( s );
+	SetRecvTimeout( s, DISTWORK_HELLO_TIMEOUT );
+
+	char szName[64];
+	Q_snprintf( szName, sizeof( szName ), "%s:%d", inet_ntoa( addr.sin_addr ), ntohs( addr.sin_port ) );
+
+	DistWorkMsg_t msg;
+	DistWorkHello_t hello;
+	CUtlBuffer buf;
+	if ( !RecvMsg( s, msg, buf, sizeof( hello ) ) || msg.nType != DISTWORK_MSG_HELLO || msg.nBytes != sizeof( hello ) )
+	{
+		Warning( "\nDistWork: %s didn't introduce itself, ignoring it\n", szName );
+		closesocket( s );
+		return;
+	}
+
+	buf.Get( &hello, sizeof( hello ) );
+	hello.szTool[ sizeof( hello.szTool ) - 1 ] = 0;
+	if ( hello.nMagic != DISTWORK_MAGIC || hello.nVersion != DISTWORK_VERSION || Q_stricmp( hello.szTool, s_szToolName ) )
+	{
+		Warning( "\nDistWork: %s isn't a %s worker of this version, ignoring it\n", szName, s_szToolName );
+		closesocket( s );
+		return;
+	}
+
+	unsigned char challenge[DISTWORK_CHALLENGE_SIZE];
+	GetRandomBytes( challenge, sizeof( challenge ) );
+	if ( !SendMsg( s, DISTWORK_MSG_CHALLENGE, 0, challenge, sizeof( challenge ) ) ||
+		 !RecvMsg( s, msg, buf, MD5_DIGEST_LENGTH ) || msg.nType != DISTWORK_MSG_AUTH || msg.nBytes != MD5_DIGEST_LENGTH )
+	{
+		Warning( "\nDistWork: %s didn't answer the challenge, ignoring it\n", szName );
+		closesocket( s );
+		return;
+	}
+
+	unsigned char expected[MD5_DIGEST_LENGTH];
+	ComputeAuth( challenge, expected );
+	if ( !AuthMatches( (const unsigned char *)buf.Base(), expected ) )
+	{
+		Warning( "\nDistWork: %s doesn't know the session secret, ignoring it\n", szName );
+		closesocket( s );
+		return;
+	}
+
+	SetRecvTimeout( s, DISTWORK_RECV_TIMEOUT );
+
+	DistWorker_t *pWorker = new DistWorker_t;
+	pWorker->m_Socket = s;
+	Q_strncpy( pWorker->m_szName, szName, sizeof( pWorker->m_szName ) );
+	pWorker->m_nThreads = clamp( hello.nThreads, 1, MAX_TOOL_THREADS );
+	pWorker->m_bLocal = ( ntohl( addr.sin_addr.s_addr ) >> 24 ) == 127;
+	pWorker->m_iStage = -1;
+
+	s_PendingMutex.Lock();
+	s_PendingWorkers.AddToTail( pWorker );
+	s_PendingMutex.Unlock();
+}
+
+// Lets workers in from the moment we start listening, so they can load the map
+// while we do and a slow handshake never holds up a stage
+static unsigned AcceptThread( void *pParam )
+{
+	while ( !s_bStopAccepting )
+	{
+		fd_set readSet;
+		FD_ZERO( &readSet );
+		FD_SET( s_ListenSocket, &readSet );
+
+		struct timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 100 * 1000;
+		if ( select( (int)s_ListenSocket + 1, &readSet, NULL, NULL, &timeout ) > 0 )
+		{
+			AcceptWorker();
+		}
+	}
+	return 0;
+}
+
+static void TakePendingWorkers()
+{
+	s_PendingMutex.Lock();
+	s_Workers.AddVectorToTail( s_PendingWorkers );
+	s_PendingWorkers.RemoveAll();
+	s_PendingMutex.Unlock();
+}
+
+// Our own threads share the machine with the local workers that have joined,
+// until they do we use all of it
+static int GetCoordinatorThreads()
+{
+	int nThreads = numthreads;
+	FOR_EACH_VEC( s_Workers, i )
+	{
+		if ( s_Workers[i]->m_bLocal )
+		{
+			nThreads -= s_Workers[i]->m_nThreads;
+		}
+	}
+	return MAX( 1, nThreads );
+}
+
+// Handles one message from a worker. Returns false if the worker has to go.
+static bool HandleWorkerMsg( DistWorker_t *pWorker, const DistWorkMsg_t &msg, CUtlBuffer &buf, DistReceiveFn receiveFn )
+{
+	switch ( msg.nType )
+	{
+	case DISTWORK_MSG_READY:
+		if ( msg.nValue == s_nStage )
+		{
+			pWorker->m_iStage = s_nStage;
+			return SendMsg( pWorker->m_Socket, DISTWORK_MSG_STAGE, s_nWorkUnits );
+		}
+		else if ( msg.nValue < s_nStage )
+		{
+			// It joined late. Stages don't build on each other's distributed
+			// results, so it can skip ahead to the one we're on.
+			return SendMsg( pWorker->m_Socket, DISTWORK_MSG_STAGE_DONE, msg.nValue );
+		}
+		return false;
+
+	case DISTWORK_MSG_RESULT:
+		{
+			int iUnit = -1;
+			FOR_EACH_VEC( pWorker->m_Units, i )
+			{
+				if ( pWorker->m_Units[i].iUnit == msg.nValue )
+				{
+					iUnit = i;
+					break;
+				}
+			}
+			if ( iUnit == -1 )
+				return false;
+
+			pWorker->m_Units.FastRemove( iUnit );
+			if ( !receiveFn( msg.nValue, buf ) || !buf.IsValid() )
+			{
+				s_QueueMutex.Lock();
+				s_ReissuedUnits.AddToTail( msg.nValue );
+				s_QueueMutex.Unlock();
+				return false;
+			}
+
+			s_QueueMutex.Lock();
+			s_nUnitsDone++;
+			s_QueueMutex.Unlock();
+		}
+		return true;
+	}
+
+	return false;
+}
+
+// Picks up new workers and waits up to nMilliseconds for messages from them
+static void PumpWorkers( DistReceiveFn receiveFn, int nMilliseconds )
+{
+	TakePendingWorkers();
+	if ( !s_Workers.Count() )
+	{
+		ThreadSleep( nMilliseconds );
+		return;
+	}
+
+	fd_set readSet;
+	FD_ZERO( &readSet );
+	int nMaxSocket = 0;
+	FOR_EACH_VEC( s_Workers, i )
+	{
+		FD_SET( s_Workers[i]->m_Socket, &readSet );
+		nMaxSocket = MAX( nMaxSocket, (int)s_Workers[i]->m_Socket );
+	}
+
+	struct timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = nMilliseconds * 1000;
+	if ( select( nMaxSocket + 1, &readSet, NULL, NULL, &timeout ) <= 0 )
+		return;
+
+	CUtlBuffer buf;
+	for ( int i = s_Workers.Count() - 1; i >= 0; i-- )
+	{
+		DistWorker_t *pWorker = s_Workers[i];
+		if ( !FD_ISSET( pWorker->m_Socket, &readSet ) )
+			continue;
+
+		DistWorkMsg_t msg;
+		if ( !RecvMsg( pWorker->m_Socket, msg, buf ) )
+		{
+			DropWorker( i, "disconnected" );
+		}
+		else if ( !HandleWorkerMsg( pWorker, msg, buf, receiveFn ) )
+		{
+			DropWorker( i, "bad message" );
+		}
+	}
+}
+
+// Tops up every worker that's on this stage
+static void FeedWorkers()
+{
+	for ( int i = s_Workers.Count() - 1; i >= 0; i-- )
+	{
+		DistWorker_t *pWorker = s_Workers[i];
+		if ( pWorker->m_iStage != s_nStage )
+			continue;
+
+		while ( pWorker->m_Units.Count() < pWorker->m_nThreads * DISTWORK_UNITS_PER_THREAD )
+		{
+			int iUnit = GetNextUnit();
+			if ( iUnit == -1 )
+				break;
+
+			// Track it first so it gets handed out again if the send fails
+			DistUnit_t unit;
+			unit.iUnit = iUnit;
+			unit.flSent = Plat_FloatTime();
+			pWorker->m_Units.AddToTail( unit );
+			if ( !SendMsg( pWorker->m_Socket, DISTWORK_MSG_WORK, iUnit ) )
+			{
+				DropWorker( i, "disconnected" );
+				break;
+			}
+		}
+	}
+}
+
+// Drops workers that are still connected but have sat on a unit past the
+// deadline. Their units go to someone else, and since the connection is closed
+// a late result can't arrive on top of the reissued one.
+static void DropHungWorkers()
+{
+	if ( s_flUnitTimeout <= 0 )
+		return;
+
+	double flNow = Plat_FloatTime();
+	for ( int i = s_Workers.Count() - 1; i >= 0; i-- )
+	{
+		DistWorker_t *pWorker = s_Workers[i];
+		FOR_EACH_VEC( pWorker->m_Units, j )
+		{
+			if ( flNow - pWorker->m_Units[j].flSent > s_flUnitTimeout )
+			{
+				DropWorker( i, "timed out" );
+				break;
+			}
+		}
+	}
+}
+
+static void CoordinatorThread( int iThread, void *pUserData )
+{
+	// Keep going until the whole stage is in, a worker may drop and
+	// give back units after the queue first runs dry.
+	while ( !s_bStageDone )
+	{
+		int iUnit = GetNextUnit();
+		if ( iUnit == -1 )
+		{
+			ThreadSleep( 10 );
+			continue;
+		}
+
+		s_ProcessFn( iThread, iUnit, NULL );
+
+		s_QueueMutex.Lock();
+		s_nUnitsDone++;
+		s_QueueMutex.Unlock();
+	}
+}
+
+static double CoordinatorRun( const char *pStageName, int nWorkUnits, DistProcessFn processFn, DistReceiveFn receiveFn )
+{
+	double flStart = Plat_FloatTime();
+
+	Msg( "%-20s ", pStageName );
+	StartPacifier( "" );
+
+	s_ProcessFn = processFn;
+	s_nWorkUnits = nWorkUnits;
+	s_iNextUnit = 0;
+	s_nUnitsDone = 0;
+	s_ReissuedUnits.RemoveAll();
+	s_bStageDone = false;
+
+	TakePendingWorkers();
+
+	int nSaveThreads = numthreads;
+	numthreads = GetCoordinatorThreads();
+	RunThreads_Start( CoordinatorThread, NULL );
+
+	while ( 1 )
+	{
+		s_QueueMutex.Lock();
+		int nUnitsDone = s_nUnitsDone;
+		s_QueueMutex.Unlock();
+
+		UpdatePacifier( (float)nUnitsDone / MAX( nWorkUnits, 1 ) );
+		if ( nUnitsDone >= nWorkUnits )
+			break;
+
+		PumpWorkers( receiveFn, 100 );
+		DropHungWorkers();
+		FeedWorkers();
+	}
+
+	s_bStageDone = true;
+	RunThreads_End();
+	numthreads = nSaveThreads;
+
+	for ( int i = s_Workers.Count() - 1; i >= 0; i-- )
+	{
+		DistWorker_t *pWorker = s_Workers[i];
+		if ( pWorker->m_iStage != s_nStage )
+			continue;
+
+		pWorker->m_iStage = -1;
+		if ( !SendMsg( pWorker->m_Socket, DISTWORK_MSG_STAGE_DONE, s_nStage ) )
+		{
+			DropWorker( i, "disconnected" );
+		}
+	}
+
+	double flElapsed = Plat_FloatTime() - flStart;
+	EndPacifier( false );
+	Msg( " (%d, %d workers)\n", (int)flElapsed, s_Workers.Count() );
+	return flElapsed;
+}
+
+static void StartLocalWorkers()
+{
+	char szExe[ MAX_PATH ];
+#ifdef _WIN32
+	GetModuleFileName( NULL, szExe, sizeof( szExe ) );
+#else
+	int nLen = readlink( "/proc/self/exe", szExe, sizeof( szExe ) - 1 );
+	szExe[ MAX( nLen, 0 ) ] = 0;
+#endif
+
+	char szCoordinator[64], szThreads[16];
+	Q_snprintf( szCoordinator, sizeof( szCoordinator ), "127.0.0.1:%d", s_nListenPort );
+	Q_snprintf( szThreads, sizeof( szThreads ), "%d", s_nLocalWorkerThreads );
+
+	// The original command line, minus the options that made us the coordinator
+	CUtlVector<const char *> args;
+	args.AddToTail( szExe );
+	for ( int i = 1; i < CommandLine()->ParmCount(); i++ )
+	{
+		const char *pParm = CommandLine()->GetParm( i );
+		if ( !Q_stricmp( pParm, "-workers" ) || !Q_stricmp( pParm, "-distport" ) || !Q_stricmp( pParm, "-distsecret" ) || !Q_stricmp( pParm, "-threads" ) )
+		{
+			i++;
+			continue;
+		}
+
+		// Worker options go in front of the map name, which has to come last
+		if ( i == CommandLine()->ParmCount() - 1 )
+		{
+			args.AddToTail( "-worker" );
+			args.AddToTail( szCoordinator );
+			args.AddToTail( "-threads" );
+			args.AddToTail( szThreads );
+		}
+		args.AddToTail( pParm );
+	}
+
+	// The secret goes through the environment, where other users can't see it
+#ifdef _WIN32
+	SetEnvironmentVariable( DISTWORK_SECRET_ENV, s_szSecret );
+
+	char szCmdLine[ 4096 ];
+	szCmdLine[0] = 0;
+	FOR_EACH_VEC( args, i )
+	{
+		Q_strncat( szCmdLine, i ? " \"" : "\"", sizeof( szCmdLine ), COPY_ALL_CHARACTERS );
+		Q_strncat( szCmdLine, args[i], sizeof( szCmdLine ), COPY_ALL_CHARACTERS );
+		Q_strncat( szCmdLine, "\"", sizeof( szCmdLine ), COPY_ALL_CHARACTERS );
+	}
+
+	for ( int i = 0; i < s_nLocalWorkers; i++ )
+	{
+		STARTUPINFO si;
+		PROCESS_INFORMATION pi;
+		memset( &si, 0, sizeof( si ) );
+		si.cb = sizeof( si );
+		if ( !CreateProcess( NULL, szCmdLine, NULL, NULL, FALSE, CREATE_NO_WINDOW | BELOW_NORMAL_PRIORITY_CLASS, NULL, NULL, &si, &pi ) )
+		{
+			Warning( "DistWork: couldn't start local worker %d (error %d)\n", i, GetLastError() );
+			continue;
+		}
+
+		CloseHandle( pi.hThread );
+		s_LocalProcesses.AddToTail( pi.hProcess );
+	}
+#else
+	args.AddToTail( NULL );
+
+	for ( int i = 0; i < s_nLocalWorkers; i++ )
+	{
+		pid_t pid = fork();
+		if ( pid == 0 )
+		{
+			// The coordinator's console is busy with its own progress
+			int fdNull = open( "/dev/null", O_WRONLY );
+			if ( fdNull >= 0 )
+			{
+				dup2( fdNull, STDOUT_FILENO );
+				close( fdNull );
+			}
+
+			setenv( DISTWORK_SECRET_ENV, s_szSecret, 1 );
+			execv( szExe, (char * const *)args.Base() );
+			_exit( 1 );
+		}
+		else if ( pid < 0 )
+		{
+			Warning( "DistWork: couldn't start local worker %d\n", i );
+			continue;
+		}
+
+		s_LocalProcesses.AddToTail( pid );
+	}
+#endif
+}
+
+static void DistWork_Shutdown()
+{
+	if ( s_hAcceptThread )
+	{
+		s_bStopAccepting = true;
+		ThreadJoin( s_hAcceptThread );
+		ReleaseThreadHandle( s_hAcceptThread );
+		s_hAcceptThread = NULL;
+	}
+	TakePendingWorkers();
+
+	// Workers notice the closed connection and exit
+	FOR_EACH_VEC( s_Workers, i )
+	{
+		closesocket( s_Workers[i]->m_Socket );
+	}
+	s_Workers.PurgeAndDeleteElements();
+
+	if ( s_ListenSocket != INVALID_SOCKET )
+	{
+		closesocket( s_ListenSocket );
+		s_ListenSocket = INVALID_SOCKET;
+	}
+
+	if ( s_CoordinatorSocket != INVALID_SOCKET )
+	{
+		closesocket( s_CoordinatorSocket );
+		s_CoordinatorSocket = INVALID_SOCKET;
+	}
+
+	FOR_EACH_VEC( s_LocalProcesses, i )
+	{
+#ifdef _WIN32
+		if ( WaitForSingleObject( s_LocalProcesses[i], 5000 ) != WAIT_OBJECT_0 )
+		{
+			TerminateProcess( s_LocalProcesses[i], 1 );
+		}
+		CloseHandle( s_LocalProcesses[i] );
+#else
+		int nWaits = 0;
+		while ( waitpid( s_LocalProcesses[i], NULL, WNOHANG ) == 0 )
+		{
+			if ( ++nWaits == 500 )
+			{
+				kill( s_LocalProcesses[i], SIGKILL );
+				waitpid( s_LocalProcesses[i], NULL, 0 );
+				break;
+			}
+			ThreadSleep( 10 );
+		}
+#endif
+	}
+	s_LocalProcesses.RemoveAll();
+}
+
+static void CoordinatorInit()
+{
+	s_ListenSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if ( s_ListenSocket == INVALID_SOCKET )
+		Error( "DistWork: couldn't create a socket.\n" );
+
+	int nOn = 1;
+	setsockopt( s_ListenSocket, SOL_SOCKET, SO_REUSEADDR, (const char *)&nOn, sizeof( nOn ) );
+
+	// Unless -distport names an address only this machine can reach us
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if ( s_szListenAddress[0] )
+	{
+		addr.sin_addr.s_addr = inet_addr( s_szListenAddress );
+		if ( addr.sin_addr.s_addr == INADDR_NONE )
+			Error( "DistWork: -distport wants an IPv4 address, got %s.\n", s_szListenAddress );
+	}
+	addr.sin_port = htons( s_nListenPort );
+	if ( bind( s_ListenSocket, (sockaddr *)&addr, sizeof( addr ) ) != 0 || listen( s_ListenSocket, 16 ) != 0 )
+		Error( "DistWork: couldn't listen on %s:%d.\n", inet_ntoa( addr.sin_addr ), s_nListenPort );
+
+	socklen_t addrLen = sizeof( addr );
+	getsockname( s_ListenSocket, (sockaddr *)&addr, &addrLen );
+	s_nListenPort = ntohs( addr.sin_port );
+
+	// Split this machine between us and the local workers
+	s_nLocalWorkerThreads = MAX( 1, numthreads / ( s_nLocalWorkers + 1 ) );
+
+	Msg( "DistWork: coordinating on %s:%d, %d local workers with %d threads each\n", inet_ntoa( addr.sin_addr ), s_nListenPort, s_nLocalWorkers, s_nLocalWorkerThreads );
+	if ( s_bGeneratedSecret && s_szListenAddress[0] )
+	{
+		Msg( "DistWork: workers on other machines need -distsecret %s\n", s_szSecret );
+	}
+
+	s_hAcceptThread = CreateSimpleThread( AcceptThread, NULL );
+	if ( !s_hAcceptThread )
+		Error( "DistWork: couldn't start the accept thread.\n" );
+
+	StartLocalWorkers();
+}
+
+
+//-----------------------------------------------------------------------------
+// Worker
+//-----------------------------------------------------------------------------
+static void WorkerThread( int iThread, void *pUserData )
+{
+	CUtlBuffer buf;
+	while ( 1 )
+	{
+		int iUnit = -1;
+		s_QueueMutex.Lock();
+		if ( s_QueuedUnits.Count() )
+		{
+			iUnit = s_QueuedUnits[0];
+			s_QueuedUnits.Remove( 0 );
+		}
+		s_QueueMutex.Unlock();
+
+		if ( iUnit == -1 )
+		{
+			// The coordinator only ends the stage once it has every result
+			if ( s_bStageDone )
+				break;
+
+			s_WorkEvent.Wait( 50 );
+			continue;
+		}
+
+		buf.Clear();
+		s_ProcessFn( iThread, iUnit, &buf );
+
+		// A failed send shows up as a failed receive on the main thread
+		s_SendMutex.Lock();
+		SendMsg( s_CoordinatorSocket, DISTWORK_MSG_RESULT, iUnit, buf.Base(), buf.TellPut() );
+		s_SendMutex.Unlock();
+	}
+}
+
+static double WorkerRun( const char *pStageName, int nWorkUnits, DistProcessFn processFn )
+{
+	double flStart = Plat_FloatTime();
+
+	DistWorkMsg_t msg;
+	CUtlBuffer buf;
+	if ( !SendMsg( s_CoordinatorSocket, DISTWORK_MSG_READY, s_nStage ) || !RecvMsg( s_CoordinatorSocket, msg, buf ) )
+		Error( "DistWork: lost the coordinator before %s.\n", pStageName );
+
+	if ( msg.nType == DISTWORK_MSG_STAGE_DONE )
+	{
+		Msg( "%-20s skipped, the coordinator has already finished it\n", pStageName );
+		return 0;
+	}
+
+	if ( msg.nType != DISTWORK_MSG_STAGE || msg.nValue != nWorkUnits )
+		Error( "DistWork: %s has %d work units here and %d on the coordinator, are we building the same map with the same options?\n", pStageName, nWorkUnits, msg.nValue );
+
+	s_ProcessFn = processFn;
+	s_QueuedUnits.RemoveAll();
+	s_bStageDone = false;
+	RunThreads_Start( WorkerThread, NULL );
+
+	int nUnits = 0;
+	while ( 1 )
+	{
+		if ( !RecvMsg( s_CoordinatorSocket, msg, buf ) )
+			Error( "DistWork: lost the coordinator during %s.\n", pStageName );
+
+		if ( msg.nType == DISTWORK_MSG_STAGE_DONE )
+			break;
+
+		if ( msg.nType == DISTWORK_MSG_WORK && msg.nValue >= 0 && msg.nValue < nWorkUnits )
+		{
+			s_QueueMutex.Lock();
+			s_QueuedUnits.AddToTail( msg.nValue );
+			s_QueueMutex.Unlock();
+			s_WorkEvent.Set();
+			nUnits++;
+		}
+	}
+
+	s_bStageDone = true;
+	RunThreads_End();
+
+	double flElapsed = Plat_FloatTime() - flStart;
+	Msg( "%-20s %d work units (%d)\n", pStageName, nUnits, (int)flElapsed );
+	return flElapsed;
+}
+
+static void WorkerInit()
+{
+	char szHost[256];
+	Q_strncpy( szHost, s_szCoordinator, sizeof( szHost ) );
+	char *pPort = strrchr( szHost, ':' );
+	if ( !pPort )
+		Error( "DistWork: -worker wants host:port, got %s.\n", s_szCoordinator );
+	*pPort++ = 0;
+
+	hostent *pHost = gethostbyname( szHost );
+	if ( !pHost || pHost->h_addrtype != AF_INET )
+		Error( "DistWork: can't resolve %s.\n", szHost );
+
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	memcpy( &addr.sin_addr, pHost->h_addr_list[0], sizeof( addr.sin_addr ) );
+	addr.sin_port = htons( atoi( pPort ) );
+
+	s_CoordinatorSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if ( s_CoordinatorSocket == INVALID_SOCKET || connect( s_CoordinatorSocket, (sockaddr *)&addr, sizeof( addr ) ) != 0 )
+		Error( "DistWork: can't connect to the coordinator at %s.\n", s_szCoordinator );
+
+	SetSocketOptions( s_CoordinatorSocket );
+
+	DistWorkHello_t hello;
+	memset( &hello, 0, sizeof( hello ) );
+	hello.nMagic = DISTWORK_MAGIC;
+	hello.nVersion = DISTWORK_VERSION;
+	hello.nThreads = numthreads;
+	Q_strncpy( hello.szTool, s_szToolName, sizeof( hello.szTool ) );
+	if ( !SendMsg( s_CoordinatorSocket, DISTWORK_MSG_HELLO, 0, &hello, sizeof( hello ) ) )
+		Error( "DistWork: lost the coordinator at %s.\n", s_szCoordinator );
+
+	DistWorkMsg_t msg;
+	CUtlBuffer buf;
+	if ( !RecvMsg( s_CoordinatorSocket, msg, buf, DISTWORK_CHALLENGE_SIZE ) || msg.nType != DISTWORK_MSG_CHALLENGE || msg.nBytes != DISTWORK_CHALLENGE_SIZE )
+		Error( "DistWork: %s turned us away, is it the same build of %s?\n", s_szCoordinator, s_szToolName );
+
+	unsigned char digest[MD5_DIGEST_LENGTH];
+	ComputeAuth( (const unsigned char *)buf.Base(), digest );
+	if ( !SendMsg( s_CoordinatorSocket, DISTWORK_MSG_AUTH, 0, digest, sizeof( digest ) ) )
+		Error( "DistWork: lost the coordinator at %s.\n", s_szCoordinator );
+
+	Msg( "DistWork: working for %s with %d threads\n", s_szCoordinator, numthreads );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void DistWork_Init( const char *pToolName )
+{
+	s_bWorker = ( s_szCoordinator[0] != 0 );
+	s_bCoordinator = !s_bWorker && ( s_nLocalWorkers > 0 || s_nListenPort > 0 );
+	if ( !DistWork_IsActive() )
+		return;
+
+	Q_strncpy( s_szToolName, pToolName, sizeof( s_szToolName ) );
+	if ( numthreads == -1 )
+		ThreadSetDefault();
+
+	if ( !s_szSecret[0] && getenv( DISTWORK_SECRET_ENV ) )
+	{
+		Q_strncpy( s_szSecret, getenv( DISTWORK_SECRET_ENV ), sizeof( s_szSecret ) );
+	}
+
+	if ( !s_szSecret[0] )
+	{
+		if ( s_bWorker )
+			Error( "DistWork: -worker needs the coordinator's secret, pass it with -distsecret.\n" );
+
+		GenerateSecret();
+	}
+
+	InitSockets();
+	CmdLib_AtCleanup( DistWork_Shutdown );
+
+	if ( s_bWorker )
+	{
+		WorkerInit();
+	}
+	else
+	{
+		CoordinatorInit();
+	}
+}
+
+double DistWork_Run( const char *pStageName, int nWorkUnits, DistProcessFn processFn, DistReceiveFn receiveFn )
+{
+	Assert( DistWork_IsActive() );
+
+	double flElapsed = s_bWorker ? WorkerRun( pStageName, nWorkUnits, processFn ) : CoordinatorRun( pStageName, nWorkUnits, processFn, receiveFn );
+	s_nStage++;
+	return flElapsed;
+}
+
+void DistWork_WorkerFinished()
+{
+	if ( !s_bWorker )
+		return;
+
+	Msg( "DistWork: worker finished.\n" );
+	CmdLib_Exit( 0 );
+}
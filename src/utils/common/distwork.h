@@ -0,0 +1,69 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Hands vvis/vrad work units to other processes over plain TCP, for
+//			builds that don't have VMPI.
+//
+//			The coordinator is the normal tool invocation with -workers and/or
+//			-distport. Workers run the same command line plus -worker host:port,
+//			load the same map themselves and follow the same code path, so every
+//			DistWork_Run on the coordinator is matched by one on each worker. Only
+//			the results of each work unit travel back.
+//
+//			Workers have to know the coordinator's session secret to join, and
+//			the coordinator only listens on loopback unless told otherwise.
+//
+//=============================================================================//
+
+#ifndef DISTWORK_H
+#define DISTWORK_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+class CUtlBuffer;
+
+
+// Workers implement this to process a work unit and append its results to pBuf.
+// Note: pBuf is NULL when one of the coordinator's own threads does the work unit.
+typedef void (*DistProcessFn)( int iThread, int iWorkUnit, CUtlBuffer *pBuf );
+
+// The coordinator implements this to read back what DistProcessFn wrote. It is
+// only ever called from the coordinator's main thread. Return false if the
+// results are malformed, the worker is then dropped and the unit handed out again.
+typedef bool (*DistReceiveFn)( int iWorkUnit, CUtlBuffer &buf );
+
+
+// Call for each argument the tool doesn't recognize itself. Returns true and
+// skips past any value if it was one of ours:
+//		-workers <n>				start n local worker processes
+//		-distport <[addr:]port>		listen for workers on this port, on loopback unless addr is given
+//		-worker <host:port>			run as a worker for the coordinator at host:port
+//		-distsecret <secret>		secret workers need to join, made up by the coordinator if missing
+//		-distunittimeout <seconds>	drop workers that sit on a unit longer than this
+bool DistWork_ParseArg( int argc, char **argv, int &i );
+
+// Help text for the tool's usage.
+const char *DistWork_GetUsage();
+
+// Call once numthreads is known and before loading the map. The coordinator
+// starts letting workers in on a thread of its own and launches its local
+// workers, a worker connects to its coordinator. Does nothing unless one of the
+// arguments above was given.
+void DistWork_Init( const char *pToolName );
+
+bool DistWork_IsActive();	// coordinator or worker
+bool DistWork_IsWorker();
+
+// Spreads nWorkUnits across the coordinator's threads and every connected worker
+// and returns how long it took. Units that were handed to a worker that
+// disconnects or times out are handed out again. Each unit's results are received exactly
+// once, so the outcome doesn't depend on who processed what.
+double DistWork_Run( const char *pStageName, int nWorkUnits, DistProcessFn processFn, DistReceiveFn receiveFn );
+
+// Workers exit here once the stages they can help with are over. Does nothing
+// on the coordinator or when not distributing.
+void DistWork_WorkerFinished();
+
+
+#endif // DISTWORK_H
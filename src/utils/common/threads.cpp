@@ -13,14 +13,20 @@
 
 #define	USED
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/resource.h>
+#endif
 #include "cmdlib.h"
 #define NO_THREAD_NAMES
 #include "threads.h"
 #include "pacifier.h"
 
-#define	MAX_THREADS	16
-
 
 class CRunThreadsData
 {
@@ -28,9 +34,12 @@ public:
 	int m_iThread;
 	void *m_pUserData;
 	RunThreadsFn m_Fn;
+#ifndef _WIN32
+	int m_nNice;		// added to the thread's nice value before it runs m_Fn
+#endif
 };
 
-CRunThreadsData g_RunThreadsData[MAX_THREADS];
+CRunThreadsData g_RunThreadsData[MAX_TOOL_THREADS];
 
 
 int		dispatch;
@@ -40,7 +49,11 @@ qboolean		pacifier;
 qboolean	threaded;
 bool g_bLowPriorityThreads = false;
 
-HANDLE g_ThreadHandles[MAX_THREADS];
+#ifdef _WIN32
+HANDLE g_ThreadHandles[MAX_TOOL_THREADS];
+#else
+pthread_t g_ThreadHandles[MAX_TOOL_THREADS];
+#endif
 
 
 
@@ -98,6 +111,10 @@ void RunThreadsOnIndividual (int workcnt, qboolean showpacifier, ThreadWorkerFn
 }
 
 
+int		numthreads = -1;
+
+#ifdef _WIN32
+
 /*
 ===================================================================
 
@@ -106,7 +123,6 @@ WIN32
 ===================================================================
 */
 
-int		numthreads = -1;
 CRITICAL_SECTION		crit;
 static int enter;
 
@@ -136,8 +152,10 @@ void ThreadSetDefault (void)
 	{
 		GetSystemInfo (&info);
 		numthreads = info.dwNumberOfProcessors;
-		if (numthreads < 1 || numthreads > 32)
+		if (numthreads < 1)
 			numthreads = 1;
+		if (numthreads > MAX_TOOL_THREADS)
+			numthreads = MAX_TOOL_THREADS;
 	}
 
 	Msg ("%i threads\n", numthreads);
@@ -218,6 +236,124 @@ void RunThreads_End()
 
 	threaded = false;
 }
+
+#else
+
+/*
+===================================================================
+
+POSIX
+
+===================================================================
+*/
+
+pthread_mutex_t		crit = PTHREAD_MUTEX_INITIALIZER;
+static int enter;
+
+
+void SetLowPriority()
+{
+	setpriority( PRIO_PROCESS, 0, 19 );
+}
+
+
+void ThreadSetDefault (void)
+{
+	if (numthreads == -1)	// not set manually
+	{
+		numthreads = sysconf( _SC_NPROCESSORS_ONLN );
+		if (numthreads < 1)
+			numthreads = 1;
+		if (numthreads > MAX_TOOL_THREADS)
+			numthreads = MAX_TOOL_THREADS;
+	}
+
+	Msg ("%i threads\n", numthreads);
+}
+
+
+void ThreadLock (void)
+{
+	if (!threaded)
+		return;
+	pthread_mutex_lock (&crit);
+	if (enter)
+		Error ("Recursive ThreadLock\n");
+	enter = 1;
+}
+
+void ThreadUnlock (void)
+{
+	if (!threaded)
+		return;
+	if (!enter)
+		Error ("ThreadUnlock without lock\n");
+	enter = 0;
+	pthread_mutex_unlock (&crit);
+}
+
+
+// This runs in the thread and dispatches a RunThreadsFn call.
+static void *InternalRunThreadsFn( void *pParameter )
+{
+	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
+
+	// Linux keeps a nice value per thread, so this only lowers this one.
+	// -1 is also a valid nice value, only errno tells a failure apart.
+	if ( pData->m_nNice )
+	{
+		errno = 0;
+		if ( nice( pData->m_nNice ) == -1 && errno != 0 )
+		{
+			Warning( "Thread %d couldn't lower its priority: %s\n", pData->m_iThread, strerror( errno ) );
+		}
+	}
+
+	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
+	return NULL;
+}
+
+
+void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePriority )
+{
+	Assert( numthreads > 0 );
+	threaded = true;
+
+	if ( numthreads > MAX_TOOL_THREADS )
+		numthreads = MAX_TOOL_THREADS;
+
+	for ( int i=0; i < numthreads ;i++ )
+	{
+		g_RunThreadsData[i].m_iThread = i;
+		g_RunThreadsData[i].m_pUserData = pUserData;
+		g_RunThreadsData[i].m_Fn = fn;
+		g_RunThreadsData[i].m_nNice = 0;
+
+		if ( ePriority == k_eRunThreadsPriority_UseGlobalState )
+		{
+			if( g_bLowPriorityThreads )
+				g_RunThreadsData[i].m_nNice = 10;
+		}
+		else if ( ePriority == k_eRunThreadsPriority_Idle )
+		{
+			g_RunThreadsData[i].m_nNice = 19;
+		}
+
+		if ( pthread_create( &g_ThreadHandles[i], NULL, InternalRunThreadsFn, &g_RunThreadsData[i] ) != 0 )
+			Error( "RunThreads_Start: pthread_create failed\n" );
+	}
+}
+
+
+void RunThreads_End()
+{
+	for ( int i=0; i < numthreads; i++ )
+		pthread_join( g_ThreadHandles[i], NULL );
+
+	threaded = false;
+}
+
+#endif // _WIN32
 	
 
 /*
@@ -18,12 +18,15 @@
 
 // Arrays that are indexed by thread should always be MAX_TOOL_THREADS+1
 // large so THREADINDEX_MAIN can be used from the main thread.
-#define MAX_TOOL_THREADS	32
+#define MAX_TOOL_THREADS	64
 #define THREADINDEX_MAIN	(MAX_TOOL_THREADS)
 
 
 extern	int		numthreads;
 
+// True only while RunThreadsOn is running, ThreadLock doesn't lock otherwise.
+extern	qboolean	threaded;
+
 // If set to true, then all the threads that are created are low priority.
 extern bool	g_bLowPriorityThreads;
 
@@ -5,9 +5,13 @@
 // $NoKeywords: $
 //=============================================================================//
 
+#ifdef _WIN32
 #include <windows.h>
 #include <dbghelp.h>
 #include "tier0/minidump.h"
+#else
+#include <stddef.h>
+#endif
 #include "tools_minidump.h"
 
 static bool g_bToolsWriteFullMinidumps = false;
@@ -18,6 +22,8 @@ static ToolsExceptionHandler g_pCustomExceptionHandler = NULL;
 // Internal helpers.
 // --------------------------------------------------------------------------------- //
 
+#ifdef _WIN32
+
 static LONG __stdcall ToolsExceptionFilter( struct _EXCEPTION_POINTERS *ExceptionInfo )
 {
 	// Non VMPI workers write a minidump and show a crash dialog like normal.
@@ -37,6 +43,8 @@ static LONG __stdcall ToolsExceptionFilter_Custom( struct _EXCEPTION_POINTERS *E
 	return EXCEPTION_EXECUTE_HANDLER; // (never gets here anyway)
 }
 
+#endif
+
 
 // --------------------------------------------------------------------------------- //
 // Interface functions.
@@ -50,12 +58,16 @@ void EnableFullMinidumps( bool bFull )
 
 void SetupDefaultToolsMinidumpHandler()
 {
+#ifdef _WIN32
 	SetUnhandledExceptionFilter( ToolsExceptionFilter );
+#endif
 }
 
 
 void SetupToolsMinidumpHandler( ToolsExceptionHandler fn )
 {
 	g_pCustomExceptionHandler = fn;
+#ifdef _WIN32
 	SetUnhandledExceptionFilter( ToolsExceptionFilter_Custom );
+#endif
 }
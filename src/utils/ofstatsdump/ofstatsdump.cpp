@@ -0,0 +1,306 @@
+//====== Copyright © 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Reads the binary stats streams written by the server when
+//			tf_stats_stream is on, and prints a summary or dumps one event
+//			type as CSV.
+//
+//=============================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "tf_statsstream_format.h"
+
+struct StreamString_t
+{
+	char	szString[ STATSSTREAM_STRING_SIZE ];
+};
+
+static CUtlVector< StreamString_t >	g_Strings;
+static int							g_nRows[ STATSSTREAM_EVENT_COUNT ];
+static int							g_nBlocks[ STATSSTREAM_EVENT_COUNT ];
+static int							g_nBytes[ STATSSTREAM_EVENT_COUNT ];
+static int							g_iCSVEvent = -1;
+static bool							g_bCSVHeader = false;
+
+void Usage( void )
+{
+	printf( "Usage: ofstatsdump [-csv <event>] file.ofstats\n" );
+	printf( "  Without -csv prints a summary of the file.\n" );
+	printf( "  Events:" );
+	for ( int i = 0; i < STATSSTREAM_EVENT_COUNT; i++ )
+	{
+		printf( " %s", g_StatsStreamEvents[i].pszName );
+	}
+	printf( "\n" );
+	exit( -1 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads a little endian integer column value
+//-----------------------------------------------------------------------------
+static int ReadInt( const byte *pData, int nSize, bool bSigned )
+{
+	switch ( nSize )
+	{
+	case 1:
+		return bSigned ? *(const int8 *)pData : *(const uint8 *)pData;
+	case 2:
+		return bSigned ? *(const int16 *)pData : *(const uint16 *)pData;
+	case 4:
+		return *(const int32 *)pData;
+	}
+	return 0;
+}
+
+static const char *GetString( int nID )
+{
+	if ( nID < 0 || nID >= g_Strings.Count() )
+		return "";
+
+	return g_Strings[nID].szString;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Remembers the strings from a string block so later blocks can use them
+//-----------------------------------------------------------------------------
+static void ReadStrings( const byte *pData, int nRows )
+{
+	const StatsStreamEventDesc_t &desc = g_StatsStreamEvents[ STATSSTREAM_STRING ];
+	const byte *pIDs = pData;
+	const byte *pText = pData + desc.pColumns[0].nSize * nRows;
+
+	for ( int iRow = 0; iRow < nRows; iRow++ )
+	{
+		int nID = ReadInt( pIDs + iRow * desc.pColumns[0].nSize, desc.pColumns[0].nSize, true );
+		if ( nID < 0 )
+			continue;
+
+		if ( nID >= g_Strings.Count() )
+		{
+			g_Strings.AddMultipleToTail( nID + 1 - g_Strings.Count() );
+		}
+
+		Q_strncpy( g_Strings[nID].szString, (const char *)pText + iRow * desc.pColumns[1].nSize, sizeof( g_Strings[nID].szString ) );
+	}
+}
+
+static void WriteCSVHeader( const StatsStreamEventDesc_t &desc )
+{
+	for ( int iColumn = 0; iColumn < desc.nColumns; iColumn++ )
+	{
+		const StatsStreamColumn_t &column = desc.pColumns[iColumn];
+		if ( column.nCount == 3 )
+		{
+			printf( "%s%s_x,%s_y,%s_z", iColumn ? "," : "", column.pszName, column.pszName, column.pszName );
+		}
+		else
+		{
+			printf( "%s%s", iColumn ? "," : "", column.pszName );
+		}
+	}
+	printf( "\n" );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Walks a block column-wise, printing one line per row
+//-----------------------------------------------------------------------------
+static void WriteCSVRows( const StatsStreamEventDesc_t &desc, const byte *pData, int nRows )
+{
+	// Where each column starts in the block
+	int nColumnStart[ 32 ];
+	int nOffset = 0;
+	for ( int iColumn = 0; iColumn < desc.nColumns && iColumn < ARRAYSIZE( nColumnStart ); iColumn++ )
+	{
+		nColumnStart[iColumn] = nOffset;
+		nOffset += desc.pColumns[iColumn].nSize * nRows;
+	}
+
+	for ( int iRow = 0; iRow < nRows; iRow++ )
+	{
+		for ( int iColumn = 0; iColumn < desc.nColumns; iColumn++ )
+		{
+			const StatsStreamColumn_t &column = desc.pColumns[iColumn];
+			const byte *pValue = pData + nColumnStart[iColumn] + iRow * column.nSize;
+			const char *pszSeparator = iColumn ? "," : "";
+
+			switch ( column.nType )
+			{
+			case STATSSTREAM_COL_INT:
+			case STATSSTREAM_COL_UINT:
+				{
+					int nElementSize = column.nSize / column.nCount;
+					for ( int i = 0; i < column.nCount; i++ )
+					{
+						printf( "%s%d", ( i == 0 ) ? pszSeparator : ",", ReadInt( pValue + i * nElementSize, nElementSize, column.nType == STATSSTREAM_COL_INT ) );
+					}
+				}
+				break;
+			case STATSSTREAM_COL_FLOAT:
+				printf( "%s%.3f", pszSeparator, *(const float *)pValue );
+				break;
+			case STATSSTREAM_COL_STRING:
+				{
+					char szValue[ 256 ];
+					Q_strncpy( szValue, (const char *)pValue, MIN( column.nSize + 1, (int)sizeof( szValue ) ) );
+					printf( "%s\"%s\"", pszSeparator, szValue );
+				}
+				break;
+			case STATSSTREAM_COL_STRINGID:
+				printf( "%s%s", pszSeparator, GetString( ReadInt( pValue, column.nSize, true ) ) );
+				break;
+			}
+		}
+		printf( "\n" );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+static bool DumpFile( const char *pszFileName )
+{
+	FILE *fp = fopen( pszFileName, "rb" );
+	if ( !fp )
+	{
+		fprintf( stderr, "Unable to open %s\n", pszFileName );
+		return false;
+	}
+
+	StatsStreamFileHeader_t header;
+	if ( fread( &header, sizeof( header ), 1, fp ) != 1 || header.nMagic != STATSSTREAM_MAGIC )
+	{
+		fprintf( stderr, "%s is not a stats stream\n", pszFileName );
+		fclose( fp );
+		return false;
+	}
+
+	if ( header.nVersion != STATSSTREAM_VERSION )
+	{
+		fprintf( stderr, "%s is version %d, expected %d\n", pszFileName, header.nVersion, STATSSTREAM_VERSION );
+		fclose( fp );
+		return false;
+	}
+
+	// Later versions may grow the header
+	fseek( fp, header.nHeaderSize, SEEK_SET );
+
+	CUtlVector< byte > data;
+	StatsStreamBlockHeader_t block;
+	int nLastTick = 0;
+	bool bTruncated = false;
+
+	while ( fread( &block, sizeof( block ), 1, fp ) == 1 )
+	{
+		data.SetCount( block.nBytes );
+		if ( block.nBytes && fread( data.Base(), block.nBytes, 1, fp ) != 1 )
+		{
+			bTruncated = true;
+			break;
+		}
+
+		// Skip anything this version doesn't understand
+		if ( block.nEvent >= STATSSTREAM_EVENT_COUNT )
+			continue;
+
+		const StatsStreamEventDesc_t &desc = g_StatsStreamEvents[ block.nEvent ];
+		if ( block.nColumns != desc.nColumns || (int)block.nBytes != desc.nRowSize * block.nRows )
+		{
+			fprintf( stderr, "Malformed %s block, skipping\n", desc.pszName );
+			continue;
+		}
+
+		g_nRows[ block.nEvent ] += block.nRows;
+		g_nBlocks[ block.nEvent ]++;
+		g_nBytes[ block.nEvent ] += sizeof( block ) + block.nBytes;
+
+		if ( block.nEvent == STATSSTREAM_STRING )
+		{
+			ReadStrings( data.Base(), block.nRows );
+			continue;
+		}
+
+		// All other rows lead with their tick, the last one is the newest
+		if ( block.nRows )
+		{
+			nLastTick = MAX( nLastTick, ReadInt( data.Base() + ( block.nRows - 1 ) * sizeof( int32 ), sizeof( int32 ), true ) );
+		}
+
+		if ( block.nEvent == g_iCSVEvent )
+		{
+			if ( !g_bCSVHeader )
+			{
+				WriteCSVHeader( desc );
+				g_bCSVHeader = true;
+			}
+
+			WriteCSVRows( desc, data.Base(), block.nRows );
+		}
+	}
+
+	fclose( fp );
+
+	if ( bTruncated )
+	{
+		fprintf( stderr, "%s ends in a partial block, the server probably didn't shut down cleanly\n", pszFileName );
+	}
+
+	// Keep the CSV clean for whatever it's piped into
+	if ( g_iCSVEvent >= 0 )
+		return true;
+
+	printf( "%s\n", pszFileName );
+	printf( "  map:           %s\n", header.szMap );
+	printf( "  tick interval: %.4f\n", header.flTickInterval );
+	printf( "  last tick:     %d (%.1f minutes)\n", nLastTick, nLastTick * header.flTickInterval / 60.0f );
+	printf( "  strings:       %d\n", g_Strings.Count() );
+	printf( "  %-8s %10s %8s %10s\n", "event", "rows", "blocks", "bytes" );
+	for ( int i = 0; i < STATSSTREAM_EVENT_COUNT; i++ )
+	{
+		printf( "  %-8s %10d %8d %10d\n", g_StatsStreamEvents[i].pszName, g_nRows[i], g_nBlocks[i], g_nBytes[i] );
+	}
+
+	return true;
+}
+
+int main( int argc, char **argv )
+{
+	const char *pszFileName = NULL;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !Q_stricmp( argv[i], "-csv" ) && i + 1 < argc )
+		{
+			const char *pszEvent = argv[++i];
+			for ( int iEvent = 0; iEvent < STATSSTREAM_EVENT_COUNT; iEvent++ )
+			{
+				if ( !Q_stricmp( pszEvent, g_StatsStreamEvents[iEvent].pszName ) )
+				{
+					g_iCSVEvent = iEvent;
+				}
+			}
+
+			if ( g_iCSVEvent < 0 || g_iCSVEvent == STATSSTREAM_STRING )
+			{
+				fprintf( stderr, "Unknown event type %s\n", pszEvent );
+				Usage();
+			}
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			Usage();
+		}
+		else
+		{
+			pszFileName = argv[i];
+		}
+	}
+
+	if ( !pszFileName )
+	{
+		Usage();
+	}
+
+	return DumpFile( pszFileName ) ? 0 : -1;
+}
@@ -7,12 +7,19 @@
 //=============================================================================//
 
 #include "vbsp.h"
+#include "tier0/threadtools.h"
 
 
 int		c_nodes;
 int		c_nonvis;
 int		c_active_brushes;
 
+// Subtrees with at least this many brushes get their own thread while fewer
+// than numthreads threads are building trees
+#define	BSP_FORK_MIN_BRUSHES	256
+
+static long volatile s_nBuildTreeThreads;
+
 // if a brush just barely pokes onto the other side,
 // let it slide by without chopping
 #define	PLANESIDE_EPSILON	0.001
@@ -1331,6 +1338,15 @@ BuildTree_r
 */
 
 
+struct BuildTreeJob_t
+{
+	node_t		*node;
+	bspbrush_t	*brushes;
+};
+
+static unsigned BuildTree_Thread( void *pParam );
+static bool ShouldForkSubtree( bspbrush_t *brushes );
+
 node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 {
 	node_t		*newnode;
@@ -1371,14 +1387,68 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	SplitBrush (node->volume, node->planenum, &node->children[0]->volume,
 		&node->children[1]->volume);
 
-	// recursively process children
+	// recursively process children, the front one on its own thread when it's
+	// big enough and one is free. Each subtree only writes its own nodes, so
+	// the tree is the same whichever way it was built.
+	ThreadHandle_t hFrontThread = NULL;
+	BuildTreeJob_t frontJob;
+	if ( ShouldForkSubtree( children[0] ) )
+	{
+		frontJob.node = node->children[0];
+		frontJob.brushes = children[0];
+		hFrontThread = CreateSimpleThread( BuildTree_Thread, &frontJob );
+		if ( !hFrontThread )
+		{
+			ThreadInterlockedDecrement( &s_nBuildTreeThreads );
+		}
+	}
+
 	for (i=0 ; i<2 ; i++)
 	{
+		if ( i == 0 && hFrontThread )
+			continue;
 		node->children[i] = BuildTree_r (node->children[i], children[i]);
 	}
 
+	if ( hFrontThread )
+	{
+		ThreadJoin( hFrontThread );
+		ReleaseThreadHandle( hFrontThread );
+		node->children[0] = frontJob.node;
+	}
+
 	return node;
 }
+
+static unsigned BuildTree_Thread( void *pParam )
+{
+	BuildTreeJob_t *pJob = (BuildTreeJob_t *)pParam;
+	pJob->node = BuildTree_r( pJob->node, pJob->brushes );
+	ThreadInterlockedDecrement( &s_nBuildTreeThreads );
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Claims a tree building thread for this brush list if one is free. Only
+// forks inside RunThreadsOn, anywhere else ThreadLock doesn't protect the
+// winding pool.
+//-----------------------------------------------------------------------------
+static bool ShouldForkSubtree( bspbrush_t *brushes )
+{
+	if ( !threaded || numthreads <= 1 || s_nBuildTreeThreads >= numthreads )
+		return false;
+
+	if ( CountBrushList( brushes ) < BSP_FORK_MIN_BRUSHES )
+		return false;
+
+	if ( ThreadInterlockedIncrement( &s_nBuildTreeThreads ) > numthreads )
+	{
+		ThreadInterlockedDecrement( &s_nBuildTreeThreads );
+		return false;
+	}
+
+	return true;
+}
 	  
 
 //===========================================================
@@ -1391,6 +1461,20 @@ The incoming list will be freed before exiting
 =================
 */
 tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs)
+{
+	return BrushBSP (brushlist, BrushFromBounds (mins, maxs));
+}
+
+/*
+=================
+BrushBSP
+
+Takes ownership of the volume, which the caller built with BrushFromBounds
+so any planes it needed already exist. Doesn't add planes, so blocks can be
+built on several threads at once.
+=================
+*/
+tree_t *BrushBSP (bspbrush_t *brushlist, bspbrush_t *headvolume)
 {
 	node_t		*node;
 	bspbrush_t	*b;
@@ -1439,15 +1523,20 @@ tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs)
 	qprintf ("%5i visible faces\n", c_faces);
 	qprintf ("%5i nonvisible faces\n", c_nonvisfaces);
 
-	c_nodes = 0;
-	c_nonvis = 0;
+	if (numthreads == 1)
+	{
+		c_nodes = 0;
+		c_nonvis = 0;
+	}
 	node = AllocNode ();
 
-	node->volume = BrushFromBounds (mins, maxs);
+	node->volume = headvolume;
 
 	tree->headnode = node;
 
+	ThreadInterlockedIncrement( &s_nBuildTreeThreads );
 	node = BuildTree_r (node, brushlist);
+	ThreadInterlockedDecrement( &s_nBuildTreeThreads );
 	qprintf ("%5i visible nodes\n", c_nodes/2 - c_nonvis);
 	qprintf ("%5i nonvis nodes\n", c_nonvis);
 	qprintf ("%5i leafs\n", (c_nodes+1)/2);
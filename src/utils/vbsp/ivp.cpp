@@ -1516,7 +1516,7 @@ void EmitPhysCollision()
 
 	int physModelCount = 0, totalSize = 0;
 
-	int start = Plat_FloatTime();
+	double start = Plat_FloatTime();
 
 	Msg("Building Physics collision data...\n" );
 
@@ -1650,7 +1650,7 @@ void EmitPhysCollision()
 	memcpy( ptr, &model, sizeof(model) );
 	ptr += sizeof(model);
 	Assert( (ptr-g_pPhysCollide) == g_PhysCollideSize);
-	Msg("done (%d) (%d bytes)\n", (int)(Plat_FloatTime() - start), g_PhysCollideSize );
+	Msg("done (%.2fs) (%d bytes)\n", Plat_FloatTime() - start, g_PhysCollideSize );
 
 	// UNDONE: Collision models (collisionList) memory leak!
 }
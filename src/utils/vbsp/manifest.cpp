@@ -3,7 +3,11 @@
 #include "map_shared.h"
 #include "fgdlib/fgdlib.h"
 #include "manifest.h"
+#ifdef _WIN32
 #include "windows.h"
+#else
+#include <unistd.h>
+#endif
 
 //-----------------------------------------------------------------------------
 // Purpose: default constructor
@@ -356,6 +360,8 @@ bool CManifest::LoadSubMaps( CMapFile *pMapFile, const char *pszFileName )
 bool CManifest::LoadVMFManifestUserPrefs( const char *pszFileName )
 {
 	char		UserName[ MAX_PATH ], FileName[ MAX_PATH ], UserPrefsFileName[ MAX_PATH ];
+
+#ifdef _WIN32
 	DWORD		UserNameSize;
 
 	UserNameSize = sizeof( UserName );
@@ -363,8 +369,14 @@ bool CManifest::LoadVMFManifestUserPrefs( const char *pszFileName )
 	{
 		strcpy( UserPrefsFileName, "default" );
 	}
+#else
+	if ( getlogin_r( UserName, sizeof( UserName ) ) != 0 )
+	{
+		strcpy( UserName, "default" );
+	}
+#endif
 
-	sprintf( UserPrefsFileName, "\\%s.vmm_prefs", UserName );
+	sprintf( UserPrefsFileName, "%c%s.vmm_prefs", CORRECT_PATH_SEPARATOR, UserName );
 	V_StripExtension( pszFileName, FileName, sizeof( FileName ) );
 	strcat( FileName, UserPrefsFileName );
 
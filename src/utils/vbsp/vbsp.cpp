@@ -148,33 +148,79 @@ node_t	*BlockTree (int xl, int yl, int xh, int yh)
 
 /*
 ============
-ProcessBlock_Thread
+GetBlockBounds
 
 ============
 */
-int			brush_start, brush_end;
-void ProcessBlock_Thread (int threadnum, int blocknum)
+static void GetBlockBounds (int blocknum, int &xblock, int &yblock, Vector& mins, Vector& maxs)
 {
-	int		xblock, yblock;
-	Vector		mins, maxs;
-	bspbrush_t	*brushes;
-	tree_t		*tree;
-	node_t		*node;
-
 	yblock = block_yl + blocknum / (block_xh-block_xl+1);
 	xblock = block_xl + blocknum % (block_xh-block_xl+1);
 
-	qprintf ("############### block %2i,%2i ###############\n", xblock, yblock);
-
 	mins[0] = xblock*BLOCKS_SIZE;
 	mins[1] = yblock*BLOCKS_SIZE;
 	mins[2] = MIN_COORD_INTEGER;
 	maxs[0] = (xblock+1)*BLOCKS_SIZE;
 	maxs[1] = (yblock+1)*BLOCKS_SIZE;
 	maxs[2] = MAX_COORD_INTEGER;
+}
+
+/*
+============
+PrepareBlock
+
+Everything that can add planes or touch map brushes happens here, one block
+at a time in block order, so the plane list comes out exactly as it would
+from a single thread. ProcessBlock_Thread only reads the planes after this.
+
+Note: the areaportal/water fixup for every block now runs before any block
+is chopped, so a block can see contents a later block fixed up on a shared
+map brush. The old serial order only let later blocks see them.
+============
+*/
+int			brush_start, brush_end;
+bspbrush_t	*block_brushes[BLOCKS_SPACE+2][BLOCKS_SPACE+2];
+bspbrush_t	*block_volumes[BLOCKS_SPACE+2][BLOCKS_SPACE+2];
+static void PrepareBlock (int blocknum)
+{
+	int		xblock, yblock;
+	Vector		mins, maxs;
+	bspbrush_t	*brushes;
+
+	GetBlockBounds (blocknum, xblock, yblock, mins, maxs);
 
 	// the makelist and chopbrushes could be cached between the passes...
 	brushes = MakeBspBrushList (brush_start, brush_end, mins, maxs, NO_DETAIL);
+	block_brushes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET] = brushes;
+	block_volumes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET] = NULL;
+	if (!brushes)
+		return;
+
+	// this retextures the original map brushes, which neighboring blocks share
+	FixupAreaportalWaterBrushes( brushes );
+	block_volumes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET] = BrushFromBounds (mins, maxs);
+}
+
+/*
+============
+ProcessBlock_Thread
+
+============
+*/
+void ProcessBlock_Thread (int threadnum, int blocknum)
+{
+	int		xblock, yblock;
+	Vector		mins, maxs;
+	bspbrush_t	*brushes;
+	tree_t		*tree;
+	node_t		*node;
+
+	GetBlockBounds (blocknum, xblock, yblock, mins, maxs);
+
+	qprintf ("############### block %2i,%2i ###############\n", xblock, yblock);
+
+	brushes = block_brushes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET];
+	block_brushes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET] = NULL;
 	if (!brushes)
 	{
 		node = AllocNode ();
@@ -184,11 +230,11 @@ void ProcessBlock_Thread (int threadnum, int blocknum)
 		return;
 	}    
 
-	FixupAreaportalWaterBrushes( brushes );
 	if (!nocsg)
 		brushes = ChopBrushes (brushes);
 
-	tree = BrushBSP (brushes, mins, maxs);
+	tree = BrushBSP (brushes, block_volumes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET]);
+	block_volumes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET] = NULL;
 	
 	block_nodes[xblock+BLOCKX_OFFSET][yblock+BLOCKY_OFFSET] = tree->headnode;
 }
@@ -253,12 +299,21 @@ void ProcessWorldModel (void)
 		block_yh = BLOCKS_MAX;
 	}
 
+	int numblocks = (block_xh-block_xl+1)*(block_yh-block_yl+1);
 	for (optimize = 0 ; optimize <= 1 ; optimize++)
 	{
 		qprintf ("--------------------------------------------\n");
 
-		RunThreadsOnIndividual ((block_xh-block_xl+1)*(block_yh-block_yl+1),
-			!verbose, ProcessBlock_Thread);
+		double flPrepareStart = Plat_FloatTime();
+		for (int blocknum = 0 ; blocknum < numblocks ; blocknum++)
+		{
+			PrepareBlock (blocknum);
+		}
+
+		double flBlockStart = Plat_FloatTime();
+		RunThreadsOnIndividual (numblocks, !verbose, ProcessBlock_Thread);
+
+		double flTreeStart = Plat_FloatTime();
 
 		//
 		// build the division tree
@@ -305,6 +360,10 @@ void ProcessWorldModel (void)
 
 		// mark the brush sides that actually turned into faces
 		MarkVisibleSides (tree, brush_start, brush_end, NO_DETAIL);
+
+		Msg ("Pass %d: brush lists %.2fs, block bsp %.2fs (%d threads), portals and flood %.2fs\n", optimize,
+			flBlockStart - flPrepareStart, flTreeStart - flBlockStart, numthreads, Plat_FloatTime() - flTreeStart);
+
 		if (noopt || leaked)
 			break;
 		if (!optimize)
@@ -1277,7 +1336,6 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
-	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
 	char logFile[512];
@@ -18,7 +18,7 @@
 #include "bsplib.h"
 #include "qfiles.h"
 #include "utilmatlib.h"
-#include "ChunkFile.h"
+#include "chunkfile.h"
 
 #ifdef WIN32
 #pragma warning( disable: 4706 )
@@ -482,6 +482,8 @@ void FreeBrushList (bspbrush_t *brushes);
 node_t	*PointInLeaf (node_t *node, Vector& point);
 
 tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs);
+tree_t *BrushBSP (bspbrush_t *brushlist, bspbrush_t *headvolume);
+bspbrush_t *BrushFromBounds (Vector& mins, Vector& maxs);
 
 #define	PSIDE_FRONT			1
 #define	PSIDE_BACK			2
@@ -0,0 +1,218 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Shares BuildFacelights and BuildVisLeafs with DistWork workers in
+//			builds without VMPI. Sends back the same per face and per patch
+//			data mpivrad.cpp does.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "vismat.h"
+#include "distwork.h"
+#include "tier1/utlbuffer.h"
+
+
+extern int total_transfer;
+extern int max_transfer;
+
+extern void BuildPatchLights( int facenum );
+
+
+template<class T> static void PutValues( CUtlBuffer *pBuf, T const *pSrc, int nValues )
+{
+	pBuf->Put( pSrc, sizeof( pSrc[0] ) * nValues );
+}
+
+template<class T> static T *GetValues( CUtlBuffer &buf, int nValues )
+{
+	T *pDest = (T *)calloc( nValues, sizeof( T ) );
+	buf.Get( pDest, sizeof( T ) * nValues );
+	return pDest;
+}
+
+
+//-----------------------------------------------------------------------------
+// BuildFacelights
+//-----------------------------------------------------------------------------
+static void DistProcessFacelights( int iThread, int iFace, CUtlBuffer *pBuf )
+{
+	BuildFacelights( iThread, iFace );
+
+	if ( !pBuf )
+		return;
+
+	facelight_t *fl = &facelight[iFace];
+	pBuf->Put( &g_pFaces[iFace], sizeof( dface_t ) );
+	pBuf->Put( fl, sizeof( facelight_t ) );
+
+	PutValues( pBuf, fl->sample, fl->numsamples );
+	for ( int i = 0; i < MAXLIGHTMAPS; i++ )
+	{
+		for ( int n = 0; n < NUM_BUMP_VECTS+1; n++ )
+		{
+			if ( fl->light[i][n] )
+			{
+				PutValues( pBuf, fl->light[i][n], fl->numsamples );
+			}
+		}
+	}
+
+	if ( fl->luxel )
+	{
+		PutValues( pBuf, fl->luxel, fl->numluxels );
+	}
+
+	if ( fl->luxelNormals )
+	{
+		PutValues( pBuf, fl->luxelNormals, fl->numluxels );
+	}
+}
+
+static bool DistReceiveFacelights( int iFace, CUtlBuffer &buf )
+{
+	dface_t face;
+	facelight_t fl;
+	buf.Get( &face, sizeof( face ) );
+	buf.Get( &fl, sizeof( fl ) );
+	if ( !buf.IsValid() || fl.numsamples < 0 || fl.numluxels < 0 )
+		return false;
+
+	// The pointers are the worker's, all they say here is which arrays follow.
+	// Check the sizes add up before touching the face.
+	int nExpected = sizeof( sample_t ) * fl.numsamples;
+	for ( int i = 0; i < MAXLIGHTMAPS; i++ )
+	{
+		for ( int n = 0; n < NUM_BUMP_VECTS+1; n++ )
+		{
+			if ( fl.light[i][n] )
+			{
+				nExpected += sizeof( LightingValue_t ) * fl.numsamples;
+			}
+		}
+	}
+	if ( fl.luxel )
+	{
+		nExpected += sizeof( Vector ) * fl.numluxels;
+	}
+	if ( fl.luxelNormals )
+	{
+		nExpected += sizeof( Vector ) * fl.numluxels;
+	}
+
+	if ( buf.GetBytesRemaining() != nExpected )
+		return false;
+
+	fl.sample = GetValues<sample_t>( buf, fl.numsamples );
+	for ( int i = 0; i < MAXLIGHTMAPS; i++ )
+	{
+		for ( int n = 0; n < NUM_BUMP_VECTS+1; n++ )
+		{
+			if ( fl.light[i][n] )
+			{
+				fl.light[i][n] = GetValues<LightingValue_t>( buf, fl.numsamples );
+			}
+		}
+	}
+
+	if ( fl.luxel )
+	{
+		fl.luxel = GetValues<Vector>( buf, fl.numluxels );
+	}
+
+	if ( fl.luxelNormals )
+	{
+		fl.luxelNormals = GetValues<Vector>( buf, fl.numluxels );
+	}
+
+	g_pFaces[iFace] = face;
+	facelight[iFace] = fl;
+	return true;
+}
+
+static void BuildPatchLightsThread( int iThread, int iFace )
+{
+	BuildPatchLights( iFace );
+}
+
+void RunDistBuildFacelights()
+{
+	DistWork_Run( "BuildFacelights:", numfaces, DistProcessFacelights, DistReceiveFacelights );
+
+	// BuildFacelights leaves this out when distributing, it lights the
+	// face's patches and those aren't sent back
+	if ( !DistWork_IsWorker() )
+	{
+		RunThreadsOnIndividual( numfaces, false, BuildPatchLightsThread );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// BuildVisLeafs
+//-----------------------------------------------------------------------------
+static transfer_t *s_pVisLeafsTransfers[MAX_TOOL_THREADS+1];
+static CUtlBuffer *s_pVisLeafsBuf[MAX_TOOL_THREADS+1];
+
+static void DistAddPatchTransfers( int iThread, int patchnum, CPatch *patch )
+{
+	CUtlBuffer *pBuf = s_pVisLeafsBuf[iThread];
+	pBuf->PutInt( patchnum );
+	pBuf->PutInt( patch->numtransfers );
+	PutValues( pBuf, patch->transfers, patch->numtransfers );
+}
+
+static void DistProcessVisLeafs( int iThread, int iCluster, CUtlBuffer *pBuf )
+{
+	s_pVisLeafsBuf[iThread] = pBuf;
+	BuildVisLeafs_Cluster( iThread, s_pVisLeafsTransfers[iThread], iCluster, pBuf ? DistAddPatchTransfers : NULL );
+}
+
+static bool DistReceiveVisLeafs( int iCluster, CUtlBuffer &buf )
+{
+	// Walk it once to check every patch is whole before keeping any of them
+	while ( buf.GetBytesRemaining() > 0 )
+	{
+		int patchnum = buf.GetInt();
+		int numtransfers = buf.GetInt();
+		if ( !buf.IsValid() || patchnum < 0 || patchnum >= g_Patches.Count() || numtransfers < 0 || numtransfers > MAX_PATCHES ||
+			buf.GetBytesRemaining() < (int)sizeof( transfer_t ) * numtransfers )
+		{
+			return false;
+		}
+
+		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, sizeof( transfer_t ) * numtransfers );
+	}
+
+	buf.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+	while ( buf.GetBytesRemaining() > 0 )
+	{
+		CPatch *patch = &g_Patches[ buf.GetInt() ];
+		patch->numtransfers = buf.GetInt();
+		patch->transfers = patch->numtransfers ? GetValues<transfer_t>( buf, patch->numtransfers ) : NULL;
+
+		// The coordinator's own threads add theirs in MakeScales
+		ThreadLock();
+		total_transfer += patch->numtransfers;
+		max_transfer = MAX( max_transfer, patch->numtransfers );
+		ThreadUnlock();
+	}
+
+	return true;
+}
+
+void RunDistBuildVisLeafs()
+{
+	for ( int i = 0; i < numthreads; i++ )
+	{
+		s_pVisLeafsTransfers[i] = BuildVisLeafs_Start();
+	}
+
+	DistWork_Run( "BuildVisLeafs:", dvis->numclusters, DistProcessVisLeafs, DistReceiveVisLeafs );
+
+	for ( int i = 0; i < numthreads; i++ )
+	{
+		BuildVisLeafs_End( s_pVisLeafsTransfers[i] );
+		s_pVisLeafsTransfers[i] = NULL;
+	}
+}
@@ -11,7 +11,6 @@
 #include "radial.h"
 #include "mathlib/bumpvects.h"
 #include "tier1/utlvector.h"
-#include "vmpi.h"
 #include "mathlib/anorms.h"
 #include "map_utils.h"
 #include "mathlib/halton.h"
@@ -2534,7 +2533,7 @@ static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, i
 			if (info.m_WarnFace != info.m_FaceNum)
 			{
 				Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
-					info.m_Points.x.m128_f32[0], info.m_Points.y.m128_f32[0], info.m_Points.z.m128_f32[0] );
+					SubFloat( info.m_Points.x, 0 ), SubFloat( info.m_Points.y, 0 ), SubFloat( info.m_Points.z, 0 ) );
 				info.m_WarnFace = info.m_FaceNum;
 			}
 			continue;
@@ -3174,10 +3173,10 @@ void BuildFacelights (int iThread, int facenum)
 		}
 	}
 
-	if (!g_bUseMPI) 
+	if ( !g_bUseMPI && !DistWork_IsActive() )
 	{
 		//
-		// This is done on the master node when MPI is used
+		// This is done on the master node when MPI or DistWork is used
 		//
 		BuildPatchLights( facenum );
 	}
@@ -294,7 +294,7 @@ void MPI_ReceiveVisLeafsResults( uint64 iWorkUnit, MessageBuffer *pBuf, int iWor
 		patch->numtransfers = numtransfers;
 		if (numtransfers) 
 		{
-			patch->transfers = new transfer_t[numtransfers];
+			patch->transfers = ( transfer_t* )malloc( numtransfers * sizeof(transfer_t) );
 			pBuf->read(patch->transfers, numtransfers * sizeof(transfer_t));
 		}
 		
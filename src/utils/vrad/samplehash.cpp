@@ -8,13 +8,14 @@
 
 #include "vrad.h"
 #include "lightmap.h"
+#include "tier0/threadtools.h"
 
 #define SAMPLEHASH_NUM_BUCKETS			65536
 #define SAMPLEHASH_GROW_SIZE			0
 #define SAMPLEHASH_INIT_SIZE			0
 
-int samplesAdded = 0;
-int patchSamplesAdded = 0;
+long volatile samplesAdded = 0;
+long volatile patchSamplesAdded = 0;
 static unsigned short g_PatchIterationKey = 0;
 
 //-----------------------------------------------------------------------------
@@ -35,6 +36,17 @@ unsigned int SampleData_KeyFunc( SampleData_t const &src )
 }
 
 
+//-----------------------------------------------------------------------------
+// The tables are filled by several threads at once, each owning the buckets
+// that land in its partition. Buckets never share storage, and every thread
+// walks the samples in the same order, so the result matches a serial build.
+//-----------------------------------------------------------------------------
+static inline bool SampleHash_InPartition( unsigned int key, int iPartition, int nPartitions )
+{
+	return ( nPartitions <= 1 ) || ( (int)( ( key & ( SAMPLEHASH_NUM_BUCKETS - 1 ) ) % nPartitions ) == iPartition );
+}
+
+
 CUtlHash<SampleData_t> g_SampleHashTable( SAMPLEHASH_NUM_BUCKETS, 
 										  SAMPLEHASH_GROW_SIZE, 
 										  SAMPLEHASH_INIT_SIZE, 
@@ -72,7 +84,7 @@ UtlHashHandle_t SampleData_InsertIntoHashTable( sample_t *pSample, SampleHandle_
 	pSampleData->z = sampleData.z;
 	pSampleData->m_Samples.AddToTail( sampleHandle );
 
-	samplesAdded++;
+	ThreadInterlockedIncrement( &samplesAdded );
 
 	return handle;
 }
@@ -80,8 +92,17 @@ UtlHashHandle_t SampleData_InsertIntoHashTable( sample_t *pSample, SampleHandle_
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
-UtlHashHandle_t SampleData_AddSample( sample_t *pSample, SampleHandle_t sampleHandle )
+UtlHashHandle_t SampleData_AddSample( sample_t *pSample, SampleHandle_t sampleHandle, int iPartition, int nPartitions )
 {
+	if ( nPartitions > 1 )
+	{
+		SampleData_t sampleData;
+		sampleData.x = ( int )( pSample->pos.x / SAMPLEHASH_VOXEL_SIZE ) * 100;
+		sampleData.y = ( int )( pSample->pos.y / SAMPLEHASH_VOXEL_SIZE ) * 10;
+		sampleData.z = ( int )( pSample->pos.z / SAMPLEHASH_VOXEL_SIZE );
+		if ( !SampleHash_InPartition( SampleData_KeyFunc( sampleData ), iPartition, nPartitions ) )
+			return g_SampleHashTable.InvalidHandle();
+	}
 
 	// find the key -- if it doesn't exist add new sample data to the
 	// hash table
@@ -95,7 +116,7 @@ UtlHashHandle_t SampleData_AddSample( sample_t *pSample, SampleHandle_t sampleHa
 		SampleData_t *pSampleData = &g_SampleHashTable.Element( handle );
 		pSampleData->m_Samples.AddToTail( sampleHandle );
 
-		samplesAdded++;
+		ThreadInterlockedIncrement( &samplesAdded );
 	}
 
 	return handle;
@@ -170,7 +191,7 @@ unsigned short IncrementPatchIterationKey()
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
-void PatchSampleData_AddSample( CPatch *pPatch, int ndxPatch )
+void PatchSampleData_AddSample( CPatch *pPatch, int ndxPatch, int iPartition, int nPartitions )
 {
 	int patchSampleMins[3], patchSampleMaxs[3];
 
@@ -203,6 +224,9 @@ void PatchSampleData_AddSample( CPatch *pPatch, int ndxPatch )
 				iteratePatch.y = iterateCoords[1] * 10;
 				iteratePatch.z = iterateCoords[2];
 
+				if ( !SampleHash_InPartition( PatchSampleData_KeyFunc( iteratePatch ), iPartition, nPartitions ) )
+					continue;
+
 				UtlHashHandle_t handle = g_PatchSampleHashTable.Find( iteratePatch );
 				if( handle == g_PatchSampleHashTable.InvalidHandle() )
 				{
@@ -214,14 +238,14 @@ void PatchSampleData_AddSample( CPatch *pPatch, int ndxPatch )
 					pPatchData->z = iteratePatch.z;
 					pPatchData->m_ndxPatches.AddToTail( ndxPatch );
 
-					patchSamplesAdded++;
+					ThreadInterlockedIncrement( &patchSamplesAdded );
 				}
 				else
 				{
 					PatchSampleData_t *pPatchData = &g_PatchSampleHashTable.Element( handle );
 					pPatchData->m_ndxPatches.AddToTail( ndxPatch );
 
-					patchSamplesAdded++;
+					ThreadInterlockedIncrement( &patchSamplesAdded );
 				}
 			}
 		}
@@ -7,7 +7,6 @@
 //=============================================================================//
 
 #include "vrad.h"
-#include "vmpi.h"
 #ifdef MPI
 #include "messbuf.h"
 static MessageBuffer mb;
@@ -467,11 +466,18 @@ BuildVisMatrix
 */
 void BuildVisMatrix (void)
 {
+#ifdef MPI
 	if ( g_bUseMPI )
 	{
 		RunMPIBuildVisLeafs();
 	}
 	else 
+#endif
+	if ( DistWork_IsActive() )
+	{
+		RunDistBuildVisLeafs();
+	}
+	else
 	{
 		RunThreadsOn (dvis->numclusters, true, BuildVisLeafs);
 	}
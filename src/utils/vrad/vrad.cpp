@@ -12,9 +12,10 @@
 #include "physdll.h"
 #include "lightmap.h"
 #include "tier1/strtools.h"
-#include "vmpi.h"
 #include "macro_texture.h"
+#ifdef MPI
 #include "vmpi_tools_shared.h"
+#endif
 #include "leaf_ambient_lighting.h"
 #include "tools_minidump.h"
 #include "loadcmdline.h"
@@ -24,6 +25,11 @@
 
 static FileHandle_t pFpTrans = NULL;
 
+#ifndef MPI
+bool g_bUseMPI = false;
+bool g_bMPIMaster = true;
+#endif
+
 /*
 
 NOTES
@@ -119,6 +125,7 @@ bool		g_bStaticPropLighting = false;
 bool        g_bStaticPropPolys = false;
 bool        g_bTextureShadows = false;
 bool        g_bDisablePropSelfShadowing = false;
+bool		g_bCompressLumps = false;
 
 
 CUtlVector<byte> g_FacesVisibleToLights;
@@ -1058,6 +1065,13 @@ MakeScales
 int	total_transfer;
 int max_transfer;
 
+CUtlVector<int>		g_TransferPatches;
+CUtlVector<float>	g_TransferAmounts;
+
+// For the end of run report
+static int			s_nTransferLists;
+static double		s_flBounceTime;
+
 
 //-----------------------------------------------------------------------------
 // Purpose: Computes the form factor from a polygon patch to a differential patch
@@ -1532,10 +1546,14 @@ void PreGetBumpNormalsForDisp( texinfo_t *pTexinfo, Vector &vecU, Vector &vecV,
 	vecV = vecTexV;
 }
 
+// emitlight * reflectivity for each patch, refreshed before every bounce
+static CUtlVector<Vector>	s_ShootLight;
+
 void GatherLight (int threadnum, void *pUserData)
 {
 	int			i, j, k;
-	transfer_t	*trans;
+	const int	*pTransferPatch;
+	const float	*pTransferAmount;
 	int			num;
 	CPatch		*patch;
 	Vector		sum, v;
@@ -1548,7 +1566,8 @@ void GatherLight (int threadnum, void *pUserData)
 
 		patch = &g_Patches[j];
 
-		trans = patch->transfers;
+		pTransferPatch = g_TransferPatches.Base() + patch->firsttransfer;
+		pTransferAmount = g_TransferAmounts.Base() + patch->firsttransfer;
 		num = patch->numtransfers;
 		if ( patch->needsBumpmap )
 		{
@@ -1583,27 +1602,56 @@ void GatherLight (int threadnum, void *pUserData)
 			// FIXME: why does the patch not use the phong normal?
 			normals[0] = patch->normal;
 
+			// four transfers at a time
+			FourVectors bumpSum4[NUM_BUMP_VECTS+1];
+			for ( i = 0; i < NUM_BUMP_VECTS+1; i++ )
+			{
+				bumpSum4[i].DuplicateVector( vec3_origin );
+			}
+
+			FourVectors origin4;
+			origin4.DuplicateVector( patch->origin );
+			for (k=0 ; k+4<=num ; k+=4)
+			{
+				const int *p = pTransferPatch + k;
+
+				// get vector to other patch
+				FourVectors delta4( g_Patches[p[0]].origin, g_Patches[p[1]].origin, g_Patches[p[2]].origin, g_Patches[p[3]].origin );
+				delta4 -= origin4;
+				delta4.VectorNormalize();
+
+				// find light emitted from other patch, removing the normal already factored into transfer steradian
+				FourVectors v4( s_ShootLight[p[0]], s_ShootLight[p[1]], s_ShootLight[p[2]], s_ShootLight[p[3]] );
+				v4 *= DivSIMD( LoadUnalignedSIMD( pTransferAmount + k ), delta4 * patch->normal );
+
+				for ( i = 0; i < NUM_BUMP_VECTS+1; i++ )
+				{
+					// transfers behind this normal add nothing
+					fltx4 dot = delta4 * normals[i];
+					dot = AndSIMD( dot, CmpGtSIMD( dot, Four_Zeros ) );
+
+					FourVectors bumpTransfer = v4;
+					bumpTransfer *= dot;
+					bumpSum4[i] += bumpTransfer;
+				}
+			}
+
 			for ( i = 0; i < NUM_BUMP_VECTS+1; i++ )
 			{
-				VectorFill( bumpSum[i], 0 );
+				bumpSum[i] = bumpSum4[i].Vec( 0 ) + bumpSum4[i].Vec( 1 ) + bumpSum4[i].Vec( 2 ) + bumpSum4[i].Vec( 3 );
 			}
 
 			float dot;
-			for (k=0 ; k<num ; k++, trans++)
+			for ( ; k<num ; k++)
 			{
-				CPatch *patch2 = &g_Patches[trans->patch];
+				CPatch *patch2 = &g_Patches[pTransferPatch[k]];
 
 				// get vector to other patch
 				VectorSubtract (patch2->origin, patch->origin, delta);
 				VectorNormalize (delta);
-				// find light emitted from other patch
-				for(i=0; i<3; i++)
-				{
-					v[i] = emitlight[trans->patch][i] * patch2->reflectivity[i];
-				}
 				// remove normal already factored into transfer steradian
 				float scale = 1.0f / DotProduct (delta, patch->normal);
-				VectorScale( v, trans->transfer * scale, v );
+				VectorScale( s_ShootLight[pTransferPatch[k]], pTransferAmount[k] * scale, v );
 				
 				Vector bumpTransfer;
 				for ( i = 0; i < NUM_BUMP_VECTS+1; i++ )
@@ -1625,15 +1673,20 @@ void GatherLight (int threadnum, void *pUserData)
 		}
 		else
 		{
-			VectorFill( sum, 0 );
-			for (k=0 ; k<num ; k++, trans++)
+			FourVectors sum4;
+			sum4.DuplicateVector( vec3_origin );
+			for (k=0 ; k+4<=num ; k+=4)
 			{
-				for(i=0; i<3; i++)
-				{
-					v[i] = emitlight[trans->patch][i] * g_Patches[trans->patch].reflectivity[i];
-				}
-				VectorScale( v, trans->transfer, v );
-				VectorAdd( sum, v, sum );
+				const int *p = pTransferPatch + k;
+				FourVectors v4( s_ShootLight[p[0]], s_ShootLight[p[1]], s_ShootLight[p[2]], s_ShootLight[p[3]] );
+				v4 *= LoadUnalignedSIMD( pTransferAmount + k );
+				sum4 += v4;
+			}
+
+			sum = sum4.Vec( 0 ) + sum4.Vec( 1 ) + sum4.Vec( 2 ) + sum4.Vec( 3 );
+			for ( ; k<num ; k++)
+			{
+				VectorMA( sum, pTransferAmount[k], s_ShootLight[pTransferPatch[k]], sum );
 			}
 			VectorCopy( sum, addlight[j].light[0] );
 		}
@@ -1700,12 +1753,19 @@ void BounceLight (void)
 	}
 #endif
 
+	double flBounceStart = Plat_FloatTime();
+	s_ShootLight.SetCount( uiPatchCount );
+
 	i = 0;
 	while ( bouncing )
 	{
+		for ( unsigned int j = 0; j < uiPatchCount; j++ )
+		{
+			VectorMultiply( emitlight[j], g_Patches[j].reflectivity, s_ShootLight[j] );
+		}
+
 		// transfer light from to the leaf patches from other patches via transfers
 		// this moves shooter->emitlight to receiver->addlight
-		unsigned int uiPatchCount = g_Patches.Size();
 		RunThreadsOn (uiPatchCount, true, GatherLight);
 		// move newly received light (addlight) to light to be sent out (emitlight)
 		// start at children and pull light up to parents
@@ -1724,6 +1784,8 @@ void BounceLight (void)
 			WriteWorld (name, 0);
 		}
 	}
+
+	s_flBounceTime = Plat_FloatTime() - flBounceStart;
 }
 
 
@@ -1922,6 +1984,45 @@ void BuildFacesVisibleToLights( bool bAllVisible )
 
 
 
+//-----------------------------------------------------------------------------
+// Moves each patch's transfer list into g_TransferPatches/g_TransferAmounts.
+// GatherLight walks every list on every bounce, and two flat arrays beat one
+// heap block per patch for both cache misses and allocator overhead.
+//-----------------------------------------------------------------------------
+static void PackTransfers( void )
+{
+	int nTotal = 0;
+	unsigned int uiPatchCount = g_Patches.Size();
+	for ( unsigned int i = 0; i < uiPatchCount; i++ )
+	{
+		nTotal += g_Patches[i].numtransfers;
+	}
+
+	g_TransferPatches.SetCount( nTotal );
+	g_TransferAmounts.SetCount( nTotal );
+
+	int nNext = 0;
+	s_nTransferLists = 0;
+	for ( unsigned int i = 0; i < uiPatchCount; i++ )
+	{
+		CPatch *patch = &g_Patches[i];
+		patch->firsttransfer = nNext;
+		if ( !patch->transfers )
+			continue;
+
+		for ( int j = 0; j < patch->numtransfers; j++ )
+		{
+			g_TransferPatches[nNext + j] = patch->transfers[j].patch;
+			g_TransferAmounts[nNext + j] = patch->transfers[j].transfer;
+		}
+		nNext += patch->numtransfers;
+
+		free( patch->transfers );
+		patch->transfers = NULL;
+		s_nTransferLists++;
+	}
+}
+
 void MakeAllScales (void)
 {
 	// determine visibility between patches
@@ -1930,10 +2031,12 @@ void MakeAllScales (void)
 	// release visibility matrix
 	FreeVisMatrix ();
 
+	PackTransfers ();
+
 	Msg("transfers %d, max %d\n", total_transfer, max_transfer );
 
 	qprintf ("transfer lists: %5.1f megs\n"
-		, (float)total_transfer * sizeof(transfer_t) / (1024*1024));
+		, (float)total_transfer * ( sizeof(int) + sizeof(float) ) / (1024*1024));
 }
 
 
@@ -2020,12 +2123,19 @@ bool RadWorld_Go()
 	}
 
 	// build initial facelights
+#ifdef MPI
 	if (g_bUseMPI) 
 	{
 		// RunThreadsOnIndividual (numfaces, true, BuildFacelights);
 		RunMPIBuildFacelights();
 	}
 	else 
+#endif
+	if ( DistWork_IsActive() )
+	{
+		RunDistBuildFacelights();
+	}
+	else
 	{
 		RunThreadsOnIndividual (numfaces, true, BuildFacelights);
 	}
@@ -2066,7 +2176,13 @@ bool RadWorld_Go()
 			memset( addlight.Base(), 0, g_Patches.Size() * sizeof( bumplights_t ) );
 
 			MakeAllScales ();
+		}
+
+		// Workers have sent back everything they can help with
+		DistWork_WorkerFinished();
 
+		if (numbounce > 0)
+		{
 			// spread light around
 			BounceLight ();
 		}
@@ -2084,8 +2200,10 @@ bool RadWorld_Go()
 		if ( !g_bUseMPI || g_bMPIMaster )
 			RunThreadsOnIndividual (numfaces, true, FinalLightFace);
 		
+#ifdef MPI
 		// Distribute the lighting data to workers.
 		VMPI_DistributeLightData();
+#endif
 			
 		Msg("FinalLightFace Done\n"); fflush(stdout);
 	}
@@ -2126,6 +2244,9 @@ void VRAD_LoadBSP( char const *pFilename )
 {
 	ThreadSetDefault ();
 
+	// Start the workers now so they load the map alongside us
+	DistWork_Init( "vrad" );
+
 	g_flStartTime = Plat_FloatTime();
 
 	if( g_bLowPriority )
@@ -2143,7 +2264,7 @@ void VRAD_LoadBSP( char const *pFilename )
 	// so we prepend qdir here.
 	strcpy( source, ExpandPath( source ) );
 
-	if ( !g_bUseMPI )
+	if ( !g_bUseMPI && !DistWork_IsWorker() )
 	{
 		// Setup the logfile.
 		char logFile[512];
@@ -2160,7 +2281,12 @@ void VRAD_LoadBSP( char const *pFilename )
 		// Otherwise, try looking in the BIN directory from which we were run from
 		Msg( "Could not find lights.rad in %s.\nTrying VRAD BIN directory instead...\n", 
 			    global_lights );
+#ifdef _WIN32
 		GetModuleFileName( NULL, global_lights, sizeof( global_lights ) );
+#else
+		int nLen = readlink( "/proc/self/exe", global_lights, sizeof( global_lights ) - 1 );
+		global_lights[ MAX( nLen, 0 ) ] = 0;
+#endif
 		Q_ExtractFilePath( global_lights, global_lights, sizeof( global_lights ) );
 		strcat( global_lights, "lights.rad" );
 	}
@@ -2295,19 +2421,27 @@ void VRAD_LoadBSP( char const *pFilename )
 
 void VRAD_ComputeOtherLighting()
 {
+	double flStart = Plat_FloatTime();
+
 	// Compute lighting for the bsp file
 	if ( !g_bNoDetailLighting )
 	{
 		ComputeDetailPropLighting( THREADINDEX_MAIN );
 	}
+	double flDetailEnd = Plat_FloatTime();
 
 	ComputePerLeafAmbientLighting();
+	double flAmbientEnd = Plat_FloatTime();
 
 	// bake the static props high quality vertex lighting into the bsp
 	if ( !do_fast && g_bStaticPropLighting )
 	{
 		StaticPropMgr()->ComputeLighting( THREADINDEX_MAIN );
 	}
+	double flEnd = Plat_FloatTime();
+
+	Msg( "Prop lighting: detail props %.2fs, leaf ambient %.2fs, static props %.2fs\n",
+		flDetailEnd - flStart, flAmbientEnd - flDetailEnd, flEnd - flAmbientEnd );
 }
 
 extern void CloseDispLuxels();
@@ -2326,6 +2460,11 @@ void VRAD_Finish()
 	VMPI_SetCurrentStage( "WriteBSPFile" );
 	WriteBSPFile(source);
 
+	if ( g_bCompressLumps )
+	{
+		CompressBSPFile( source, verbose );
+	}
+
 	if ( g_bDumpPatches )
 	{
 		for ( int iStyle = 0; iStyle < 4; ++iStyle )
@@ -2341,6 +2480,14 @@ void VRAD_Finish()
 
 	StaticPropMgr()->Shutdown();
 
+	if ( numbounce > 0 && g_TransferPatches.Count() )
+	{
+		Msg( "%d transfers packed from %d lists: %.1f MB, bounce light %.2fs\n",
+			g_TransferPatches.Count(), s_nTransferLists,
+			(float)( g_TransferPatches.Count() * ( sizeof(int) + sizeof(float) ) ) / ( 1024.0f * 1024.0f ),
+			s_flBounceTime );
+	}
+
 	double end = Plat_FloatTime();
 	
 	char str[512];
@@ -2463,6 +2610,9 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 				return -1;
 			}
 		}
+		else if ( DistWork_ParseArg( argc, argv, i ) )
+		{
+		}
 		else if ( !Q_stricmp(argv[i], "-lights" ) )
 		{
 			if ( ++i < argc && *argv[i] )
@@ -2479,6 +2629,10 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			do_extra = false;
 		}
+		else if (!Q_stricmp(argv[i],"-compresslumps"))
+		{
+			g_bCompressLumps = true;
+		}
 		else if (!Q_stricmp(argv[i],"-debugextra"))
 		{
 			debug_extra = true;
@@ -2754,6 +2908,7 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		// NOTE: the -mpi checks must come last here because they allow the previous argument 
 		// to be -mpi as well. If it game before something else like -game, then if the previous
 		// argument was -mpi and the current argument was something valid like -game, it would skip it.
+#ifdef MPI
 		else if ( !Q_strncasecmp( argv[i], "-mpi", 4 ) || !Q_strncasecmp( argv[i-1], "-mpi", 4 ) )
 		{
 			if ( stricmp( argv[i], "-mpi" ) == 0 )
@@ -2763,6 +2918,7 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 			if ( i == argc - 1 && V_stricmp( argv[i], "-mpi_ListParams" ) != 0 )
 				break;
 		}
+#endif
 		else if ( mapArg == -1 )
 		{
 			mapArg = i;
@@ -2821,6 +2977,8 @@ void PrintUsage( int argc, char **argv )
 		"  -lights <file>  : Load a lights file in addition to lights.rad and the\n"
 		"                    level lights file.\n"
 		"  -noextra        : Disable supersampling.\n"
+		"  -compresslumps  : LZMA compress the bsp's lumps once it's written. -v prints\n"
+		"                    each lump's ratio and decode time.\n"
 		"  -debugextra     : Places debugging data in lightmaps to visualize\n"
 		"                    supersampling.\n"
 		"  -smooth #       : Set the threshold for smoothing groups, in degrees\n"
@@ -2883,6 +3041,8 @@ void PrintUsage( int argc, char **argv )
 		}
 	}
 #endif
+
+	Warning( "Distributing without VMPI:\n%s\n", DistWork_GetUsage() );
 }
 
 int RunVRAD( int argc, char **argv )
@@ -2918,6 +3078,9 @@ int RunVRAD( int argc, char **argv )
 		RadWorld_Go();
 	}
 
+	// -onlydetail and -OnlyStaticProps runs don't share anything
+	DistWork_WorkerFinished();
+
 	VRAD_ComputeOtherLighting();
 
 	VRAD_Finish();
@@ -2936,10 +3099,12 @@ int VRAD_Main(int argc, char **argv)
 
 	VRAD_Init();
 
+#ifdef MPI
 	// This must come first.
 	VRAD_SetupMPI( argc, argv );
+#endif
 
-#if !defined( _DEBUG )
+#if !defined( _DEBUG ) && defined( MPI )
 	if ( g_bUseMPI && !g_bMPIMaster )
 	{
 		SetupToolsMinidumpHandler( VMPI_ExceptionFilter );
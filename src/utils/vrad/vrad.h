@@ -24,9 +24,9 @@
 #include "polylib.h"
 #include "threads.h"
 #include "builddisp.h"
-#include "VRAD_DispColl.h"
-#include "UtlMemory.h"
-#include "UtlHash.h"
+#include "vrad_dispcoll.h"
+#include "utlmemory.h"
+#include "utlhash.h"
 #include "utlvector.h"
 #include "iincremental.h"
 #include "raytrace.h"
@@ -39,12 +39,18 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#ifdef _WIN32
 #pragma warning(disable: 4142 4028)
 #include <io.h>
 #pragma warning(default: 4142 4028)
+#endif
 
 #include <fcntl.h>
+#ifdef _WIN32
 #include <direct.h>
+#else
+#include <unistd.h>
+#endif
 #include <ctype.h>
 
 
@@ -237,7 +243,8 @@ struct CPatch
 //	struct		patch_s		*nextclusterchild;		// next terminal child in cluster
 
 	int			numtransfers;
-	transfer_t	*transfers;
+	transfer_t	*transfers;				// only until PackTransfers, then NULL
+	int			firsttransfer;			// index into g_TransferPatches/g_TransferAmounts
 
 	short		indices[3];				// displacement use these for subdivision
 };
@@ -248,6 +255,11 @@ extern CUtlVector<int>		g_FacePatches;		// constains all patches, children first
 extern CUtlVector<int>		faceParents;		// contains only root patches, use next parent to iterate
 extern CUtlVector<int>		clusterChildren;
 
+// Every patch's transfers back to back, filled by PackTransfers once the
+// vis matrix is done
+extern CUtlVector<int>		g_TransferPatches;
+extern CUtlVector<float>	g_TransferAmounts;
+
 
 struct sky_camera_t
 {
@@ -303,6 +315,20 @@ extern bool IsModelTextureShadowsForced( const char *pModelName );
 extern RayTracingEnvironment g_RtEnv;
 
 #include "mpivrad.h"
+#include "distwork.h"
+
+#ifdef MPI
+#include "vmpi.h"
+#else
+// Builds without VMPI (the POSIX tools) always run as a single master process.
+extern bool g_bUseMPI;
+extern bool g_bMPIMaster;
+inline void VMPI_SetCurrentStage( const char *pStageName ) {}
+#endif
+
+// Shares these with DistWork workers, see distvrad.cpp
+void RunDistBuildFacelights( void );
+void RunDistBuildVisLeafs( void );
 
 void MakeShadowSplits (void);
 
@@ -564,16 +590,18 @@ struct PatchSampleData_t
 	CUtlVector<int>				m_ndxPatches;
 };
 
-UtlHashHandle_t SampleData_AddSample( sample_t *pSample, SampleHandle_t sampleHandle );
-void PatchSampleData_AddSample( CPatch *pPatch, int ndxPatch );
+// iPartition/nPartitions let several threads fill the tables at once, each
+// only adding the keys whose bucket falls in its partition
+UtlHashHandle_t SampleData_AddSample( sample_t *pSample, SampleHandle_t sampleHandle, int iPartition = 0, int nPartitions = 1 );
+void PatchSampleData_AddSample( CPatch *pPatch, int ndxPatch, int iPartition = 0, int nPartitions = 1 );
 unsigned short IncrementPatchIterationKey();
 void SampleData_Log( void );
 
 extern CUtlHash<SampleData_t>		g_SampleHashTable;
 extern CUtlHash<PatchSampleData_t>	g_PatchSampleHashTable;
 
-extern int samplesAdded;
-extern int patchSamplesAdded;
+extern long volatile samplesAdded;
+extern long volatile patchSamplesAdded;
 
 //-----------------------------------------------------------------------------
 // Computes lighting for the detail props
@@ -10,16 +10,18 @@
 //=============================================================================//
 
 #include "vrad.h"
-#include "Bsplib.h"
-#include "GameBSPFile.h"
+#include "bsplib.h"
+#include "gamebspfile.h"
 #include "utlbuffer.h"
 #include "utlvector.h"
-#include "CModel.h"
+#include "cmodel.h"
 #include "studio.h"
 #include "pacifier.h"
 #include "vraddetailprops.h"
 #include "mathlib/halton.h"
+#ifdef MPI
 #include "messbuf.h"
+#endif
 #include "byteswap.h"
 
 bool LoadStudioModel( char const* pModelName, CUtlBuffer& buf );
@@ -227,7 +229,7 @@ static void ComputeMaxDirectLighting( DetailObjectLump_t& prop, Vector* maxcolor
 		normal4.DuplicateVector( normal );
 
 		GatherSampleLightSSE ( out, dl, -1, origin4, &normal4, 1, iThread );
-		VectorMA( maxcolor[dl->light.style], out.m_flFalloff.m128_f32[0] * out.m_flDot[0].m128_f32[0], dl->light.intensity, maxcolor[dl->light.style] );
+		VectorMA( maxcolor[dl->light.style], SubFloat( out.m_flFalloff, 0 ) * SubFloat( out.m_flDot[0], 0 ), dl->light.intensity, maxcolor[dl->light.style] );
 	}
 }
 
@@ -778,10 +780,11 @@ static void ComputeAmbientLighting( int iThread, DetailObjectLump_t& prop, Vecto
 
 
 //-----------------------------------------------------------------------------
-// Computes lighting for a single detal prop
+// Computes lighting for a single detal prop, its lightstyles go in styles
+// until StoreLightStyles puts them in the lump
 //-----------------------------------------------------------------------------
 
-static void ComputeLighting( DetailObjectLump_t& prop, int iThread )
+static void ComputeLighting( DetailObjectLump_t& prop, int iThread, CUtlVector<DetailPropLightstylesLump_t> &styles )
 {
 	// We're going to take the maximum of the ambient lighting and 
 	// the strongest directional light. This works because we're assuming
@@ -801,7 +804,6 @@ static void ComputeLighting( DetailObjectLump_t& prop, int iThread )
 	VectorAdd( directColor[0], ambColor[0], totalColor );
 	VectorToColorRGBExp32( totalColor, prop.m_Lighting );
 
-	bool hasLightstyles = false;
 	prop.m_LightStyleCount = 0;
 	
 	// lightstyles
@@ -813,20 +815,32 @@ static void ComputeLighting( DetailObjectLump_t& prop, int iThread )
 		if ((totalColor[0] != 0.0f) || (totalColor[1] != 0.0f) ||
 			(totalColor[2] != 0.0f) )
 		{
-			if (!hasLightstyles)
-			{
-				prop.m_LightStyles = s_pDetailPropLightStyleLump->Size();
-				hasLightstyles = true;
-			}
-
-			int j = s_pDetailPropLightStyleLump->AddToTail();
-			VectorToColorRGBExp32( totalColor, (*s_pDetailPropLightStyleLump)[j].m_Lighting );
-			(*s_pDetailPropLightStyleLump)[j].m_Style = i;
+			int j = styles.AddToTail();
+			VectorToColorRGBExp32( totalColor, styles[j].m_Lighting );
+			styles[j].m_Style = i;
 			++prop.m_LightStyleCount;
 		}
 	}
 }
 
+static void StoreLightStyles( DetailObjectLump_t& prop, const CUtlVector<DetailPropLightstylesLump_t> &styles )
+{
+	if ( !styles.Count() )
+		return;
+
+	prop.m_LightStyles = s_pDetailPropLightStyleLump->Count();
+	s_pDetailPropLightStyleLump->AddVectorToTail( styles );
+}
+
+#ifdef MPI
+static void ComputeLighting( DetailObjectLump_t& prop, int iThread )
+{
+	CUtlVector<DetailPropLightstylesLump_t> styles;
+	ComputeLighting( prop, iThread, styles );
+	StoreLightStyles( prop, styles );
+}
+#endif
+
 
 //-----------------------------------------------------------------------------
 // Unserialization
@@ -959,6 +973,7 @@ void UnserializeDetailPropLighting( int lumpID, int lumpVersion, CUtlVector<Deta
 	buf.Get( lumpData.Base(), lightsize );
 }
 
+#ifdef MPI
 DetailObjectLump_t *g_pMPIDetailProps = NULL;
 
 void VMPI_ProcessDetailPropWU( int iThread, int iWorkUnit, MessageBuffer *pBuf )
@@ -1001,7 +1016,20 @@ void VMPI_ReceiveDetailPropWU( int iWorkUnit, MessageBuffer *pBuf, int iWorker )
 		pBuf->read( &l->m_Style, sizeof( l->m_Style ) );
 	}
 }
+#endif
 	
+//-----------------------------------------------------------------------------
+// Detail props are lit on every thread, their lightstyles are appended to the
+// lump afterwards in prop order so the lump matches a single threaded run
+//-----------------------------------------------------------------------------
+static DetailObjectLump_t *s_pLightingDetailProps = NULL;
+static CUtlVector< CUtlVector<DetailPropLightstylesLump_t> > s_DetailPropStyles;
+
+static void ThreadComputeDetailPropLighting( int iThread, int iProp )
+{
+	ComputeLighting( s_pLightingDetailProps[iProp], iThread, s_DetailPropStyles[iProp] );
+}
+
 //-----------------------------------------------------------------------------
 // Computes lighting for the detail props
 //-----------------------------------------------------------------------------
@@ -1025,11 +1053,19 @@ void ComputeDetailPropLighting( int iThread )
 
 	StartPacifier("Computing detail prop lighting : ");
 
+	// Fill in the sky light cache here so the threads only ever read it
+	FindAmbientSkyLight();
+
+	s_pLightingDetailProps = pProps;
+	s_DetailPropStyles.SetCount( count );
+	RunThreadsOnIndividual( count, true, ThreadComputeDetailPropLighting );
+
 	for (int i = 0; i < count; ++i)
 	{
-		UpdatePacifier( (float)i / (float)count );
-		ComputeLighting( pProps[i], iThread );
+		StoreLightStyles( pProps[i], s_DetailPropStyles[i] );
 	}
+	s_DetailPropStyles.Purge();
+	s_pLightingDetailProps = NULL;
 
 	// Write detail prop lightstyle lump...
 	WriteDetailLightingLumps();
@@ -8,12 +8,12 @@
 #include "vrad.h"
 #include "utlvector.h"
 #include "cmodel.h"
-#include "BSPTreeData.h"
-#include "VRAD_DispColl.h"
-#include "CollisionUtils.h"
+#include "bsptreedata.h"
+#include "vrad_dispcoll.h"
+#include "collisionutils.h"
 #include "lightmap.h"
-#include "Radial.h"
-#include "CollisionUtils.h"
+#include "radial.h"
+#include "collisionutils.h"
 #include "mathlib/bumpvects.h"
 #include "utlrbtree.h"
 #include "tier0/fasttimer.h"
@@ -98,6 +98,8 @@ public:
 	// pre "FinalLightFace"
 	void InsertSamplesDataIntoHashTable( void );
 	void InsertPatchSampleDataIntoHashTable( void );
+	void InsertSamplesDataIntoHashTable( int iPartition, int nPartitions );
+	void InsertPatchSampleDataIntoHashTable( int iPartition, int nPartitions );
 
 	// "FinalLightFace"
 	radial_t *BuildLuxelRadial( int ndxFace, int ndxStyle, bool bBump );
@@ -1420,9 +1422,35 @@ bool SampleInSolid( sample_t *pSample )
 }
 
 
+//-----------------------------------------------------------------------------
+// Each thread fills the hash buckets in its own partition
+//-----------------------------------------------------------------------------
+static void InsertSamplesData_Thread( int iThread, void *pUserData )
+{
+	( ( CVRadDispMgr* )pUserData )->InsertSamplesDataIntoHashTable( iThread, numthreads );
+}
+
+static void InsertPatchSampleData_Thread( int iThread, void *pUserData )
+{
+	( ( CVRadDispMgr* )pUserData )->InsertPatchSampleDataIntoHashTable( iThread, numthreads );
+}
+
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 void CVRadDispMgr::InsertSamplesDataIntoHashTable( void )
+{
+	RunThreads_Start( InsertSamplesData_Thread, this );
+	RunThreads_End();
+
+	// log the distribution
+	SampleData_Log();
+}
+
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+void CVRadDispMgr::InsertSamplesDataIntoHashTable( int iPartition, int nPartitions )
 {
 	int totalSamples = 0;
 #if 0
@@ -1466,7 +1494,7 @@ void CVRadDispMgr::InsertSamplesDataIntoHashTable( void )
 				SampleHandle_t sampleHandle = ndxSample;
 				sampleHandle |= ( ndxFace << 16 );
 				
-				SampleData_AddSample( pSample, sampleHandle );
+				SampleData_AddSample( pSample, sampleHandle, iPartition, nPartitions );
 			}
 
 		}
@@ -1478,9 +1506,6 @@ void CVRadDispMgr::InsertSamplesDataIntoHashTable( void )
 	// not implemented yet!!!
 	Msg( "%d samples in solid\n", totalSamplesInSolid );
 #endif
-
-	// log the distribution
-	SampleData_Log();
 }
 
 
@@ -1492,6 +1517,15 @@ void CVRadDispMgr::InsertPatchSampleDataIntoHashTable( void )
 	if( numbounce <= 0 )
 		return;
 
+	RunThreads_Start( InsertPatchSampleData_Thread, this );
+	RunThreads_End();
+}
+
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+void CVRadDispMgr::InsertPatchSampleDataIntoHashTable( int iPartition, int nPartitions )
+{
 	int totalPatchSamples = 0;
 
 	for( int ndxFace = 0; ndxFace < numfaces; ndxFace++ )
@@ -1524,7 +1558,7 @@ void CVRadDispMgr::InsertPatchSampleDataIntoHashTable( void )
 					continue;
 			
 				int ndxPatch = pPatch - g_Patches.Base();
-				PatchSampleData_AddSample( pPatch, ndxPatch );
+				PatchSampleData_AddSample( pPatch, ndxPatch, iPartition, nPartitions );
 
 				totalPatchSamples++;
 			}
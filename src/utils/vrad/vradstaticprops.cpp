@@ -13,14 +13,14 @@
 #include "mathlib/vector.h"
 #include "utlbuffer.h"
 #include "utlvector.h"
-#include "GameBSPFile.h"
-#include "BSPTreeData.h"
-#include "VPhysics_Interface.h"
-#include "Studio.h"
-#include "Optimize.h"
-#include "Bsplib.h"
-#include "CModel.h"
-#include "PhysDll.h"
+#include "gamebspfile.h"
+#include "bsptreedata.h"
+#include "vphysics_interface.h"
+#include "studio.h"
+#include "optimize.h"
+#include "bsplib.h"
+#include "cmodel.h"
+#include "physdll.h"
 #include "phyfile.h"
 #include "collisionutils.h"
 #include "tier1/KeyValues.h"
@@ -33,15 +33,21 @@
 #include "vtf/vtf.h"
 #include "tier1/utldict.h"
 #include "tier1/utlsymbol.h"
+#include "tier0/threadtools.h"
 #include "bitmap/tgawriter.h"
 
+#ifdef MPI
 #include "messbuf.h"
-#include "vmpi.h"
 #include "vmpi_distribute_work.h"
+#endif
 
 
 #define ALIGN_TO_POW2(x,y) (((x)+(y-1))&~(y-1))
 
+// Vertexes lit by one work item. Small enough that a dense prop spreads
+// across every thread, big enough to keep GetThreadWork out of the profile.
+#define STATICPROP_LIGHTING_VERTS_PER_WORK	64
+
 // identifies a vertex embedded in solid
 // lighting will be copied from nearest valid neighbor
 struct badVertex_t
@@ -233,7 +239,7 @@ static void ConvertTexelDataToTexture(unsigned int _resX, unsigned int _resY, Im
 // Such a monstrosity. :(
 static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const matrix3x4_t& _matNormal, int _iThread, int _skipProp, int _nFlags, int _lightmapResX, int _lightmapResY, 
 											studiohdr_t* _pStudioHdr, mstudiomodel_t* _pStudioModel, OptimizedModel::ModelHeader_t* _pVtxModel, int _meshID, 
-											CComputeStaticPropLightingResults *_pResults );
+											CUtlVector<colorTexel_t> &_outColorTexels );
 
 // Debug function, converts lightmaps to linear space then dumps them out. 
 // TODO: Write out the file in a .dds instead of a .tga, in whatever format we're supposed to use.
@@ -259,15 +265,31 @@ public:
 	void ComputeLighting( int iThread );
 
 private:
+#ifdef MPI
 	// VMPI stuff.
 	static void VMPI_ProcessStaticProp_Static( int iThread, uint64 iStaticProp, MessageBuffer *pBuf );
 	static void VMPI_ReceiveStaticPropResults_Static( uint64 iStaticProp, MessageBuffer *pBuf, int iWorker );
 	void VMPI_ProcessStaticProp( int iThread, int iStaticProp, MessageBuffer *pBuf );
 	void VMPI_ReceiveStaticPropResults( int iStaticProp, MessageBuffer *pBuf, int iWorker );
+#endif
 	
+	// A slice of one prop's lighting, handed to a single thread
+	struct LightingWork_t
+	{
+		int		m_iStaticProp;
+		int		m_nBodyPart;
+		int		m_nModel;
+		int		m_nMesh;				// -1 lights the model's lightmap texels instead
+		int		m_nFirstVertex;			// within the mesh
+		int		m_nVertexCount;
+		int		m_nColorVertex;			// m_nFirstVertex's slot in the model's color verts
+		int		m_iColorVertsArray;
+		int		m_iColorTexelsArray;
+	};
+
 	// local thread version
-	static void ThreadComputeStaticPropLighting( int iThread, void *pUserData );
-	void ComputeLightingForProp( int iThread, int iStaticProp );
+	static void ThreadComputeStaticPropLighting( int iThread, int iWork );
+	CComputeStaticPropLightingResults *GetLightingResults( int iStaticProp );
 
 	// Methods associated with unserializing static props
 	void UnserializeModelDict( CUtlBuffer& buf );
@@ -335,7 +357,17 @@ private:
 
 	bool m_bIgnoreStaticPropTrace;
 
-	void ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults );
+	// Work items for the local threads, each prop finishes when its last item does
+	CUtlVector<LightingWork_t>		m_LightingWork;
+	CUtlVector<CComputeStaticPropLightingResults*>	m_LightingResults;
+	CUtlVector<long>				m_LightingWorkLeft;
+
+	bool HasLighting( int iStaticProp );
+	void AllocateLightingResults( int iStaticProp, CComputeStaticPropLightingResults *pResults );
+	void BuildLightingWork( int iStaticProp, CUtlVector<LightingWork_t> &work );
+	void DoLightingWork( int iThread, const LightingWork_t &work, CComputeStaticPropLightingResults *pResults );
+	void FixupBadVertexes( int iThread, int iStaticProp, CComputeStaticPropLightingResults *pResults );
+	void ComputeLighting( int iThread, int iStaticProp, CComputeStaticPropLightingResults *pResults );
 	void ApplyLightingToStaticProp( int iStaticProp, CStaticProp &prop, const CComputeStaticPropLightingResults *pResults );
 
 	void SerializeLighting();
@@ -1145,17 +1177,32 @@ bool PositionInSolid( Vector &position )
 }
 
 //-----------------------------------------------------------------------------
-// Trace from a vertex to each direct light source, accumulating its contribution.
+// Trace from up to four vertexes to each direct light source, accumulating its
+// contribution. The vertexes share one SSE gather per light.
 //-----------------------------------------------------------------------------
-void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
-								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+void ComputeDirectLightingAtPoints( const Vector *pPosition, const Vector *pNormal, int nCount, Vector *pOutColor, int iThread,
+								    int static_prop_id_to_skip=-1, int nLFlags = 0)
 {
+	Assert( nCount >= 1 && nCount <= 4 );
+
 	SSE_sampleLightOutput_t	sampleOutput;
 
-	outColor.Init();
+	// pad the batch with its first vertex
+	int cluster[4];
+	Vector normal[4];
+	int i;
+	for ( i = 0; i < 4; i++ )
+	{
+		int n = ( i < nCount ) ? i : 0;
+		cluster[i] = ( i < nCount ) ? ClusterFromPoint( pPosition[n] ) : cluster[0];
+		normal[i] = pNormal[n];
+		if ( i < nCount )
+		{
+			pOutColor[i].Init();
+		}
+	}
 
 	// Iterate over all direct lights and accumulate their contribution
-	int cluster = ClusterFromPoint( position );
 	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
 	{
 		if ( dl->light.style )
@@ -1165,46 +1212,72 @@ void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &out
 		}
 
 		// is this lights cluster visible?
-		if ( !PVSCheck( dl->pvs, cluster ) )
+		bool bVisible[4];
+		bool bAnyVisible = false;
+		for ( i = 0; i < nCount; i++ )
+		{
+			bVisible[i] = PVSCheck( dl->pvs, cluster[i] );
+			bAnyVisible = bAnyVisible || bVisible[i];
+		}
+		if ( !bAnyVisible )
 			continue;
 
 		// push the vertex towards the light to avoid surface acne
-		Vector adjusted_pos = position;
+		Vector adjusted_pos[4];
 		float flEpsilon = 0.0;
 
-		if  (dl->light.type != emit_skyambient)
+		for ( i = 0; i < 4; i++ )
 		{
-			// push towards the light
-			Vector fudge;
-			if ( dl->light.type == emit_skylight )
-				fudge = -( dl->light.normal);
-			else
+			const Vector &position = pPosition[( i < nCount ) ? i : 0];
+			adjusted_pos[i] = position;
+
+			if  (dl->light.type != emit_skyambient)
 			{
-				fudge = dl->light.origin-position;
-				VectorNormalize( fudge );
+				// push towards the light
+				Vector fudge;
+				if ( dl->light.type == emit_skylight )
+					fudge = -( dl->light.normal);
+				else
+				{
+					fudge = dl->light.origin-position;
+					VectorNormalize( fudge );
+				}
+				fudge *= 4.0;
+				adjusted_pos[i] += fudge;
+			}
+			else 
+			{
+				// push out along normal
+				adjusted_pos[i] += 4.0 * normal[i];
+//				flEpsilon = 1.0;
 			}
-			fudge *= 4.0;
-			adjusted_pos += fudge;
-		}
-		else 
-		{
-			// push out along normal
-			adjusted_pos += 4.0 * normal;
-//			flEpsilon = 1.0;
 		}
 
-		FourVectors adjusted_pos4;
-		FourVectors normal4;
-		adjusted_pos4.DuplicateVector( adjusted_pos );
-		normal4.DuplicateVector( normal );
+		FourVectors adjusted_pos4( adjusted_pos[0], adjusted_pos[1], adjusted_pos[2], adjusted_pos[3] );
+		FourVectors normal4( normal[0], normal[1], normal[2], normal[3] );
 
 		GatherSampleLightSSE( sampleOutput, dl, -1, adjusted_pos4, &normal4, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
 		                      static_prop_id_to_skip, flEpsilon );
 		
-		VectorMA( outColor, sampleOutput.m_flFalloff.m128_f32[0] * sampleOutput.m_flDot[0].m128_f32[0], dl->light.intensity, outColor );
+		for ( i = 0; i < nCount; i++ )
+		{
+			if ( bVisible[i] )
+			{
+				VectorMA( pOutColor[i], SubFloat( sampleOutput.m_flFalloff, i ) * SubFloat( sampleOutput.m_flDot[0], i ), dl->light.intensity, pOutColor[i] );
+			}
+		}
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Trace from a vertex to each direct light source, accumulating its contribution.
+//-----------------------------------------------------------------------------
+void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
+								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+{
+	ComputeDirectLightingAtPoints( &position, &normal, 1, &outColor, iThread, static_prop_id_to_skip, nLFlags );
+}
+
 //-----------------------------------------------------------------------------
 // Takes the results from a ComputeLighting call and applies it to the static prop in question.
 //-----------------------------------------------------------------------------
@@ -1302,47 +1375,42 @@ void CVradStaticPropMgr::ApplyLightingToStaticProp( int iStaticProp, CStaticProp
 }
 
 //-----------------------------------------------------------------------------
-// Trace rays from each unique vertex, accumulating direct and indirect
-// sources at each ray termination. Use the winding data to distribute the unique vertexes
-// into the rendering layout.
+// Does this prop get any baked lighting at all?
 //-----------------------------------------------------------------------------
-void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults )
+bool CVradStaticPropMgr::HasLighting( int iStaticProp )
 {
-	CUtlVector<badVertex_t>		badVerts;
-
+	CStaticProp &prop = m_StaticProps[iStaticProp];
 	StaticPropDict_t &dict = m_StaticPropDict[prop.m_ModelIdx];
-	studiohdr_t	*pStudioHdr = dict.m_pStudioHdr;
-	OptimizedModel::FileHeader_t *pVtxHdr = (OptimizedModel::FileHeader_t *)dict.m_VtxBuf.Base();
-	if ( !pStudioHdr || !pVtxHdr )
+	if ( !dict.m_pStudioHdr || !dict.m_VtxBuf.Base() )
 	{
 		// must have model and its verts for lighting computation
 		// game will fallback to fullbright
-		return;
+		return false;
 	}
 
 	const bool withVertexLighting = (prop.m_Flags & STATIC_PROP_NO_PER_VERTEX_LIGHTING) == 0;
 	const bool withTexelLighting = (prop.m_Flags & STATIC_PROP_NO_PER_TEXEL_LIGHTING) == 0;
+	return withVertexLighting || withTexelLighting;
+}
 
-	if (!withVertexLighting && !withTexelLighting)
+//-----------------------------------------------------------------------------
+// Creates the per model color lists that the work items fill in. Each model
+// gets its lightmap texels (if any) followed by its unique vertexes.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::AllocateLightingResults( int iStaticProp, CComputeStaticPropLightingResults *pResults )
+{
+	if ( !HasLighting( iStaticProp ) )
 		return;
 
-	const int skip_prop = (g_bDisablePropSelfShadowing || (prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING)) ? prop_index : -1;
-	const int nFlags = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) ? GATHERLFLAGS_IGNORE_NORMALS : 0;
-
-	VMPI_SetCurrentStage( "ComputeLighting" );
+	CStaticProp &prop = m_StaticProps[iStaticProp];
+	studiohdr_t	*pStudioHdr = m_StaticPropDict[prop.m_ModelIdx].m_pStudioHdr;
+	const bool withTexelLighting = (prop.m_Flags & STATIC_PROP_NO_PER_TEXEL_LIGHTING) == 0;
 
-	matrix3x4_t	matPos, matNormal;
-	AngleMatrix(prop.m_Angles, prop.m_Origin, matPos);
-	AngleMatrix(prop.m_Angles, matNormal);
-	
 	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
 	{
-		OptimizedModel::BodyPartHeader_t* pVtxBodyPart = pVtxHdr->pBodyPart( bodyID );
 		mstudiobodyparts_t *pBodyPart = pStudioHdr->pBodypart( bodyID );
-
 		for ( int modelID = 0; modelID < pBodyPart->nummodels; ++modelID )
 		{
-			OptimizedModel::ModelHeader_t* pVtxModel = pVtxBodyPart->pModel(modelID);
 			mstudiomodel_t *pStudioModel = pBodyPart->pModel( modelID );
 
 			if (withTexelLighting)
@@ -1351,79 +1419,221 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 				pResults->m_ColorTexelsArrays.AddToTail(pColorTexelArray);
 			}
 			
-			// light all unique vertexes
+			// If we do lightmapping, we also do vertex lighting as a potential fallback. This may change.
 			CUtlVector<colorVertex_t> *pColorVertsArray = new CUtlVector<colorVertex_t>;
 			pResults->m_ColorVertsArrays.AddToTail( pColorVertsArray );
 						
-			CUtlVector<colorVertex_t> &colorVerts = *pColorVertsArray; 
-			colorVerts.EnsureCount( pStudioModel->numvertices );
-			memset( colorVerts.Base(), 0, colorVerts.Count() * sizeof(colorVertex_t) );
+			pColorVertsArray->EnsureCount( pStudioModel->numvertices );
+			memset( pColorVertsArray->Base(), 0, pColorVertsArray->Count() * sizeof(colorVertex_t) );
+		}
+	}
+}
 
-			int numVertexes = 0;
+//-----------------------------------------------------------------------------
+// Splits a prop into one item per model lightmap and one per run of
+// STATICPROP_LIGHTING_VERTS_PER_WORK vertexes
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::BuildLightingWork( int iStaticProp, CUtlVector<LightingWork_t> &work )
+{
+	if ( !HasLighting( iStaticProp ) )
+		return;
+
+	CStaticProp &prop = m_StaticProps[iStaticProp];
+	studiohdr_t	*pStudioHdr = m_StaticPropDict[prop.m_ModelIdx].m_pStudioHdr;
+	const bool withTexelLighting = (prop.m_Flags & STATIC_PROP_NO_PER_TEXEL_LIGHTING) == 0;
+
+	LightingWork_t item;
+	item.m_iStaticProp = iStaticProp;
+	item.m_iColorVertsArray = 0;
+	item.m_iColorTexelsArray = withTexelLighting ? 0 : -1;
+
+	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
+	{
+		mstudiobodyparts_t *pBodyPart = pStudioHdr->pBodypart( bodyID );
+		for ( int modelID = 0; modelID < pBodyPart->nummodels; ++modelID )
+		{
+			mstudiomodel_t *pStudioModel = pBodyPart->pModel( modelID );
+			item.m_nBodyPart = bodyID;
+			item.m_nModel = modelID;
+
+			if ( withTexelLighting )
+			{
+				item.m_nMesh = -1;
+				item.m_nFirstVertex = 0;
+				item.m_nVertexCount = 0;
+				item.m_nColorVertex = 0;
+				work.AddToTail( item );
+			}
+
+			int nColorVertex = 0;
 			for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
 			{
 				mstudiomesh_t *pStudioMesh = pStudioModel->pMesh( meshID );
-				const mstudio_meshvertexdata_t *vertData = pStudioMesh->GetVertexData((void *)pStudioHdr);
-
-				Assert(vertData); // This can only return NULL on X360 for now
-				
-				// TODO: Move this into its own function. In fact, refactor this whole function.
-				if (withTexelLighting)
+				item.m_nMesh = meshID;
+				for ( int nFirst = 0; nFirst < pStudioMesh->numvertices; nFirst += STATICPROP_LIGHTING_VERTS_PER_WORK )
 				{
-					GenerateLightmapSamplesForMesh( matPos, matNormal, iThread, skip_prop, nFlags, prop.m_LightmapImageWidth, prop.m_LightmapImageHeight, pStudioHdr, pStudioModel, pVtxModel, meshID, pResults );
+					item.m_nFirstVertex = nFirst;
+					item.m_nVertexCount = MIN( STATICPROP_LIGHTING_VERTS_PER_WORK, pStudioMesh->numvertices - nFirst );
+					item.m_nColorVertex = nColorVertex + nFirst;
+					work.AddToTail( item );
 				}
+				nColorVertex += pStudioMesh->numvertices;
+			}
 
-				// If we do lightmapping, we also do vertex lighting as a potential fallback. This may change.
-				for ( int vertexID = 0; vertexID < pStudioMesh->numvertices; ++vertexID )
-				{
-					Vector sampleNormal;
-					Vector samplePosition;
-					// transform position and normal into world coordinate system
-					VectorTransform(*vertData->Position(vertexID), matPos, samplePosition);
-					VectorTransform(*vertData->Normal(vertexID), matNormal, sampleNormal);
+			item.m_iColorVertsArray++;
+			if ( withTexelLighting )
+			{
+				item.m_iColorTexelsArray++;
+			}
+		}
+	}
+}
 
-					if ( PositionInSolid( samplePosition ) )
-					{
-						// vertex is in solid, add to the bad list, and recover later
-						badVertex_t badVertex;
-						badVertex.m_ColorVertex = numVertexes;
-						badVertex.m_Position = samplePosition;
-						badVertex.m_Normal = sampleNormal;
-						badVerts.AddToTail( badVertex );			
-					}
-					else
-					{
-						Vector direct_pos=samplePosition;
-							
-						
+//-----------------------------------------------------------------------------
+// Lights one work item. Vertexes in solid are only marked invalid here,
+// FixupBadVertexes relights them once the whole prop is done.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::DoLightingWork( int iThread, const LightingWork_t &work, CComputeStaticPropLightingResults *pResults )
+{
+	CStaticProp &prop = m_StaticProps[work.m_iStaticProp];
+	StaticPropDict_t &dict = m_StaticPropDict[prop.m_ModelIdx];
+	studiohdr_t	*pStudioHdr = dict.m_pStudioHdr;
+	OptimizedModel::FileHeader_t *pVtxHdr = (OptimizedModel::FileHeader_t *)dict.m_VtxBuf.Base();
+	mstudiomodel_t *pStudioModel = pStudioHdr->pBodypart( work.m_nBodyPart )->pModel( work.m_nModel );
 
-						Vector directColor(0,0,0);
-						ComputeDirectLightingAtPoint( direct_pos,
-														sampleNormal, directColor, iThread,
-														skip_prop, nFlags );
-						Vector indirectColor(0,0,0);
+	const int skip_prop = (g_bDisablePropSelfShadowing || (prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING)) ? work.m_iStaticProp : -1;
+	const int nFlags = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) ? GATHERLFLAGS_IGNORE_NORMALS : 0;
 
-						if (g_bShowStaticPropNormals)
-						{
-							directColor= sampleNormal;
-							directColor += Vector(1.0,1.0,1.0);
-							directColor *= 50.0;
-						}
-						else
-						{
-							if (numbounce >= 1)
-								ComputeIndirectLightingAtPoint( 
-									samplePosition, sampleNormal, 
-									indirectColor, iThread, true,
-									( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS) != 0 );
-						}
-						
-						colorVerts[numVertexes].m_bValid = true;
-						colorVerts[numVertexes].m_Position = samplePosition;
-						VectorAdd( directColor, indirectColor, colorVerts[numVertexes].m_Color );
-					}
-					
-					numVertexes++;
+	matrix3x4_t	matPos, matNormal;
+	AngleMatrix(prop.m_Angles, prop.m_Origin, matPos);
+	AngleMatrix(prop.m_Angles, matNormal);
+
+	if ( work.m_nMesh < 0 )
+	{
+		OptimizedModel::ModelHeader_t* pVtxModel = pVtxHdr->pBodyPart( work.m_nBodyPart )->pModel( work.m_nModel );
+		CUtlVector<colorTexel_t> &colorTexels = *pResults->m_ColorTexelsArrays[work.m_iColorTexelsArray];
+		for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
+		{
+			GenerateLightmapSamplesForMesh( matPos, matNormal, iThread, skip_prop, nFlags, prop.m_LightmapImageWidth, prop.m_LightmapImageHeight, pStudioHdr, pStudioModel, pVtxModel, meshID, colorTexels );
+		}
+		return;
+	}
+
+	mstudiomesh_t *pStudioMesh = pStudioModel->pMesh( work.m_nMesh );
+	const mstudio_meshvertexdata_t *vertData = pStudioMesh->GetVertexData((void *)pStudioHdr);
+	Assert(vertData); // This can only return NULL on X360 for now
+
+	CUtlVector<colorVertex_t> &colorVerts = *pResults->m_ColorVertsArrays[work.m_iColorVertsArray];
+
+	// Vertexes outside solid are lit four at a time
+	int nBatch = 0;
+	int batchColorVertex[4];
+	Vector batchPosition[4];
+	Vector batchNormal[4];
+
+	for ( int i = 0; i <= work.m_nVertexCount; i++ )
+	{
+		if ( i < work.m_nVertexCount )
+		{
+			int vertexID = work.m_nFirstVertex + i;
+			colorVertex_t &colorVert = colorVerts[work.m_nColorVertex + i];
+
+			// transform position and normal into world coordinate system
+			Vector sampleNormal;
+			Vector samplePosition;
+			VectorTransform(*vertData->Position(vertexID), matPos, samplePosition);
+			VectorTransform(*vertData->Normal(vertexID), matNormal, sampleNormal);
+
+			colorVert.m_Position = samplePosition;
+			if ( PositionInSolid( samplePosition ) )
+			{
+				// vertex is in solid, recover later
+				colorVert.m_bValid = false;
+				continue;
+			}
+
+			colorVert.m_bValid = true;
+			batchColorVertex[nBatch] = work.m_nColorVertex + i;
+			batchPosition[nBatch] = samplePosition;
+			batchNormal[nBatch] = sampleNormal;
+			if ( ++nBatch < 4 )
+				continue;
+		}
+
+		if ( !nBatch )
+			break;
+
+		Vector directColor[4];
+		ComputeDirectLightingAtPoints( batchPosition, batchNormal, nBatch, directColor, iThread, skip_prop, nFlags );
+
+		for ( int j = 0; j < nBatch; j++ )
+		{
+			Vector indirectColor(0,0,0);
+
+			if (g_bShowStaticPropNormals)
+			{
+				directColor[j] = batchNormal[j];
+				directColor[j] += Vector(1.0,1.0,1.0);
+				directColor[j] *= 50.0;
+			}
+			else
+			{
+				if (numbounce >= 1)
+					ComputeIndirectLightingAtPoint( 
+						batchPosition[j], batchNormal[j], 
+						indirectColor, iThread, true,
+						( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS) != 0 );
+			}
+
+			VectorAdd( directColor[j], indirectColor, colorVerts[batchColorVertex[j]].m_Color );
+		}
+		nBatch = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Relights the vertexes embedded in solid from the nearest valid position.
+// Needs every other vertex of the model lit first.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::FixupBadVertexes( int iThread, int iStaticProp, CComputeStaticPropLightingResults *pResults )
+{
+	if ( !pResults->m_ColorVertsArrays.Count() )
+		return;
+
+	CUtlVector<badVertex_t>		badVerts;
+
+	CStaticProp &prop = m_StaticProps[iStaticProp];
+	studiohdr_t	*pStudioHdr = m_StaticPropDict[prop.m_ModelIdx].m_pStudioHdr;
+
+	matrix3x4_t	matNormal;
+	AngleMatrix(prop.m_Angles, matNormal);
+
+	int iColorVertsArray = 0;
+	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
+	{
+		mstudiobodyparts_t *pBodyPart = pStudioHdr->pBodypart( bodyID );
+
+		for ( int modelID = 0; modelID < pBodyPart->nummodels; ++modelID )
+		{
+			mstudiomodel_t *pStudioModel = pBodyPart->pModel( modelID );
+			CUtlVector<colorVertex_t> &colorVerts = *pResults->m_ColorVertsArrays[iColorVertsArray++];
+
+			int numVertexes = 0;
+			for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
+			{
+				mstudiomesh_t *pStudioMesh = pStudioModel->pMesh( meshID );
+				const mstudio_meshvertexdata_t *vertData = pStudioMesh->GetVertexData((void *)pStudioHdr);
+
+				for ( int vertexID = 0; vertexID < pStudioMesh->numvertices; ++vertexID, ++numVertexes )
+				{
+					if ( colorVerts[numVertexes].m_bValid )
+						continue;
+
+					badVertex_t badVertex;
+					badVertex.m_ColorVertex = numVertexes;
+					badVertex.m_Position = colorVerts[numVertexes].m_Position;
+					VectorTransform(*vertData->Normal(vertexID), matNormal, badVertex.m_Normal);
+					badVerts.AddToTail( badVertex );
 				}
 			}
 			
@@ -1500,6 +1710,27 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Trace rays from each unique vertex, accumulating direct and indirect
+// sources at each ray termination. Use the winding data to distribute the unique vertexes
+// into the rendering layout.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::ComputeLighting( int iThread, int iStaticProp, CComputeStaticPropLightingResults *pResults )
+{
+	VMPI_SetCurrentStage( "ComputeLighting" );
+
+	CUtlVector<LightingWork_t> work;
+	AllocateLightingResults( iStaticProp, pResults );
+	BuildLightingWork( iStaticProp, work );
+
+	for ( int i = 0; i < work.Count(); i++ )
+	{
+		DoLightingWork( iThread, work[i], pResults );
+	}
+
+	FixupBadVertexes( iThread, iStaticProp, pResults );
+}
+
 //-----------------------------------------------------------------------------
 // Write the lighitng to bsp pak lump
 //-----------------------------------------------------------------------------
@@ -1655,6 +1886,7 @@ void CVradStaticPropMgr::SerializeLighting()
 	}
 }
 
+#ifdef MPI
 void CVradStaticPropMgr::VMPI_ProcessStaticProp_Static( int iThread, uint64 iStaticProp, MessageBuffer *pBuf )
 {
 	g_StaticPropMgr.VMPI_ProcessStaticProp( iThread, iStaticProp, pBuf );
@@ -1673,7 +1905,7 @@ void CVradStaticPropMgr::VMPI_ProcessStaticProp( int iThread, int iStaticProp, M
 {
 	// Compute the lighting.
 	CComputeStaticPropLightingResults results;
-	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
+	ComputeLighting( iThread, iStaticProp, &results );
 
 	VMPI_SetCurrentStage( "EncodeLightingResults" );
 	
@@ -1739,25 +1971,43 @@ void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults( int iStaticProp, Message
 	// Apply the results.
 	ApplyLightingToStaticProp( iStaticProp, m_StaticProps[iStaticProp], &results );
 }
+#endif
 
 
-void CVradStaticPropMgr::ComputeLightingForProp( int iThread, int iStaticProp )
+//-----------------------------------------------------------------------------
+// The first work item of a prop to run creates its results
+//-----------------------------------------------------------------------------
+CComputeStaticPropLightingResults *CVradStaticPropMgr::GetLightingResults( int iStaticProp )
 {
-	// Compute the lighting.
-	CComputeStaticPropLightingResults results;
-	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
-	ApplyLightingToStaticProp( iStaticProp, m_StaticProps[iStaticProp], &results );
+	ThreadLock();
+	CComputeStaticPropLightingResults *pResults = m_LightingResults[iStaticProp];
+	if ( !pResults )
+	{
+		pResults = new CComputeStaticPropLightingResults;
+		AllocateLightingResults( iStaticProp, pResults );
+		m_LightingResults[iStaticProp] = pResults;
+	}
+	ThreadUnlock();
+
+	return pResults;
 }
 
-void CVradStaticPropMgr::ThreadComputeStaticPropLighting( int iThread, void *pUserData )
+void CVradStaticPropMgr::ThreadComputeStaticPropLighting( int iThread, int iWork )
 {
-	while (1)
+	const LightingWork_t &work = g_StaticPropMgr.m_LightingWork[iWork];
+	int iStaticProp = work.m_iStaticProp;
+
+	CComputeStaticPropLightingResults *pResults = g_StaticPropMgr.GetLightingResults( iStaticProp );
+	g_StaticPropMgr.DoLightingWork( iThread, work, pResults );
+
+	// The last item of a prop finishes it, so only the props in flight hold results
+	if ( ThreadInterlockedDecrement( &g_StaticPropMgr.m_LightingWorkLeft[iStaticProp] ) == 0 )
 	{
-		int j = GetThreadWork ();
-		if (j == -1)
-			break;
-		CComputeStaticPropLightingResults results;
-		g_StaticPropMgr.ComputeLightingForProp( iThread, j );
+		g_StaticPropMgr.FixupBadVertexes( iThread, iStaticProp, pResults );
+		g_StaticPropMgr.ApplyLightingToStaticProp( iStaticProp, g_StaticPropMgr.m_StaticProps[iStaticProp], pResults );
+
+		g_StaticPropMgr.m_LightingResults[iStaticProp] = NULL;
+		delete pResults;
 	}
 }
 
@@ -1780,6 +2030,7 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 	// ensure any traces against us are ignored because we have no inherit lighting contribution
 	m_bIgnoreStaticPropTrace = true;
 
+#ifdef MPI
 	if ( g_bUseMPI )
 	{
 		// Distribute the work among the workers.
@@ -1792,8 +2043,26 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 			&CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static );
 	}
 	else
+#endif
 	{
-		RunThreadsOn(count, true, ThreadComputeStaticPropLighting);
+		// Split the props into lightmaps and runs of vertexes so a few dense
+		// props don't leave every other thread idle at the end. A prop's items
+		// stay together so its results can be applied and freed early.
+		for ( int i = 0; i < count; i++ )
+		{
+			int nFirst = m_LightingWork.Count();
+			BuildLightingWork( i, m_LightingWork );
+			m_LightingWorkLeft.AddToTail( m_LightingWork.Count() - nFirst );
+		}
+		m_LightingResults.SetCount( count );
+		memset( m_LightingResults.Base(), 0, count * sizeof( CComputeStaticPropLightingResults* ) );
+
+		qprintf( "%d static props split into %d work items\n", count, m_LightingWork.Count() );
+		RunThreadsOnIndividual( m_LightingWork.Count(), true, ThreadComputeStaticPropLighting );
+
+		m_LightingWork.Purge();
+		m_LightingWorkLeft.Purge();
+		m_LightingResults.Purge();
 	}
 
 	// restore default
@@ -2274,14 +2543,14 @@ inline float ComputeBarycentricDistanceToTri( Vector _barycentricCoord, Vector2D
 }
 
 // ------------------------------------------------------------------------------------------------
-static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const matrix3x4_t& _matNormal, int _iThread, int _skipProp, int _flags, int _lightmapResX, int _lightmapResY, studiohdr_t* _pStudioHdr, mstudiomodel_t* _pStudioModel, OptimizedModel::ModelHeader_t* _pVtxModel, int _meshID, CComputeStaticPropLightingResults *_outResults )
+static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const matrix3x4_t& _matNormal, int _iThread, int _skipProp, int _flags, int _lightmapResX, int _lightmapResY, studiohdr_t* _pStudioHdr, mstudiomodel_t* _pStudioModel, OptimizedModel::ModelHeader_t* _pVtxModel, int _meshID, CUtlVector<colorTexel_t> &_outColorTexels )
 {
 	// Could iterate and gen this if needed.
 	int nLod = 0;
 
 	OptimizedModel::ModelLODHeader_t *pVtxLOD = _pVtxModel->pLOD(nLod);
 
-	CUtlVector<colorTexel_t> &colorTexels = (*_outResults->m_ColorTexelsArrays.Tail());
+	CUtlVector<colorTexel_t> &colorTexels = _outColorTexels;
 	const int cTotalPixelCount = _lightmapResX * _lightmapResY;
 	colorTexels.EnsureCount(cTotalPixelCount);
 	memset(colorTexels.Base(), 0, colorTexels.Count() * sizeof(colorTexel_t));
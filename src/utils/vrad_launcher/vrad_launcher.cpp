@@ -9,7 +9,12 @@
 //
 
 #include "stdafx.h"
+#ifdef _WIN32
 #include <direct.h>
+#else
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
 #include "tier1/strtools.h"
 #include "tier0/icommandline.h"
 
@@ -18,6 +23,7 @@ char* GetLastErrorString()
 {
 	static char err[2048];
 	
+#ifdef _WIN32
 	LPVOID lpMsgBuf;
 	FormatMessage( 
 		FORMAT_MESSAGE_ALLOCATE_BUFFER | 
@@ -33,6 +39,10 @@ char* GetLastErrorString()
 
 	strncpy( err, (char*)lpMsgBuf, sizeof( err ) );
 	LocalFree( lpMsgBuf );
+#else
+	const char *pError = dlerror();
+	strncpy( err, pError ? pError : "", sizeof( err ) );
+#endif
 
 	err[ sizeof( err ) - 1 ] = 0;
 
@@ -50,7 +60,7 @@ void MakeFullPath( const char *pIn, char *pOut, int outLen )
 	else
 	{
 		_getcwd( pOut, outLen );
-		Q_strncat( pOut, "\\", outLen, COPY_ALL_CHARACTERS );
+		Q_strncat( pOut, CORRECT_PATH_SEPARATOR_S, outLen, COPY_ALL_CHARACTERS );
 		Q_strncat( pOut, pIn, outLen, COPY_ALL_CHARACTERS );
 	}
 }
@@ -71,9 +81,15 @@ int main(int argc, char* argv[])
 		}
 
 	char fullPath[512], redirectFilename[512];
+#ifdef _WIN32
 	MakeFullPath( argv[0], fullPath, sizeof( fullPath ) );
+#else
+	// argv[0] may only be a name that was found on the PATH
+	int nLen = readlink( "/proc/self/exe", fullPath, sizeof( fullPath ) - 1 );
+	fullPath[ MAX( nLen, 0 ) ] = 0;
+#endif
 	Q_StripFilename( fullPath );
-	Q_snprintf( redirectFilename, sizeof( redirectFilename ), "%s\\%s", fullPath, "vrad.redirect" );
+	Q_snprintf( redirectFilename, sizeof( redirectFilename ), "%s%c%s", fullPath, CORRECT_PATH_SEPARATOR, "vrad.redirect" );
 
 	// First, look for vrad.redirect and load the dll specified in there if possible.
 	CSysModule *pModule = NULL;
@@ -107,7 +123,12 @@ int main(int argc, char* argv[])
 		// If it didn't load the module above, then use the 
 		if ( !pModule )
 		{
+#ifdef _WIN32
 			strcpy( dllName, "vrad_dll.dll" );
+#else
+			// dlopen doesn't look next to the executable the way LoadLibrary does
+			Q_snprintf( dllName, sizeof( dllName ), "%s/vrad_dll.so", fullPath );
+#endif
 			pModule = Sys_LoadModule( dllName );
 		}
 		
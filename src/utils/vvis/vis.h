@@ -11,6 +11,13 @@
 #include "mathlib/mathlib.h"
 #include "bsplib.h"
 
+#ifdef MPI
+#include "vmpi.h"
+#else
+// Builds without VMPI (the POSIX tools) always run as a single master process.
+extern bool g_bUseMPI;
+extern bool g_bMPIMaster;
+#endif
 
 #define	MAX_PORTALS	65536
 
@@ -7,19 +7,24 @@
 //=============================================================================//
 // vis.c
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include "vis.h"
 #include "threads.h"
 #include "stdlib.h"
 #include "pacifier.h"
-#include "vmpi.h"
 #include "mpivis.h"
 #include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
 #include "collisionutils.h"
 #include "tier0/icommandline.h"
+#ifdef MPI
 #include "vmpi_tools_shared.h"
+#endif
 #include "ilaunchabledll.h"
 #include "tools_minidump.h"
+#include "distwork.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
 
@@ -56,6 +61,11 @@ double		g_VisRadius = 4096.0f * 4096.0f;
 
 bool		g_bLowPriority = false;
 
+#ifndef MPI
+bool		g_bUseMPI = false;
+bool		g_bMPIMaster = true;
+#endif
+
 //=============================================================================
 
 void PlaneFromWinding (winding_t *w, plane_t *plane)
@@ -281,6 +291,29 @@ static int CompressAndCrosscheckClusterVis( int clusternum )
 }
 
 
+static void DistProcessPortalFlow( int iThread, int iPortal, CUtlBuffer *pBuf )
+{
+	PortalFlow( iThread, iPortal );
+
+	if ( pBuf )
+	{
+		pBuf->Put( sorted_portals[iPortal]->portalvis, portalbytes );
+	}
+}
+
+
+static bool DistReceivePortalFlow( int iPortal, CUtlBuffer &buf )
+{
+	if ( buf.TellPut() != portalbytes )
+		return false;
+
+	portal_t *p = sorted_portals[iPortal];
+	buf.Get( p->portalvis, portalbytes );
+	p->status = stat_done;
+	return true;
+}
+
+
 /*
 ==================
 CalcPortalVis
@@ -302,11 +335,19 @@ void CalcPortalVis (void)
 	}
 
 
+#ifdef MPI
     if (g_bUseMPI) 
 	{
  		RunMPIPortalFlow();
 	}
 	else 
+#endif
+	if ( DistWork_IsActive() )
+	{
+		// Every process does BasePortalVis itself, so only the flow is shared
+		DistWork_Run( "PortalFlow:", g_numportals*2, DistProcessPortalFlow, DistReceivePortalFlow );
+	}
+	else
 	{
 		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
 	}
@@ -331,11 +372,13 @@ void CalcVis (void)
 {
 	int		i;
 
+#ifdef MPI
 	if (g_bUseMPI) 
 	{
 		RunMPIBasePortalVis();
 	}
 	else 
+#endif
 	{
 	    RunThreadsOnIndividual (g_numportals*2, true, BasePortalVis);
 	}
@@ -414,6 +457,7 @@ void LoadPortals (char *name)
 	FILE *f;
 
 	// Open the portal file.
+#ifdef MPI
 	if ( g_bUseMPI )
 	{
 		// If we're using MPI, copy off the file to a temporary first. This will download the file
@@ -448,6 +492,7 @@ void LoadPortals (char *name)
 		f = fopen( tempFile, "rSTD" ); // read only, sequential, temporary, delete on close
 	}
 	else
+#endif
 	{
 		f = fopen( name, "r" );
 	}
@@ -968,9 +1013,13 @@ int ParseCommandLine( int argc, char **argv )
 		{
 			// nothing to do here, but don't bail on this option
 		}
+		else if ( DistWork_ParseArg( argc, argv, i ) )
+		{
+		}
 		// NOTE: the -mpi checks must come last here because they allow the previous argument 
 		// to be -mpi as well. If it game before something else like -game, then if the previous
 		// argument was -mpi and the current argument was something valid like -game, it would skip it.
+#ifdef MPI
 		else if ( !Q_strncasecmp( argv[i], "-mpi", 4 ) || !Q_strncasecmp( argv[i-1], "-mpi", 4 ) )
 		{
 			if ( stricmp( argv[i], "-mpi" ) == 0 )
@@ -980,6 +1029,7 @@ int ParseCommandLine( int argc, char **argv )
 			if ( i == argc - 1 )
 				break;
 		}
+#endif
 		else if (argv[i][0] == '-')
 		{
 			Warning("VBSP: Unknown option \"%s\"\n\n", argv[i]);
@@ -1065,6 +1115,8 @@ void PrintUsage( int argc, char **argv )
 		}
 	}
 #endif
+
+	Warning( "Distributing without VMPI:\n%s\n", DistWork_GetUsage() );
 }
 
 
@@ -1110,7 +1162,7 @@ int RunVVis( int argc, char **argv )
 	start = Plat_FloatTime();
 
 
-	if (!g_bUseMPI)
+	if ( !g_bUseMPI && !DistWork_IsWorker() )
 	{
 		// Setup the logfile.
 		char logFile[512];
@@ -1126,6 +1178,9 @@ int RunVVis( int argc, char **argv )
 
 	ThreadSetDefault ();
 
+	// Start the workers now so they load the map alongside us
+	DistWork_Init( "vvis" );
+
 	Msg ("reading %s\n", mapFile);
 	LoadBSPFile (mapFile);
 	if (numnodes == 0 || numfaces == 0)
@@ -1166,6 +1221,10 @@ int RunVVis( int argc, char **argv )
 	if ( g_TraceClusterStart < 0 )
 	{
 		CalcVis ();
+
+		// The rest is the coordinator's, including -fast runs that share nothing
+		DistWork_WorkerFinished();
+
 		CalcPAS ();
 
 		// We need a mapping from cluster to leaves, since the PVS
@@ -1187,9 +1246,10 @@ int RunVVis( int argc, char **argv )
 		{
 			Error("Invalid cluster trace: %d to %d, valid range is 0 to %d\n", g_TraceClusterStart, g_TraceClusterStop, portalclusters-1 );
 		}
-		if ( g_bUseMPI )
+		if ( g_bUseMPI || DistWork_IsActive() )
 		{
 			Warning("Can't compile trace in MPI mode\n");
+			DistWork_WorkerFinished();
 		}
 		CalcVisTrace ();
 		WritePortalTrace(source);
@@ -1221,12 +1281,14 @@ int main (int argc, char **argv)
 	InstallAllocationFunctions();
 	InstallSpewFunction();
 
+#ifdef MPI
 	VVIS_SetupMPI( argc, argv );
 
 	// Install an exception handler.
 	if ( g_bUseMPI && !g_bMPIMaster )
 		SetupToolsMinidumpHandler( VMPI_ExceptionFilter );
 	else
+#endif
 		SetupDefaultToolsMinidumpHandler();
 
 	return RunVVis( argc, argv );
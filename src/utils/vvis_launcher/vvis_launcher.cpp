@@ -8,8 +8,13 @@
 // vvis_launcher.cpp : Defines the entry point for the console application.
 //
 
-#include "stdafx.h"
+#include "StdAfx.h"
+#ifdef _WIN32
 #include <direct.h>
+#else
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
 #include "tier1/strtools.h"
 #include "tier0/icommandline.h"
 #include "ilaunchabledll.h"
@@ -20,6 +25,7 @@ char* GetLastErrorString()
 {
 	static char err[2048];
 	
+#ifdef _WIN32
 	LPVOID lpMsgBuf;
 	FormatMessage( 
 		FORMAT_MESSAGE_ALLOCATE_BUFFER | 
@@ -35,6 +41,10 @@ char* GetLastErrorString()
 
 	strncpy( err, (char*)lpMsgBuf, sizeof( err ) );
 	LocalFree( lpMsgBuf );
+#else
+	const char *pError = dlerror();
+	strncpy( err, pError ? pError : "", sizeof( err ) );
+#endif
 
 	err[ sizeof( err ) - 1 ] = 0;
 
@@ -45,7 +55,17 @@ char* GetLastErrorString()
 int main(int argc, char* argv[])
 {
 	CommandLine()->CreateCmdLine( argc, argv );
+#ifdef _WIN32
 	const char *pDLLName = "vvis_dll.dll";
+#else
+	// dlopen doesn't look next to the executable the way LoadLibrary does
+	char szDLLName[512];
+	int nLen = readlink( "/proc/self/exe", szDLLName, sizeof( szDLLName ) - 1 );
+	szDLLName[ MAX( nLen, 0 ) ] = 0;
+	Q_StripFilename( szDLLName );
+	Q_strncat( szDLLName, "/vvis_dll.so", sizeof( szDLLName ), COPY_ALL_CHARACTERS );
+	const char *pDLLName = szDLLName;
+#endif
 	
 	CSysModule *pModule = Sys_LoadModule( pDLLName );
 	if ( !pModule )
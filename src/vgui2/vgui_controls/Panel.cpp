@@ -5575,11 +5575,14 @@ bool Panel::RequestInfoFromChild(const char *childName, KeyValues *outputData)
 //-----------------------------------------------------------------------------
 void Panel::PostMessage(Panel *target, KeyValues *message, float delay)
 {
+	// vgui2 frees messages with its own KeyValues code, which can't free a frozen tree
+	AssertMsg( !message || !message->IsFrozen(), "Panel::PostMessage: frozen KeyValues can't be sent through vgui, MakeCopy() it first" );
 	ivgui()->PostMessage(target->GetVPanel(), message, GetVPanel(), delay);
 }
 
 void Panel::PostMessage(VPANEL target, KeyValues *message, float delaySeconds)
 {
+	AssertMsg( !message || !message->IsFrozen(), "Panel::PostMessage: frozen KeyValues can't be sent through vgui, MakeCopy() it first" );
 	ivgui()->PostMessage(target, message, GetVPanel(), delaySeconds);
 }
 
@@ -5613,6 +5616,8 @@ void Panel::PostMessageToAllSiblings( KeyValues *msg, float delaySeconds /*= 0.0
 //-----------------------------------------------------------------------------
 void Panel::PostMessageToChild(const char *childName, KeyValues *message)
 {
+	AssertMsg( !message || !message->IsFrozen(), "Panel::PostMessageToChild: frozen KeyValues can't be sent through vgui, MakeCopy() it first" );
+
 	Panel *panel = FindChildByName(childName);
 	if (panel)
 	{